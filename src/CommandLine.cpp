@@ -0,0 +1,86 @@
+#include <vector>
+#include <string>
+#include <exception>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+
+#include <CommandLine.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+CCommandLine::CCommandLine( const int argc, const char* const argv[] )
+{
+	for( int i = 1; i < argc; i++ ) {
+		const string argument = argv[i];
+		if( argument.compare( 0, 2, "--" ) == 0 && argument.length() > 2 ) {
+			const size_t equalSign = argument.find( '=' );
+			const string name = argument.substr( 2, equalSign - 2 );
+			options[name] = ( equalSign == string::npos ) ?
+				"" : argument.substr( equalSign + 1 );
+		} else {
+			arguments.push_back( argument );
+		}
+	}
+}
+
+const string& CCommandLine::Argument( size_t index ) const
+{
+	if( index >= arguments.size() ) {
+		throw exception( "too few arguments!" );
+	}
+	return arguments[index];
+}
+
+bool CCommandLine::HasOption( const string& name ) const
+{
+	requestedOptions.insert( name );
+	return ( options.find( name ) != options.end() );
+}
+
+string CCommandLine::Option( const string& name, const string& defaultValue ) const
+{
+	requestedOptions.insert( name );
+	auto option = options.find( name );
+	return ( option == options.end() ) ? defaultValue : option->second;
+}
+
+size_t CCommandLine::SizeOption( const string& name, size_t defaultValue ) const
+{
+	const string value = Option( name );
+	if( value.empty() ) {
+		return defaultValue;
+	}
+	size_t length = 0;
+	const size_t result = stoul( value, &length );
+	if( length != value.length() ) {
+		throw exception( ( "option '--" + name + "' must be a number!" ).c_str() );
+	}
+	return result;
+}
+
+double CCommandLine::DoubleOption( const string& name, double defaultValue ) const
+{
+	const string value = Option( name );
+	if( value.empty() ) {
+		return defaultValue;
+	}
+	size_t length = 0;
+	const double result = stod( value, &length );
+	if( length != value.length() ) {
+		throw exception( ( "option '--" + name + "' must be a number!" ).c_str() );
+	}
+	return result;
+}
+
+void CCommandLine::CheckUnknownOptions() const
+{
+	for( const auto& option : options ) {
+		if( requestedOptions.find( option.first ) == requestedOptions.end() ) {
+			throw exception( ( "unknown option '--" + option.first + "'!" ).c_str() );
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -9,6 +9,12 @@ class CDissimilarityMatrix {
 
 public:
 	typedef DISTANCE_TYPE DistanceType;
+	// Distance( i, j ) equals Distance( j, i ).
+	static const bool IsSymmetric = true;
+	// Distances of any rows are read by turns as fast as of one row.
+	static const bool IsRandomAccess = true;
+	// Rows are set by blocks of RowsBlockSize rows.
+	static const size_t RowsBlockSize = 1;
 
 	CDissimilarityMatrix() :
 		size( 0 )
@@ -36,17 +42,42 @@ public:
 		return distances[i * size + j];
 	}
 
+	// Maximal error of distances in row, distances are exact.
+	DistanceType MaxError( size_t /* row */ ) const { return 0; }
+
+	// Pages of rows are first touched on cores of threads which step their
+	// objects if threads are pinned.
+	void Reset( size_t newSize )
+	{
+		size = newSize;
+		DistancesVector( size * size ).swap( distances );
+		CNumaSupport::FirstTouch( size, [this]( size_t beginRow, size_t endRow ) {
+			fill( distances.begin() + beginRow * size, distances.begin() + endRow * size, 0 );
+		} );
+	}
+
+	void SetRows( size_t firstRow, size_t numberOfRows, const DistanceType* rowsDistances )
+	{
+		assert( firstRow + numberOfRows <= size );
+		copy( rowsDistances, rowsDistances + numberOfRows * size, distances.begin() + firstRow * size );
+	}
+
 	void Load( istream& input )
 	{
 		bool good = false;
 		distances.clear();
-		if( input.good() && input >> size ) {
-			distances.reserve( size * size );
+		size_t newSize = 0;
+		if( input.good() && input >> newSize ) {
+			Reset( newSize );
+			size_t count = 0;
 			DistanceType distance;
 			while( input.good() && input >> distance ) {
-				distances.push_back( distance );
+				if( count < distances.size() ) {
+					distances[count] = distance;
+				}
+				count++;
 			}
-			if( distances.size() == size * size ) {
+			if( count == distances.size() ) {
 				good = true;
 			}
 		}
@@ -58,6 +89,7 @@ public:
 
 	void Save( ostream& output ) const
 	{
+		output.precision( numeric_limits<DistanceType>::digits10 + 3 );
 		output << size;
 		for( const DistanceType distance : distances ) {
 			output << " " << distance;
@@ -65,22 +97,84 @@ public:
 	}
 
 protected:
+	typedef vector<DistanceType, CPageAllocator<DistanceType>> DistancesVector;
+
+	size_t size;
+	DistancesVector distances;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Dissimilarity matrix given by consecutive rows of caller's distances,
+// which are used in place and must outlive the view.
+template<typename DISTANCE_TYPE>
+class CDissimilarityMatrixView {
+public:
+	typedef DISTANCE_TYPE DistanceType;
+	// Distance( i, j ) may differ from Distance( j, i ).
+	static const bool IsSymmetric = false;
+	// Distances of any rows are read by turns as fast as of one row.
+	static const bool IsRandomAccess = true;
+
+	CDissimilarityMatrixView( const DistanceType* _distances, size_t _size ) :
+		distances( _distances ),
+		size( _size )
+	{
+	}
+
+	size_t Size() const { return size; }
+
+	DistanceType Distance( size_t i, size_t j ) const
+	{
+		assert( i < size && j < size );
+		return distances[i * size + j];
+	}
+
+	// Maximal error of distances in row, distances are exact.
+	DistanceType MaxError( size_t /* row */ ) const { return 0; }
+
+private:
+	const DistanceType* distances;
 	size_t size;
-	vector<DistanceType> distances;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 
-template<typename OBJECT_TYPE>
-class CDissimilarityMatrixBuilder :
-	public vector<OBJECT_TYPE>,
-	private CDissimilarityMatrix<typename OBJECT_TYPE::DistanceType> {
+// Sets rows [firstRow, firstRow + numberOfRows) of newMatrix, which extends
+// matrix of its first matrix.Size() objects. Rows of old objects are given
+// only with distances to new objects, distances to old objects are taken
+// from matrix. Matrices which keep distances approximately overload it, so
+// the old distances are not encoded again.
+template<typename DISSIMILARITY_MATRIX_TYPE>
+void SetExtendedRows( DISSIMILARITY_MATRIX_TYPE& newMatrix, const DISSIMILARITY_MATRIX_TYPE& matrix,
+	size_t firstRow, size_t numberOfRows,
+	typename DISSIMILARITY_MATRIX_TYPE::DistanceType* rowsDistances )
+{
+	const size_t oldSize = matrix.Size();
+	const size_t newSize = newMatrix.Size();
+	const size_t endOldRow = min( firstRow + numberOfRows, oldSize );
+	for( size_t object = firstRow; object < endOldRow; object++ ) {
+		typename DISSIMILARITY_MATRIX_TYPE::DistanceType* const row =
+			rowsDistances + ( object - firstRow ) * newSize;
+		for( size_t j = 0; j < oldSize; j++ ) {
+			row[j] = matrix.Distance( object, j );
+		}
+	}
+	newMatrix.SetRows( firstRow, numberOfRows, rowsDistances );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+template<typename OBJECT_TYPE, typename DISSIMILARITY_MATRIX_TYPE =
+	CDissimilarityMatrix<typename OBJECT_TYPE::DistanceType>>
+class CDissimilarityMatrixBuilder : public vector<OBJECT_TYPE> {
 	CDissimilarityMatrixBuilder( const CDissimilarityMatrixBuilder& ) = delete;
 	CDissimilarityMatrixBuilder& operator=( const CDissimilarityMatrixBuilder& ) = delete;
 
 public:
 	typedef OBJECT_TYPE ObjectType;
-	typedef CDissimilarityMatrix<DistanceType> DissimilarityMatrixType;
+	typedef DISSIMILARITY_MATRIX_TYPE DissimilarityMatrixType;
+	typedef typename DissimilarityMatrixType::DistanceType DistanceType;
 
 	CDissimilarityMatrixBuilder()
 	{
@@ -88,36 +182,118 @@ public:
 
 	explicit CDissimilarityMatrixBuilder( size_t numberOfObjects )
 	{
-		reserve( numberOfObjects );
+		vector<ObjectType>::reserve( numberOfObjects );
+	}
+
+	DissimilarityMatrixType Build() const
+	{
+		vector<DistanceType> distancesToAll;
+		return Build( vector<DistanceType>( vector<ObjectType>::size(), 1 ), distancesToAll );
 	}
 
-	CDissimilarityMatrix Build()
+	// Builds matrix and sums of weighted distances from each object to all
+	// objects, which are summed while rows are calculated, so the first
+	// building step of PAM does not sweep the matrix again. Sums are empty
+	// if the matrix does not keep distances exactly.
+	DissimilarityMatrixType Build( const vector<DistanceType>& weights,
+		vector<DistanceType>& distancesToAll ) const
 	{
 		const size_t numberOfObjects = vector<ObjectType>::size();
-		DissimilarityMatrixType::size = numberOfObjects;
-		distances.reserve( numberOfObjects * numberOfObjects );
-		for( size_t i = 0; i < numberOfObjects; i++ ) {
-			for( size_t j = 0; j < numberOfObjects; j++ ) {
-				if( i == j ) {
-					distances.push_back( 0 );
+		if( weights.size() != numberOfObjects ) {
+			throw invalid_argument( "CDissimilarityMatrixBuilder: wrong number of weights" );
+		}
+		DissimilarityMatrixType matrix;
+		matrix.Reset( numberOfObjects );
+		distancesToAll.resize( numberOfObjects );
+		bool isExact = true;
+		vector<DistanceType> rows;
+		for( size_t firstRow = 0; firstRow < numberOfObjects; firstRow += RowsBlockSize ) {
+			const size_t numberOfRows = min( firstRow + RowsBlockSize, numberOfObjects ) - firstRow;
+			rows.resize( numberOfRows * numberOfObjects );
+			for( size_t i = 0; i < numberOfRows; i++ ) {
+				DistanceType* const row = rows.data() + i * numberOfObjects;
+				calculateDistances( firstRow + i, 0, numberOfObjects, row );
+				// the same order of sums as PAM sweeps the row
+				DistanceType distance = 0;
+				for( size_t j = 0; j < numberOfObjects; j++ ) {
+					distance += weights[j] * row[j];
+				}
+				distancesToAll[firstRow + i] = distance;
+			}
+			matrix.SetRows( firstRow, numberOfRows, rows.data() );
+			for( size_t i = 0; i < numberOfRows; i++ ) {
+				isExact = isExact && ( matrix.MaxError( firstRow + i ) == 0 );
+			}
+		}
+		if( !isExact ) {
+			vector<DistanceType>().swap( distancesToAll );
+		}
+		return matrix;
+	}
+
+	// Extends matrix of the first matrix.Size() objects to all objects,
+	// only distances to the rest objects are calculated.
+	DissimilarityMatrixType Extend( DissimilarityMatrixType&& matrix ) const
+	{
+		const size_t oldSize = matrix.Size();
+		const size_t newSize = vector<ObjectType>::size();
+		if( oldSize > newSize ) {
+			throw invalid_argument( "CDissimilarityMatrixBuilder: too few objects to extend matrix" );
+		}
+
+		DissimilarityMatrixType newMatrix;
+		newMatrix.Reset( newSize );
+		vector<DistanceType> rows;
+		for( size_t firstRow = 0; firstRow < newSize; firstRow += RowsBlockSize ) {
+			const size_t numberOfRows = min( firstRow + RowsBlockSize, newSize ) - firstRow;
+			rows.resize( numberOfRows * newSize );
+			for( size_t i = 0; i < numberOfRows; i++ ) {
+				const size_t object = firstRow + i;
+				DistanceType* row = rows.data() + i * newSize;
+				if( object < oldSize ) {
+					calculateDistances( object, oldSize, newSize, row + oldSize );
 				} else {
-					distances.push_back( operator[]( i ).Distance( operator[]( j ) ) );
+					calculateDistances( object, 0, newSize, row );
 				}
 			}
+			SetExtendedRows( newMatrix, matrix, firstRow, numberOfRows, rows.data() );
 		}
-		return move( static_cast<DissimilarityMatrixType&>( *this ) );
+		matrix = DissimilarityMatrixType();
+		return newMatrix;
 	}
 
 	template<typename FORWARD_ITERATOR_TYPE>
 	static DissimilarityMatrixType Build( FORWARD_ITERATOR_TYPE begin, FORWARD_ITERATOR_TYPE end )
 	{
-		CDissimilarityMatrixBuilder<OBJECT_TYPE> builder;
-		while( begin != end ) {
-			builder.push_back( *begin );
-			++begin;
-		}
+		CDissimilarityMatrixBuilder builder;
+		builder.assign( begin, end );
 		return builder.Build();
 	}
+
+	template<typename FORWARD_ITERATOR_TYPE>
+	static DissimilarityMatrixType Extend( DissimilarityMatrixType&& matrix,
+		FORWARD_ITERATOR_TYPE begin, FORWARD_ITERATOR_TYPE end )
+	{
+		CDissimilarityMatrixBuilder builder;
+		builder.assign( begin, end );
+		return builder.Extend( move( matrix ) );
+	}
+
+private:
+	static const size_t RowsBlockSize = DissimilarityMatrixType::RowsBlockSize;
+
+	// Calculates distances from object to objects [begin, end).
+	void calculateDistances( size_t object, size_t begin, size_t end,
+		DistanceType* distances ) const
+	{
+		if( begin < end ) {
+			const vector<ObjectType>& objects = *this;
+			ObjectType::Distances( objects[object], objects.data() + begin, end - begin, distances );
+			if( begin <= object && object < end ) {
+				distances[object - begin] = 0;
+			}
+		}
+	}
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,435 @@
+#pragma once
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Statistics of reading of a matrix from file.
+struct CMatrixReadStatistics {
+	double BytesRead;
+	// Number of tiles, which were not read in advance, and time waiting for them.
+	size_t Stalls;
+	double StallTime;
+	// Time from the first read to the last access to a new tile.
+	double ReadingTime;
+
+	CMatrixReadStatistics() :
+		BytesRead( 0 ),
+		Stalls( 0 ),
+		StallTime( 0 ),
+		ReadingTime( 0 )
+	{
+	}
+
+	// Achieved bandwidth in bytes per second.
+	double Bandwidth() const { return ( ReadingTime > 0 ) ? ( BytesRead / ReadingTime ) : 0; }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Symmetric dissimilarity matrix stored in a file, for matrices which do
+// not fit in memory. Rows are read by tiles of TileBytes bytes by a reading
+// thread, which also reads the tile following each requested one of the
+// swept rows in advance, so sequential sweeps of worker threads over their
+// rows overlap reading with computation. A few tiles per worker thread are
+// kept in memory, the least recently used tile is evicted. An error of
+// reading is thrown by Distance of threads waiting for tiles. The file is
+// removed with the matrix.
+template<typename DISTANCE_TYPE>
+class CFileDissimilarityMatrix {
+	CFileDissimilarityMatrix( const CFileDissimilarityMatrix& ) = delete;
+	CFileDissimilarityMatrix& operator=( const CFileDissimilarityMatrix& ) = delete;
+
+public:
+	typedef DISTANCE_TYPE DistanceType;
+	// Distance( i, j ) equals Distance( j, i ).
+	static const bool IsSymmetric = true;
+	// Rows are read by tiles, so they are read one by one.
+	static const bool IsRandomAccess = false;
+	// Rows are set by blocks of RowsBlockSize rows.
+	static const size_t RowsBlockSize = 1;
+	static const size_t TileBytes = 4 << 20;
+
+	// Files of matrices are named FILENAME_PREFIX.N.
+	static void SetFilenamePrefix( const string& prefix ) { filenamePrefix() = prefix; }
+
+	CFileDissimilarityMatrix() :
+		size( 0 ),
+		tileRows( 1 ),
+		sweptRowsBegin( 0 ),
+		sweptRowsEnd( 0 ),
+		generation( newGeneration() )
+	{
+	}
+
+	CFileDissimilarityMatrix( CFileDissimilarityMatrix&& matrix ) :
+		CFileDissimilarityMatrix()
+	{
+		*this = move( matrix );
+	}
+
+	CFileDissimilarityMatrix& operator=( CFileDissimilarityMatrix&& matrix );
+
+	~CFileDissimilarityMatrix()
+	{
+		try {
+			close();
+		} catch( ... ) {
+			// joining of the reading thread failed, the file may be left
+		}
+	}
+
+	size_t Size() const { return size; }
+
+	DistanceType Distance( size_t i, size_t j ) const
+	{
+		assert( i < size && j < size );
+		const CTileView& tile = tileOfRow( i );
+		return tile.Distances[( i - tile.FirstRow ) * size + j];
+	}
+
+	// Maximal error of distances in row, distances are exact.
+	DistanceType MaxError( size_t /* row */ ) const { return 0; }
+
+	// Rows [beginRow, endRow) are swept by threads of this process, all rows
+	// after Reset, other tiles are not read in advance.
+	void SetSweptRows( size_t beginRow, size_t endRow )
+	{
+		assert( beginRow <= endRow && endRow <= size );
+		sweptRowsBegin = beginRow;
+		sweptRowsEnd = endRow;
+	}
+
+	CMatrixReadStatistics ReadStatistics() const
+	{
+		lock_guard<mutex> lock( tilesMutex );
+		return statistics;
+	}
+
+	void Reset( size_t newSize );
+	void SetRows( size_t firstRow, size_t numberOfRows, const DistanceType* rowsDistances );
+
+	void Load( istream& input );
+	void Save( ostream& output ) const;
+
+private:
+	struct CTile {
+		size_t FirstRow;
+		size_t EndRow;
+		vector<DistanceType> Distances;
+	};
+
+	// Tile used last by the thread, it is kept by tileOwner of the thread.
+	// Trivial type, so access to the thread local view is cheap.
+	struct CTileView {
+		size_t Generation;
+		size_t FirstRow;
+		size_t EndRow;
+		const DistanceType* Distances;
+	};
+
+	size_t size;
+	string filename;
+	mutable fstream file;
+	size_t tileRows;
+	size_t maxTiles;
+	size_t sweptRowsBegin;
+	size_t sweptRowsEnd;
+	// changes when distances change, views of other generations are invalid
+	size_t generation;
+
+	mutable mutex tilesMutex;
+	mutable condition_variable tilesCondition;
+	mutable thread readingThread;
+	mutable bool stopReading;
+	// error of the reading thread, which stops on it
+	mutable exception_ptr readError;
+	mutable unordered_map<size_t, shared_ptr<const CTile>> tiles;
+	mutable unordered_map<size_t, size_t> tileLastUses;
+	mutable size_t numberOfUses;
+	mutable deque<size_t> requests;
+	mutable unordered_set<size_t> requestedTiles;
+	mutable CMatrixReadStatistics statistics;
+	mutable chrono::steady_clock::time_point firstReadTime;
+
+	static thread_local CTileView view;
+
+	static string& filenamePrefix()
+	{
+		static string prefix( "pam_matrix" );
+		return prefix;
+	}
+
+	static size_t newGeneration()
+	{
+		static atomic<size_t> lastGeneration( 0 );
+		return ++lastGeneration;
+	}
+
+	size_t numberOfTiles() const { return ( size + tileRows - 1 ) / tileRows; }
+	streamoff rowOffset( size_t row ) const
+	{
+		return static_cast<streamoff>( row ) * size * sizeof( DistanceType );
+	}
+
+	const CTileView& tileOfRow( size_t row ) const
+	{
+		if( view.Generation != generation || row < view.FirstRow || row >= view.EndRow ) {
+			static thread_local shared_ptr<const CTile> tileOwner;
+			tileOwner = loadTile( row / tileRows );
+			view.Generation = generation;
+			view.FirstRow = tileOwner->FirstRow;
+			view.EndRow = tileOwner->EndRow;
+			view.Distances = tileOwner->Distances.data();
+		}
+		return view;
+	}
+
+	shared_ptr<const CTile> loadTile( size_t tileIndex ) const;
+	void request( size_t tileIndex ) const;
+	void read() const;
+	void finishReading();
+	void close();
+};
+
+template<typename DISTANCE_TYPE>
+thread_local typename CFileDissimilarityMatrix<DISTANCE_TYPE>::CTileView
+	CFileDissimilarityMatrix<DISTANCE_TYPE>::view;
+
+///////////////////////////////////////////////////////////////////////////////
+
+template<typename DISTANCE_TYPE>
+CFileDissimilarityMatrix<DISTANCE_TYPE>& CFileDissimilarityMatrix<DISTANCE_TYPE>::operator=(
+	CFileDissimilarityMatrix&& matrix )
+{
+	close();
+	matrix.finishReading();
+	size = matrix.size;
+	filename = move( matrix.filename );
+	file = move( matrix.file );
+	tileRows = matrix.tileRows;
+	maxTiles = matrix.maxTiles;
+	sweptRowsBegin = matrix.sweptRowsBegin;
+	sweptRowsEnd = matrix.sweptRowsEnd;
+	statistics = matrix.statistics;
+	generation = newGeneration();
+	matrix.size = 0;
+	matrix.filename.clear();
+	matrix.generation = newGeneration();
+	return *this;
+}
+
+template<typename DISTANCE_TYPE>
+void CFileDissimilarityMatrix<DISTANCE_TYPE>::Reset( size_t newSize )
+{
+	static atomic<size_t> numberOfFiles( 0 );
+
+	close();
+	size = newSize;
+	tileRows = max<size_t>( 1, TileBytes / max<size_t>( 1, size * sizeof( DistanceType ) ) );
+	maxTiles = 2 * max<size_t>( 1, thread::hardware_concurrency() ) + 2;
+	sweptRowsBegin = 0;
+	sweptRowsEnd = size;
+	statistics = CMatrixReadStatistics();
+	generation = newGeneration();
+
+	filename = filenamePrefix() + "." + to_string( numberOfFiles++ );
+	file.open( filename, ios::in | ios::out | ios::binary | ios::trunc );
+	if( !file.is_open() ) {
+		throw exception( ( "CFileDissimilarityMatrix: cannot create file '" + filename + "'" ).c_str() );
+	}
+}
+
+template<typename DISTANCE_TYPE>
+void CFileDissimilarityMatrix<DISTANCE_TYPE>::SetRows( size_t firstRow,
+	size_t numberOfRows, const DistanceType* rowsDistances )
+{
+	assert( firstRow + numberOfRows <= size );
+
+	// tiles may contain old distances
+	finishReading();
+	generation = newGeneration();
+
+	file.seekp( rowOffset( firstRow ) );
+	file.write( reinterpret_cast<const char*>( rowsDistances ),
+		numberOfRows * size * sizeof( DistanceType ) );
+	if( !file.good() ) {
+		throw exception( ( "CFileDissimilarityMatrix: cannot write file '" + filename + "'" ).c_str() );
+	}
+}
+
+template<typename DISTANCE_TYPE>
+void CFileDissimilarityMatrix<DISTANCE_TYPE>::Load( istream& input )
+{
+	bool good = false;
+	size_t newSize = 0;
+	if( input.good() && input >> newSize ) {
+		Reset( newSize );
+		good = true;
+		vector<DistanceType> row( size );
+		for( size_t i = 0; good && i < size; i++ ) {
+			for( DistanceType& distance : row ) {
+				good = good && input.good() && input >> distance;
+			}
+			if( good ) {
+				SetRows( i, 1, row.data() );
+			}
+		}
+	}
+	if( !good ) {
+		Reset( 0 );
+	}
+}
+
+template<typename DISTANCE_TYPE>
+void CFileDissimilarityMatrix<DISTANCE_TYPE>::Save( ostream& output ) const
+{
+	output.precision( numeric_limits<DistanceType>::digits10 + 3 );
+	output << size;
+	for( size_t i = 0; i < size; i++ ) {
+		for( size_t j = 0; j < size; j++ ) {
+			output << " " << Distance( i, j );
+		}
+	}
+}
+
+template<typename DISTANCE_TYPE>
+shared_ptr<const typename CFileDissimilarityMatrix<DISTANCE_TYPE>::CTile>
+CFileDissimilarityMatrix<DISTANCE_TYPE>::loadTile( size_t tileIndex ) const
+{
+	unique_lock<mutex> lock( tilesMutex );
+	const auto start = chrono::steady_clock::now();
+	if( !readingThread.joinable() ) {
+		file.flush();
+		stopReading = false;
+		firstReadTime = start;
+		readingThread = thread( &CFileDissimilarityMatrix::read, this );
+	}
+
+	if( tiles.find( tileIndex ) == tiles.end() ) {
+		statistics.Stalls++;
+		// the tile may be evicted before the thread wakes up, then it is
+		// requested again
+		while( tiles.find( tileIndex ) == tiles.end() ) {
+			if( readError ) {
+				rethrow_exception( readError );
+			}
+			if( requestedTiles.insert( tileIndex ).second ) {
+				requests.push_front( tileIndex );
+				tilesCondition.notify_all();
+			}
+			tilesCondition.wait( lock );
+		}
+	}
+	// sweeps go over the swept rows sequentially and start again
+	const size_t firstSweptTile = sweptRowsBegin / tileRows;
+	const size_t endSweptTile = ( sweptRowsEnd + tileRows - 1 ) / tileRows;
+	if( firstSweptTile <= tileIndex && tileIndex < endSweptTile ) {
+		const size_t nextTile = ( tileIndex + 1 < endSweptTile ) ? ( tileIndex + 1 ) : firstSweptTile;
+		if( nextTile != tileIndex ) {
+			request( nextTile );
+		}
+	}
+	tileLastUses[tileIndex] = ++numberOfUses;
+
+	const auto end = chrono::steady_clock::now();
+	statistics.StallTime += chrono::duration<double>( end - start ).count();
+	statistics.ReadingTime = chrono::duration<double>( end - firstReadTime ).count();
+	return tiles[tileIndex];
+}
+
+// Tiles mutex must be locked.
+template<typename DISTANCE_TYPE>
+void CFileDissimilarityMatrix<DISTANCE_TYPE>::request( size_t tileIndex ) const
+{
+	if( tiles.find( tileIndex ) == tiles.end() && requestedTiles.insert( tileIndex ).second ) {
+		requests.push_back( tileIndex );
+		tilesCondition.notify_all();
+	}
+}
+
+template<typename DISTANCE_TYPE>
+void CFileDissimilarityMatrix<DISTANCE_TYPE>::read() const
+{
+	try {
+		ifstream input( filename, ios::binary );
+		unique_lock<mutex> lock( tilesMutex );
+		while( true ) {
+			tilesCondition.wait( lock, [&]() { return ( stopReading || !requests.empty() ); } );
+			if( stopReading ) {
+				break;
+			}
+			const size_t tileIndex = requests.front();
+			requests.pop_front();
+			lock.unlock();
+
+			auto tile = make_shared<CTile>();
+			tile->FirstRow = tileIndex * tileRows;
+			tile->EndRow = min( tile->FirstRow + tileRows, size );
+			tile->Distances.resize( ( tile->EndRow - tile->FirstRow ) * size );
+			input.seekg( rowOffset( tile->FirstRow ) );
+			input.read( reinterpret_cast<char*>( tile->Distances.data() ),
+				tile->Distances.size() * sizeof( DistanceType ) );
+			if( !input.good() ) {
+				throw exception(
+					( "CFileDissimilarityMatrix: cannot read file '" + filename + "'" ).c_str() );
+			}
+
+			lock.lock();
+			if( tiles.size() >= maxTiles ) {
+				auto leastRecentlyUsed = tileLastUses.begin();
+				for( auto i = tileLastUses.begin(); i != tileLastUses.end(); ++i ) {
+					if( i->second < leastRecentlyUsed->second ) {
+						leastRecentlyUsed = i;
+					}
+				}
+				tiles.erase( leastRecentlyUsed->first );
+				tileLastUses.erase( leastRecentlyUsed );
+			}
+			tiles[tileIndex] = tile;
+			tileLastUses[tileIndex] = numberOfUses;
+			requestedTiles.erase( tileIndex );
+			statistics.BytesRead += tile->Distances.size() * sizeof( DistanceType );
+			tilesCondition.notify_all();
+		}
+	} catch( ... ) {
+		// threads waiting for tiles rethrow it instead of hanging
+		lock_guard<mutex> lock( tilesMutex );
+		readError = current_exception();
+		tilesCondition.notify_all();
+	}
+}
+
+template<typename DISTANCE_TYPE>
+void CFileDissimilarityMatrix<DISTANCE_TYPE>::finishReading()
+{
+	if( readingThread.joinable() ) {
+		{
+			lock_guard<mutex> lock( tilesMutex );
+			stopReading = true;
+			tilesCondition.notify_all();
+		}
+		readingThread.join();
+	}
+	readError = nullptr;
+	tiles.clear();
+	tileLastUses.clear();
+	numberOfUses = 0;
+	requests.clear();
+	requestedTiles.clear();
+}
+
+template<typename DISTANCE_TYPE>
+void CFileDissimilarityMatrix<DISTANCE_TYPE>::close()
+{
+	finishReading();
+	if( file.is_open() ) {
+		file.close();
+	}
+	if( !filename.empty() ) {
+		remove( filename.c_str() );
+		filename.clear();
+	}
+	size = 0;
+	generation = newGeneration();
+}
+
+///////////////////////////////////////////////////////////////////////////////
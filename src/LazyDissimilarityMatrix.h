@@ -0,0 +1,291 @@
+#pragma once
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Statistics of row cache: rows found in the cache, calculated rows and
+// rows removed from the cache to calculate other rows.
+struct CRowCacheStatistics {
+	size_t Hits;
+	size_t Misses;
+	size_t Evictions;
+
+	CRowCacheStatistics() :
+		Hits( 0 ),
+		Misses( 0 ),
+		Evictions( 0 )
+	{
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Calculates rows of dissimilarity matrix of objects.
+template<typename DISTANCE_TYPE>
+class CRowCalculator {
+public:
+	typedef DISTANCE_TYPE DistanceType;
+
+	virtual ~CRowCalculator() {}
+	virtual size_t Size() const = 0;
+	virtual void Calculate( size_t row, DistanceType* distances ) const = 0;
+};
+
+template<typename OBJECT_TYPE>
+class CObjectsRowCalculator : public CRowCalculator<typename OBJECT_TYPE::DistanceType> {
+public:
+	typedef OBJECT_TYPE ObjectType;
+	typedef typename ObjectType::DistanceType DistanceType;
+
+	explicit CObjectsRowCalculator( const vector<ObjectType>& _objects ) :
+		objects( _objects )
+	{
+	}
+
+	size_t Size() const override { return objects.size(); }
+
+	void Calculate( size_t row, DistanceType* distances ) const override
+	{
+		ObjectType::Distances( objects[row], objects.data(), objects.size(), distances );
+		distances[row] = 0;
+	}
+
+private:
+	const vector<ObjectType> objects;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Dissimilarity matrix of objects, which calculates rows on the first access
+// and keeps at most cache size bytes of rows, for expensive dissimilarities.
+// Rows are evicted from the cache by the CLOCK algorithm: a row, which was
+// used since the last pass of the clock hand, is kept for one more pass.
+// The cache is shared by threads, each row is calculated by one thread,
+// others wait for it. Each thread also keeps the row it uses last.
+template<typename DISTANCE_TYPE>
+class CLazyDissimilarityMatrix {
+	CLazyDissimilarityMatrix( const CLazyDissimilarityMatrix& ) = delete;
+	CLazyDissimilarityMatrix& operator=( const CLazyDissimilarityMatrix& ) = delete;
+
+public:
+	typedef DISTANCE_TYPE DistanceType;
+	// Distance( i, j ) equals Distance( j, i ).
+	static const bool IsSymmetric = true;
+	// Rows are found in the cache or calculated, so they are read one by one.
+	static const bool IsRandomAccess = false;
+
+	// At least one row is kept regardless of the cache size.
+	static void SetCacheSize( size_t bytes ) { cacheSize() = bytes; }
+	static size_t CacheSize() { return cacheSize(); }
+
+	CLazyDissimilarityMatrix() :
+		maxCachedRows( 0 ),
+		clockHand( 0 ),
+		generation( newGeneration() )
+	{
+	}
+
+	CLazyDissimilarityMatrix( CLazyDissimilarityMatrix&& matrix ) :
+		CLazyDissimilarityMatrix()
+	{
+		*this = move( matrix );
+	}
+
+	CLazyDissimilarityMatrix& operator=( CLazyDissimilarityMatrix&& matrix );
+
+	size_t Size() const { return rowSlots.size(); }
+
+	DistanceType Distance( size_t i, size_t j ) const
+	{
+		assert( i < Size() && j < Size() );
+		if( view.Generation != generation || view.Row != i ) {
+			static thread_local shared_ptr<const vector<DistanceType>> rowOwner;
+			rowOwner = findRow( i );
+			view.Generation = generation;
+			view.Row = i;
+			view.Distances = rowOwner->data();
+		}
+		return view.Distances[j];
+	}
+
+	// Maximal error of distances in row, distances are exact.
+	DistanceType MaxError( size_t /* row */ ) const { return 0; }
+
+	// Accesses of a thread to the row of its previous access are not counted.
+	CRowCacheStatistics CacheStatistics() const
+	{
+		lock_guard<mutex> lock( cacheMutex );
+		return statistics;
+	}
+
+	// Objects are copied, OBJECT_TYPE must provide static Distances
+	// as CDissimilarityMatrixBuilder requires.
+	template<typename OBJECT_TYPE>
+	void SetObjects( const vector<OBJECT_TYPE>& objects )
+	{
+		SetCalculator( unique_ptr<const CRowCalculator<DistanceType>>(
+			new CObjectsRowCalculator<OBJECT_TYPE>( objects ) ) );
+	}
+	void SetCalculator( unique_ptr<const CRowCalculator<DistanceType>> newCalculator );
+
+	void Load( istream& input );
+	void Save( ostream& output ) const;
+
+private:
+	static const size_t NotCached = numeric_limits<size_t>::max();
+
+	struct CCachedRow {
+		size_t Row;
+		bool Referenced;
+		shared_ptr<const vector<DistanceType>> Distances;
+	};
+
+	// Row used last by the thread, it is kept by rowOwner of the thread.
+	// Trivial type, so access to the thread local view is cheap.
+	struct CRowView {
+		size_t Generation;
+		size_t Row;
+		const DistanceType* Distances;
+	};
+
+	unique_ptr<const CRowCalculator<DistanceType>> calculator;
+	size_t maxCachedRows;
+	// changes when distances change, views of other generations are invalid
+	size_t generation;
+
+	mutable mutex cacheMutex;
+	mutable condition_variable rowsCondition;
+	mutable vector<CCachedRow> cachedRows;
+	mutable vector<size_t> rowSlots;
+	mutable size_t clockHand;
+	mutable unordered_set<size_t> calculatingRows;
+	mutable CRowCacheStatistics statistics;
+
+	static thread_local CRowView view;
+
+	static size_t& cacheSize()
+	{
+		static size_t bytes = 256 << 20;
+		return bytes;
+	}
+
+	static size_t newGeneration()
+	{
+		static atomic<size_t> lastGeneration( 0 );
+		return ++lastGeneration;
+	}
+
+	shared_ptr<const vector<DistanceType>> findRow( size_t row ) const;
+};
+
+template<typename DISTANCE_TYPE>
+thread_local typename CLazyDissimilarityMatrix<DISTANCE_TYPE>::CRowView
+	CLazyDissimilarityMatrix<DISTANCE_TYPE>::view;
+
+template<typename DISTANCE_TYPE>
+const size_t CLazyDissimilarityMatrix<DISTANCE_TYPE>::NotCached;
+
+///////////////////////////////////////////////////////////////////////////////
+
+template<typename DISTANCE_TYPE>
+CLazyDissimilarityMatrix<DISTANCE_TYPE>& CLazyDissimilarityMatrix<DISTANCE_TYPE>::operator=(
+	CLazyDissimilarityMatrix&& matrix )
+{
+	calculator = move( matrix.calculator );
+	maxCachedRows = matrix.maxCachedRows;
+	cachedRows = move( matrix.cachedRows );
+	rowSlots = move( matrix.rowSlots );
+	clockHand = matrix.clockHand;
+	calculatingRows.clear();
+	statistics = matrix.statistics;
+	generation = newGeneration();
+	matrix.maxCachedRows = 0;
+	matrix.cachedRows.clear();
+	matrix.rowSlots.clear();
+	matrix.generation = newGeneration();
+	return *this;
+}
+
+template<typename DISTANCE_TYPE>
+void CLazyDissimilarityMatrix<DISTANCE_TYPE>::Load( istream& /* input */ )
+{
+	throw exception( "CLazyDissimilarityMatrix: loading is not supported" );
+}
+
+template<typename DISTANCE_TYPE>
+void CLazyDissimilarityMatrix<DISTANCE_TYPE>::Save( ostream& output ) const
+{
+	output.precision( numeric_limits<DistanceType>::digits10 + 3 );
+	output << Size();
+	for( size_t i = 0; i < Size(); i++ ) {
+		for( size_t j = 0; j < Size(); j++ ) {
+			output << " " << Distance( i, j );
+		}
+	}
+}
+
+template<typename DISTANCE_TYPE>
+void CLazyDissimilarityMatrix<DISTANCE_TYPE>::SetCalculator(
+	unique_ptr<const CRowCalculator<DistanceType>> newCalculator )
+{
+	calculator = move( newCalculator );
+
+	const size_t size = calculator->Size();
+	const size_t rowSize = max<size_t>( 1, size * sizeof( DistanceType ) );
+	maxCachedRows = min( size, max<size_t>( 1, cacheSize() / rowSize ) );
+	cachedRows.clear();
+	cachedRows.reserve( maxCachedRows );
+	rowSlots.assign( size, NotCached );
+	clockHand = 0;
+	calculatingRows.clear();
+	statistics = CRowCacheStatistics();
+	generation = newGeneration();
+}
+
+template<typename DISTANCE_TYPE>
+shared_ptr<const vector<typename CLazyDissimilarityMatrix<DISTANCE_TYPE>::DistanceType>>
+CLazyDissimilarityMatrix<DISTANCE_TYPE>::findRow( size_t row ) const
+{
+	unique_lock<mutex> lock( cacheMutex );
+	while( rowSlots[row] == NotCached && calculatingRows.count( row ) > 0 ) {
+		rowsCondition.wait( lock );
+	}
+	if( rowSlots[row] != NotCached ) {
+		statistics.Hits++;
+		CCachedRow& cachedRow = cachedRows[rowSlots[row]];
+		cachedRow.Referenced = true;
+		return cachedRow.Distances;
+	}
+
+	statistics.Misses++;
+	calculatingRows.insert( row );
+	lock.unlock();
+	auto distances = make_shared<vector<DistanceType>>( Size() );
+	calculator->Calculate( row, distances->data() );
+	lock.lock();
+
+	size_t slot = cachedRows.size();
+	if( cachedRows.size() < maxCachedRows ) {
+		cachedRows.push_back( CCachedRow() );
+	} else {
+		while( cachedRows[clockHand].Referenced ) {
+			cachedRows[clockHand].Referenced = false;
+			clockHand = ( clockHand + 1 ) % cachedRows.size();
+		}
+		slot = clockHand;
+		clockHand = ( clockHand + 1 ) % cachedRows.size();
+		// threads using the evicted row keep it until they use another row
+		rowSlots[cachedRows[slot].Row] = NotCached;
+		statistics.Evictions++;
+	}
+
+	CCachedRow& cachedRow = cachedRows[slot];
+	cachedRow.Row = row;
+	cachedRow.Referenced = false;
+	cachedRow.Distances = distances;
+	rowSlots[row] = slot;
+	calculatingRows.erase( row );
+	rowsCondition.notify_all();
+	return distances;
+}
+
+///////////////////////////////////////////////////////////////////////////////
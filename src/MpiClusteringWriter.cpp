@@ -0,0 +1,148 @@
+#include <vector>
+#include <string>
+#include <limits>
+#include <climits>
+#include <cstring>
+#include <sstream>
+#include <cstdint>
+#include <exception>
+
+using namespace std;
+
+#include <MpiSupport.h>
+#include <MpiClusteringWriter.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+static void AppendNumber( vector<char>& buffer, uint64_t number )
+{
+	char digits[20];
+	size_t length = 0;
+	do {
+		digits[length++] = static_cast<char>( '0' + number % 10 );
+		number /= 10;
+	} while( number > 0 );
+	while( length > 0 ) {
+		buffer.push_back( digits[--length] );
+	}
+}
+
+static void AppendBytes( vector<char>& buffer, const void* data, size_t size )
+{
+	const char* const bytes = static_cast<const char*>( data );
+	buffer.insert( buffer.end(), bytes, bytes + size );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void CMpiClusteringWriter::WriteText( const string& filename,
+	const CClusteringOutput& clustering )
+{
+	vector<char> buffer;
+	if( CMpiSupport::Rank() == 0 ) {
+		ostringstream header;
+		header.precision( numeric_limits<double>::digits10 );
+		header << "cost\t" << clustering.Cost << "\n";
+		header << "medoids\t" << clustering.Medoids.size() << "\n";
+		for( size_t i = 0; i < clustering.Medoids.size(); i++ ) {
+			header << clustering.Medoids[i] << "\n";
+		}
+		header << "vectors\t" << clustering.NumberOfVectors << "\n";
+		const string headerText = header.str();
+		AppendBytes( buffer, headerText.data(), headerText.size() );
+	}
+	for( size_t i = 0; i < clustering.Clusters.size(); i++ ) {
+		AppendNumber( buffer, clustering.FirstVector + i );
+		buffer.push_back( '\t' );
+		AppendNumber( buffer, clustering.Clusters[i] );
+		buffer.push_back( '\n' );
+	}
+
+	// slices of processes follow in order of ranks
+	uint64_t size = buffer.size();
+	uint64_t offset = 0;
+	uint64_t fileSize = 0;
+	MpiCheck( MPI_Exscan( &size, &offset, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD ),
+		"MPI_Exscan for clustering file" );
+	MpiCheck( MPI_Allreduce( &size, &fileSize, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD ),
+		"MPI_Allreduce for clustering file" );
+	if( CMpiSupport::Rank() == 0 ) {
+		offset = 0;
+	}
+	write( filename, static_cast<MPI_Offset>( offset ), buffer,
+		static_cast<MPI_Offset>( fileSize ) );
+}
+
+void CMpiClusteringWriter::WriteBinary( const string& filename,
+	const CClusteringOutput& clustering )
+{
+	const MPI_Offset clustersOffset = sizeof( CClusteringBinaryHeader )
+		+ clustering.Medoids.size() * sizeof( uint64_t );
+	vector<char> buffer;
+	if( CMpiSupport::Rank() == 0 ) {
+		CClusteringBinaryHeader header;
+		memcpy( header.Magic, binaryMagic(), sizeof( header.Magic ) );
+		header.Version = BinaryVersion;
+		header.NumberOfClusters = clustering.Medoids.size();
+		header.NumberOfVectors = clustering.NumberOfVectors;
+		header.Cost = clustering.Cost;
+		AppendBytes( buffer, &header, sizeof( header ) );
+		for( size_t i = 0; i < clustering.Medoids.size(); i++ ) {
+			const uint64_t medoid = clustering.Medoids[i];
+			AppendBytes( buffer, &medoid, sizeof( medoid ) );
+		}
+	}
+	if( !clustering.Clusters.empty() ) {
+		AppendBytes( buffer, clustering.Clusters.data(),
+			clustering.Clusters.size() * sizeof( uint32_t ) );
+	}
+
+	const MPI_Offset offset = ( CMpiSupport::Rank() == 0 ) ?
+		0 : ( clustersOffset + clustering.FirstVector * sizeof( uint32_t ) );
+	write( filename, offset, buffer,
+		clustersOffset + clustering.NumberOfVectors * sizeof( uint32_t ) );
+}
+
+void CMpiClusteringWriter::write( const string& filename, MPI_Offset offset,
+	const vector<char>& buffer, MPI_Offset fileSize )
+{
+	MPI_File file;
+	if( MPI_File_open( MPI_COMM_WORLD, const_cast<char*>( filename.c_str() ),
+		MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file ) != MPI_SUCCESS )
+	{
+		throw exception( ( "cannot write clustering file '" + filename + "'!" ).c_str() );
+	}
+
+	// pieces of at most INT_MAX bytes, the same number for all processes
+	uint64_t size = buffer.size();
+	uint64_t maxSize = 0;
+	MpiCheck( MPI_Allreduce( &size, &maxSize, 1, MPI_UINT64_T, MPI_MAX, MPI_COMM_WORLD ),
+		"MPI_Allreduce for clustering file" );
+	const size_t numberOfPieces = static_cast<size_t>( maxSize / INT_MAX + 1 );
+	const size_t pieceSize = ( buffer.size() + numberOfPieces - 1 ) / numberOfPieces;
+
+	// errors are gathered before closing, so all processes throw together
+	int failed = ( MPI_File_set_size( file, fileSize ) == MPI_SUCCESS ) ? 0 : 1;
+	for( size_t piece = 0; piece < numberOfPieces; piece++ ) {
+		const size_t begin = min( buffer.size(), piece * pieceSize );
+		const int count = static_cast<int>( min( buffer.size() - begin, pieceSize ) );
+		char* const data = const_cast<char*>( buffer.data() ) + begin;
+		MPI_Status status;
+		int written = 0;
+		if( MPI_File_write_at_all( file, offset + begin, data, count, MPI_CHAR, &status )
+				!= MPI_SUCCESS
+			|| MPI_Get_count( &status, MPI_CHAR, &written ) != MPI_SUCCESS
+			|| written != count )
+		{
+			failed = 1;
+		}
+	}
+	MpiCheck( MPI_Allreduce( MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD ),
+		"MPI_Allreduce for clustering file" );
+	MPI_File_close( &file );
+	if( failed != 0 ) {
+		throw exception( ( "cannot write clustering file '" + filename + "'!" ).c_str() );
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <mpi.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Vectors text file read cooperatively by all processes: the header is read
+// by the process with rank 0, vectors lines are divided into byte ranges of
+// about equal size, each process reads its range by collective MPI-IO and
+// parses lines starting in it, then parsed coordinates are gathered by all
+// processes. So each byte of the file is read once regardless of
+// the number of processes. Lines are parsed by numberOfThreads threads.
+// Must be constructed by all processes.
+class CMpiVectorsText {
+	CMpiVectorsText( const CMpiVectorsText& ) = delete;
+	CMpiVectorsText& operator=( const CMpiVectorsText& ) = delete;
+
+public:
+	// Lines longer than MaxLineLength are not supported.
+	static const size_t MaxLineLength = 1 << 16;
+
+	CMpiVectorsText( const string& filename, size_t numberOfThreads );
+
+	size_t NumberOfVectors() const { return numberOfVectors; }
+	size_t Dimension() const { return dimension; }
+
+	// Copies coordinates of vector i to vectorsCoordinates[i][0, Dimension()).
+	void Read( float* const* vectorsCoordinates ) const;
+
+private:
+	size_t numberOfVectors;
+	size_t dimension;
+	// coordinates of vectors one after another
+	vector<float> coordinates;
+
+	void readHeader( MPI_File file, MPI_Offset fileSize, MPI_Offset& vectorsBegin );
+	void readVectors( MPI_File file, MPI_Offset fileSize, MPI_Offset vectorsBegin,
+		size_t numberOfThreads );
+	void gatherVectors( vector<float>& rankCoordinates, const string& error );
+};
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,206 @@
+#include <new>
+#include <limits>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <iostream>
+#include <condition_variable>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+#include <MpiSupport.h>
+#include <NumaSupport.h>
+#include <PamEngine.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+CNumaSupport::HugePagesType CNumaSupport::hugePages = CNumaSupport::NoHugePages;
+bool CNumaSupport::pinThreads = false;
+size_t CNumaSupport::nodeRank = 0;
+size_t CNumaSupport::rank = 0;
+size_t CNumaSupport::numberOfProcesses = 1;
+size_t CNumaSupport::numberOfThreads = 1;
+
+void CNumaSupport::SetHugePages( HugePagesType _hugePages )
+{
+	hugePages = _hugePages;
+}
+
+void CNumaSupport::SetWorkers( size_t _rank, size_t _numberOfProcesses, size_t _numberOfThreads )
+{
+	if( _numberOfProcesses == 0 || _rank >= _numberOfProcesses || _numberOfThreads == 0 ) {
+		throw invalid_argument( "CNumaSupport: bad workers" );
+	}
+	rank = _rank;
+	numberOfProcesses = _numberOfProcesses;
+	numberOfThreads = _numberOfThreads;
+}
+
+// Rank of the process among processes of its node, 0 without MPI.
+static size_t NodeRank()
+{
+	int initialized = 0;
+	MPI_Initialized( &initialized );
+	if( initialized == 0 ) {
+		return 0;
+	}
+	MPI_Comm node;
+	MpiCheck( MPI_Comm_split_type( MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL,
+		&node ), "MPI_Comm_split_type" );
+	int nodeRank = 0;
+	MpiCheck( MPI_Comm_rank( node, &nodeRank ), "MPI_Comm_rank" );
+	MpiCheck( MPI_Comm_free( &node ), "MPI_Comm_free" );
+	return static_cast<size_t>( nodeRank );
+}
+
+void CNumaSupport::SetPinThreads( bool _pinThreads )
+{
+	pinThreads = _pinThreads;
+	nodeRank = pinThreads ? NodeRank() : 0;
+}
+
+void CNumaSupport::PinThread( size_t threadIndex )
+{
+	const size_t numberOfCores = thread::hardware_concurrency();
+	if( !pinThreads || numberOfCores == 0 ) {
+		return;
+	}
+	const size_t core = ( nodeRank * numberOfThreads + threadIndex ) % numberOfCores;
+#ifdef _WIN32
+	// cores of the first processor group only
+	const bool pinned = ( SetThreadAffinityMask( GetCurrentThread(),
+		DWORD_PTR( 1 ) << ( core % 64 ) ) != 0 );
+#else
+	cpu_set_t cores;
+	CPU_ZERO( &cores );
+	CPU_SET( core, &cores );
+	const bool pinned = ( pthread_setaffinity_np( pthread_self(), sizeof( cores ), &cores ) == 0 );
+#endif
+	// threads are pinned by each run of PAM, a failure is reported once
+	static atomic<bool> warned( false );
+	if( !pinned && !warned.exchange( true ) ) {
+		cerr << "Warning: cannot pin thread to core " << core << "!" << endl;
+	}
+}
+
+void* CNumaSupport::AllocatePages( size_t bytes )
+{
+	if( bytes < HugePageSize ) {
+		return ::operator new( bytes );
+	}
+	void* pages = nullptr;
+#ifdef _WIN32
+	if( hugePages == ExplicitHugePages ) {
+		// requires the lock pages in memory privilege
+		const size_t largePageSize = GetLargePageMinimum();
+		if( largePageSize > 0 ) {
+			pages = VirtualAlloc( nullptr, ( bytes + largePageSize - 1 ) / largePageSize * largePageSize,
+				MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE );
+		}
+	}
+	if( pages == nullptr ) {
+		pages = VirtualAlloc( nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+	}
+	if( pages == nullptr ) {
+		throw bad_alloc();
+	}
+#else
+	const size_t length = ( bytes + HugePageSize - 1 ) / HugePageSize * HugePageSize;
+#ifdef MAP_HUGETLB
+	if( hugePages == ExplicitHugePages ) {
+		pages = mmap( nullptr, length, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+		if( pages == MAP_FAILED ) {
+			pages = nullptr;
+		}
+	}
+#endif
+	if( pages == nullptr ) {
+		pages = mmap( nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+		if( pages == MAP_FAILED ) {
+			throw bad_alloc();
+		}
+#ifdef MADV_HUGEPAGE
+		if( hugePages != NoHugePages ) {
+			// ignored if transparent huge pages are disabled
+			madvise( pages, length, MADV_HUGEPAGE );
+		}
+#endif
+	}
+#endif
+	return pages;
+}
+
+void CNumaSupport::FreePages( void* pages, size_t bytes )
+{
+	if( pages == nullptr ) {
+		return;
+	}
+	if( bytes < HugePageSize ) {
+		::operator delete( pages );
+		return;
+	}
+#ifdef _WIN32
+	VirtualFree( pages, 0, MEM_RELEASE );
+#else
+	munmap( pages, ( bytes + HugePageSize - 1 ) / HugePageSize * HugePageSize );
+#endif
+}
+
+void CNumaSupport::FirstTouch( size_t numberOfRows,
+	const function<void( size_t, size_t )>& touch )
+{
+	// threads of PAM run on arbitrary cores if they are not pinned
+	if( !pinThreads ) {
+		touch( 0, numberOfRows );
+		return;
+	}
+	// a thread touches rows of its worker and then of workers with the same
+	// thread index of other processes, so their rows are spread over threads
+	const size_t numberOfWorkers = numberOfProcesses * numberOfThreads;
+	vector<exception_ptr> errors( numberOfThreads );
+	vector<thread> threads;
+	threads.reserve( numberOfThreads );
+	for( size_t threadIndex = 0; threadIndex < numberOfThreads; threadIndex++ ) {
+		threads.emplace_back( [&, threadIndex] {
+			try {
+				PinThread( threadIndex );
+				size_t worker = ( rank * numberOfThreads + threadIndex ) % numberOfWorkers;
+				for( size_t i = 0; i < numberOfProcesses; i++ ) {
+					size_t beginRow = 0;
+					size_t endRow = 0;
+					CalcBeginEndObjects( numberOfRows, numberOfWorkers, worker, beginRow, endRow );
+					touch( beginRow, endRow );
+					worker = ( worker + numberOfThreads ) % numberOfWorkers;
+				}
+			} catch( ... ) {
+				errors[threadIndex] = current_exception();
+			}
+		} );
+	}
+	for( thread& t : threads ) {
+		t.join();
+	}
+	for( const exception_ptr& error : errors ) {
+		if( error ) {
+			rethrow_exception( error );
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
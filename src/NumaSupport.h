@@ -0,0 +1,107 @@
+#pragma once
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Placement of dissimilarity matrix in memory and of threads on cores, it is
+// set by the command line before the matrix is built. Worker
+// rank * NumberOfThreads + thread of all processes steps objects by
+// CalcBeginEndObjects. If threads are pinned, rows of these objects are first
+// touched by a thread pinned to the core of that worker, so on NUMA systems
+// they are allocated on the node of its core.
+class CNumaSupport {
+	CNumaSupport() = delete;
+
+public:
+	enum HugePagesType {
+		// pages of the system
+		NoHugePages,
+		// pages are merged to huge pages by the kernel if it can
+		TransparentHugePages,
+		// pages are reserved huge pages, regular pages if there are no free ones
+		ExplicitHugePages
+	};
+
+	// Allocations of at least HugePageSize bytes are pages of the system,
+	// smaller ones are on the heap.
+	static const size_t HugePageSize = 2 << 20;
+
+	static void SetHugePages( HugePagesType hugePages );
+	static HugePagesType HugePages() { return hugePages; }
+	static void SetWorkers( size_t rank, size_t numberOfProcesses, size_t numberOfThreads );
+	// Threads of workers are pinned to cores by numbers of workers among
+	// processes of their node, all processes call it.
+	static void SetPinThreads( bool pinThreads );
+	static bool PinThreads() { return pinThreads; }
+
+	// Pins calling thread of worker rank * NumberOfThreads + threadIndex to
+	// its core if threads are pinned.
+	static void PinThread( size_t threadIndex );
+
+	// Pages are not touched, so they are not allocated yet.
+	static void* AllocatePages( size_t bytes );
+	static void FreePages( void* pages, size_t bytes );
+
+	// Calls touch( beginRow, endRow ) for rows of objects of all workers,
+	// each by a thread pinned as the thread which steps them, or for all rows
+	// by the calling thread if threads are not pinned.
+	static void FirstTouch( size_t numberOfRows,
+		const function<void( size_t, size_t )>& touch );
+
+private:
+	static HugePagesType hugePages;
+	static bool pinThreads;
+	static size_t nodeRank;
+	static size_t rank;
+	static size_t numberOfProcesses;
+	static size_t numberOfThreads;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Allocator of CNumaSupport pages, elements are default initialized, so
+// vector( size ) of numbers does not touch them.
+template<typename TYPE>
+class CPageAllocator {
+public:
+	typedef TYPE value_type;
+
+	CPageAllocator() = default;
+	template<typename OTHER_TYPE>
+	CPageAllocator( const CPageAllocator<OTHER_TYPE>& ) {}
+
+	TYPE* allocate( size_t n )
+	{
+		return static_cast<TYPE*>( CNumaSupport::AllocatePages( n * sizeof( TYPE ) ) );
+	}
+
+	void deallocate( TYPE* pointer, size_t n )
+	{
+		CNumaSupport::FreePages( pointer, n * sizeof( TYPE ) );
+	}
+
+	template<typename OTHER_TYPE>
+	void construct( OTHER_TYPE* pointer )
+	{
+		::new( static_cast<void*>( pointer ) ) OTHER_TYPE;
+	}
+
+	template<typename OTHER_TYPE, typename... ARGUMENTS>
+	void construct( OTHER_TYPE* pointer, ARGUMENTS&&... arguments )
+	{
+		::new( static_cast<void*>( pointer ) ) OTHER_TYPE( forward<ARGUMENTS>( arguments )... );
+	}
+};
+
+template<typename TYPE, typename OTHER_TYPE>
+bool operator==( const CPageAllocator<TYPE>&, const CPageAllocator<OTHER_TYPE>& )
+{
+	return true;
+}
+
+template<typename TYPE, typename OTHER_TYPE>
+bool operator!=( const CPageAllocator<TYPE>&, const CPageAllocator<OTHER_TYPE>& )
+{
+	return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,184 @@
+#include <cassert>
+#include <limits>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <algorithm>
+#include <functional>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <iostream>
+#include <condition_variable>
+
+using namespace std;
+
+#include <MpiSupport.h>
+#include <NumaSupport.h>
+#include <PamEngine.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+double WallTime()
+{
+	return chrono::duration<double>( chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+void CalcBeginEndObjects(
+	const size_t numberOfObjects, const size_t numberOfProcess, const size_t rank,
+	size_t& beginObject, size_t& endObject )
+{
+	const size_t objectsPerProcess = numberOfObjects / numberOfProcess;
+	const size_t additionalObjects = numberOfObjects % numberOfProcess;
+	beginObject = objectsPerProcess * rank + min( rank, additionalObjects );
+	endObject = beginObject + objectsPerProcess;
+	if( rank < additionalObjects ) {
+		endObject++;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void CObjectMedoidDistance::Min( const CObjectMedoidDistance& another )
+{
+	const uint32_t stop = ( Stop != 0 || another.Stop != 0 ) ? 1 : 0;
+	const uint64_t visited = Visited + another.Visited;
+	const uint64_t skipped = Skipped + another.Skipped;
+	if( another.Distance < Distance ) {
+		*this = another;
+	}
+	Stop = stop;
+	Visited = visited;
+	Skipped = skipped;
+}
+
+void CObjectMedoidDistance::AllReduce()
+{
+	MpiCheck( MPI_Allreduce( MPI_IN_PLACE, this, 1 /* count */, datatype(), op(), MPI_COMM_WORLD ),
+		"MPI_Allreduce for CObjectMedoidDistance" );
+}
+
+MPI_Datatype CObjectMedoidDistance::datatype()
+{
+	static MPI_Datatype type = MPI_DATATYPE_NULL;
+	if( type == MPI_DATATYPE_NULL ) {
+		const int count = 6;
+		int blocklengths[count] = { 1, 1, 1, 1, 1, 1 };
+		MPI_Datatype types[count] = { MPI_UINT32_T, MPI_UINT32_T, MPI_FLOAT, MPI_UINT32_T,
+			MPI_UINT64_T, MPI_UINT64_T };
+		MPI_Aint offsets[count] = {
+			offsetof( CObjectMedoidDistance, Object ),
+			offsetof( CObjectMedoidDistance, Medoid ),
+			offsetof( CObjectMedoidDistance, Distance ),
+			offsetof( CObjectMedoidDistance, Stop ),
+			offsetof( CObjectMedoidDistance, Visited ),
+			offsetof( CObjectMedoidDistance, Skipped ) };
+		MpiCheck( MPI_Type_create_struct( count, blocklengths, offsets, types, &type ),
+			"MPI_Type_create_struct for CObjectMedoidDistance" );
+		MpiCheck( MPI_Type_commit( &type ), "MPI_Type_commit for CObjectMedoidDistance" );
+	}
+	return type;
+}
+
+MPI_Op CObjectMedoidDistance::op()
+{
+	static MPI_Op op = MPI_OP_NULL;
+	if( op == MPI_OP_NULL ) {
+		MpiCheck( MPI_Op_create( (MPI_User_function*)objectMedoidDistanceMin,
+			false /* commute */, &op ), "MPI_Op_create for CObjectMedoidDistance" );
+	}
+	return op;
+}
+
+void MPIAPI CObjectMedoidDistance::objectMedoidDistanceMin(
+	CObjectMedoidDistance* in, CObjectMedoidDistance* inout,
+	int* length, MPI_Datatype* /*type*/ )
+{
+	for( int i = 0; i < *length; i++ ) {
+		inout[i].Min( in[i] );
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+const char* CPamResult::StopReasonName() const
+{
+	switch( StopReason ) {
+		case NotStopped:
+			return "not stopped";
+		case Converged:
+			return "converged";
+		case MaxIterationsReached:
+			return "max iterations reached";
+		case SmallImprovement:
+			return "small improvement";
+		case TimeLimitReached:
+			return "time limit reached";
+	}
+	assert( false );
+	return "";
+}
+
+void CPamCheckpoint::Save( const string& filename ) const
+{
+	// the previous checkpoint is replaced only by a completely written one
+	const string temporaryFilename = filename + ".tmp";
+	{
+		ofstream output( temporaryFilename );
+		output << NumberOfObjects << " " << NumberOfClusters << " "
+			<< Iterations << " " << Medoids.size();
+		for( const size_t medoid : Medoids ) {
+			output << " " << medoid;
+		}
+		output << endl;
+		if( output.fail() ) {
+			throw exception( ( "cannot write checkpoint file '"
+				+ temporaryFilename + "'!" ).c_str() );
+		}
+	}
+	remove( filename.c_str() ); // rename does not replace existing files on Windows
+	if( rename( temporaryFilename.c_str(), filename.c_str() ) != 0 ) {
+		throw exception( ( "cannot write checkpoint file '" + filename + "'!" ).c_str() );
+	}
+}
+
+void CPamCheckpoint::Load( const string& filename )
+{
+	vector<uint32_t> buffer;
+	if( CMpiSupport::Rank() == 0 ) {
+		ifstream input( filename );
+		size_t numberOfMedoids = 0;
+		input >> NumberOfObjects >> NumberOfClusters >> Iterations >> numberOfMedoids;
+		Medoids.resize( numberOfMedoids );
+		for( size_t& medoid : Medoids ) {
+			input >> medoid;
+		}
+		if( !input.fail() ) {
+			buffer.push_back( static_cast<uint32_t>( NumberOfObjects ) );
+			buffer.push_back( static_cast<uint32_t>( NumberOfClusters ) );
+			buffer.push_back( static_cast<uint32_t>( Iterations ) );
+			buffer.insert( buffer.end(), Medoids.begin(), Medoids.end() );
+		}
+	}
+
+	uint32_t size = static_cast<uint32_t>( buffer.size() );
+	MpiCheck( MPI_Bcast( &size, 1, MPI_UINT32_T, 0, MPI_COMM_WORLD ),
+		"MPI_Bcast for CPamCheckpoint" );
+	if( size == 0 ) {
+		throw exception( ( "bad checkpoint file '" + filename + "'!" ).c_str() );
+	}
+	buffer.resize( size );
+	MpiCheck( MPI_Bcast( buffer.data(), static_cast<int>( size ), MPI_UINT32_T,
+		0, MPI_COMM_WORLD ), "MPI_Bcast for CPamCheckpoint" );
+
+	NumberOfObjects = buffer[0];
+	NumberOfClusters = buffer[1];
+	Iterations = buffer[2];
+	Medoids.assign( buffer.begin() + 3, buffer.end() );
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,435 @@
+#pragma once
+
+#include <mpi.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Dissimilarities of objects, they are passed by MPI as MPI_FLOAT.
+typedef float DistanceType;
+
+// Seconds since an arbitrary moment, does not require MPI.
+double WallTime();
+
+void CalcBeginEndObjects(
+	const size_t numberOfObjects, const size_t numberOfProcess, const size_t rank,
+	size_t& beginObject, size_t& endObject );
+
+///////////////////////////////////////////////////////////////////////////////
+
+class CBarrier {
+	CBarrier( const CBarrier& ) = delete;
+	CBarrier& operator=( const CBarrier& ) = delete;
+
+public:
+	// Thrown by Sync after Abort.
+	struct CAborted {};
+
+	explicit CBarrier( size_t _numberOfThreads ) :
+		numberOfThreads( _numberOfThreads ),
+		counter( 0 ),
+		isCountingDown( false ),
+		isAborted( false )
+	{
+		if( numberOfThreads == 0 ) {
+			throw invalid_argument( "CBarrier: number of threads must be positive" );
+		}
+	}
+
+	void Sync()
+	{
+		unique_lock<mutex> lock{ m };
+
+		if( isAborted ) {
+			throw CAborted();
+		}
+		if( isCountingDown ) {
+			counter--;
+			if( counter == 0 ) {
+				isCountingDown = false;
+				cv.notify_all();
+			} else {
+				cv.wait( lock, [this]{ return !isCountingDown || isAborted; } );
+			}
+		} else {
+			counter++;
+			if( counter == numberOfThreads ) {
+				isCountingDown = true;
+				cv.notify_all();
+			} else {
+				cv.wait( lock, [this]{ return isCountingDown || isAborted; } );
+			}
+		}
+		if( isAborted ) {
+			throw CAborted();
+		}
+	}
+
+	// Releases threads waiting in Sync, called by a failed thread, so the
+	// other threads do not wait for it.
+	void Abort()
+	{
+		unique_lock<mutex> lock{ m };
+		isAborted = true;
+		cv.notify_all();
+	}
+
+private:
+	mutex m;
+	condition_variable cv;
+
+	size_t counter;
+	const size_t numberOfThreads;
+	bool isCountingDown;
+	bool isAborted;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MPIAPI
+#define MPIAPI
+#endif
+
+static_assert( sizeof( size_t ) <= sizeof( uint32_t ),
+	"invalid: sizeof( size_t ) <= sizeof( uint32_t )" );
+
+struct CObjectMedoidDistance {
+	uint32_t Object;
+	uint32_t Medoid;
+	DistanceType Distance;
+	// Nonzero if any worker asks to stop, reduced by logical or.
+	uint32_t Stop;
+	// Objects visited and skipped by the step, reduced by sum.
+	uint64_t Visited;
+	uint64_t Skipped;
+
+	CObjectMedoidDistance() :
+		Object( 0 ),
+		Medoid( 0 ),
+		Distance( 0 ),
+		Stop( 0 ),
+		Visited( 0 ),
+		Skipped( 0 )
+	{
+	}
+
+	void Min( const CObjectMedoidDistance& another );
+	void AllReduce();
+
+private:
+	static MPI_Datatype datatype();
+	static MPI_Op op();
+	static void MPIAPI objectMedoidDistanceMin(
+		CObjectMedoidDistance* in, CObjectMedoidDistance* inout,
+		int* length, MPI_Datatype* /*type*/ );
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Criteria to stop swapping, besides absence of improving swaps.
+struct CStopCriteria {
+	size_t MaxIterations = 1000;
+	// Swapping stops if a swap improves cost by less than this part of it.
+	double MinRelativeImprovement = 0;
+	// Swapping stops after this number of seconds of clustering, 0 - no limit.
+	double TimeLimit = 0;
+};
+
+struct CPamResult {
+	enum StopReasonType {
+		NotStopped,
+		Converged,
+		MaxIterationsReached,
+		SmallImprovement,
+		TimeLimitReached
+	};
+
+	StopReasonType StopReason = NotStopped;
+	// Number of swap steps.
+	size_t Iterations = 0;
+	DistanceType Cost = 0;
+	// Objects visited and skipped by building and swapping, objects are
+	// skipped only by scans of sorted neighbors.
+	uint64_t VisitedObjects = 0;
+	uint64_t SkippedObjects = 0;
+
+	const char* StopReasonName() const;
+};
+
+// State of PAM, saved periodically by rank 0 to restart a failed run.
+struct CPamCheckpoint {
+	size_t NumberOfObjects = 0;
+	size_t NumberOfClusters = 0;
+	// Number of swap steps done.
+	size_t Iterations = 0;
+	// All medoids when swapping, medoids found so far when building.
+	vector<size_t> Medoids;
+
+	void Save( const string& filename ) const;
+	// Loads checkpoint on rank 0 and broadcasts it to all ranks.
+	void Load( const string& filename );
+};
+
+// Saves checkpoints of PAM on rank 0 not more often than once per interval.
+class CPamCheckpointer {
+	CPamCheckpointer( const CPamCheckpointer& ) = delete;
+	CPamCheckpointer& operator=( const CPamCheckpointer& ) = delete;
+
+public:
+	// Does nothing if filename is empty.
+	CPamCheckpointer( const string& _filename, double _interval ) :
+		filename( _filename ),
+		interval( _interval ),
+		lastTime( WallTime() )
+	{
+	}
+
+	// Saves checkpoint if the interval passed since the last one or if forced.
+	template<typename PAM_TYPE>
+	void Checkpoint( const PAM_TYPE& pam, size_t iterations, bool force = false );
+
+private:
+	const string filename;
+	const double interval;
+	double lastTime;
+};
+
+template<typename PAM_TYPE>
+void CPamCheckpointer::Checkpoint( const PAM_TYPE& pam, size_t iterations, bool force )
+{
+	if( filename.empty() || CMpiSupport::Rank() != 0 ) {
+		return;
+	}
+	const double time = WallTime();
+	if( force || time - lastTime >= interval ) {
+		CPamCheckpoint checkpoint;
+		checkpoint.NumberOfObjects = pam.NumberOfObjects();
+		checkpoint.NumberOfClusters = pam.NumberOfClusters();
+		checkpoint.Iterations = iterations;
+		checkpoint.Medoids = pam.Medoids();
+		checkpoint.Save( filename );
+		lastTime = time;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Initializing or Build  step
+template<typename PAM_TYPE>
+void DoBuildStep( PAM_TYPE& pam, CObjectMedoidDistance& best,
+	const size_t objectBegin, const size_t objectEnd )
+{
+	best.Distance = numeric_limits<DistanceType>::max();
+	best.Object = objectBegin;
+	best.Visited = 0;
+	best.Skipped = 0;
+	for( size_t object = objectBegin; object < objectEnd; object++ ) {
+		if( pam.IsMedoid( object ) ) {
+			continue; // if object is medoid
+		}
+
+		size_t visited = pam.NumberOfObjects();
+		const DistanceType distance = ( pam.State() == PAM_TYPE::Initializing ) ?
+			pam.FindObjectDistanceToAll( object, visited ) :
+			-pam.AddMedoidProfit( object, visited );
+		best.Visited += visited;
+		best.Skipped += pam.NumberOfObjects() - visited;
+
+		if( distance < best.Distance ) {
+			best.Distance = distance;
+			best.Object = object;
+		}
+	}
+}
+
+// Swap step
+template<typename PAM_TYPE>
+void DoSwapStep( PAM_TYPE& pam, CObjectMedoidDistance& best,
+	const size_t objectBegin, const size_t objectEnd )
+{
+	best.Distance = 0;
+	best.Medoid = pam.Medoids().front();
+	best.Object = objectBegin;
+	best.Visited = pam.UpdateSwapCache( objectBegin, objectEnd );
+	best.Skipped = 0;
+
+	vector<DistanceType> results( pam.Medoids().size() );
+	for( size_t object = objectBegin; object < objectEnd; object++ ) {
+		if( pam.IsMedoid( object ) ) {
+			continue; // if object is medoid
+		}
+		size_t visited = 0;
+		pam.SwapResults( object, results.data(), visited );
+		best.Visited += visited;
+		best.Skipped += results.size() * pam.NumberOfObjects() - visited;
+		for( size_t i = 0; i < results.size(); i++ ) {
+			if( results[i] < best.Distance ) {
+				best.Distance = results[i];
+				best.Medoid = pam.Medoids()[i];
+				best.Object = object;
+			}
+		}
+	}
+	// cached results are sums updated by many swaps, so the best one is
+	// calculated again not to swap by rounding errors
+	if( pam.HasSwapCache() && best.Distance < 0 ) {
+		best.Distance = pam.SwapResult( best.Medoid, best.Object );
+	}
+}
+
+// Result is filled and checkpoints are saved by the thread with threadIndex 0.
+// Swap steps are counted from iterations done before.
+template<typename PAM_TYPE>
+void PamThread( PAM_TYPE& pam,
+	vector<CObjectMedoidDistance>& bests, CBarrier& barrier,
+	const CStopCriteria& stopCriteria, const double deadline,
+	CPamCheckpointer& checkpointer, const size_t iterations, CPamResult& result,
+	const bool distributed, size_t threadIndex,
+	const size_t objectBegin, const size_t objectEnd )
+{
+#ifdef _DEBUG
+	static mutex coutMutex;
+#endif
+
+	CNumaSupport::PinThread( threadIndex );
+
+	// Building and Initializing, skipped if medoids were set
+	for( size_t i = pam.Medoids().size(); i < pam.NumberOfClusters(); i++ ) {
+#ifdef _DEBUG
+		{
+			unique_lock<mutex> lock{ coutMutex };
+			cout << CMpiSupport::Rank() << "," << threadIndex << " ["
+				<< objectBegin << ", " << objectEnd << ") "
+				<< "Building..." << i << endl;
+		}
+#endif
+		DoBuildStep( pam, bests[threadIndex], objectBegin, objectEnd );
+
+		barrier.Sync();
+
+		if( threadIndex == 0 ) {
+			for( size_t i = 1; i < bests.size(); i++ ) {
+				bests.front().Min( bests[i] );
+			}
+			if( distributed ) {
+				bests.front().AllReduce();
+			}
+			result.VisitedObjects += bests.front().Visited;
+			result.SkippedObjects += bests.front().Skipped;
+			pam.AddMedoid( bests.front().Object );
+			checkpointer.Checkpoint( pam, iterations );
+		}
+
+		barrier.Sync();
+	}
+
+	// Swapping
+	if( threadIndex == 0 ) {
+		result.Iterations = iterations;
+		result.Cost = pam.Cost();
+	}
+	for( size_t iteration = iterations; ; iteration++ ) {
+		if( iteration >= stopCriteria.MaxIterations ) {
+			if( threadIndex == 0 ) {
+				result.StopReason = CPamResult::MaxIterationsReached;
+			}
+			break;
+		}
+#ifdef _DEBUG
+		{
+			unique_lock<mutex> lock{ coutMutex };
+			cout << CMpiSupport::Rank() << "," << threadIndex <<
+				": " << "Swapping..." << iteration << endl;
+		}
+#endif
+		DoSwapStep( pam, bests[threadIndex], objectBegin, objectEnd );
+		bests[threadIndex].Stop =
+			( stopCriteria.TimeLimit > 0 && WallTime() >= deadline ) ? 1 : 0;
+
+		barrier.Sync();
+
+		if( threadIndex == 0 ) {
+			for( size_t i = 1; i < bests.size(); i++ ) {
+				bests.front().Min( bests[i] );
+			}
+			if( distributed ) {
+				bests.front().AllReduce();
+			}
+			result.Iterations++;
+			result.VisitedObjects += bests.front().Visited;
+			result.SkippedObjects += bests.front().Skipped;
+			if( bests.front().Distance < 0 ) {
+				pam.Swap( bests.front().Medoid, bests.front().Object );
+				checkpointer.Checkpoint( pam, result.Iterations );
+				const DistanceType improvement = -bests.front().Distance;
+				if( bests.front().Stop != 0 ) {
+					result.StopReason = CPamResult::TimeLimitReached;
+				} else if( improvement < stopCriteria.MinRelativeImprovement * result.Cost ) {
+					result.StopReason = CPamResult::SmallImprovement;
+				}
+				result.Cost -= improvement;
+			} else {
+				result.StopReason = CPamResult::Converged;
+			}
+		}
+
+		barrier.Sync();
+
+		if( result.StopReason != CPamResult::NotStopped ) {
+			break;
+		}
+
+		barrier.Sync();
+	}
+
+	if( threadIndex == 0 ) {
+		checkpointer.Checkpoint( pam, result.Iterations, true /* force */ );
+		result.Cost = pam.Cost();
+	}
+}
+
+// Runs a thread for each element of threadObjects, which steps objects
+// [first, second). The best steps of all processes are reduced if
+// distributed, otherwise the threads must step all objects. An exception of
+// a thread stops the others and is rethrown after they are joined.
+template<typename PAM_TYPE>
+CPamResult RunPam( PAM_TYPE& pam, const CStopCriteria& stopCriteria,
+	CPamCheckpointer& checkpointer, const size_t iterations,
+	const vector<pair<size_t, size_t>>& threadObjects, const bool distributed = true )
+{
+	const size_t numberOfThreads = threadObjects.size();
+	const double deadline = WallTime() + stopCriteria.TimeLimit;
+	CPamResult result;
+
+	vector<thread> threads;
+	threads.reserve( numberOfThreads );
+	vector<CObjectMedoidDistance> bests( numberOfThreads );
+	CBarrier barrier( numberOfThreads );
+	vector<exception_ptr> errors( numberOfThreads );
+
+	for( size_t threadIndex = 0; threadIndex < numberOfThreads; threadIndex++ ) {
+		threads.emplace_back( [&, threadIndex] {
+			try {
+				PamThread( pam, bests, barrier, stopCriteria, deadline,
+					checkpointer, iterations, result, distributed, threadIndex,
+					threadObjects[threadIndex].first, threadObjects[threadIndex].second );
+			} catch( const CBarrier::CAborted& ) {
+				// stopped by the failed thread
+			} catch( ... ) {
+				errors[threadIndex] = current_exception();
+				barrier.Abort();
+			}
+		} );
+	}
+
+	for( thread& t : threads ) {
+		t.join();
+	}
+	for( const exception_ptr& error : errors ) {
+		if( error ) {
+			rethrow_exception( error );
+		}
+	}
+	return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
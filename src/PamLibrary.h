@@ -0,0 +1,183 @@
+#pragma once
+
+// Clustering of vectors or objects given by buffers of the caller, which are
+// used in place. A process calls it alone without MPI, or all processes of
+// MPI_COMM_WORLD call it with the same arguments and share the work.
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct CClusteringOptions {
+	// Storage of dissimilarity matrix of vectors.
+	enum MatrixType {
+		// all distances as floats
+		DenseMatrix,
+		// all distances quantized to 16 bits, cost is approximate
+		QuantizedMatrix,
+		// rows are calculated on demand, at most RowCacheSize bytes are kept
+		LazyMatrix,
+		// distances to NumberOfNeighbors nearest vectors are kept, others are
+		// calculated on demand or capped
+		KnnMatrix
+	};
+	// Partitions of vectors for two-level clustering.
+	enum PartitioningType {
+		// vectors are shuffled
+		RandomPartitioning,
+		// space is split by medians of coordinates of the largest spread
+		SpatialPartitioning
+	};
+
+	size_t NumberOfClusters = 0;
+	// Medoids to start swapping from, building is skipped if they are given.
+	vector<size_t> InitialMedoids;
+	CStopCriteria StopCriteria;
+	// Dissimilarity of vectors: euclidean, squared-euclidean, manhattan,
+	// chebyshev or cosine.
+	string Metric = "euclidean";
+	MatrixType Matrix = DenseMatrix;
+	size_t RowCacheSize = 256 << 20;
+	size_t NumberOfNeighbors = 32;
+	// Distances to non-neighbors of KnnMatrix are the largest distance to
+	// neighbors instead of calculated ones, cost is approximate.
+	bool CapNonNeighbors = false;
+	// Number of threads of each process.
+	size_t NumberOfThreads = 1;
+	// All processes cluster together, MPI must be initialized.
+	bool Distributed = false;
+	// Weights of objects or vectors, all are 1 if empty.
+	vector<DistanceType> Weights;
+	// Vectors are clustered by two levels if there are more than
+	// PartitionSize of them: partitions of at most PartitionSize vectors are
+	// clustered separately, then their medoids weighted by sizes of their
+	// clusters are clustered, and all vectors are assigned to the nearest
+	// resulting medoids. Memory is that of matrices of PartitionSize vectors
+	// and of NumberOfClusters medoids of each partition, so PartitionSize
+	// about sqrt( vectors * NumberOfClusters ) takes the least memory.
+	// 0 - one level.
+	size_t PartitionSize = 0;
+	PartitioningType Partitioning = RandomPartitioning;
+	// Building and swapping scan lists of SortedNeighbors nearest objects of
+	// each object instead of all objects, the matrix must not be quantized.
+	// 0 - no lists.
+	size_t SortedNeighbors = 0;
+	// Swap results are cached and updated by objects changed by swaps,
+	// which takes ( NumberOfClusters + 1 ) doubles per vector or object.
+	// SortedNeighbors must be 0, swaps of the cache do not scan lists.
+	bool SwapCache = false;
+};
+
+// Matrix type by its name: dense, quantized, lazy or knn.
+CClusteringOptions::MatrixType ParseMatrixType( const string& name );
+
+struct CClusteringResult {
+	// Indices of medoid vectors or objects.
+	vector<size_t> Medoids;
+	// Cluster of each vector or object: index of its medoid in Medoids.
+	vector<uint32_t> Clusters;
+	// Cost of two-level clustering is that of all vectors.
+	double Cost = 0;
+	// Stop reason and swap steps of clustering of medoids of partitions for
+	// two-level clustering.
+	CPamResult::StopReasonType StopReason = CPamResult::NotStopped;
+	// Number of swap steps.
+	size_t Iterations = 0;
+};
+
+class CClusteringMatrix;
+
+// Dissimilarity matrix of vectors given by consecutive rows of dimension
+// coordinates, which is built once by options.Metric, options.Matrix,
+// options.RowCacheSize, options.NumberOfNeighbors and options.CapNonNeighbors
+// and clustered many times. Coordinates are used in place and must outlive
+// it, Reset replaces them reusing memory of matrix.
+class CVectorsDissimilarities {
+	CVectorsDissimilarities( const CVectorsDissimilarities& ) = delete;
+	CVectorsDissimilarities& operator=( const CVectorsDissimilarities& ) = delete;
+
+public:
+	CVectorsDissimilarities( const DistanceType* coordinates, size_t numberOfVectors,
+		size_t dimension, const CClusteringOptions& options );
+	~CVectorsDissimilarities();
+
+	// Bytes taken by matrix of numberOfVectors vectors.
+	static size_t MemorySize( size_t numberOfVectors, const CClusteringOptions& options );
+
+	// Builds matrix of other vectors with the same options.
+	void Reset( const DistanceType* coordinates, size_t numberOfVectors, size_t dimension );
+
+	size_t NumberOfVectors() const;
+	size_t MemorySize() const { return memorySize; }
+	// Options.Metric and options.Matrix are not used.
+	CClusteringResult Cluster( const CClusteringOptions& options ) const;
+
+private:
+	const unique_ptr<CClusteringMatrix> matrix;
+	const CClusteringOptions options;
+	size_t memorySize = 0;
+};
+
+// Clusters numberOfVectors vectors given by consecutive rows of dimension
+// coordinates, dissimilarities are calculated by options.Metric. Two-level
+// clustering does not support options.InitialMedoids and options.Weights.
+CClusteringResult ClusterVectors( const DistanceType* coordinates,
+	size_t numberOfVectors, size_t dimension, const CClusteringOptions& options );
+
+// Clusters numberOfObjects objects given by their dissimilarity matrix:
+// consecutive rows of numberOfObjects distances, options.Metric and
+// options.Matrix are not used.
+CClusteringResult ClusterObjects( const DistanceType* dissimilarities,
+	size_t numberOfObjects, const CClusteringOptions& options );
+
+// Nearest and second nearest medoids of a vector.
+struct CMedoidAssignment {
+	uint32_t Cluster;
+	DistanceType Distance;
+	// If there is one cluster, second cluster is the largest uint32_t and
+	// second distance is the largest DistanceType.
+	uint32_t SecondCluster;
+	DistanceType SecondDistance;
+};
+
+class CMedoidsIndex;
+
+// Medoids of clustering of vectors with the metric, new vectors are assigned
+// to the nearest medoids without clustering again. Model file has lines
+// 'metric METRIC', 'dimension DIMENSION', 'medoids NUMBER_OF_CLUSTERS' and
+// a line 'VECTOR X1 ... XDIMENSION' for each medoid, separated by tabs.
+class CClusteringModel {
+	CClusteringModel( const CClusteringModel& ) = delete;
+	CClusteringModel& operator=( const CClusteringModel& ) = delete;
+
+public:
+	CClusteringModel();
+	~CClusteringModel();
+
+	// Medoid vectors are indices of medoids in the clustered vectors,
+	// coordinates of medoids are given by consecutive rows.
+	void Reset( const string& metric, size_t dimension, const vector<size_t>& medoidVectors,
+		const vector<DistanceType>& medoidsCoordinates );
+	void Save( const string& filename ) const;
+	void Load( const string& filename );
+
+	const string& Metric() const { return metric; }
+	size_t Dimension() const { return dimension; }
+	size_t NumberOfClusters() const { return medoidVectors.size(); }
+	const vector<size_t>& MedoidVectors() const { return medoidVectors; }
+
+	// Assigns numberOfVectors vectors given by consecutive rows of dimension
+	// coordinates (so arrays of CVector2d and CVectorNd of DistanceType) to
+	// clusters. Distances to all medoids are calculated by batch kernels of
+	// the metric, for many clusters of a metric satisfying the triangle
+	// inequality most medoids are skipped by an index.
+	void Predict( const DistanceType* coordinates, size_t numberOfVectors,
+		CMedoidAssignment* assignments ) const;
+
+private:
+	string metric;
+	size_t dimension = 0;
+	vector<size_t> medoidVectors;
+	vector<DistanceType> medoidsCoordinates;
+	unique_ptr<const CMedoidsIndex> index;
+};
+
+///////////////////////////////////////////////////////////////////////////////
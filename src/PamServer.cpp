@@ -0,0 +1,776 @@
+#include <cassert>
+#include <map>
+#include <mutex>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <limits>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <thread>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <exception>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <condition_variable>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <afunix.h>
+#else
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/socket.h>
+#endif
+
+using namespace std;
+
+#include <MpiSupport.h>
+#include <CommandLine.h>
+#include <VectorsText.h>
+#include <VectorsBinary.h>
+#include <NumaSupport.h>
+#include <PamEngine.h>
+#include <PamLibrary.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Vectors of a dataset and their dissimilarity matrix, kept between requests.
+// Requests hold it by shared_ptr, so it is freed after the last request using
+// it even if it is unloaded meanwhile.
+struct CDataset {
+	size_t Dimension = 0;
+	vector<DistanceType> Coordinates;
+	unique_ptr<CVectorsDissimilarities> Dissimilarities;
+	// Number of the request, which used the dataset last.
+	size_t LastUse = 0;
+
+	size_t MemorySize() const
+	{
+		return Coordinates.size() * sizeof( DistanceType ) + Dissimilarities->MemorySize();
+	}
+};
+
+// Handles requests given by lines 'REQUEST [--NAME[=VALUE]]... [ARGUMENT]...',
+// Handle is called by many threads at once. Requests of different datasets
+// and clustering requests of the same dataset run in parallel, loads run by
+// turns since settings of matrices are static.
+class CClusteringServer {
+	CClusteringServer( const CClusteringServer& ) = delete;
+	CClusteringServer& operator=( const CClusteringServer& ) = delete;
+
+public:
+	// Least recently used datasets are unloaded to keep memory of datasets
+	// below maxMemorySize bytes, each request uses numberOfThreads threads.
+	CClusteringServer( size_t _maxMemorySize, size_t _numberOfThreads ) :
+		maxMemorySize( _maxMemorySize ),
+		numberOfThreads( _numberOfThreads )
+	{
+	}
+
+	bool Stopped() const { return stopped; }
+	// Returns lines 'NAME<TAB>VALUE' of the response, throws on errors.
+	string Handle( const string& request );
+
+private:
+	typedef map<string, shared_ptr<CDataset>> CDatasets;
+
+	const size_t maxMemorySize;
+	const size_t numberOfThreads;
+	atomic<bool> stopped{ false };
+	// Guards datasets and requests.
+	mutable mutex datasetsMutex;
+	CDatasets datasets;
+	size_t requests = 0;
+	mutex loadMutex;
+
+	void load( const CCommandLine& request, ostream& response );
+	void cluster( const CCommandLine& request, ostream& response );
+	void unload( const CCommandLine& request, ostream& response );
+	void status( const CCommandLine& request, ostream& response ) const;
+
+	// Memory of datasets except replacedId.
+	size_t memorySize( const string& replacedId = "" ) const;
+	// Memory of dataset replacedId is counted as freed, it is not unloaded.
+	void admit( size_t datasetMemorySize, const string& replacedId );
+	shared_ptr<CDataset> find( const string& id );
+	void readVectors( const CVectorsBinary& vectorsFile, CDataset& dataset ) const;
+	void readVectors( const CVectorsText& vectorsFile, CDataset& dataset ) const;
+	template<typename VECTORS_FILE>
+	void loadDataset( const VECTORS_FILE& vectorsFile, const CClusteringOptions& options,
+		const string& id, CDataset& dataset );
+};
+
+static size_t ParseSize( const string& text, const string& name )
+{
+	char* end = nullptr;
+	const unsigned long value = strtoul( text.c_str(), &end, 10 );
+	if( text.empty() || *end != '\0' ) {
+		throw exception( ( name + " must be a number!" ).c_str() );
+	}
+	return static_cast<size_t>( value );
+}
+
+string CClusteringServer::Handle( const string& request )
+{
+	vector<string> words;
+	istringstream input( request );
+	string word;
+	while( input >> word ) {
+		words.push_back( word );
+	}
+	vector<const char*> argv( 1, "pam_server" );
+	for( const string& w : words ) {
+		argv.push_back( w.c_str() );
+	}
+	const CCommandLine commandLine( static_cast<int>( argv.size() ), argv.data() );
+
+	ostringstream response;
+	const string& name = commandLine.Argument( 0 );
+	if( name == "load" ) {
+		load( commandLine, response );
+	} else if( name == "cluster" ) {
+		cluster( commandLine, response );
+	} else if( name == "unload" ) {
+		unload( commandLine, response );
+	} else if( name == "status" ) {
+		status( commandLine, response );
+	} else if( name == "shutdown" ) {
+		commandLine.CheckUnknownOptions();
+		stopped = true;
+	} else {
+		throw exception( ( "unknown request '" + name + "'!" ).c_str() );
+	}
+	return response.str();
+}
+
+void CClusteringServer::load( const CCommandLine& request, ostream& response )
+{
+	if( request.NumberOfArguments() != 3 ) {
+		throw exception( "load request is 'load ID FILENAME [OPTIONS]'!" );
+	}
+	const string& id = request.Argument( 1 );
+	const string& filename = request.Argument( 2 );
+	CClusteringOptions options;
+	options.Metric = request.Option( "metric", options.Metric );
+	options.Matrix = ParseMatrixType( request.Option( "matrix", "dense" ) );
+	options.RowCacheSize = request.SizeOption( "row-cache", options.RowCacheSize >> 20 ) << 20;
+	options.NumberOfNeighbors = request.SizeOption( "neighbors", options.NumberOfNeighbors );
+	options.CapNonNeighbors = request.HasOption( "cap-non-neighbors" );
+	options.NumberOfThreads = numberOfThreads;
+	request.CheckUnknownOptions();
+
+	lock_guard<mutex> loadLock( loadMutex );
+	// the replaced dataset is kept until the new one is loaded, so it is not
+	// lost if loading fails
+	const double startTime = WallTime();
+	shared_ptr<CDataset> dataset = make_shared<CDataset>();
+	if( CVectorsBinary::IsBinary( filename ) ) {
+		const CVectorsBinary vectorsFile( filename );
+		loadDataset( vectorsFile, options, id, *dataset );
+	} else {
+		const CVectorsText vectorsFile( filename );
+		loadDataset( vectorsFile, options, id, *dataset );
+	}
+	{
+		lock_guard<mutex> lock( datasetsMutex );
+		dataset->LastUse = ++requests;
+		datasets[id] = dataset;
+	}
+
+	response << "vectors\t" << dataset->Dissimilarities->NumberOfVectors() << endl;
+	response << "dimension\t" << dataset->Dimension << endl;
+	response << "memory\t" << dataset->MemorySize() << endl;
+	response << "load time\t" << WallTime() - startTime << endl;
+}
+
+void CClusteringServer::readVectors( const CVectorsBinary& vectorsFile, CDataset& dataset ) const
+{
+	vector<DistanceType*> vectorsCoordinates( vectorsFile.NumberOfVectors() );
+	for( size_t i = 0; i < vectorsCoordinates.size(); i++ ) {
+		vectorsCoordinates[i] = dataset.Coordinates.data() + i * dataset.Dimension;
+	}
+	vectorsFile.Read( vectorsCoordinates.data() );
+}
+
+// Chunks of lines are parsed by threads of the request.
+void CClusteringServer::readVectors( const CVectorsText& vectorsFile, CDataset& dataset ) const
+{
+	vector<CVectorsChunk> chunks;
+	vectorsFile.Split( numberOfThreads, chunks );
+	vector<exception_ptr> errors( chunks.size() );
+	vector<thread> threads;
+	threads.reserve( chunks.size() );
+	for( size_t chunkIndex = 0; chunkIndex < chunks.size(); chunkIndex++ ) {
+		threads.emplace_back( [&, chunkIndex] {
+			try {
+				const CVectorsChunk& chunk = chunks[chunkIndex];
+				const char* position = chunk.Begin;
+				const size_t end = chunk.FirstVector + chunk.NumberOfVectors;
+				for( size_t i = chunk.FirstVector; i < end; i++ ) {
+					vectorsFile.ParseVector( position, chunk.End,
+						dataset.Coordinates.data() + i * dataset.Dimension );
+				}
+			} catch( ... ) {
+				errors[chunkIndex] = current_exception();
+			}
+		} );
+	}
+	for( thread& t : threads ) {
+		t.join();
+	}
+	for( const exception_ptr& error : errors ) {
+		if( error ) {
+			rethrow_exception( error );
+		}
+	}
+}
+
+template<typename VECTORS_FILE>
+void CClusteringServer::loadDataset( const VECTORS_FILE& vectorsFile,
+	const CClusteringOptions& options, const string& id, CDataset& dataset )
+{
+	const size_t numberOfVectors = vectorsFile.NumberOfVectors();
+	dataset.Dimension = vectorsFile.Dimension();
+	admit( numberOfVectors * dataset.Dimension * sizeof( DistanceType )
+		+ CVectorsDissimilarities::MemorySize( numberOfVectors, options ), id );
+
+	dataset.Coordinates.resize( numberOfVectors * dataset.Dimension );
+	readVectors( vectorsFile, dataset );
+	dataset.Dissimilarities.reset( new CVectorsDissimilarities(
+		dataset.Coordinates.data(), numberOfVectors, dataset.Dimension, options ) );
+}
+
+void CClusteringServer::cluster( const CCommandLine& request, ostream& response )
+{
+	if( request.NumberOfArguments() != 3 ) {
+		throw exception( "cluster request is 'cluster ID NUMBER_OF_CLUSTERS [OPTIONS]'!" );
+	}
+	CClusteringOptions options;
+	options.NumberOfClusters = ParseSize( request.Argument( 2 ), "number of clusters" );
+	options.StopCriteria.MaxIterations = request.SizeOption( "max-iterations",
+		options.StopCriteria.MaxIterations );
+	options.StopCriteria.MinRelativeImprovement = request.DoubleOption( "min-improvement",
+		options.StopCriteria.MinRelativeImprovement );
+	options.StopCriteria.TimeLimit = request.DoubleOption( "time-limit",
+		options.StopCriteria.TimeLimit );
+	if( request.HasOption( "medoids" ) ) {
+		istringstream medoids( request.Option( "medoids" ) );
+		string medoid;
+		while( getline( medoids, medoid, ',' ) ) {
+			options.InitialMedoids.push_back( ParseSize( medoid, "medoid" ) );
+		}
+	}
+	options.SortedNeighbors = request.SizeOption( "sorted-neighbors", options.SortedNeighbors );
+	options.SwapCache = request.HasOption( "swap-cache" );
+	options.NumberOfThreads = numberOfThreads;
+	const bool withClusters = request.HasOption( "clusters" );
+	request.CheckUnknownOptions();
+	const shared_ptr<CDataset> dataset = find( request.Argument( 1 ) );
+
+	const double startTime = WallTime();
+	const CClusteringResult result = dataset->Dissimilarities->Cluster( options );
+	CPamResult pamResult;
+	pamResult.StopReason = result.StopReason;
+	response << "stop reason\t" << pamResult.StopReasonName() << endl;
+	response << "iterations\t" << result.Iterations << endl;
+	response << "pam time\t" << WallTime() - startTime << endl;
+	response << "cost\t" << result.Cost << endl;
+	response << "medoids\t" << result.Medoids.size() << endl;
+	for( const size_t medoid : result.Medoids ) {
+		response << medoid << endl;
+	}
+	if( withClusters ) {
+		response << "vectors\t" << result.Clusters.size() << endl;
+		for( size_t i = 0; i < result.Clusters.size(); i++ ) {
+			response << i << "\t" << result.Clusters[i] << "\n";
+		}
+	}
+}
+
+void CClusteringServer::unload( const CCommandLine& request, ostream& /* response */ )
+{
+	if( request.NumberOfArguments() != 2 ) {
+		throw exception( "unload request is 'unload ID'!" );
+	}
+	request.CheckUnknownOptions();
+	lock_guard<mutex> lock( datasetsMutex );
+	if( datasets.erase( request.Argument( 1 ) ) == 0 ) {
+		throw exception( ( "unknown dataset '" + request.Argument( 1 ) + "'!" ).c_str() );
+	}
+}
+
+void CClusteringServer::status( const CCommandLine& request, ostream& response ) const
+{
+	request.CheckUnknownOptions();
+	lock_guard<mutex> lock( datasetsMutex );
+	response << "memory\t" << memorySize() << endl;
+	response << "memory limit\t" << maxMemorySize << endl;
+	response << "datasets\t" << datasets.size() << endl;
+	for( const CDatasets::value_type& dataset : datasets ) {
+		response << dataset.first << "\t" << dataset.second->Dissimilarities->NumberOfVectors()
+			<< "\t" << dataset.second->Dimension << "\t" << dataset.second->MemorySize() << endl;
+	}
+}
+
+size_t CClusteringServer::memorySize( const string& replacedId ) const
+{
+	size_t size = 0;
+	for( const CDatasets::value_type& dataset : datasets ) {
+		if( dataset.first != replacedId ) {
+			size += dataset.second->MemorySize();
+		}
+	}
+	return size;
+}
+
+// Datasets being clustered are freed when their requests finish, so memory
+// may exceed the limit until then.
+void CClusteringServer::admit( size_t datasetMemorySize, const string& replacedId )
+{
+	if( datasetMemorySize > maxMemorySize ) {
+		throw exception( "dataset does not fit into the memory limit!" );
+	}
+	lock_guard<mutex> lock( datasetsMutex );
+	while( memorySize( replacedId ) + datasetMemorySize > maxMemorySize ) {
+		CDatasets::iterator leastRecentlyUsed = datasets.end();
+		for( CDatasets::iterator i = datasets.begin(); i != datasets.end(); ++i ) {
+			if( i->first != replacedId && ( leastRecentlyUsed == datasets.end()
+				|| i->second->LastUse < leastRecentlyUsed->second->LastUse ) )
+			{
+				leastRecentlyUsed = i;
+			}
+		}
+		datasets.erase( leastRecentlyUsed );
+	}
+}
+
+shared_ptr<CDataset> CClusteringServer::find( const string& id )
+{
+	lock_guard<mutex> lock( datasetsMutex );
+	CDatasets::iterator dataset = datasets.find( id );
+	if( dataset == datasets.end() ) {
+		throw exception( ( "unknown dataset '" + id + "'!" ).c_str() );
+	}
+	dataset->second->LastUse = ++requests;
+	return dataset->second;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef _WIN32
+typedef SOCKET CSocket;
+static const CSocket InvalidSocket = INVALID_SOCKET;
+
+static void CloseSocket( CSocket socket ) { closesocket( socket ); }
+static bool IsInterrupted() { return false; }
+static int PollSockets( pollfd* descriptors, size_t count, int timeout )
+{
+	return WSAPoll( descriptors, static_cast<ULONG>( count ), timeout );
+}
+static bool SetBlocking( CSocket socket, bool blocking )
+{
+	u_long nonBlocking = blocking ? 0 : 1;
+	return ( ioctlsocket( socket, FIONBIO, &nonBlocking ) == 0 );
+}
+#else
+typedef int CSocket;
+static const CSocket InvalidSocket = -1;
+
+static void CloseSocket( CSocket socket ) { close( socket ); }
+static bool IsInterrupted() { return ( errno == EINTR ); }
+static int PollSockets( pollfd* descriptors, size_t count, int timeout )
+{
+	return poll( descriptors, count, timeout );
+}
+static bool SetBlocking( CSocket socket, bool blocking )
+{
+	const int flags = fcntl( socket, F_GETFL );
+	return ( flags != -1 && fcntl( socket, F_SETFL,
+		blocking ? ( flags & ~O_NONBLOCK ) : ( flags | O_NONBLOCK ) ) == 0 );
+}
+#endif
+
+// Unix socket, clients of which send one request line each and receive
+// the response, after which the connection is closed. Connections over the
+// queue size are refused by an error response. Responses are sent by any
+// thread, other methods are called by one thread.
+class CRequestListener {
+	CRequestListener( const CRequestListener& ) = delete;
+	CRequestListener& operator=( const CRequestListener& ) = delete;
+
+public:
+	static const size_t MaxRequestLength = 1 << 16;
+
+	// Replaces an existing socket file at path.
+	CRequestListener( const string& _path, size_t _maxQueueSize );
+	~CRequestListener();
+
+	// Waits for the next request at most timeout milliseconds, returns false
+	// if there is no request.
+	bool Next( CSocket& client, string& request, int timeout );
+	// Sends response to client and closes the connection.
+	static void Respond( CSocket client, const string& response );
+
+private:
+	// Connection of a client, which request is being received.
+	struct CConnection {
+		CSocket Client;
+		string Request;
+	};
+
+	const string path;
+	const size_t maxQueueSize;
+	CSocket listener = InvalidSocket;
+	vector<CConnection> connections;
+	deque<CConnection> requests;
+
+	void poll( int timeout );
+	void accept();
+	// Returns false if the connection is closed.
+	bool receive( CConnection& connection );
+};
+
+CRequestListener::CRequestListener( const string& _path, size_t _maxQueueSize ) :
+	path( _path ),
+	maxQueueSize( _maxQueueSize )
+{
+	sockaddr_un address;
+	memset( &address, 0, sizeof( address ) );
+	address.sun_family = AF_UNIX;
+	if( path.empty() || path.length() >= sizeof( address.sun_path ) ) {
+		throw exception( ( "bad socket path '" + path + "'!" ).c_str() );
+	}
+	strcpy( address.sun_path, path.c_str() );
+
+	listener = socket( AF_UNIX, SOCK_STREAM, 0 );
+	if( listener == InvalidSocket ) {
+		throw exception( "cannot create socket!" );
+	}
+	remove( path.c_str() );
+	if( bind( listener, reinterpret_cast<sockaddr*>( &address ), sizeof( address ) ) != 0
+		|| listen( listener, SOMAXCONN ) != 0
+		|| !SetBlocking( listener, false ) )
+	{
+		CloseSocket( listener );
+		throw exception( ( "cannot listen on socket '" + path + "'!" ).c_str() );
+	}
+}
+
+CRequestListener::~CRequestListener()
+{
+	for( const CConnection& connection : connections ) {
+		CloseSocket( connection.Client );
+	}
+	for( const CConnection& connection : requests ) {
+		CloseSocket( connection.Client );
+	}
+	CloseSocket( listener );
+	remove( path.c_str() );
+}
+
+bool CRequestListener::Next( CSocket& client, string& request, int timeout )
+{
+	if( requests.empty() ) {
+		poll( timeout );
+	}
+	if( requests.empty() ) {
+		return false;
+	}
+	client = requests.front().Client;
+	request = requests.front().Request;
+	requests.pop_front();
+	return true;
+}
+
+void CRequestListener::Respond( CSocket client, const string& response )
+{
+	SetBlocking( client, true );
+	size_t sent = 0;
+	while( sent < response.size() ) {
+		const int size = send( client, response.data() + sent,
+			static_cast<int>( min<size_t>( response.size() - sent, 1 << 20 ) ), 0 );
+		if( size < 0 && IsInterrupted() ) {
+			continue;
+		}
+		if( size <= 0 ) {
+			break; // the client has gone
+		}
+		sent += size;
+	}
+	// unread input makes close reset the connection and drop the response
+#ifdef _WIN32
+	shutdown( client, SD_SEND );
+#else
+	shutdown( client, SHUT_WR );
+#endif
+	SetBlocking( client, false );
+	char buffer[4096];
+	while( recv( client, buffer, sizeof( buffer ), 0 ) > 0 ) {
+	}
+	CloseSocket( client );
+}
+
+void CRequestListener::poll( int timeout )
+{
+	vector<pollfd> descriptors( connections.size() + 1 );
+	descriptors[0].fd = listener;
+	descriptors[0].events = POLLIN;
+	for( size_t i = 0; i < connections.size(); i++ ) {
+		descriptors[i + 1].fd = connections[i].Client;
+		descriptors[i + 1].events = POLLIN;
+	}
+	if( PollSockets( descriptors.data(), descriptors.size(), timeout ) < 0 ) {
+		if( IsInterrupted() ) {
+			return;
+		}
+		throw exception( ( "cannot poll socket '" + path + "'!" ).c_str() );
+	}
+
+	vector<CConnection> receiving;
+	for( size_t i = 0; i < connections.size(); i++ ) {
+		if( descriptors[i + 1].revents == 0 || receive( connections[i] ) ) {
+			receiving.push_back( connections[i] );
+		}
+	}
+	connections.swap( receiving );
+	if( descriptors[0].revents != 0 ) {
+		accept();
+	}
+}
+
+void CRequestListener::accept()
+{
+	while( true ) {
+		const CSocket client = ::accept( listener, nullptr, nullptr );
+		if( client == InvalidSocket ) {
+			if( IsInterrupted() ) {
+				continue;
+			}
+			return; // no more connections
+		}
+		if( connections.size() + requests.size() >= maxQueueSize ) {
+			Respond( client, "error\tserver is busy!\n" );
+		} else {
+			SetBlocking( client, false );
+			connections.push_back( CConnection{ client, string() } );
+		}
+	}
+}
+
+bool CRequestListener::receive( CConnection& connection )
+{
+	char buffer[4096];
+	const int size = recv( connection.Client, buffer, sizeof( buffer ), 0 );
+	if( size < 0 && IsInterrupted() ) {
+		return true;
+	}
+	if( size > 0 ) {
+		connection.Request.append( buffer, size );
+	}
+	const size_t lineEnd = connection.Request.find( '\n' );
+	if( lineEnd != string::npos || ( size == 0 && !connection.Request.empty() ) ) {
+		connection.Request.resize( min( lineEnd, connection.Request.size() ) );
+		requests.push_back( connection );
+		return false;
+	}
+	if( size <= 0 ) {
+		CloseSocket( connection.Client );
+		return false;
+	}
+	if( connection.Request.size() > MaxRequestLength ) {
+		Respond( connection.Client, "error\trequest is too long!\n" );
+		return false;
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Workers handle queued requests by the server and respond to their clients,
+// requests over the queue size are refused.
+class CWorkerPool {
+	CWorkerPool( const CWorkerPool& ) = delete;
+	CWorkerPool& operator=( const CWorkerPool& ) = delete;
+
+public:
+	CWorkerPool( CClusteringServer& server, size_t numberOfWorkers, size_t _maxQueueSize );
+	// Handles queued requests and stops workers.
+	~CWorkerPool();
+
+	// Returns false if the queue is full.
+	bool Push( CSocket client, const string& request );
+
+private:
+	struct CJob {
+		CSocket Client;
+		string Request;
+	};
+
+	const size_t maxQueueSize;
+	mutex jobsMutex;
+	condition_variable jobsCondition;
+	deque<CJob> jobs;
+	bool stopping = false;
+	vector<thread> workers;
+
+	void work( CClusteringServer& server );
+};
+
+CWorkerPool::CWorkerPool( CClusteringServer& server, size_t numberOfWorkers,
+		size_t _maxQueueSize ) :
+	maxQueueSize( _maxQueueSize )
+{
+	if( numberOfWorkers == 0 ) {
+		throw exception( "number of workers must be positive!" );
+	}
+	workers.reserve( numberOfWorkers );
+	for( size_t i = 0; i < numberOfWorkers; i++ ) {
+		workers.emplace_back( &CWorkerPool::work, this, ref( server ) );
+	}
+}
+
+CWorkerPool::~CWorkerPool()
+{
+	{
+		lock_guard<mutex> lock( jobsMutex );
+		stopping = true;
+	}
+	jobsCondition.notify_all();
+	for( thread& worker : workers ) {
+		worker.join();
+	}
+}
+
+bool CWorkerPool::Push( CSocket client, const string& request )
+{
+	{
+		lock_guard<mutex> lock( jobsMutex );
+		if( jobs.size() >= maxQueueSize ) {
+			return false;
+		}
+		jobs.push_back( CJob{ client, request } );
+	}
+	jobsCondition.notify_one();
+	return true;
+}
+
+void CWorkerPool::work( CClusteringServer& server )
+{
+	while( true ) {
+		CJob job;
+		{
+			unique_lock<mutex> lock( jobsMutex );
+			jobsCondition.wait( lock, [this] { return ( stopping || !jobs.empty() ); } );
+			if( jobs.empty() ) {
+				return;
+			}
+			job = jobs.front();
+			jobs.pop_front();
+		}
+		string response;
+		try {
+			response = "ok\n" + server.Handle( job.Request );
+		} catch( exception& e ) {
+			response = string( "error\t" ) + e.what() + "\n";
+		}
+		CRequestListener::Respond( job.Client, response );
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+const char* const Usage =
+	"Usage: pam_server [OPTIONS] SOCKET_PATH\n"
+	"Serves clustering requests on Unix socket SOCKET_PATH, datasets are loaded\n"
+	"once and kept in memory. A client sends one request line and receives\n"
+	"'ok' or 'error<TAB>MESSAGE' followed by lines 'NAME<TAB>VALUE'. Requests\n"
+	"are handled by a pool of workers, each request by its own threads.\n"
+	"Options:\n"
+	"  --workers=N             requests handled at once (default: number of cores)\n"
+	"  --threads=T             threads of each request (default: 1)\n"
+	"  --max-queue=N           refuse requests when N requests wait (default: 16)\n"
+	"  --max-memory=MIB        memory for datasets (default: 4096), least recently\n"
+	"                          used datasets are unloaded to load new ones\n"
+	"Requests:\n"
+	"  load ID FILENAME        load vectors file as dataset ID, options:\n"
+	"                          --metric=NAME as of pam (default: euclidean),\n"
+	"                          --matrix=dense|quantized|lazy|knn (default: dense),\n"
+	"                          --row-cache=MIB rows of lazy matrix (default: 256),\n"
+	"                          --neighbors=M nearest neighbors of knn matrix\n"
+	"                          (default: 32), --cap-non-neighbors\n"
+	"  cluster ID K            cluster dataset ID to K clusters, options:\n"
+	"                          --max-iterations=N, --min-improvement=R,\n"
+	"                          --time-limit=SECONDS, --sorted-neighbors=L,\n"
+	"                          --swap-cache as of pam, --medoids=I,J,... to start\n"
+	"                          swapping from, --clusters to list clusters of\n"
+	"                          vectors\n"
+	"  unload ID               unload dataset ID\n"
+	"  status                  list loaded datasets\n"
+	"  shutdown                stop the server after queued requests";
+
+void DoMain( const int argc, const char* const argv[] )
+{
+	const CCommandLine commandLine( argc, argv );
+	if( commandLine.NumberOfArguments() != 1 ) {
+		throw exception( Usage );
+	}
+	const size_t numberOfWorkers = commandLine.SizeOption( "workers",
+		max<size_t>( 1, thread::hardware_concurrency() ) );
+	const size_t numberOfThreads = commandLine.SizeOption( "threads", 1 );
+	const size_t maxQueueSize = commandLine.SizeOption( "max-queue", 16 );
+	const size_t maxMemorySize = commandLine.SizeOption( "max-memory", 4096 ) << 20;
+	commandLine.CheckUnknownOptions();
+	if( numberOfThreads == 0 ) {
+		throw exception( "number of threads must be positive!" );
+	}
+
+	CClusteringServer server( maxMemorySize, numberOfThreads );
+	CRequestListener listener( commandLine.Argument( 0 ), maxQueueSize );
+	CWorkerPool workers( server, numberOfWorkers, maxQueueSize );
+	// shutdown is checked at least every interval
+	const int PollInterval = 100;
+	while( !server.Stopped() ) {
+		CSocket client = InvalidSocket;
+		string request;
+		if( listener.Next( client, request, PollInterval )
+			&& !workers.Push( client, request ) )
+		{
+			CRequestListener::Respond( client, "error\tserver is busy!\n" );
+		}
+	}
+}
+
+int main( int argc, char** argv )
+{
+	try {
+#ifdef _WIN32
+		WSADATA data;
+		if( WSAStartup( MAKEWORD( 2, 2 ), &data ) != 0 ) {
+			throw exception( "cannot initialize sockets!" );
+		}
+#else
+		signal( SIGPIPE, SIG_IGN );
+#endif
+		DoMain( argc, argv );
+	} catch( exception& e ) {
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	} catch( ... ) {
+		cerr << "Unknown error!" << endl;
+		return 2;
+	}
+
+	return 0;
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Lists of objects sorted by distances from each object, ties by objects,
+// the object itself is not in its list. Lists of Length nearest objects are
+// truncated if there are more other objects. PAM scans them to stop early
+// instead of sweeping all objects.
+template<typename DISTANCE_TYPE>
+class CSortedNeighbors {
+	CSortedNeighbors( const CSortedNeighbors& ) = delete;
+	CSortedNeighbors& operator=( const CSortedNeighbors& ) = delete;
+
+public:
+	typedef DISTANCE_TYPE DistanceType;
+
+	CSortedNeighbors() = default;
+
+	size_t Size() const { return size; }
+	size_t Length() const { return length; }
+	bool IsTruncated() const { return ( length + 1 < size ); }
+	const uint32_t* Neighbors( size_t object ) const
+	{
+		assert( object < size );
+		return neighbors.data() + object * length;
+	}
+	const DistanceType* Distances( size_t object ) const
+	{
+		assert( object < size );
+		return distances.data() + object * length;
+	}
+
+	// Builds lists of at most maxLength objects by rows of the matrix. Each
+	// of processes of MPI_COMM_WORLD sorts rows of its objects by
+	// CalcBeginEndObjects with numberOfThreads threads and the lists are gathered.
+	template<typename MATRIX>
+	void Build( const MATRIX& matrix, size_t maxLength,
+		size_t rank, size_t numberOfProcesses, size_t numberOfThreads );
+
+private:
+	size_t size = 0;
+	size_t length = 0;
+	vector<uint32_t> neighbors;
+	vector<DistanceType> distances;
+
+	template<typename MATRIX>
+	void sortRows( const MATRIX& matrix, size_t objectBegin, size_t objectEnd );
+	void allGather( size_t numberOfProcesses );
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+template<typename DISTANCE_TYPE>
+template<typename MATRIX>
+void CSortedNeighbors<DISTANCE_TYPE>::Build( const MATRIX& matrix, size_t maxLength,
+	size_t rank, size_t numberOfProcesses, size_t numberOfThreads )
+{
+	size = matrix.Size();
+	if( size > numeric_limits<uint32_t>::max() ) {
+		throw invalid_argument( "CSortedNeighbors: too many objects" );
+	}
+	length = min( maxLength, size > 0 ? size - 1 : 0 );
+	neighbors.assign( size * length, 0 );
+	distances.assign( size * length, 0 );
+
+	size_t objectBegin = 0;
+	size_t objectEnd = 0;
+	CalcBeginEndObjects( size, numberOfProcesses, rank, objectBegin, objectEnd );
+	const size_t threads = max<size_t>( 1, numberOfThreads );
+	vector<exception_ptr> errors( threads );
+	vector<thread> workers;
+	workers.reserve( threads );
+	for( size_t threadIndex = 0; threadIndex < threads; threadIndex++ ) {
+		size_t threadBegin = 0;
+		size_t threadEnd = 0;
+		CalcBeginEndObjects( objectEnd - objectBegin, threads, threadIndex,
+			threadBegin, threadEnd );
+		workers.emplace_back( [&, threadIndex, threadBegin, threadEnd] {
+			try {
+				sortRows( matrix, objectBegin + threadBegin, objectBegin + threadEnd );
+			} catch( ... ) {
+				errors[threadIndex] = current_exception();
+			}
+		} );
+	}
+	for( thread& worker : workers ) {
+		worker.join();
+	}
+	for( const exception_ptr& error : errors ) {
+		if( error ) {
+			rethrow_exception( error );
+		}
+	}
+
+	if( numberOfProcesses > 1 ) {
+		allGather( numberOfProcesses );
+	}
+}
+
+template<typename DISTANCE_TYPE>
+template<typename MATRIX>
+void CSortedNeighbors<DISTANCE_TYPE>::sortRows( const MATRIX& matrix,
+	size_t objectBegin, size_t objectEnd )
+{
+	vector<DistanceType> row( size );
+	vector<uint32_t> objects( size );
+	for( size_t object = objectBegin; object < objectEnd; object++ ) {
+		for( size_t i = 0; i < size; i++ ) {
+			row[i] = matrix.Distance( object, i );
+			objects[i] = static_cast<uint32_t>( i );
+		}
+		// the object itself is moved to the end
+		swap( objects[object], objects[size - 1] );
+		partial_sort( objects.begin(), objects.begin() + length, objects.end() - 1,
+			[&row]( uint32_t object1, uint32_t object2 ) {
+				return ( row[object1] < row[object2]
+					|| ( row[object1] == row[object2] && object1 < object2 ) );
+			} );
+		for( size_t i = 0; i < length; i++ ) {
+			neighbors[object * length + i] = objects[i];
+			distances[object * length + i] = row[objects[i]];
+		}
+	}
+}
+
+template<typename DISTANCE_TYPE>
+void CSortedNeighbors<DISTANCE_TYPE>::allGather( size_t numberOfProcesses )
+{
+	if( neighbors.empty() ) {
+		return;
+	}
+	if( size * length > static_cast<size_t>( numeric_limits<int>::max() ) ) {
+		throw invalid_argument( "CSortedNeighbors: too long lists to gather" );
+	}
+	vector<int> counts( numberOfProcesses );
+	vector<int> displacements( numberOfProcesses );
+	for( size_t process = 0; process < numberOfProcesses; process++ ) {
+		size_t processBegin = 0;
+		size_t processEnd = 0;
+		CalcBeginEndObjects( size, numberOfProcesses, process, processBegin, processEnd );
+		counts[process] = static_cast<int>( ( processEnd - processBegin ) * length );
+		displacements[process] = static_cast<int>( processBegin * length );
+	}
+	MpiCheck( MPI_Allgatherv( MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, neighbors.data(),
+		counts.data(), displacements.data(), MPI_UINT32_T, MPI_COMM_WORLD ),
+		"MPI_Allgatherv for sorted neighbors" );
+	MpiCheck( MPI_Allgatherv( MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, distances.data(),
+		counts.data(), displacements.data(), CMpiDatatype<DISTANCE_TYPE>::Type(),
+		MPI_COMM_WORLD ),
+		"MPI_Allgatherv for sorted neighbors distances" );
+}
+
+///////////////////////////////////////////////////////////////////////////////
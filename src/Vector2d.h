@@ -21,6 +21,24 @@ struct CVector2d {
 		const DistanceType dy = Y - point.Y;
 		return sqrt( dx * dx + dy * dy );
 	}
+
+	static void Distances( const CVector2d& point, const CVector2d* points,
+		size_t count, DistanceType* distances )
+	{
+		for( size_t i = 0; i < count; i++ ) {
+			distances[i] = point.Distance( points[i] );
+		}
+	}
+
+	bool operator==( const CVector2d& point ) const
+	{
+		return ( X == point.X && Y == point.Y );
+	}
+
+	bool operator<( const CVector2d& point ) const
+	{
+		return ( X < point.X || ( X == point.X && Y < point.Y ) );
+	}
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstring>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Header of binary vectors file, it is followed by Dimension columns of
+// NumberOfVectors coordinates of ElementSize bytes (4 - float, 8 - double).
+// Byte order is the native one.
+struct CVectorsBinaryHeader {
+	char Magic[4];
+	uint32_t Version;
+	uint32_t ElementSize;
+	uint32_t Reserved;
+	uint64_t NumberOfVectors;
+	uint64_t Dimension;
+};
+
+// Binary vectors file, it is read to memory by one read.
+class CVectorsBinary {
+	CVectorsBinary( const CVectorsBinary& ) = delete;
+	CVectorsBinary& operator=( const CVectorsBinary& ) = delete;
+
+public:
+	static const uint32_t Version = 1;
+
+	// File starts with the magic of binary vectors files.
+	static bool IsBinary( const string& filename );
+	// Writes numberOfVectors vectors given by rows of coordinates.
+	static void Write( ostream& output, size_t numberOfVectors, size_t dimension,
+		const float* coordinates );
+
+	explicit CVectorsBinary( const string& filename );
+
+	size_t NumberOfVectors() const { return static_cast<size_t>( header.NumberOfVectors ); }
+	size_t Dimension() const { return static_cast<size_t>( header.Dimension ); }
+
+	// Copies coordinates of vector i to vectorsCoordinates[i][0, Dimension()).
+	template<typename NUMERIC_TYPE>
+	void Read( NUMERIC_TYPE* const* vectorsCoordinates ) const;
+
+private:
+	vector<char> data;
+	CVectorsBinaryHeader header;
+
+	static const char* magic() { return "PAMV"; }
+
+	template<typename NUMERIC_TYPE, typename ELEMENT_TYPE>
+	void read( NUMERIC_TYPE* const* vectorsCoordinates ) const;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+inline bool CVectorsBinary::IsBinary( const string& filename )
+{
+	ifstream input( filename, ios::binary );
+	char fileMagic[sizeof( header.Magic )];
+	return ( input.read( fileMagic, sizeof( fileMagic ) )
+		&& equal( fileMagic, fileMagic + sizeof( fileMagic ), magic() ) );
+}
+
+inline void CVectorsBinary::Write( ostream& output, size_t numberOfVectors,
+	size_t dimension, const float* coordinates )
+{
+	CVectorsBinaryHeader fileHeader;
+	memcpy( fileHeader.Magic, magic(), sizeof( fileHeader.Magic ) );
+	fileHeader.Version = Version;
+	fileHeader.ElementSize = sizeof( float );
+	fileHeader.Reserved = 0;
+	fileHeader.NumberOfVectors = numberOfVectors;
+	fileHeader.Dimension = dimension;
+	output.write( reinterpret_cast<const char*>( &fileHeader ), sizeof( fileHeader ) );
+
+	vector<float> column( numberOfVectors );
+	for( size_t j = 0; j < dimension; j++ ) {
+		for( size_t i = 0; i < numberOfVectors; i++ ) {
+			column[i] = coordinates[i * dimension + j];
+		}
+		output.write( reinterpret_cast<const char*>( column.data() ),
+			numberOfVectors * sizeof( float ) );
+	}
+}
+
+inline CVectorsBinary::CVectorsBinary( const string& filename )
+{
+	ifstream input( filename, ios::binary | ios::ate );
+	const streamoff size = input.tellg();
+	if( !input.good() || size < static_cast<streamoff>( sizeof( header ) ) ) {
+		throw exception( ( "bad binary vectors file '" + filename + "'!" ).c_str() );
+	}
+	data.resize( static_cast<size_t>( size ) );
+	input.seekg( 0 );
+	if( !input.read( data.data(), size ) ) {
+		throw exception( ( "cannot read vectors file '" + filename + "'!" ).c_str() );
+	}
+
+	memcpy( &header, data.data(), sizeof( header ) );
+	const size_t dataSize = data.size();
+	const bool good = ( equal( header.Magic, header.Magic + sizeof( header.Magic ), magic() )
+		&& header.Version == Version
+		&& ( header.ElementSize == sizeof( float ) || header.ElementSize == sizeof( double ) )
+		&& header.Dimension > 0
+		&& ( dataSize - sizeof( header ) ) / header.ElementSize / header.Dimension
+			== header.NumberOfVectors
+		&& ( dataSize - sizeof( header ) ) % ( header.ElementSize * header.Dimension ) == 0 );
+	if( !good ) {
+		throw exception( ( "bad binary vectors file '" + filename + "'!" ).c_str() );
+	}
+}
+
+template<typename NUMERIC_TYPE>
+void CVectorsBinary::Read( NUMERIC_TYPE* const* vectorsCoordinates ) const
+{
+	if( header.ElementSize == sizeof( float ) ) {
+		read<NUMERIC_TYPE, float>( vectorsCoordinates );
+	} else {
+		read<NUMERIC_TYPE, double>( vectorsCoordinates );
+	}
+}
+
+template<typename NUMERIC_TYPE, typename ELEMENT_TYPE>
+void CVectorsBinary::read( NUMERIC_TYPE* const* vectorsCoordinates ) const
+{
+	// header size is a multiple of element size, so columns are aligned
+	const ELEMENT_TYPE* column = reinterpret_cast<const ELEMENT_TYPE*>( data.data() + sizeof( header ) );
+	for( size_t j = 0; j < Dimension(); j++ ) {
+		for( size_t i = 0; i < NumberOfVectors(); i++ ) {
+			vectorsCoordinates[i][j] = static_cast<NUMERIC_TYPE>( column[i] );
+		}
+		column += NumberOfVectors();
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
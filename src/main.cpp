@@ -1,363 +1,932 @@
 #include <cassert>
+#include <map>
 #include <mutex>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <chrono>
 #include <limits>
 #include <vector>
 #include <string>
+#include <sstream>
 #include <thread>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
 #include <exception>
+#include <cstring>
 #include <algorithm>
+#include <functional>
 #include <unordered_map>
+#include <unordered_set>
 #include <condition_variable>
 
 using namespace std;
 
 #include <MpiSupport.h>
-#include <Vector2d.h>
+#include <CommandLine.h>
+#include <VectorNd.h>
+#include <VectorsText.h>
+#include <MpiVectorsText.h>
+#include <MpiClusteringWriter.h>
+#include <VectorsBinary.h>
+#include <NumaSupport.h>
+#include <PamEngine.h>
 #include <DissimilarityMatrix.h>
+#include <QuantizedDissimilarityMatrix.h>
+#ifdef PAM_FILE_MATRIX
+#include <FileDissimilarityMatrix.h>
+#endif
+#ifdef PAM_LAZY_MATRIX
+#include <LazyDissimilarityMatrix.h>
+#endif
+#ifdef PAM_KNN_MATRIX
+#include <KnnDissimilarityMatrix.h>
+#endif
+#include <SortedNeighbors.h>
 #include <PartitioningAroundMedoids.h>
-
-typedef float DistanceType;
-typedef CVector2d<DistanceType> CVector;
+#include <ClusteringQuality.h>
+#include <PamLibrary.h>
+
+#if defined( PAM_QUANTIZED_MATRIX )
+typedef CQuantizedDissimilarityMatrix<DistanceType> DissimilarityMatrixType;
+#elif defined( PAM_FILE_MATRIX )
+typedef CFileDissimilarityMatrix<DistanceType> DissimilarityMatrixType;
+#elif defined( PAM_LAZY_MATRIX )
+typedef CLazyDissimilarityMatrix<DistanceType> DissimilarityMatrixType;
+#elif defined( PAM_KNN_MATRIX )
+typedef CKnnDissimilarityMatrix<DistanceType> DissimilarityMatrixType;
+#else
 typedef CDissimilarityMatrix<DistanceType> DissimilarityMatrixType;
+#endif
 typedef CPartitioningAroundMedois<DissimilarityMatrixType> PamType;
+typedef CClusteringQuality<DissimilarityMatrixType> ClusteringQualityType;
 
 ///////////////////////////////////////////////////////////////////////////////
 
-class CBarrier {
-	CBarrier( const CBarrier& ) = delete;
-	CBarrier& operator=( const CBarrier& ) = delete;
-
-public:
-	explicit CBarrier( size_t _numberOfThreads ) :
-		numberOfThreads( _numberOfThreads ),
-		counter( 0 ),
-		isCountingDown( false )
-	{
-		if( numberOfThreads == 0 ) {
-			throw invalid_argument( "CBarrier: number of threads must be positive" );
-		}
-	}
+// Input vectors collapsed into objects: identical vectors are one object,
+// weight of which is the number of the vectors.
+struct CInputObjects {
+	vector<DistanceType> Weights;
+	// object of each input vector
+	vector<size_t> VectorObjects;
+	// first input vector of each object
+	vector<size_t> ObjectVectors;
+	// Coordinates of objects by consecutive rows, only if KeepCoordinates.
+	bool KeepCoordinates = false;
+	size_t Dimension = 0;
+	vector<DistanceType> Coordinates;
+	// Sums of weighted distances from each object to all objects, only if
+	// the matrix is built exactly and not extended.
+	vector<DistanceType> DistancesToAll;
+};
 
-	void Sync()
-	{
-		unique_lock<mutex> lock{ m };
+void AllReduce( CClusteringQualitySums& sums )
+{
+	const size_t numberOfClusters = sums.NumberOfClusters();
+	vector<double> buffer;
+	buffer.reserve( 4 * numberOfClusters );
+	buffer.insert( buffer.end(), sums.Sizes.begin(), sums.Sizes.end() );
+	buffer.insert( buffer.end(), sums.Deviations.begin(), sums.Deviations.end() );
+	buffer.insert( buffer.end(), sums.Silhouettes.begin(), sums.Silhouettes.end() );
+	buffer.insert( buffer.end(), sums.SimplifiedSilhouettes.begin(),
+		sums.SimplifiedSilhouettes.end() );
+
+	MpiCheck( MPI_Allreduce( MPI_IN_PLACE, buffer.data(), static_cast<int>( buffer.size() ),
+		MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD ), "MPI_Allreduce for CClusteringQualitySums" );
+
+	auto begin = buffer.cbegin();
+	copy( begin, begin + numberOfClusters, sums.Sizes.begin() );
+	begin += numberOfClusters;
+	copy( begin, begin + numberOfClusters, sums.Deviations.begin() );
+	begin += numberOfClusters;
+	copy( begin, begin + numberOfClusters, sums.Silhouettes.begin() );
+	begin += numberOfClusters;
+	copy( begin, begin + numberOfClusters, sums.SimplifiedSilhouettes.begin() );
+}
 
-		if( isCountingDown ) {
-			counter--;
-			if( counter == 0 ) {
-				isCountingDown = false;
-				cv.notify_all();
-			} else {
-				cv.wait( lock, [this]{ return !isCountingDown; } );
-			}
-		} else {
-			counter++;
-			if( counter == numberOfThreads ) {
-				isCountingDown = true;
-				cv.notify_all();
-			} else {
-				cv.wait( lock, [this]{ return isCountingDown; } );
-			}
-		}
+// Gathers values of all objects, each process has values of objects
+// of its numberOfThreads threads.
+void AllGatherObjects( vector<DistanceType>& values, const size_t numberOfThreads )
+{
+	const size_t numberOfWorkers = CMpiSupport::NumberOfProccess() * numberOfThreads;
+	vector<int> counts( CMpiSupport::NumberOfProccess() );
+	vector<int> displacements( CMpiSupport::NumberOfProccess() );
+	for( size_t rank = 0; rank < CMpiSupport::NumberOfProccess(); rank++ ) {
+		size_t objectBegin = 0;
+		size_t objectEnd = 0;
+		size_t unused = 0;
+		CalcBeginEndObjects( values.size(), numberOfWorkers,
+			rank * numberOfThreads, objectBegin, unused );
+		CalcBeginEndObjects( values.size(), numberOfWorkers,
+			rank * numberOfThreads + numberOfThreads - 1, unused, objectEnd );
+		counts[rank] = static_cast<int>( objectEnd - objectBegin );
+		displacements[rank] = static_cast<int>( objectBegin );
 	}
 
-private:
-	mutex m;
-	condition_variable cv;
-
-	size_t counter;
-	const size_t numberOfThreads;
-	bool isCountingDown;
-};
-
-///////////////////////////////////////////////////////////////////////////////
-
-static_assert( sizeof( size_t ) <= sizeof( uint32_t ),
-	"invalid: sizeof( size_t ) <= sizeof( uint32_t )" );
+	MpiCheck( MPI_Allgatherv( MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+		values.data(), counts.data(), displacements.data(), MPI_FLOAT, MPI_COMM_WORLD ),
+		"MPI_Allgatherv for objects" );
+}
 
-struct CObjectMedoidDistance {
-	uint32_t Object;
-	uint32_t Medoid;
-	DistanceType Distance;
+void PrintQuality( const PamType& pam, const CInputObjects& objects,
+	const CClusteringQualitySums& sums )
+{
+	cout << "cost\t" << sums.Deviation() << endl;
+	cout << "silhouette\t" << sums.Silhouette() << endl;
+	cout << "simplified silhouette\t" << sums.SimplifiedSilhouette() << endl;
+	for( size_t cluster = 0; cluster < sums.NumberOfClusters(); cluster++ ) {
+		const double size = sums.Sizes[cluster];
+		cout << "cluster\t" << objects.ObjectVectors[pam.Medoids()[cluster]] << "\t" << size
+			<< "\t" << sums.Silhouettes[cluster] / size
+			<< "\t" << sums.SimplifiedSilhouettes[cluster] / size << endl;
+	}
+}
 
-	CObjectMedoidDistance() :
-		Object( 0 ),
-		Medoid( 0 ),
-		Distance( 0 )
+void EvaluateQuality( const PamType& pam, const CInputObjects& objects,
+	const vector<pair<size_t, size_t>>& threadObjects )
+{
+	double qualityTime = 0.0;
+	CClusteringQualitySums sums( pam.NumberOfClusters() );
+	ClusteringQualityType quality( pam.DissimilarityMatrix(),
+		pam.Medoids(), pam.ObjectMedoids(), pam.Weights() );
 	{
+		CMpiTimer timer( qualityTime );
+
+		vector<CClusteringQualitySums> threadSums( threadObjects.size(), sums );
+		vector<thread> threads;
+		threads.reserve( threadObjects.size() );
+		for( size_t threadIndex = 0; threadIndex < threadObjects.size(); threadIndex++ ) {
+			threads.emplace_back( [&, threadIndex] {
+				quality.Evaluate( threadObjects[threadIndex].first,
+					threadObjects[threadIndex].second, threadSums[threadIndex] );
+			} );
+		}
+		for( thread& t : threads ) {
+			t.join();
+		}
+
+		for( const CClusteringQualitySums& partialSums : threadSums ) {
+			sums.Add( partialSums );
+		}
+		AllReduce( sums );
+		AllGatherObjects( quality.Silhouettes(), threadObjects.size() );
 	}
 
-	void Min( const CObjectMedoidDistance& another );
-	void AllReduce();
+	if( CMpiSupport::Rank() == 0 ) {
+		PrintQuality( pam, objects, sums );
+		cout << "quality time\t" << qualityTime << endl;
+#ifdef _DEBUG
+		cout << endl;
+		for( size_t i = 0; i < objects.VectorObjects.size(); i++ ) {
+			const size_t object = objects.VectorObjects[i];
+			cout << i << "\t" << quality.ObjectCluster( object )
+				<< "\t" << quality.Silhouettes()[object] << endl;
+		}
+#endif
+	}
+}
 
-private:
-	static MPI_Datatype datatype();
-	static MPI_Op op();
-	static void MPIAPI objectMedoidDistanceMin(
-		CObjectMedoidDistance* in, CObjectMedoidDistance* inout,
-		int* length, MPI_Datatype* /*type*/ );
+// Options of pam given by command line.
+struct CPamOptions {
+	size_t NumberOfClusters = 0;
+	CStopCriteria StopCriteria;
+	size_t NumberOfThreads = 1;
+	// Medoids to start swapping from, building is skipped if they are given.
+	vector<size_t> InitialMedoids;
+	string SaveMedoidsFilename;
+	// Clusters of all vectors are saved if filename is given.
+	string SaveClusteringFilename;
+	bool BinaryClustering = false;
+	string MatrixFilename;
+	string SaveMatrixFilename;
+	string CheckpointFilename;
+	// Minimal number of seconds between checkpoints.
+	double CheckpointInterval = 60;
+	string ResumeFilename;
+	bool EvaluateQuality = false;
+	string Metric;
+	string SaveModelFilename;
+	// Vectors are clustered by two levels if PartitionSize is not 0,
+	// see CClusteringOptions::PartitionSize.
+	size_t PartitionSize = 0;
+	CClusteringOptions::PartitioningType Partitioning = CClusteringOptions::RandomPartitioning;
+	// Length of lists of sorted neighbors, 0 - no lists.
+	size_t SortedNeighbors = 0;
+	bool SwapCache = false;
 };
 
-void CObjectMedoidDistance::Min( const CObjectMedoidDistance& another )
+vector<size_t> ReadMedoids( const string& filename )
 {
-	if( another.Distance < Distance ) {
-		*this = another;
+	ifstream input( filename );
+	vector<size_t> medoids;
+	size_t medoid = 0;
+	while( input >> medoid ) {
+		medoids.push_back( medoid );
+	}
+	if( !input.eof() ) {
+		throw exception( ( "bad medoids file '" + filename + "'!" ).c_str() );
 	}
+	return medoids;
 }
 
-void CObjectMedoidDistance::AllReduce()
+void SaveMedoids( const string& filename, const vector<size_t>& medoids )
 {
-	MpiCheck( MPI_Allreduce( MPI_IN_PLACE, this, 1 /* count */, datatype(), op(), MPI_COMM_WORLD ),
-		"MPI_Allreduce for CObjectMedoidDistance" );
+	ofstream output( filename );
+	for( const size_t medoid : medoids ) {
+		output << medoid << endl;
+	}
+	if( output.fail() ) {
+		throw exception( ( "cannot write medoids file '" + filename + "'!" ).c_str() );
+	}
 }
 
-MPI_Datatype CObjectMedoidDistance::datatype()
+// Saves clusters of vectors, each process gives clusters of its slice of vectors.
+void SaveClustering( const CPamOptions& options, const PamType& pam,
+	const CInputObjects& objects, DistanceType cost )
 {
-	static MPI_Datatype type = MPI_DATATYPE_NULL;
-	if( type == MPI_DATATYPE_NULL ) {
-		const int count = 3;
-		int blocklengths[count] = { 1, 1, 1 };
-		MPI_Datatype types[count] = { MPI_UINT32_T, MPI_UINT32_T, MPI_FLOAT };
-		MPI_Aint offsets[count] = {
-			offsetof( CObjectMedoidDistance, Object ),
-			offsetof( CObjectMedoidDistance, Medoid ),
-			offsetof( CObjectMedoidDistance, Distance ) };
-		MpiCheck( MPI_Type_create_struct( count, blocklengths, offsets, types, &type ),
-			"MPI_Type_create_struct for CObjectMedoidDistance" );
-		MpiCheck( MPI_Type_commit( &type ), "MPI_Type_commit for CObjectMedoidDistance" );
-	}
-	return type;
-}
+	CClusteringOutput clustering;
+	clustering.Cost = cost;
+	vector<uint32_t> medoidClusters( pam.NumberOfObjects() );
+	for( size_t i = 0; i < pam.Medoids().size(); i++ ) {
+		clustering.Medoids.push_back( objects.ObjectVectors[pam.Medoids()[i]] );
+		medoidClusters[pam.Medoids()[i]] = static_cast<uint32_t>( i );
+	}
+	clustering.NumberOfVectors = objects.VectorObjects.size();
+	size_t vectorEnd = 0;
+	CalcBeginEndObjects( clustering.NumberOfVectors,
+		CMpiSupport::NumberOfProccess(), CMpiSupport::Rank(),
+		clustering.FirstVector, vectorEnd );
+	clustering.Clusters.resize( vectorEnd - clustering.FirstVector );
+	for( size_t i = clustering.FirstVector; i < vectorEnd; i++ ) {
+		const size_t medoid = pam.ObjectMedoids()[objects.VectorObjects[i]];
+		clustering.Clusters[i - clustering.FirstVector] = medoidClusters[medoid];
+	}
 
-MPI_Op CObjectMedoidDistance::op()
-{
-	static MPI_Op op = MPI_OP_NULL;
-	if( op == MPI_OP_NULL ) {
-		MpiCheck( MPI_Op_create( (MPI_User_function*)objectMedoidDistanceMin,
-			false /* commute */, &op ), "MPI_Op_create for CObjectMedoidDistance" );
+	if( options.BinaryClustering ) {
+		CMpiClusteringWriter::WriteBinary( options.SaveClusteringFilename, clustering );
+	} else {
+		CMpiClusteringWriter::WriteText( options.SaveClusteringFilename, clustering );
 	}
-	return op;
 }
 
-void MPIAPI CObjectMedoidDistance::objectMedoidDistanceMin(
-	CObjectMedoidDistance* in, CObjectMedoidDistance* inout,
-	int* length, MPI_Datatype* /*type*/ )
+// Saves medoids with their coordinates to assign other vectors to clusters.
+void SaveModel( const CPamOptions& options, const PamType& pam, const CInputObjects& objects )
 {
-	for( int i = 0; i < *length; i++ ) {
-		inout[i].Min( in[i] );
+	vector<size_t> medoidVectors;
+	vector<DistanceType> medoidsCoordinates;
+	for( const size_t medoid : pam.Medoids() ) {
+		medoidVectors.push_back( objects.ObjectVectors[medoid] );
+		medoidsCoordinates.insert( medoidsCoordinates.end(),
+			objects.Coordinates.begin() + medoid * objects.Dimension,
+			objects.Coordinates.begin() + ( medoid + 1 ) * objects.Dimension );
 	}
+	CClusteringModel model;
+	model.Reset( options.Metric, objects.Dimension, medoidVectors, medoidsCoordinates );
+	model.Save( options.SaveModelFilename );
 }
 
-///////////////////////////////////////////////////////////////////////////////
-
-// Initializing or Build  step
-void DoBuildStep( PamType& pam, CObjectMedoidDistance& best,
-	const size_t objectBegin, const size_t objectEnd )
+// Bound of difference between the cost and the cost of exact distances.
+DistanceType CostErrorBound( const PamType& pam )
 {
-	best.Distance = numeric_limits<DistanceType>::max();
-	best.Object = objectBegin;
-	for( size_t object = objectBegin; object < objectEnd; object++ ) {
-		if( pam.IsMedoid( object ) ) {
-			continue; // if object is medoid
-		}
-
-		const DistanceType distance = ( pam.State() == PamType::Initializing ) ?
-			pam.FindObjectDistanceToAll( object ) : -pam.AddMedoidProfit( object );
-
-		if( distance < best.Distance ) {
-			best.Distance = distance;
-			best.Object = object;
-		}
+	DistanceType bound = 0;
+	for( size_t object = 0; object < pam.NumberOfObjects(); object++ ) {
+		bound += pam.Weights()[object] * pam.DissimilarityMatrix().MaxError( object );
 	}
+	return bound;
 }
 
-// Swap step
-void DoSwapStep( PamType& pam, CObjectMedoidDistance& best,
-	const size_t objectBegin, const size_t objectEnd )
+void DoPam( const CPamOptions& options, const DissimilarityMatrixType& matrix,
+	const CInputObjects& objects, double& pamTime )
 {
-	best.Distance = 0;
-	best.Medoid = pam.Medoids().front();
-	best.Object = objectBegin;
-
-	for( size_t object = objectBegin; object < objectEnd; object++ ) {
-		if( pam.IsMedoid( object ) ) {
-			continue; // if object is medoid
+	typedef CPartitioningAroundMedois<DissimilarityMatrixType> PamType;
+	PamType pam( matrix, options.NumberOfClusters );
+	pam.SetWeights( objects.Weights );
+	if( !objects.DistancesToAll.empty() ) {
+		pam.SetDistancesToAll( objects.DistancesToAll );
+	}
+	if( options.SwapCache ) {
+		pam.EnableSwapCache();
+	}
+	CSortedNeighbors<DistanceType> sortedNeighbors;
+	if( options.SortedNeighbors > 0 ) {
+		double sortTime = 0.0;
+		{
+			CMpiTimer timer( sortTime );
+			sortedNeighbors.Build( matrix, options.SortedNeighbors,
+				CMpiSupport::Rank(), CMpiSupport::NumberOfProccess(), options.NumberOfThreads );
 		}
-		for( const size_t medoid : pam.Medoids() ) {
-			DistanceType distance = pam.SwapResult( medoid, object );
-			if( distance < best.Distance ) {
-				best.Distance = distance;
-				best.Medoid = medoid;
-				best.Object = object;
+		if( CMpiSupport::Rank() == 0 ) {
+			cout << "sorted neighbors time\t" << sortTime << endl;
+		}
+		pam.SetSortedNeighbors( sortedNeighbors );
+	}
+	if( !options.InitialMedoids.empty() ) {
+		vector<size_t> initialMedoids;
+		for( const size_t medoid : options.InitialMedoids ) {
+			if( medoid >= objects.VectorObjects.size() ) {
+				throw exception( "bad initial medoids!" );
 			}
+			initialMedoids.push_back( objects.VectorObjects[medoid] );
 		}
+		pam.SetMedoids( initialMedoids );
+	}
+	size_t iterations = 0;
+	if( !options.ResumeFilename.empty() ) {
+		CPamCheckpoint checkpoint;
+		checkpoint.Load( options.ResumeFilename );
+		if( checkpoint.NumberOfObjects != pam.NumberOfObjects()
+			|| checkpoint.NumberOfClusters != pam.NumberOfClusters() )
+		{
+			throw exception( ( "checkpoint '" + options.ResumeFilename
+				+ "' is for another problem!" ).c_str() );
+		}
+		pam.SetMedoids( checkpoint.Medoids );
+		iterations = checkpoint.Iterations;
 	}
-}
 
-void CalcBeginEndObjects(
-	const size_t numberOfObjects, const size_t numberOfProcess, const size_t rank,
-	size_t& beginObject, size_t& endObject )
-{
-	const size_t objectsPerProcess = numberOfObjects / numberOfProcess;
-	const size_t additionalObjects = numberOfObjects % numberOfProcess;
-	beginObject = objectsPerProcess * rank + min( rank, additionalObjects );
-	endObject = beginObject + objectsPerProcess;
-	if( rank < additionalObjects ) {
-		endObject++;
+	const size_t numberOfThreads = options.NumberOfThreads;
+	vector<pair<size_t, size_t>> threadObjects( numberOfThreads );
+	for( size_t threadIndex = 0; threadIndex < numberOfThreads; threadIndex++ ) {
+		CalcBeginEndObjects( pam.NumberOfObjects(),
+			CMpiSupport::NumberOfProccess() * numberOfThreads,
+			CMpiSupport::Rank() * numberOfThreads + threadIndex,
+			threadObjects[threadIndex].first, threadObjects[threadIndex].second );
 	}
-}
 
-void PamThread( PamType& pam,
-	vector<CObjectMedoidDistance>& bests, CBarrier& barrier,
-	size_t threadIndex,
-	const size_t objectBegin, const size_t objectEnd )
-{
-#ifdef _DEBUG
-	static mutex coutMutex;
-#endif
+	CPamResult result;
+	{
+		CMpiTimer timer( pamTime );
+		CPamCheckpointer checkpointer( options.CheckpointFilename, options.CheckpointInterval );
+		result = RunPam( pam, options.StopCriteria, checkpointer, iterations, threadObjects );
+	}
 
+	if( CMpiSupport::Rank() == 0 ) {
+		cout << "stop reason\t" << result.StopReasonName() << endl;
+		cout << "iterations\t" << result.Iterations << endl;
+		cout << "final cost\t" << result.Cost << endl;
+		const DistanceType costErrorBound = CostErrorBound( pam );
+		if( costErrorBound > 0 ) {
+			cout << "cost error bound\t" << costErrorBound << endl;
+		}
+		if( options.SortedNeighbors > 0 || options.SwapCache ) {
+			cout << "visited objects\t" << result.VisitedObjects << endl;
+			cout << "skipped objects\t" << result.SkippedObjects << endl;
+		}
+	}
 
-	// Building and Initializing
-	for( size_t i = 0; i < pam.NumberOfClusters(); i++ ) {
 #ifdef _DEBUG
-		{
-			unique_lock<mutex> lock{ coutMutex };
-			cout << CMpiSupport::Rank() << "," << threadIndex << " ["
-				<< objectBegin << ", " << objectEnd << ") "
-				<< "Building..." << i << endl;
+	if( CMpiSupport::Rank() == 0 ) {
+		cout << endl;
+		unordered_map<size_t, size_t> medoidToClusterId;
+		for( size_t i = 0; i < objects.VectorObjects.size(); i++ ) {
+			const size_t object = objects.VectorObjects[i];
+			auto pair = medoidToClusterId.insert(
+				make_pair( pam.ObjectMedoids()[object], medoidToClusterId.size() ) );
+			cout << i << "\t" << pair.first->second << endl;
 		}
+	}
 #endif
-		DoBuildStep( pam, bests[threadIndex], objectBegin, objectEnd );
-
-		barrier.Sync();
 
-		if( threadIndex == 0 ) {
-			for( CObjectMedoidDistance& objectMedoidDistance : bests ) {
-				bests.front().Min( objectMedoidDistance );
-			}
-			bests.front().AllReduce();
-			pam.AddMedoid( bests.front().Object );
+	if( CMpiSupport::Rank() == 0 && !options.SaveMedoidsFilename.empty() ) {
+		vector<size_t> medoids;
+		for( const size_t medoid : pam.Medoids() ) {
+			medoids.push_back( objects.ObjectVectors[medoid] );
 		}
+		SaveMedoids( options.SaveMedoidsFilename, medoids );
+	}
 
-		barrier.Sync();
+	if( !options.SaveClusteringFilename.empty() ) {
+		SaveClustering( options, pam, objects, result.Cost );
 	}
 
-	// Swapping
-	for( size_t iteration = 0; iteration < 1000; iteration++ ) {
-#ifdef _DEBUG
-		{
-			unique_lock<mutex> lock{ coutMutex };
-			cout << CMpiSupport::Rank() << "," << threadIndex <<
-				": " << "Swapping..." << iteration << endl;
-		}
+	if( CMpiSupport::Rank() == 0 && !options.SaveModelFilename.empty() ) {
+		SaveModel( options, pam, objects );
+	}
+
+	if( options.EvaluateQuality ) {
+		EvaluateQuality( pam, objects, threadObjects );
+	}
+}
+
+// Clusters vectors given by consecutive rows of dimension coordinates by
+// partitions and then their medoids, all processes share partitions.
+void DoPartitionedPam( const CPamOptions& options, const vector<DistanceType>& coordinates,
+	size_t dimension, double& pamTime )
+{
+	CClusteringOptions clusteringOptions;
+	clusteringOptions.NumberOfClusters = options.NumberOfClusters;
+	clusteringOptions.StopCriteria = options.StopCriteria;
+	clusteringOptions.Metric = options.Metric;
+#if defined( PAM_QUANTIZED_MATRIX )
+	clusteringOptions.Matrix = CClusteringOptions::QuantizedMatrix;
+#elif defined( PAM_LAZY_MATRIX )
+	clusteringOptions.Matrix = CClusteringOptions::LazyMatrix;
+	clusteringOptions.RowCacheSize = DissimilarityMatrixType::CacheSize();
+#elif defined( PAM_KNN_MATRIX )
+	clusteringOptions.Matrix = CClusteringOptions::KnnMatrix;
+	clusteringOptions.NumberOfNeighbors = DissimilarityMatrixType::NumberOfNeighbors();
+	clusteringOptions.CapNonNeighbors = DissimilarityMatrixType::CapNonNeighbors();
 #endif
-		DoSwapStep( pam, bests[threadIndex], objectBegin, objectEnd );
+	clusteringOptions.NumberOfThreads = options.NumberOfThreads;
+	clusteringOptions.Distributed = true;
+	clusteringOptions.PartitionSize = options.PartitionSize;
+	clusteringOptions.Partitioning = options.Partitioning;
+	clusteringOptions.SortedNeighbors = options.SortedNeighbors;
+	clusteringOptions.SwapCache = options.SwapCache;
+
+	const size_t numberOfVectors = coordinates.size() / dimension;
+	CClusteringResult result;
+	{
+		CMpiTimer timer( pamTime );
+		result = ClusterVectors( coordinates.data(), numberOfVectors, dimension,
+			clusteringOptions );
+	}
 
-		barrier.Sync();
+	if( CMpiSupport::Rank() == 0 ) {
+		CPamResult pamResult;
+		pamResult.StopReason = result.StopReason;
+		cout << "partitions\t"
+			<< ( numberOfVectors + options.PartitionSize - 1 ) / options.PartitionSize << endl;
+		cout << "stop reason\t" << pamResult.StopReasonName() << endl;
+		cout << "iterations\t" << result.Iterations << endl;
+		cout << "final cost\t" << result.Cost << endl;
+	}
 
-		if( threadIndex == 0 ) {
-			for( CObjectMedoidDistance& objectMedoidDistance : bests ) {
-				bests.front().Min( objectMedoidDistance );
-			}
-			bests.front().AllReduce();
-			if( bests.front().Distance < 0 ) {
-				pam.Swap( bests.front().Medoid, bests.front().Object );
-			}
-		}
+	if( CMpiSupport::Rank() == 0 && !options.SaveMedoidsFilename.empty() ) {
+		SaveMedoids( options.SaveMedoidsFilename, result.Medoids );
+	}
 
-		barrier.Sync();
+	if( !options.SaveClusteringFilename.empty() ) {
+		CClusteringOutput clustering;
+		clustering.Cost = result.Cost;
+		clustering.Medoids = result.Medoids;
+		clustering.NumberOfVectors = numberOfVectors;
+		size_t vectorEnd = 0;
+		CalcBeginEndObjects( numberOfVectors, CMpiSupport::NumberOfProccess(),
+			CMpiSupport::Rank(), clustering.FirstVector, vectorEnd );
+		clustering.Clusters.assign( result.Clusters.begin() + clustering.FirstVector,
+			result.Clusters.begin() + vectorEnd );
+		if( options.BinaryClustering ) {
+			CMpiClusteringWriter::WriteBinary( options.SaveClusteringFilename, clustering );
+		} else {
+			CMpiClusteringWriter::WriteText( options.SaveClusteringFilename, clustering );
+		}
+	}
 
-		if( !( bests.front().Distance < 0 ) ) {
-			break;
+	if( CMpiSupport::Rank() == 0 && !options.SaveModelFilename.empty() ) {
+		vector<DistanceType> medoidsCoordinates;
+		for( const size_t medoid : result.Medoids ) {
+			medoidsCoordinates.insert( medoidsCoordinates.end(),
+				coordinates.begin() + medoid * dimension,
+				coordinates.begin() + ( medoid + 1 ) * dimension );
 		}
+		CClusteringModel model;
+		model.Reset( options.Metric, dimension, result.Medoids, medoidsCoordinates );
+		model.Save( options.SaveModelFilename );
+	}
+}
 
-		barrier.Sync();
+// Collapses identical vectors into weighted objects, keeping order of
+// the first occurrences.
+template<typename VECTOR_TYPE>
+void CollapseDuplicates( vector<VECTOR_TYPE>& vectors, CInputObjects& objects )
+{
+	objects.Weights.clear();
+	objects.VectorObjects.resize( vectors.size() );
+	objects.ObjectVectors.clear();
+
+	map<VECTOR_TYPE, size_t> vectorToObject;
+	for( size_t i = 0; i < vectors.size(); i++ ) {
+		auto pair = vectorToObject.insert( make_pair( vectors[i], objects.ObjectVectors.size() ) );
+		if( pair.second ) {
+			vectors[objects.ObjectVectors.size()] = vectors[i];
+			objects.ObjectVectors.push_back( i );
+			objects.Weights.push_back( 0 );
+		}
+		objects.Weights[pair.first->second] += 1;
+		objects.VectorObjects[i] = pair.first->second;
 	}
+	vectors.resize( objects.ObjectVectors.size() );
 }
 
-void DoPam( const size_t numberOfClusters, const DissimilarityMatrixType& matrix,
-	size_t numberOfThreads = 1 )
+template<size_t DIMENSION, typename METRIC>
+DistanceType* VectorCoordinates( size_t /* dimension */,
+	CVectorNd<DIMENSION, DistanceType, METRIC>& point )
 {
-	typedef CPartitioningAroundMedois<DissimilarityMatrixType> PamType;
-	PamType pam( matrix, numberOfClusters );
+	return point.Coordinates;
+}
 
+template<typename METRIC>
+DistanceType* VectorCoordinates( size_t dimension,
+	CDynamicVector<DistanceType, METRIC>& point )
+{
+	point.Coordinates.resize( dimension );
+	return point.Coordinates.data();
+}
+
+// Parses chunks of vectors in numberOfThreads threads.
+template<typename VECTOR_TYPE>
+vector<VECTOR_TYPE> ReadVectors( const CVectorsText& text, size_t numberOfThreads )
+{
+	vector<CVectorsChunk> chunks;
+	text.Split( numberOfThreads, chunks );
+	vector<VECTOR_TYPE> vectors( text.NumberOfVectors() );
+	vector<exception_ptr> errors( chunks.size() );
 	vector<thread> threads;
-	threads.reserve( numberOfThreads );
-	vector<CObjectMedoidDistance> bests( numberOfThreads );
-	CBarrier barrier( numberOfThreads );
+	threads.reserve( chunks.size() );
+	for( size_t chunkIndex = 0; chunkIndex < chunks.size(); chunkIndex++ ) {
+		threads.emplace_back( [&, chunkIndex] {
+			try {
+				const CVectorsChunk& chunk = chunks[chunkIndex];
+				const char* position = chunk.Begin;
+				const size_t end = chunk.FirstVector + chunk.NumberOfVectors;
+				for( size_t i = chunk.FirstVector; i < end; i++ ) {
+					text.ParseVector( position, chunk.End,
+						VectorCoordinates( text.Dimension(), vectors[i] ) );
+				}
+			} catch( ... ) {
+				errors[chunkIndex] = current_exception();
+			}
+		} );
+	}
+	for( thread& t : threads ) {
+		t.join();
+	}
+	for( const exception_ptr& error : errors ) {
+		if( error ) {
+			rethrow_exception( error );
+		}
+	}
+	return vectors;
+}
 
-	for( size_t threadIndex = 0; threadIndex < numberOfThreads; threadIndex++ ) {
-		size_t objectBegin = 0;
-		size_t objectEnd = 0;
-		CalcBeginEndObjects( pam.NumberOfObjects(),
-			CMpiSupport::NumberOfProccess() * numberOfThreads,
-			CMpiSupport::Rank() * numberOfThreads + threadIndex,
-			objectBegin, objectEnd );
+template<typename VECTOR_TYPE>
+vector<VECTOR_TYPE> ReadVectors( const CVectorsBinary& binary, size_t /* numberOfThreads */ )
+{
+	vector<VECTOR_TYPE> vectors( binary.NumberOfVectors() );
+	vector<DistanceType*> coordinates( vectors.size() );
+	for( size_t i = 0; i < vectors.size(); i++ ) {
+		coordinates[i] = VectorCoordinates( binary.Dimension(), vectors[i] );
+	}
+	binary.Read( coordinates.data() );
+	return vectors;
+}
 
-		threads.emplace_back( PamThread,
-			ref( pam ), ref( bests ), ref( barrier ),
-			threadIndex, objectBegin, objectEnd );
+template<typename VECTOR_TYPE>
+vector<VECTOR_TYPE> ReadVectors( const CMpiVectorsText& text, size_t /* numberOfThreads */ )
+{
+	vector<VECTOR_TYPE> vectors( text.NumberOfVectors() );
+	vector<DistanceType*> coordinates( vectors.size() );
+	for( size_t i = 0; i < vectors.size(); i++ ) {
+		coordinates[i] = VectorCoordinates( text.Dimension(), vectors[i] );
 	}
+	text.Read( coordinates.data() );
+	return vectors;
+}
 
-	for( thread& t : threads ) {
-		t.join();
+// Reads vectors of CMpiVectorsText or CVectorsBinary by consecutive rows.
+template<typename VECTORS_FILE>
+vector<DistanceType> ReadCoordinates( const VECTORS_FILE& vectorsFile )
+{
+	const size_t dimension = vectorsFile.Dimension();
+	vector<DistanceType> coordinates( vectorsFile.NumberOfVectors() * dimension );
+	vector<DistanceType*> vectors( vectorsFile.NumberOfVectors() );
+	for( size_t i = 0; i < vectors.size(); i++ ) {
+		vectors[i] = coordinates.data() + i * dimension;
 	}
+	vectorsFile.Read( vectors.data() );
+	return coordinates;
+}
 
-#ifdef _DEBUG
-	if( CMpiSupport::Rank() == 0 ) {
-		cout << endl;
-		unordered_map<size_t, size_t> medoidToClusterId;
-		for( size_t object = 0; object < pam.NumberOfObjects(); object++ ) {
-			auto pair = medoidToClusterId.insert(
-				make_pair( pam.ObjectMedoids()[object], medoidToClusterId.size() ) );
-			cout << object << "\t" << pair.first->second << endl;
+template<typename VECTOR_TYPE, typename VECTORS_FILE>
+DissimilarityMatrixType BuildDissimilarityMatrix( const VECTORS_FILE& vectorsFile,
+	size_t numberOfThreads, CInputObjects& objects, DissimilarityMatrixType&& matrix )
+{
+	vector<VECTOR_TYPE> vectors = ReadVectors<VECTOR_TYPE>( vectorsFile, numberOfThreads );
+	CollapseDuplicates( vectors, objects );
+	if( objects.KeepCoordinates ) {
+		objects.Dimension = vectorsFile.Dimension();
+		objects.Coordinates.resize( vectors.size() * objects.Dimension );
+		for( size_t i = 0; i < vectors.size(); i++ ) {
+			const DistanceType* const coordinates =
+				VectorCoordinates( objects.Dimension, vectors[i] );
+			copy( coordinates, coordinates + objects.Dimension,
+				objects.Coordinates.begin() + i * objects.Dimension );
 		}
 	}
+#if defined( PAM_LAZY_MATRIX )
+	matrix.SetObjects( vectors );
+	return move( matrix );
+#elif defined( PAM_KNN_MATRIX )
+	matrix.SetObjects( vectors, CMpiSupport::Rank(), CMpiSupport::NumberOfProccess() );
+	return move( matrix );
+#else
+	if( matrix.Size() == 0 ) {
+		CDissimilarityMatrixBuilder<VECTOR_TYPE, DissimilarityMatrixType> builder;
+		builder.assign( vectors.begin(), vectors.end() );
+		return builder.Build( objects.Weights, objects.DistancesToAll );
+	}
+	return CDissimilarityMatrixBuilder<VECTOR_TYPE, DissimilarityMatrixType>::Extend(
+		move( matrix ), vectors.begin(), vectors.end() );
 #endif
 }
 
-DissimilarityMatrixType BuildDissimilarityMatrix( istream& input )
+template<typename METRIC, typename VECTORS_FILE>
+DissimilarityMatrixType BuildMetricDissimilarityMatrix( const VECTORS_FILE& vectorsFile,
+	size_t numberOfThreads, CInputObjects& objects, DissimilarityMatrixType&& matrix )
 {
-	size_t unused = 0;
-	size_t numberOfVectors = 0;
-	input >> unused >> numberOfVectors;
-	vector<CVector> vectors;
-	vectors.resize( numberOfVectors );
-	for( size_t i = 0; input.good() && i < numberOfVectors; i++ ) {
-		input >> unused >> vectors[i].X >> vectors[i].Y;
-	}
-	if( !input.fail() ) {
-		return CDissimilarityMatrixBuilder<CVector>::Build( vectors.begin(), vectors.end() );
-	}
-	throw exception( "bad vectors file format!" );
+	switch( vectorsFile.Dimension() ) {
+		case 2:
+			return BuildDissimilarityMatrix<CVectorNd<2, DistanceType, METRIC>>(
+				vectorsFile, numberOfThreads, objects, move( matrix ) );
+		case 3:
+			return BuildDissimilarityMatrix<CVectorNd<3, DistanceType, METRIC>>(
+				vectorsFile, numberOfThreads, objects, move( matrix ) );
+		case 4:
+			return BuildDissimilarityMatrix<CVectorNd<4, DistanceType, METRIC>>(
+				vectorsFile, numberOfThreads, objects, move( matrix ) );
+		case 8:
+			return BuildDissimilarityMatrix<CVectorNd<8, DistanceType, METRIC>>(
+				vectorsFile, numberOfThreads, objects, move( matrix ) );
+		case 16:
+			return BuildDissimilarityMatrix<CVectorNd<16, DistanceType, METRIC>>(
+				vectorsFile, numberOfThreads, objects, move( matrix ) );
+		case 32:
+			return BuildDissimilarityMatrix<CVectorNd<32, DistanceType, METRIC>>(
+				vectorsFile, numberOfThreads, objects, move( matrix ) );
+		case 64:
+			return BuildDissimilarityMatrix<CVectorNd<64, DistanceType, METRIC>>(
+				vectorsFile, numberOfThreads, objects, move( matrix ) );
+		case 128:
+			return BuildDissimilarityMatrix<CVectorNd<128, DistanceType, METRIC>>(
+				vectorsFile, numberOfThreads, objects, move( matrix ) );
+	}
+	return BuildDissimilarityMatrix<CDynamicVector<DistanceType, METRIC>>(
+		vectorsFile, numberOfThreads, objects, move( matrix ) );
+}
+
+// Vectors file is CVectorsText, CMpiVectorsText or CVectorsBinary, text is parsed in
+// numberOfThreads threads. Common dimensions have fixed size vectors.
+// Identical vectors are collapsed into weighted objects.
+// If matrix is not empty it must contain distances of the first
+// matrix.Size() objects, only distances to the rest objects are calculated.
+template<typename VECTORS_FILE>
+DissimilarityMatrixType BuildDissimilarityMatrix( const VECTORS_FILE& vectorsFile, const string& metric,
+	size_t numberOfThreads, CInputObjects& objects,
+	DissimilarityMatrixType&& matrix = DissimilarityMatrixType() )
+{
+	if( metric == CEuclideanMetric::Name() ) {
+		return BuildMetricDissimilarityMatrix<CEuclideanMetric>(
+			vectorsFile, numberOfThreads, objects, move( matrix ) );
+	}
+	if( metric == CSquaredEuclideanMetric::Name() ) {
+		return BuildMetricDissimilarityMatrix<CSquaredEuclideanMetric>(
+			vectorsFile, numberOfThreads, objects, move( matrix ) );
+	}
+	if( metric == CManhattanMetric::Name() ) {
+		return BuildMetricDissimilarityMatrix<CManhattanMetric>(
+			vectorsFile, numberOfThreads, objects, move( matrix ) );
+	}
+	if( metric == CChebyshevMetric::Name() ) {
+		return BuildMetricDissimilarityMatrix<CChebyshevMetric>(
+			vectorsFile, numberOfThreads, objects, move( matrix ) );
+	}
+	if( metric == CCosineMetric::Name() ) {
+		return BuildMetricDissimilarityMatrix<CCosineMetric>(
+			vectorsFile, numberOfThreads, objects, move( matrix ) );
+	}
+	throw exception( ( "unknown metric '" + metric + "'!" ).c_str() );
 }
 
+const char* const Usage =
+	"Usage: pam [OPTIONS] NUMBER_OF_CLUSTERS VECTORS_FILENAME [NUMBER_OF_THREADS]\n"
+	"Options:\n"
+	"  --max-iterations=N      do at most N swap steps (default: 1000)\n"
+	"  --min-improvement=R     stop when a swap improves cost by less than R * cost\n"
+	"  --time-limit=SECONDS    stop swapping after SECONDS of clustering\n"
+	"  --checkpoint=FILE       periodically save state of clustering to FILE\n"
+	"  --checkpoint-interval=SECONDS\n"
+	"                          minimal time between checkpoints (default: 60)\n"
+	"  --resume=FILE           continue clustering from checkpoint FILE\n"
+	"  --quality               evaluate cost and silhouettes of the result\n"
+	"  --medoids=FILE          start swapping from medoids in FILE\n"
+	"  --save-medoids=FILE     save result medoids to FILE\n"
+	"  --save-clustering=FILE  save cost, medoids and clusters of vectors to FILE\n"
+	"  --save-model=FILE       save medoids and their coordinates to FILE to assign\n"
+	"                          other vectors to clusters\n"
+	"  --binary-clustering     save clustering in binary format\n"
+	"  --matrix=FILE           reuse dissimilarity matrix saved to FILE\n"
+	"                          for the first vectors of VECTORS_FILENAME\n"
+	"  --save-matrix=FILE      save dissimilarity matrix to FILE\n"
+	"  --metric=NAME           dissimilarity of vectors: euclidean (default),\n"
+	"                          squared-euclidean, manhattan, chebyshev or cosine\n"
+	"  --partition-size=N      cluster partitions of at most N vectors, then their\n"
+	"                          medoids, and assign vectors to the nearest medoids\n"
+	"  --partitioning=NAME     partitions of vectors: random (default) or spatial\n"
+	"  --sorted-neighbors=L    scan lists of L nearest objects sorted by distances\n"
+	"                          instead of all objects when building and swapping,\n"
+	"                          the lists take L * 8 bytes per object\n"
+	"  --swap-cache            keep results of swaps and update them by objects\n"
+	"                          changed by swaps, takes ( NUMBER_OF_CLUSTERS + 1 ) * 8\n"
+	"                          bytes per object, not with --sorted-neighbors\n"
+	"  --huge-pages=MODE       back dissimilarity matrix by huge pages: none (default),\n"
+	"                          transparent or explicit (reserved by the system)\n"
+	"  --pin-threads           pin threads to cores by objects they step, pages of\n"
+	"                          matrix rows are first touched on cores of threads\n"
+	"                          stepping them, without it pages are placed arbitrarily\n"
+#ifdef PAM_FILE_MATRIX
+	"  --matrix-files=PREFIX   keep dissimilarity matrix in files PREFIX.RANK.N\n"
+	"                          (default: pam_matrix)\n"
+#endif
+#ifdef PAM_LAZY_MATRIX
+	"  --row-cache=MIB         keep at most MIB MiB of dissimilarity matrix rows\n"
+	"                          (default: 256), rows are calculated on demand\n"
+#endif
+#ifdef PAM_KNN_MATRIX
+	"  --neighbors=M           keep distances to M nearest neighbors (default: 32),\n"
+	"                          distances to others are calculated on demand\n"
+	"  --cap-non-neighbors     distances to non-neighbors are the largest distance\n"
+	"                          to neighbors, cost is approximate\n"
+#endif
+	"Header of VECTORS_FILENAME is 'UNUSED NUMBER_OF_VECTORS [DIMENSION]',\n"
+	"each vector is given by a line 'UNUSED X1 ... XDIMENSION'.\n"
+	"VECTORS_FILENAME may also be a binary vectors file made by pam_convert.";
+
 void DoMain( const int argc, const char* const argv[] )
 {
-	if( argc < 3 || argc > 4 ) {
-		throw exception( "too few arguments!\n"
-			"Usage: pam NUMBER_OF_CLUSTERS VECTORS_FILENAME [NUMBER_OF_THREADS]" );
+	const CCommandLine commandLine( argc, argv );
+	if( commandLine.NumberOfArguments() < 2 || commandLine.NumberOfArguments() > 3 ) {
+		throw exception( ( string( "too few arguments!\n" ) + Usage ).c_str() );
 	}
 
 	double readDataTime = 0.0;
 	double pamTime = 0.0;
 
-	const size_t numberOfClusters = stoul( argv[1] );
+	CPamOptions options;
+	options.NumberOfClusters = stoul( commandLine.Argument( 0 ) );
+	if( commandLine.NumberOfArguments() == 3 ) {
+		options.NumberOfThreads = stoul( commandLine.Argument( 2 ) );
+	}
+	options.StopCriteria.MaxIterations = commandLine.SizeOption( "max-iterations",
+		options.StopCriteria.MaxIterations );
+	options.StopCriteria.MinRelativeImprovement = commandLine.DoubleOption( "min-improvement",
+		options.StopCriteria.MinRelativeImprovement );
+	options.StopCriteria.TimeLimit = commandLine.DoubleOption( "time-limit",
+		options.StopCriteria.TimeLimit );
+	options.CheckpointFilename = commandLine.Option( "checkpoint" );
+	options.CheckpointInterval = commandLine.DoubleOption( "checkpoint-interval",
+		options.CheckpointInterval );
+	options.ResumeFilename = commandLine.Option( "resume" );
+	if( !options.ResumeFilename.empty() && commandLine.HasOption( "medoids" ) ) {
+		throw exception( "options '--resume' and '--medoids' are incompatible!" );
+	}
+	options.EvaluateQuality = commandLine.HasOption( "quality" );
+	if( commandLine.HasOption( "medoids" ) ) {
+		options.InitialMedoids = ReadMedoids( commandLine.Option( "medoids" ) );
+	}
+	options.SaveMedoidsFilename = commandLine.Option( "save-medoids" );
+	options.SaveClusteringFilename = commandLine.Option( "save-clustering" );
+	options.BinaryClustering = commandLine.HasOption( "binary-clustering" );
+	options.MatrixFilename = commandLine.Option( "matrix" );
+	options.SaveMatrixFilename = commandLine.Option( "save-matrix" );
+	options.Metric = commandLine.Option( "metric", CEuclideanMetric::Name() );
+	options.SaveModelFilename = commandLine.Option( "save-model" );
+	options.PartitionSize = commandLine.SizeOption( "partition-size", 0 );
+	const string partitioning = commandLine.Option( "partitioning", "random" );
+	if( partitioning == "spatial" ) {
+		options.Partitioning = CClusteringOptions::SpatialPartitioning;
+	} else if( partitioning != "random" ) {
+		throw exception( ( "unknown partitioning '" + partitioning + "'!" ).c_str() );
+	}
+	options.SortedNeighbors = commandLine.SizeOption( "sorted-neighbors", 0 );
+	options.SwapCache = commandLine.HasOption( "swap-cache" );
+	// swaps of the swap cache do not scan the lists
+	if( options.SortedNeighbors > 0 && options.SwapCache ) {
+		throw exception( "options '--sorted-neighbors' and '--swap-cache' are incompatible!" );
+	}
+	const string hugePages = commandLine.Option( "huge-pages", "none" );
+	if( hugePages == "transparent" ) {
+		CNumaSupport::SetHugePages( CNumaSupport::TransparentHugePages );
+	} else if( hugePages == "explicit" ) {
+		CNumaSupport::SetHugePages( CNumaSupport::ExplicitHugePages );
+	} else if( hugePages != "none" ) {
+		throw exception( ( "unknown huge pages '" + hugePages + "'!" ).c_str() );
+	}
+	CNumaSupport::SetWorkers( CMpiSupport::Rank(), CMpiSupport::NumberOfProccess(),
+		max<size_t>( 1, options.NumberOfThreads ) );
+	CNumaSupport::SetPinThreads( commandLine.HasOption( "pin-threads" ) );
+	if( options.PartitionSize > 0 ) {
+		for( const char* const option :
+			{ "matrix", "save-matrix", "checkpoint", "resume", "medoids", "quality" } )
+		{
+			if( commandLine.HasOption( option ) ) {
+				throw exception( ( string( "options '--partition-size' and '--" ) + option
+					+ "' are incompatible!" ).c_str() );
+			}
+		}
+	}
+#ifdef PAM_FILE_MATRIX
+	DissimilarityMatrixType::SetFilenamePrefix( commandLine.Option( "matrix-files", "pam_matrix" )
+		+ "." + to_string( CMpiSupport::Rank() ) );
+#endif
+#ifdef PAM_LAZY_MATRIX
+	DissimilarityMatrixType::SetCacheSize( commandLine.SizeOption( "row-cache", 256 ) << 20 );
+#endif
+#ifdef PAM_KNN_MATRIX
+	DissimilarityMatrixType::SetNumberOfNeighbors( commandLine.SizeOption( "neighbors", 32 ) );
+	DissimilarityMatrixType::SetCapNonNeighbors( commandLine.HasOption( "cap-non-neighbors" ) );
+	DissimilarityMatrixType::SetNumberOfThreads( options.NumberOfThreads );
+#endif
+	commandLine.CheckUnknownOptions();
+
+	if( options.PartitionSize > 0 ) {
+		vector<DistanceType> coordinates;
+		size_t dimension = 0;
+		{
+			CMpiTimer timer( readDataTime );
+			const string vectorsFilename = commandLine.Argument( 1 );
+			if( CVectorsBinary::IsBinary( vectorsFilename ) ) {
+				const CVectorsBinary vectorsFile( vectorsFilename );
+				coordinates = ReadCoordinates( vectorsFile );
+				dimension = vectorsFile.Dimension();
+			} else {
+				const CMpiVectorsText vectorsFile( vectorsFilename, options.NumberOfThreads );
+				coordinates = ReadCoordinates( vectorsFile );
+				dimension = vectorsFile.Dimension();
+			}
+		}
+		if( coordinates.empty() ) {
+			throw exception( "no vectors to cluster!" );
+		}
+		DoPartitionedPam( options, coordinates, dimension, pamTime );
+		cout << CMpiSupport::Rank() << "\t" << readDataTime << "\t" << pamTime << endl;
+		return;
+	}
+
 	DissimilarityMatrixType matrix;
+	CInputObjects objects;
+	objects.KeepCoordinates = !options.SaveModelFilename.empty();
 	{
 		CMpiTimer timer( readDataTime );
-		matrix = BuildDissimilarityMatrix( ifstream( argv[2] ) );
+		if( !options.MatrixFilename.empty() ) {
+			matrix.Load( ifstream( options.MatrixFilename ) );
+			if( matrix.Size() == 0 ) {
+				throw exception( ( "bad matrix file '" + options.MatrixFilename + "'!" ).c_str() );
+			}
+		}
+		const string vectorsFilename = commandLine.Argument( 1 );
+		if( CVectorsBinary::IsBinary( vectorsFilename ) ) {
+			matrix = BuildDissimilarityMatrix( CVectorsBinary( vectorsFilename ), options.Metric,
+				options.NumberOfThreads, objects, move( matrix ) );
+		} else {
+			const CMpiVectorsText vectorsFile( vectorsFilename, options.NumberOfThreads );
+			matrix = BuildDissimilarityMatrix( vectorsFile, options.Metric,
+				options.NumberOfThreads, objects, move( matrix ) );
+		}
 	}
-	const size_t numberOfThreads = ( argc == 4 ) ? stoul( argv[3] ) : 1;
 
+#ifdef PAM_FILE_MATRIX
 	{
-		CMpiTimer timer( pamTime );
-		DoPam( numberOfClusters, matrix, numberOfThreads );
+		// rows of objects which threads of this process step in DoPam
+		const size_t numberOfThreads = max<size_t>( 1, options.NumberOfThreads );
+		const size_t numberOfWorkers = CMpiSupport::NumberOfProccess() * numberOfThreads;
+		const size_t firstWorker = CMpiSupport::Rank() * numberOfThreads;
+		size_t beginRow = 0;
+		size_t endRow = 0;
+		size_t unused = 0;
+		CalcBeginEndObjects( matrix.Size(), numberOfWorkers, firstWorker, beginRow, unused );
+		CalcBeginEndObjects( matrix.Size(), numberOfWorkers, firstWorker + numberOfThreads - 1,
+			unused, endRow );
+		matrix.SetSweptRows( beginRow, endRow );
+	}
+#endif
+
+	if( CMpiSupport::Rank() == 0 && !options.SaveMatrixFilename.empty() ) {
+		matrix.Save( ofstream( options.SaveMatrixFilename ) );
 	}
 
+	DoPam( options, matrix, objects, pamTime );
+
 	cout << CMpiSupport::Rank() << "\t" << readDataTime << "\t" << pamTime << endl;
+#ifdef PAM_FILE_MATRIX
+	// rank, MiB read, achieved MiB/s, number of stalls and their total time
+	const CMatrixReadStatistics statistics = matrix.ReadStatistics();
+	const double mebibyte = 1 << 20;
+	cout << CMpiSupport::Rank() << "\tmatrix read\t" << statistics.BytesRead / mebibyte
+		<< "\t" << statistics.Bandwidth() / mebibyte << "\t" << statistics.Stalls
+		<< "\t" << statistics.StallTime << endl;
+#endif
+#ifdef PAM_LAZY_MATRIX
+	// rank, row cache hits, misses and evictions
+	const CRowCacheStatistics statistics = matrix.CacheStatistics();
+	cout << CMpiSupport::Rank() << "\trow cache\t" << statistics.Hits << "\t"
+		<< statistics.Misses << "\t" << statistics.Evictions << endl;
+#endif
+#ifdef PAM_KNN_MATRIX
+	// rank and kept distances
+	cout << CMpiSupport::Rank() << "\tknn graph\t" << matrix.NumberOfEdges() << endl;
+#endif
 }
 
 int main( int argc, char** argv )
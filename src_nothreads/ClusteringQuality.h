@@ -0,0 +1,166 @@
+#pragma once
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Sums of clustering quality measures for each cluster over some objects.
+struct CClusteringQualitySums {
+	vector<double> Sizes;
+	vector<double> Deviations;
+	vector<double> Silhouettes;
+	vector<double> SimplifiedSilhouettes;
+
+	explicit CClusteringQualitySums( size_t numberOfClusters = 0 ) :
+		Sizes( numberOfClusters, 0 ),
+		Deviations( numberOfClusters, 0 ),
+		Silhouettes( numberOfClusters, 0 ),
+		SimplifiedSilhouettes( numberOfClusters, 0 )
+	{
+	}
+
+	size_t NumberOfClusters() const { return Sizes.size(); }
+
+	void Add( const CClusteringQualitySums& sums )
+	{
+		assert( sums.NumberOfClusters() == NumberOfClusters() );
+		for( size_t cluster = 0; cluster < NumberOfClusters(); cluster++ ) {
+			Sizes[cluster] += sums.Sizes[cluster];
+			Deviations[cluster] += sums.Deviations[cluster];
+			Silhouettes[cluster] += sums.Silhouettes[cluster];
+			SimplifiedSilhouettes[cluster] += sums.SimplifiedSilhouettes[cluster];
+		}
+	}
+
+	double Deviation() const { return sum( Deviations ); }
+	double Silhouette() const { return sum( Silhouettes ) / sum( Sizes ); }
+	double SimplifiedSilhouette() const { return sum( SimplifiedSilhouettes ) / sum( Sizes ); }
+
+private:
+	static double sum( const vector<double>& values )
+	{
+		double result = 0;
+		for( size_t i = 0; i < values.size(); i++ ) {
+			result += values[i];
+		}
+		return result;
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Evaluates total deviation, silhouette and simplified (medoid-based)
+// silhouette of the clustering, given by medoids and objectMedoids.
+// Object of weight w is counted as w identical objects.
+// Evaluation of disjoint ranges of objects may be done independently.
+template<typename DISSIMILARITY_MATRIX_TYPE>
+class CClusteringQuality {
+private:
+	CClusteringQuality( const CClusteringQuality& );
+	CClusteringQuality& operator=( const CClusteringQuality& );
+
+public:
+	typedef DISSIMILARITY_MATRIX_TYPE DissimilarityMatrixType;
+	typedef typename DissimilarityMatrixType::DistanceType DistanceType;
+
+	CClusteringQuality( const DissimilarityMatrixType& dissimilarityMatrix,
+			const vector<size_t>& _medoids, const vector<size_t>& _objectMedoids,
+			const vector<DistanceType>& _weights ) :
+		matrix( dissimilarityMatrix ),
+		medoids( _medoids ),
+		objectMedoids( _objectMedoids ),
+		weights( _weights ),
+		objectClusters( matrix.Size(), 0 ),
+		clusterSizes( medoids.size(), 0 ),
+		silhouettes( matrix.Size(), 0 )
+	{
+		assert( objectMedoids.size() == NumberOfObjects() );
+		assert( weights.size() == NumberOfObjects() );
+
+		vector<size_t> medoidClusters( NumberOfObjects(), NumberOfClusters() );
+		for( size_t cluster = 0; cluster < NumberOfClusters(); cluster++ ) {
+			medoidClusters[medoids[cluster]] = cluster;
+		}
+		for( size_t object = 0; object < NumberOfObjects(); object++ ) {
+			objectClusters[object] = medoidClusters[objectMedoids[object]];
+			assert( objectClusters[object] < NumberOfClusters() );
+			clusterSizes[objectClusters[object]] += weights[object];
+		}
+	}
+
+	size_t NumberOfObjects() const { return matrix.Size(); }
+	size_t NumberOfClusters() const { return medoids.size(); }
+	// Index of object cluster in medoids.
+	size_t ObjectCluster( size_t object ) const { return objectClusters[object]; }
+	// Silhouettes of objects, filled by Evaluate.
+	const vector<DistanceType>& Silhouettes() const { return silhouettes; }
+	vector<DistanceType>& Silhouettes() { return silhouettes; }
+
+	// Evaluates objects [objectBegin, objectEnd) and adds results to sums.
+	void Evaluate( size_t objectBegin, size_t objectEnd, CClusteringQualitySums& sums );
+
+private:
+	const DissimilarityMatrixType& matrix;
+	const vector<size_t>& medoids;
+	const vector<size_t>& objectMedoids;
+	const vector<DistanceType>& weights;
+	vector<size_t> objectClusters;
+	vector<double> clusterSizes;
+	vector<DistanceType> silhouettes;
+
+	static double silhouette( double a, double b )
+	{
+		const double maxAB = max( a, b );
+		return ( maxAB > 0 ) ? ( ( b - a ) / maxAB ) : 0;
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+template<typename DMT>
+void CClusteringQuality<DMT>::Evaluate( size_t objectBegin, size_t objectEnd,
+	CClusteringQualitySums& sums )
+{
+	assert( objectBegin <= objectEnd && objectEnd <= NumberOfObjects() );
+	assert( sums.NumberOfClusters() == NumberOfClusters() );
+
+	vector<double> clusterDistances( NumberOfClusters() );
+	for( size_t object = objectBegin; object < objectEnd; object++ ) {
+		const size_t cluster = objectClusters[object];
+		const double weight = weights[object];
+
+		// simplified silhouette
+		const double a = matrix.Distance( object, medoids[cluster] );
+		double b = numeric_limits<double>::max();
+		for( size_t another = 0; another < NumberOfClusters(); another++ ) {
+			if( another != cluster ) {
+				b = min( b, static_cast<double>( matrix.Distance( object, medoids[another] ) ) );
+			}
+		}
+		sums.Sizes[cluster] += weight;
+		sums.Deviations[cluster] += weight * a;
+		sums.SimplifiedSilhouettes[cluster] += weight * silhouette( a, b );
+
+		// silhouette
+		fill( clusterDistances.begin(), clusterDistances.end(), 0 );
+		for( size_t anotherObject = 0; anotherObject < NumberOfObjects(); anotherObject++ ) {
+			clusterDistances[objectClusters[anotherObject]] +=
+				weights[anotherObject] * matrix.Distance( object, anotherObject );
+		}
+
+		// weight - 1 identical objects are at zero distance in the same cluster
+		DistanceType objectSilhouette = 0;
+		if( clusterSizes[cluster] > 1 ) {
+			const double meanA = clusterDistances[cluster] / ( clusterSizes[cluster] - 1 );
+			double meanB = numeric_limits<double>::max();
+			for( size_t another = 0; another < NumberOfClusters(); another++ ) {
+				if( another != cluster && clusterSizes[another] > 0 ) {
+					meanB = min( meanB, clusterDistances[another] / clusterSizes[another] );
+				}
+			}
+			objectSilhouette = static_cast<DistanceType>( silhouette( meanA, meanB ) );
+		}
+		silhouettes[object] = objectSilhouette;
+		sums.Silhouettes[cluster] += weight * objectSilhouette;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
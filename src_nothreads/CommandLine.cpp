@@ -0,0 +1,91 @@
+#include <map>
+#include <set>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <exception>
+#include <stdexcept>
+
+using namespace std;
+
+#include <CommandLine.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+CCommandLine::CCommandLine( const int argc, const char* const argv[] )
+{
+	for( int i = 1; i < argc; i++ ) {
+		const string argument = argv[i];
+		if( argument.compare( 0, 2, "--" ) == 0 && argument.length() > 2 ) {
+			const size_t equalSign = argument.find( '=' );
+			const string name = argument.substr( 2, equalSign - 2 );
+			const string value = ( equalSign == string::npos ) ?
+				"" : argument.substr( equalSign + 1 );
+			options[name] = value;
+		} else {
+			arguments.push_back( argument );
+		}
+	}
+}
+
+const string& CCommandLine::Argument( size_t index ) const
+{
+	if( index >= arguments.size() ) {
+		throw domain_error( "too few arguments!" );
+	}
+	return arguments[index];
+}
+
+bool CCommandLine::HasOption( const string& name ) const
+{
+	requestedOptions.insert( name );
+	return ( options.find( name ) != options.end() );
+}
+
+string CCommandLine::Option( const string& name, const string& defaultValue ) const
+{
+	requestedOptions.insert( name );
+	map<string, string>::const_iterator option = options.find( name );
+	return ( option == options.end() ) ? defaultValue : option->second;
+}
+
+size_t CCommandLine::SizeOption( const string& name, size_t defaultValue ) const
+{
+	const string value = Option( name );
+	if( value.empty() ) {
+		return defaultValue;
+	}
+	char* end = 0;
+	const unsigned long result = strtoul( value.c_str(), &end, 10 );
+	if( *end != '\0' ) {
+		throw domain_error( "option '--" + name + "' must be a number!" );
+	}
+	return static_cast<size_t>( result );
+}
+
+double CCommandLine::DoubleOption( const string& name, double defaultValue ) const
+{
+	const string value = Option( name );
+	if( value.empty() ) {
+		return defaultValue;
+	}
+	char* end = 0;
+	const double result = strtod( value.c_str(), &end );
+	if( *end != '\0' ) {
+		throw domain_error( "option '--" + name + "' must be a number!" );
+	}
+	return result;
+}
+
+void CCommandLine::CheckUnknownOptions() const
+{
+	for( map<string, string>::const_iterator option = options.begin();
+		option != options.end(); ++option )
+	{
+		if( requestedOptions.find( option->first ) == requestedOptions.end() ) {
+			throw domain_error( "unknown option '--" + option->first + "'!" );
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
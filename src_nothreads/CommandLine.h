@@ -0,0 +1,30 @@
+#pragma once
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Command line in form: PROGRAM [--NAME[=VALUE]]... [ARGUMENT]...
+class CCommandLine {
+private:
+	CCommandLine( const CCommandLine& );
+	CCommandLine& operator=( const CCommandLine& );
+
+public:
+	CCommandLine( const int argc, const char* const argv[] );
+
+	size_t NumberOfArguments() const { return arguments.size(); }
+	const string& Argument( size_t index ) const;
+
+	bool HasOption( const string& name ) const;
+	string Option( const string& name, const string& defaultValue = "" ) const;
+	size_t SizeOption( const string& name, size_t defaultValue ) const;
+	double DoubleOption( const string& name, double defaultValue ) const;
+	// Throws if there are options which were never requested.
+	void CheckUnknownOptions() const;
+
+private:
+	vector<string> arguments;
+	map<string, string> options;
+	mutable set<string> requestedOptions;
+};
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,57 @@
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+using namespace std;
+
+#include <VectorsText.h>
+#include <VectorsBinary.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+const char* const Usage =
+	"Usage: pam_convert VECTORS_FILENAME BINARY_VECTORS_FILENAME\n"
+	"Converts vectors text file to binary vectors file, which pam reads\n"
+	"without parsing. Coordinates are stored as floats.";
+
+void DoMain( const int argc, const char* const argv[] )
+{
+	if( argc != 3 ) {
+		throw invalid_argument( Usage );
+	}
+
+	const CVectorsText text( argv[1] );
+	vector<CVectorsChunk> chunks;
+	text.Split( 1, chunks );
+	vector<float> coordinates( text.NumberOfVectors() * text.Dimension() );
+	for( size_t chunk = 0; chunk < chunks.size(); chunk++ ) {
+		const char* position = chunks[chunk].Begin;
+		const size_t end = chunks[chunk].FirstVector + chunks[chunk].NumberOfVectors;
+		for( size_t i = chunks[chunk].FirstVector; i < end; i++ ) {
+			text.ParseVector( position, chunks[chunk].End, &coordinates[i * text.Dimension()] );
+		}
+	}
+
+	ofstream output( argv[2], ios::binary );
+	CVectorsBinary::Write( output, text.NumberOfVectors(), text.Dimension(),
+		coordinates.empty() ? 0 : &coordinates[0] );
+	if( !output.good() ) {
+		throw runtime_error( "cannot write file '" + string( argv[2] ) + "'!" );
+	}
+}
+
+int main( int argc, char** argv )
+{
+	try {
+		DoMain( argc, argv );
+	} catch( exception& e ) {
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -4,14 +4,18 @@
 
 template<typename DISTANCE_TYPE>
 class CDissimilarityMatrix {
-	template<typename OBJECT_TYPE> friend class CDissimilarityMatrixBuilder;
-
 private:
 	CDissimilarityMatrix( const CDissimilarityMatrix& matrix );
 	CDissimilarityMatrix& operator=( const CDissimilarityMatrix& matrix );
 
 public:
 	typedef DISTANCE_TYPE DistanceType;
+	// Distance( i, j ) equals Distance( j, i ).
+	static const bool IsSymmetric = true;
+	// Distances of any rows are read by turns as fast as of one row.
+	static const bool IsRandomAccess = true;
+	// Rows are set by blocks of RowsBlockSize rows.
+	static const size_t RowsBlockSize = 1;
 
 	CDissimilarityMatrix() :
 		size( 0 )
@@ -26,6 +30,27 @@ public:
 		return distances[i * size + j];
 	}
 
+	// Maximal error of distances in row, distances are exact.
+	DistanceType MaxError( size_t /* row */ ) const { return 0; }
+
+	void Reset( size_t newSize )
+	{
+		size = newSize;
+		distances.assign( size * size, 0 );
+	}
+
+	void SetRows( size_t firstRow, size_t numberOfRows, const DistanceType* rowsDistances )
+	{
+		assert( firstRow + numberOfRows <= size );
+		copy( rowsDistances, rowsDistances + numberOfRows * size, distances.begin() + firstRow * size );
+	}
+
+	void Swap( CDissimilarityMatrix& matrix )
+	{
+		swap( size, matrix.size );
+		distances.swap( matrix.distances );
+	}
+
 	void Load( istream& input )
 	{
 		bool good = false;
@@ -48,8 +73,12 @@ public:
 
 	void Save( ostream& output ) const
 	{
+		output.precision( numeric_limits<DistanceType>::digits10 + 3 );
 		output << size << endl;
-		typename vector<DistanceType>::const_iterator distance = distances.begin();
+		if( size == 0 ) {
+			return;
+		}
+		typename DistancesVector::const_iterator distance = distances.begin();
 		output << *distance;
 		for( ++distance; distance != distances.end(); ++distance ) {
 			output << " " << *distance;
@@ -58,13 +87,76 @@ public:
 	}
 
 protected:
+	typedef vector<DistanceType, CPageAllocator<DistanceType> > DistancesVector;
+
+	size_t size;
+	DistancesVector distances;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Dissimilarity matrix given by consecutive rows of caller's distances,
+// which are used in place and must outlive the view.
+template<typename DISTANCE_TYPE>
+class CDissimilarityMatrixView {
+public:
+	typedef DISTANCE_TYPE DistanceType;
+	// Distance( i, j ) may differ from Distance( j, i ).
+	static const bool IsSymmetric = false;
+	// Distances of any rows are read by turns as fast as of one row.
+	static const bool IsRandomAccess = true;
+
+	CDissimilarityMatrixView( const DistanceType* _distances, size_t _size ) :
+		distances( _distances ),
+		size( _size )
+	{
+	}
+
+	size_t Size() const { return size; }
+
+	DistanceType Distance( size_t i, size_t j ) const
+	{
+		assert( i < size && j < size );
+		return distances[i * size + j];
+	}
+
+	// Maximal error of distances in row, distances are exact.
+	DistanceType MaxError( size_t /* row */ ) const { return 0; }
+
+private:
+	const DistanceType* distances;
 	size_t size;
-	vector<DistanceType> distances;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 
-template<typename OBJECT_TYPE>
+// Sets rows [firstRow, firstRow + numberOfRows) of newMatrix, which extends
+// matrix of its first matrix.Size() objects. Rows of old objects are given
+// only with distances to new objects, distances to old objects are taken
+// from matrix. Matrices which keep distances approximately overload it, so
+// the old distances are not encoded again.
+template<typename DISSIMILARITY_MATRIX_TYPE>
+void SetExtendedRows( DISSIMILARITY_MATRIX_TYPE& newMatrix, const DISSIMILARITY_MATRIX_TYPE& matrix,
+	size_t firstRow, size_t numberOfRows,
+	typename DISSIMILARITY_MATRIX_TYPE::DistanceType* rowsDistances )
+{
+	const size_t oldSize = matrix.Size();
+	const size_t newSize = newMatrix.Size();
+	const size_t endOldRow = min( firstRow + numberOfRows, oldSize );
+	for( size_t object = firstRow; object < endOldRow; object++ ) {
+		typename DISSIMILARITY_MATRIX_TYPE::DistanceType* const row =
+			rowsDistances + ( object - firstRow ) * newSize;
+		for( size_t j = 0; j < oldSize; j++ ) {
+			row[j] = matrix.Distance( object, j );
+		}
+	}
+	newMatrix.SetRows( firstRow, numberOfRows, rowsDistances );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+template<typename OBJECT_TYPE, typename DISSIMILARITY_MATRIX_TYPE =
+	CDissimilarityMatrix<typename OBJECT_TYPE::DistanceType> >
 class CDissimilarityMatrixBuilder : public vector<OBJECT_TYPE> {
 private:
 	CDissimilarityMatrixBuilder( const CDissimilarityMatrixBuilder& );
@@ -72,8 +164,8 @@ private:
 
 public:
 	typedef OBJECT_TYPE ObjectType;
-	typedef typename OBJECT_TYPE::DistanceType DistanceType;
-	typedef CDissimilarityMatrix<DistanceType> DissimilarityMatrixType;
+	typedef DISSIMILARITY_MATRIX_TYPE DissimilarityMatrixType;
+	typedef typename DissimilarityMatrixType::DistanceType DistanceType;
 
 	CDissimilarityMatrixBuilder( size_t numberOfObjects )
 	{
@@ -82,32 +174,115 @@ public:
 
 	void Build( DissimilarityMatrixType& matrix )
 	{
-		matrix.size = vector<ObjectType>::size();
-		matrix.distances.clear();
-		matrix.distances.reserve( matrix.size * matrix.size );
-		for( size_t i = 0; i < matrix.size; i++ ) {
-			for( size_t j = 0; j < matrix.size; j++ ) {
-				if( i == j ) {
-					matrix.distances.push_back( 0 );
+		vector<DistanceType> distancesToAll;
+		Build( matrix, vector<DistanceType>( vector<ObjectType>::size(), 1 ), distancesToAll );
+	}
+
+	// Builds matrix and sums of weighted distances from each object to all
+	// objects, which are summed while rows are calculated, so the first
+	// building step of PAM does not sweep the matrix again. Sums are empty
+	// if the matrix does not keep distances exactly.
+	void Build( DissimilarityMatrixType& matrix, const vector<DistanceType>& weights,
+		vector<DistanceType>& distancesToAll )
+	{
+		const size_t numberOfObjects = vector<ObjectType>::size();
+		if( weights.size() != numberOfObjects ) {
+			throw invalid_argument( "CDissimilarityMatrixBuilder: wrong number of weights" );
+		}
+		matrix.Reset( numberOfObjects );
+		distancesToAll.resize( numberOfObjects );
+		bool isExact = true;
+		vector<DistanceType> rows;
+		for( size_t firstRow = 0; firstRow < numberOfObjects; firstRow += RowsBlockSize ) {
+			const size_t numberOfRows = min( firstRow + RowsBlockSize, numberOfObjects ) - firstRow;
+			rows.resize( numberOfRows * numberOfObjects );
+			for( size_t i = 0; i < numberOfRows; i++ ) {
+				DistanceType* const row = &rows[i * numberOfObjects];
+				calculateDistances( firstRow + i, 0, numberOfObjects, row );
+				// the same order of sums as PAM sweeps the row
+				DistanceType distance = 0;
+				for( size_t j = 0; j < numberOfObjects; j++ ) {
+					distance += weights[j] * row[j];
+				}
+				distancesToAll[firstRow + i] = distance;
+			}
+			matrix.SetRows( firstRow, numberOfRows, &rows[0] );
+			for( size_t i = 0; i < numberOfRows; i++ ) {
+				isExact = isExact && ( matrix.MaxError( firstRow + i ) == 0 );
+			}
+		}
+		if( !isExact ) {
+			vector<DistanceType>().swap( distancesToAll );
+		}
+	}
+
+	// Extends matrix of the first matrix.Size() objects to all objects,
+	// only distances to the rest objects are calculated.
+	void Extend( DissimilarityMatrixType& matrix )
+	{
+		const size_t oldSize = matrix.Size();
+		const size_t newSize = vector<ObjectType>::size();
+		if( oldSize > newSize ) {
+			throw invalid_argument( "CDissimilarityMatrixBuilder: too few objects to extend matrix" );
+		}
+
+		DissimilarityMatrixType newMatrix;
+		newMatrix.Reset( newSize );
+		vector<DistanceType> rows;
+		for( size_t firstRow = 0; firstRow < newSize; firstRow += RowsBlockSize ) {
+			const size_t numberOfRows = min( firstRow + RowsBlockSize, newSize ) - firstRow;
+			rows.resize( numberOfRows * newSize );
+			for( size_t i = 0; i < numberOfRows; i++ ) {
+				const size_t object = firstRow + i;
+				DistanceType* row = &rows[i * newSize];
+				if( object < oldSize ) {
+					calculateDistances( object, oldSize, newSize, row + oldSize );
 				} else {
-					matrix.distances.push_back(
-						vector<OBJECT_TYPE>::operator[]( i ).Distance(
-							vector<OBJECT_TYPE>::operator[]( j ) ) );
+					calculateDistances( object, 0, newSize, row );
 				}
 			}
+			SetExtendedRows( newMatrix, matrix, firstRow, numberOfRows, &rows[0] );
 		}
+		matrix.Swap( newMatrix );
 	}
 
 	template<typename FORWARD_ITERATOR_TYPE>
 	static void Build( DissimilarityMatrixType& matrix, FORWARD_ITERATOR_TYPE begin, FORWARD_ITERATOR_TYPE end )
 	{
-		CDissimilarityMatrixBuilder<OBJECT_TYPE> builder( end - begin );
+		CDissimilarityMatrixBuilder builder( end - begin );
 		while( begin != end ) {
 			builder.push_back( *begin );
 			++begin;
 		}
 		builder.Build( matrix );
 	}
+
+	template<typename FORWARD_ITERATOR_TYPE>
+	static void Extend( DissimilarityMatrixType& matrix, FORWARD_ITERATOR_TYPE begin, FORWARD_ITERATOR_TYPE end )
+	{
+		CDissimilarityMatrixBuilder builder( end - begin );
+		while( begin != end ) {
+			builder.push_back( *begin );
+			++begin;
+		}
+		builder.Extend( matrix );
+	}
+
+private:
+	static const size_t RowsBlockSize = DissimilarityMatrixType::RowsBlockSize;
+
+	// Calculates distances from object to objects [begin, end).
+	void calculateDistances( size_t object, size_t begin, size_t end,
+		DistanceType* distances ) const
+	{
+		if( begin < end ) {
+			const vector<OBJECT_TYPE>& objects = *this;
+			ObjectType::Distances( objects[object], &objects[begin], end - begin, distances );
+			if( begin <= object && object < end ) {
+				distances[object - begin] = 0;
+			}
+		}
+	}
 };
 
 ///////////////////////////////////////////////////////////////////////////////
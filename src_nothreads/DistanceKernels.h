@@ -0,0 +1,193 @@
+#pragma once
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define PAM_SSE2_KERNELS
+#include <emmintrin.h>
+#endif
+
+#if defined( __AVX__ )
+#define PAM_AVX_KERNELS
+#include <immintrin.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Distance of METRIC, which reduces coordinate differences of two points
+// by Accumulate and Combine starting from zero and applies Finish to the
+// result. For float METRIC also provides them for SIMD registers.
+template<typename METRIC, typename NUMERIC_TYPE>
+struct CDistanceKernel {
+	typedef NUMERIC_TYPE NumericType;
+
+	static NumericType Distance( const NumericType* first, const NumericType* second,
+		const size_t dimension )
+	{
+		NumericType result = 0;
+		for( size_t i = 0; i < dimension; i++ ) {
+			result = METRIC::Accumulate( result, first[i] - second[i] );
+		}
+		return METRIC::Finish( result );
+	}
+
+	// Distances from point to count consecutive points.
+	static void Distances( const NumericType* point, const NumericType* points,
+		const size_t count, const size_t dimension, NumericType* distances )
+	{
+		for( size_t i = 0; i < count; i++ ) {
+			distances[i] = Distance( point, points + i * dimension, dimension );
+		}
+	}
+};
+
+#ifdef PAM_SSE2_KERNELS
+
+// Points of low dimension are vectorized four points at a time, points of
+// high dimension are vectorized along coordinates. Both ways accumulate
+// in the same order for the same dimension, so the distance is symmetric.
+template<typename METRIC>
+struct CDistanceKernel<METRIC, float> {
+	typedef float NumericType;
+
+	static const size_t MinVectorizedDimension = 8;
+
+	static float Distance( const float* first, const float* second, const size_t dimension )
+	{
+		if( dimension < MinVectorizedDimension ) {
+			float result = 0;
+			for( size_t i = 0; i < dimension; i++ ) {
+				result = METRIC::Accumulate( result, first[i] - second[i] );
+			}
+			return METRIC::Finish( result );
+		}
+
+		size_t i = 0;
+		const size_t blocksEnd = dimension - dimension % 4;
+		__m128 sum = _mm_setzero_ps();
+#ifdef PAM_AVX_KERNELS
+		__m256 sum8 = _mm256_setzero_ps();
+		for( ; i + 8 <= blocksEnd; i += 8 ) {
+			sum8 = METRIC::Accumulate( sum8,
+				_mm256_sub_ps( _mm256_loadu_ps( first + i ), _mm256_loadu_ps( second + i ) ) );
+		}
+		sum = METRIC::Combine( _mm256_castps256_ps128( sum8 ), _mm256_extractf128_ps( sum8, 1 ) );
+#endif
+		for( ; i < blocksEnd; i += 4 ) {
+			sum = METRIC::Accumulate( sum,
+				_mm_sub_ps( _mm_loadu_ps( first + i ), _mm_loadu_ps( second + i ) ) );
+		}
+		// reduction of four lanes
+		sum = METRIC::Combine( sum, _mm_movehl_ps( sum, sum ) );
+		sum = METRIC::Combine( sum, _mm_shuffle_ps( sum, sum, 1 ) );
+		float result = _mm_cvtss_f32( sum );
+
+		for( ; i < dimension; i++ ) {
+			result = METRIC::Accumulate( result, first[i] - second[i] );
+		}
+		return METRIC::Finish( result );
+	}
+
+	static void Distances( const float* point, const float* points,
+		const size_t count, const size_t dimension, float* distances )
+	{
+		size_t i = 0;
+		if( dimension < MinVectorizedDimension ) {
+			for( ; i + 4 <= count; i += 4 ) {
+				const float* block = points + i * dimension;
+				__m128 sum = _mm_setzero_ps();
+				for( size_t d = 0; d < dimension; d++ ) {
+					const __m128 coordinates = _mm_set_ps( block[3 * dimension + d],
+						block[2 * dimension + d], block[dimension + d], block[d] );
+					sum = METRIC::Accumulate( sum, _mm_sub_ps( _mm_set1_ps( point[d] ), coordinates ) );
+				}
+				_mm_storeu_ps( distances + i, METRIC::Finish( sum ) );
+			}
+		}
+		for( ; i < count; i++ ) {
+			distances[i] = Distance( point, points + i * dimension, dimension );
+		}
+	}
+};
+
+#endif // PAM_SSE2_KERNELS
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Metric, which distance is calculated by CDistanceKernel.
+template<typename METRIC>
+struct CDifferencesMetric {
+	template<typename NUMERIC_TYPE>
+	static NUMERIC_TYPE Distance( const NUMERIC_TYPE* first, const NUMERIC_TYPE* second,
+		const size_t dimension )
+	{
+		return CDistanceKernel<METRIC, NUMERIC_TYPE>::Distance( first, second, dimension );
+	}
+
+	template<typename NUMERIC_TYPE>
+	static void Distances( const NUMERIC_TYPE* point, const NUMERIC_TYPE* points,
+		const size_t count, const size_t dimension, NUMERIC_TYPE* distances )
+	{
+		CDistanceKernel<METRIC, NUMERIC_TYPE>::Distances( point, points, count, dimension, distances );
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Adds coordinates from i on to the sums of products and finishes cosine distance.
+template<typename NUMERIC_TYPE>
+inline NUMERIC_TYPE AccumulateCosineDistance( const NUMERIC_TYPE* first, const NUMERIC_TYPE* second,
+	const size_t dimension, NUMERIC_TYPE product, NUMERIC_TYPE firstNorm, NUMERIC_TYPE secondNorm,
+	size_t i )
+{
+	for( ; i < dimension; i++ ) {
+		product += first[i] * second[i];
+		firstNorm += first[i] * first[i];
+		secondNorm += second[i] * second[i];
+	}
+	const NUMERIC_TYPE norms = firstNorm * secondNorm;
+	if( norms <= 0 ) {
+		return ( firstNorm == secondNorm ) ? 0 : 1;
+	}
+	return max( NUMERIC_TYPE( 0 ), NUMERIC_TYPE( 1 - product / sqrt( norms ) ) );
+}
+
+// One minus cosine of the angle between vectors, zero vector is
+// at distance one from all the rest vectors.
+template<typename NUMERIC_TYPE>
+inline NUMERIC_TYPE CosineDistance( const NUMERIC_TYPE* first, const NUMERIC_TYPE* second,
+	const size_t dimension )
+{
+	return AccumulateCosineDistance<NUMERIC_TYPE>( first, second, dimension, 0, 0, 0, 0 );
+}
+
+#ifdef PAM_SSE2_KERNELS
+
+template<>
+inline float CosineDistance<float>( const float* first, const float* second,
+	const size_t dimension )
+{
+	const size_t blocksEnd = dimension - dimension % 4;
+	__m128 product = _mm_setzero_ps();
+	__m128 firstNorm = _mm_setzero_ps();
+	__m128 secondNorm = _mm_setzero_ps();
+	for( size_t i = 0; i < blocksEnd; i += 4 ) {
+		const __m128 firstCoordinates = _mm_loadu_ps( first + i );
+		const __m128 secondCoordinates = _mm_loadu_ps( second + i );
+		product = _mm_add_ps( product, _mm_mul_ps( firstCoordinates, secondCoordinates ) );
+		firstNorm = _mm_add_ps( firstNorm, _mm_mul_ps( firstCoordinates, firstCoordinates ) );
+		secondNorm = _mm_add_ps( secondNorm, _mm_mul_ps( secondCoordinates, secondCoordinates ) );
+	}
+	// sums of four lanes, vector products are symmetric
+	float sums[3][4];
+	_mm_storeu_ps( sums[0], product );
+	_mm_storeu_ps( sums[1], firstNorm );
+	_mm_storeu_ps( sums[2], secondNorm );
+	return AccumulateCosineDistance<float>( first, second, dimension,
+		( sums[0][0] + sums[0][1] ) + ( sums[0][2] + sums[0][3] ),
+		( sums[1][0] + sums[1][1] ) + ( sums[1][2] + sums[1][3] ),
+		( sums[2][0] + sums[2][1] ) + ( sums[2][2] + sums[2][3] ),
+		blocksEnd );
+}
+
+#endif // PAM_SSE2_KERNELS
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,352 @@
+#pragma once
+
+#include <aio.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Statistics of reading of a matrix from file.
+struct CMatrixReadStatistics {
+	double BytesRead;
+	// Number of tiles, which were not read in advance, and time waiting for them.
+	size_t Stalls;
+	double StallTime;
+	// Time from the first read to the last access to a new tile.
+	double ReadingTime;
+
+	CMatrixReadStatistics() :
+		BytesRead( 0 ),
+		Stalls( 0 ),
+		StallTime( 0 ),
+		ReadingTime( 0 )
+	{
+	}
+
+	// Achieved bandwidth in bytes per second.
+	double Bandwidth() const { return ( ReadingTime > 0 ) ? ( BytesRead / ReadingTime ) : 0; }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Symmetric dissimilarity matrix stored in a file, for matrices which do
+// not fit in memory. Rows are read by tiles of TileBytes bytes, the next tile
+// of the swept rows is read asynchronously while the current one is used, so
+// sequential sweeps over rows overlap reading with computation. The file is
+// removed with the matrix.
+template<typename DISTANCE_TYPE>
+class CFileDissimilarityMatrix {
+private:
+	CFileDissimilarityMatrix( const CFileDissimilarityMatrix& matrix );
+	CFileDissimilarityMatrix& operator=( const CFileDissimilarityMatrix& matrix );
+
+public:
+	typedef DISTANCE_TYPE DistanceType;
+	// Distance( i, j ) equals Distance( j, i ).
+	static const bool IsSymmetric = true;
+	// Rows are read by tiles, so they are read one by one.
+	static const bool IsRandomAccess = false;
+	// Rows are set by blocks of RowsBlockSize rows.
+	static const size_t RowsBlockSize = 1;
+	static const size_t TileBytes = 4 << 20;
+
+	// Files of matrices are named FILENAME_PREFIX.N.
+	static void SetFilenamePrefix( const string& prefix ) { filenamePrefix() = prefix; }
+
+	CFileDissimilarityMatrix() :
+		size( 0 ),
+		file( -1 ),
+		tileRows( 1 ),
+		sweptRowsBegin( 0 ),
+		sweptRowsEnd( 0 ),
+		tileFirstRow( 0 ),
+		tileEndRow( 0 ),
+		nextTileIndex( 0 ),
+		prefetching( false ),
+		firstReadTime( 0 )
+	{
+	}
+
+	~CFileDissimilarityMatrix() { close(); }
+
+	size_t Size() const { return size; }
+
+	DistanceType Distance( size_t i, size_t j ) const
+	{
+		assert( i < size && j < size );
+		if( i < tileFirstRow || i >= tileEndRow ) {
+			loadTile( i / tileRows );
+		}
+		return tile[( i - tileFirstRow ) * size + j];
+	}
+
+	// Maximal error of distances in row, distances are exact.
+	DistanceType MaxError( size_t /* row */ ) const { return 0; }
+
+	// Rows [beginRow, endRow) are swept by this process, all rows after
+	// Reset, other tiles are not read in advance.
+	void SetSweptRows( size_t beginRow, size_t endRow )
+	{
+		assert( beginRow <= endRow && endRow <= size );
+		sweptRowsBegin = beginRow;
+		sweptRowsEnd = endRow;
+	}
+
+	const CMatrixReadStatistics& ReadStatistics() const { return statistics; }
+
+	void Reset( size_t newSize );
+	void SetRows( size_t firstRow, size_t numberOfRows, const DistanceType* rowsDistances );
+	void Swap( CFileDissimilarityMatrix& matrix );
+
+	void Load( istream& input );
+	void Save( ostream& output ) const;
+
+private:
+	size_t size;
+	string filename;
+	int file;
+	size_t tileRows;
+	size_t sweptRowsBegin;
+	size_t sweptRowsEnd;
+	mutable size_t tileFirstRow;
+	mutable size_t tileEndRow;
+	mutable vector<DistanceType> tile;
+	// the tile being read asynchronously
+	mutable vector<DistanceType> nextTile;
+	mutable size_t nextTileIndex;
+	mutable bool prefetching;
+	mutable aiocb request;
+	mutable CMatrixReadStatistics statistics;
+	mutable double firstReadTime;
+
+	static string& filenamePrefix()
+	{
+		static string prefix( "pam_matrix" );
+		return prefix;
+	}
+
+	size_t numberOfTiles() const { return ( size + tileRows - 1 ) / tileRows; }
+	size_t tileSize( size_t tileIndex ) const
+	{
+		return ( min( ( tileIndex + 1 ) * tileRows, size ) - tileIndex * tileRows ) * size;
+	}
+	off_t rowOffset( size_t row ) const
+	{
+		return static_cast<off_t>( row ) * size * sizeof( DistanceType );
+	}
+	// Does not throw, so the file is removed in any case.
+	void close();
+	void loadTile( size_t tileIndex ) const;
+	void prefetchTile( size_t tileIndex ) const;
+	void finishPrefetch() const;
+	static double now();
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+template<typename DISTANCE_TYPE>
+void CFileDissimilarityMatrix<DISTANCE_TYPE>::Reset( size_t newSize )
+{
+	static size_t numberOfFiles = 0;
+
+	close();
+	size = newSize;
+	tileRows = max<size_t>( 1, TileBytes / max<size_t>( 1, size * sizeof( DistanceType ) ) );
+	sweptRowsBegin = 0;
+	sweptRowsEnd = size;
+	tileFirstRow = 0;
+	tileEndRow = 0;
+	statistics = CMatrixReadStatistics();
+
+	ostringstream name;
+	name << filenamePrefix() << "." << numberOfFiles++;
+	filename = name.str();
+	file = open( filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600 );
+	if( file == -1 || ftruncate( file, rowOffset( size ) ) != 0 ) {
+		throw runtime_error( "CFileDissimilarityMatrix: cannot create file '" + filename + "'" );
+	}
+}
+
+template<typename DISTANCE_TYPE>
+void CFileDissimilarityMatrix<DISTANCE_TYPE>::SetRows( size_t firstRow,
+	size_t numberOfRows, const DistanceType* rowsDistances )
+{
+	assert( firstRow + numberOfRows <= size );
+
+	// tiles may contain old distances
+	finishPrefetch();
+	tileFirstRow = 0;
+	tileEndRow = 0;
+
+	const char* buffer = reinterpret_cast<const char*>( rowsDistances );
+	size_t bytes = numberOfRows * size * sizeof( DistanceType );
+	off_t offset = rowOffset( firstRow );
+	while( bytes > 0 ) {
+		const ssize_t written = pwrite( file, buffer, bytes, offset );
+		if( written <= 0 ) {
+			throw runtime_error( "CFileDissimilarityMatrix: cannot write file '" + filename + "'" );
+		}
+		buffer += written;
+		bytes -= written;
+		offset += written;
+	}
+}
+
+template<typename DISTANCE_TYPE>
+void CFileDissimilarityMatrix<DISTANCE_TYPE>::Swap( CFileDissimilarityMatrix& matrix )
+{
+	finishPrefetch();
+	matrix.finishPrefetch();
+	swap( size, matrix.size );
+	filename.swap( matrix.filename );
+	swap( file, matrix.file );
+	swap( tileRows, matrix.tileRows );
+	swap( sweptRowsBegin, matrix.sweptRowsBegin );
+	swap( sweptRowsEnd, matrix.sweptRowsEnd );
+	swap( tileFirstRow, matrix.tileFirstRow );
+	swap( tileEndRow, matrix.tileEndRow );
+	tile.swap( matrix.tile );
+	nextTile.swap( matrix.nextTile );
+	swap( statistics, matrix.statistics );
+	swap( firstReadTime, matrix.firstReadTime );
+}
+
+template<typename DISTANCE_TYPE>
+void CFileDissimilarityMatrix<DISTANCE_TYPE>::Load( istream& input )
+{
+	bool good = false;
+	size_t newSize = 0;
+	if( input.good() && input >> newSize ) {
+		Reset( newSize );
+		good = true;
+		vector<DistanceType> row( size );
+		for( size_t i = 0; good && i < size; i++ ) {
+			for( size_t j = 0; good && j < size; j++ ) {
+				good = ( input.good() && input >> row[j] );
+			}
+			if( good ) {
+				SetRows( i, 1, &row[0] );
+			}
+		}
+	}
+	if( !good ) {
+		Reset( 0 );
+	}
+}
+
+template<typename DISTANCE_TYPE>
+void CFileDissimilarityMatrix<DISTANCE_TYPE>::Save( ostream& output ) const
+{
+	output.precision( numeric_limits<DistanceType>::digits10 + 3 );
+	output << size << endl;
+	for( size_t i = 0; i < size; i++ ) {
+		for( size_t j = 0; j < size; j++ ) {
+			if( i > 0 || j > 0 ) {
+				output << " ";
+			}
+			output << Distance( i, j );
+		}
+	}
+	output << endl;
+}
+
+template<typename DISTANCE_TYPE>
+void CFileDissimilarityMatrix<DISTANCE_TYPE>::close()
+{
+	try {
+		finishPrefetch();
+	} catch( const exception& ) {
+		// the tile being read is not needed any more
+	}
+	if( file != -1 ) {
+		::close( file );
+		unlink( filename.c_str() );
+		file = -1;
+	}
+	tileFirstRow = 0;
+	tileEndRow = 0;
+}
+
+template<typename DISTANCE_TYPE>
+void CFileDissimilarityMatrix<DISTANCE_TYPE>::loadTile( size_t tileIndex ) const
+{
+	const double start = now();
+	if( statistics.BytesRead == 0 ) {
+		firstReadTime = start;
+	}
+
+	if( !prefetching || nextTileIndex != tileIndex ) {
+		finishPrefetch();
+		prefetchTile( tileIndex );
+	}
+	if( aio_error( &request ) == EINPROGRESS ) {
+		statistics.Stalls++;
+	}
+	finishPrefetch();
+	tile.swap( nextTile );
+	tileFirstRow = tileIndex * tileRows;
+	tileEndRow = min( tileFirstRow + tileRows, size );
+
+	// sweeps go over the swept rows sequentially and start again
+	const size_t firstSweptTile = sweptRowsBegin / tileRows;
+	const size_t endSweptTile = ( sweptRowsEnd + tileRows - 1 ) / tileRows;
+	if( firstSweptTile <= tileIndex && tileIndex < endSweptTile ) {
+		const size_t nextTile = ( tileIndex + 1 < endSweptTile ) ? ( tileIndex + 1 ) : firstSweptTile;
+		if( nextTile != tileIndex ) {
+			prefetchTile( nextTile );
+		}
+	}
+
+	const double end = now();
+	statistics.StallTime += end - start;
+	statistics.ReadingTime = end - firstReadTime;
+}
+
+template<typename DISTANCE_TYPE>
+void CFileDissimilarityMatrix<DISTANCE_TYPE>::prefetchTile( size_t tileIndex ) const
+{
+	assert( !prefetching );
+	nextTile.resize( tileSize( tileIndex ) );
+	memset( &request, 0, sizeof( request ) );
+	request.aio_fildes = file;
+	request.aio_offset = rowOffset( tileIndex * tileRows );
+	request.aio_buf = &nextTile[0];
+	request.aio_nbytes = nextTile.size() * sizeof( DistanceType );
+	if( aio_read( &request ) != 0 ) {
+		throw runtime_error( "CFileDissimilarityMatrix: cannot read file '" + filename + "'" );
+	}
+	nextTileIndex = tileIndex;
+	prefetching = true;
+}
+
+template<typename DISTANCE_TYPE>
+void CFileDissimilarityMatrix<DISTANCE_TYPE>::finishPrefetch() const
+{
+	if( !prefetching ) {
+		return;
+	}
+	prefetching = false;
+
+	const aiocb* const requests[1] = { &request };
+	while( aio_error( &request ) == EINPROGRESS ) {
+		aio_suspend( requests, 1, 0 );
+	}
+	const ssize_t bytesRead = aio_return( &request );
+	if( bytesRead < 0 || static_cast<size_t>( bytesRead ) != request.aio_nbytes ) {
+		throw runtime_error( "CFileDissimilarityMatrix: cannot read file '" + filename + "'" );
+	}
+	statistics.BytesRead += bytesRead;
+}
+
+template<typename DISTANCE_TYPE>
+double CFileDissimilarityMatrix<DISTANCE_TYPE>::now()
+{
+	timespec time;
+	clock_gettime( CLOCK_MONOTONIC, &time );
+	return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,335 @@
+#pragma once
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Calculates distances of objects for CKnnDissimilarityMatrix.
+template<typename DISTANCE_TYPE>
+class CDistanceCalculator {
+public:
+	typedef DISTANCE_TYPE DistanceType;
+
+	virtual ~CDistanceCalculator() {}
+	virtual size_t Size() const = 0;
+	// Distances from object to all objects.
+	virtual void CalculateRow( size_t object, DistanceType* distances ) const = 0;
+	virtual DistanceType Calculate( size_t object1, size_t object2 ) const = 0;
+};
+
+template<typename OBJECT_TYPE>
+class CObjectsDistanceCalculator :
+	public CDistanceCalculator<typename OBJECT_TYPE::DistanceType> {
+public:
+	typedef OBJECT_TYPE ObjectType;
+	typedef typename ObjectType::DistanceType DistanceType;
+
+	explicit CObjectsDistanceCalculator( const vector<ObjectType>& _objects ) :
+		objects( _objects )
+	{
+	}
+
+	virtual size_t Size() const { return objects.size(); }
+
+	virtual void CalculateRow( size_t object, DistanceType* distances ) const
+	{
+		ObjectType::Distances( objects[object], &objects[0], objects.size(), distances );
+		distances[object] = 0;
+	}
+
+	virtual DistanceType Calculate( size_t object1, size_t object2 ) const
+	{
+		return objects[object1].Distance( objects[object2] );
+	}
+
+private:
+	const vector<ObjectType> objects;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Sparse dissimilarity matrix of the graph of nearest neighbors: each object
+// keeps distances to its NumberOfNeighbors nearest objects and to objects,
+// which have it among their nearest ones. Rows are stored by CSR layout
+// sorted by neighbors, so memory is O( size * NumberOfNeighbors ). Distances
+// to other objects are calculated on demand by the calculator or, if
+// non-neighbors are capped, are the largest distance of the graph, which is
+// an approximation without any bound. Each of processes finds neighbors of its
+// objects by CalcBeginEndObjects and the edges are gathered.
+template<typename DISTANCE_TYPE>
+class CKnnDissimilarityMatrix {
+private:
+	CKnnDissimilarityMatrix( const CKnnDissimilarityMatrix& matrix );
+	CKnnDissimilarityMatrix& operator=( const CKnnDissimilarityMatrix& matrix );
+
+public:
+	typedef DISTANCE_TYPE DistanceType;
+	// Distance( i, j ) equals Distance( j, i ).
+	static const bool IsSymmetric = true;
+	// Distances of any rows are read by turns as fast as of one row.
+	static const bool IsRandomAccess = true;
+
+	static void SetNumberOfNeighbors( size_t count ) { numberOfNeighbors() = count; }
+	static size_t NumberOfNeighbors() { return numberOfNeighbors(); }
+	// Calculator is not used for distances to non-neighbors if they are capped.
+	static void SetCapNonNeighbors( bool cap ) { capNonNeighbors() = cap; }
+	static bool CapNonNeighbors() { return capNonNeighbors(); }
+
+	CKnnDissimilarityMatrix() :
+		calculator( 0 ),
+		cap( 0 ),
+		capped( false )
+	{
+	}
+
+	~CKnnDissimilarityMatrix() { delete calculator; }
+
+	size_t Size() const { return rowBegins.empty() ? 0 : rowBegins.size() - 1; }
+
+	DistanceType Distance( size_t i, size_t j ) const
+	{
+		assert( i < Size() && j < Size() );
+		if( i == j ) {
+			return 0;
+		}
+		const uint32_t* const begin = &neighbors[0] + rowBegins[i];
+		const uint32_t* const end = &neighbors[0] + rowBegins[i + 1];
+		const uint32_t* const neighbor = lower_bound( begin, end, static_cast<uint32_t>( j ) );
+		if( neighbor != end && *neighbor == j ) {
+			return distances[neighbor - &neighbors[0]];
+		}
+		return capped ? cap : calculator->Calculate( i, j );
+	}
+
+	// Maximal error of distances in row, capped distances are not bounded.
+	DistanceType MaxError( size_t /* row */ ) const
+	{
+		return capped ? numeric_limits<DistanceType>::infinity() : 0;
+	}
+
+	// Number of kept distances.
+	size_t NumberOfEdges() const { return neighbors.size(); }
+
+	// Objects are copied, OBJECT_TYPE must provide static Distances
+	// as CDissimilarityMatrixBuilder requires and Distance.
+	template<typename OBJECT_TYPE>
+	void SetObjects( const vector<OBJECT_TYPE>& objects,
+		size_t rank, size_t numberOfProcesses )
+	{
+		SetCalculator( new CObjectsDistanceCalculator<OBJECT_TYPE>( objects ),
+			rank, numberOfProcesses );
+	}
+	// Takes ownership of the calculator and builds the graph by rows of it,
+	// all processes of MPI_COMM_WORLD call it if there are more than one.
+	void SetCalculator( const CDistanceCalculator<DistanceType>* newCalculator,
+		size_t rank, size_t numberOfProcesses );
+
+	void Swap( CKnnDissimilarityMatrix& matrix );
+
+	void Load( istream& input );
+	void Save( ostream& output ) const;
+
+private:
+	struct CEdge {
+		uint32_t From;
+		uint32_t To;
+		DistanceType Distance;
+
+		bool operator<( const CEdge& edge ) const
+		{
+			return ( From < edge.From || ( From == edge.From && To < edge.To ) );
+		}
+		bool operator==( const CEdge& edge ) const
+		{
+			return ( From == edge.From && To == edge.To );
+		}
+	};
+
+	// Orders objects by distances from an object, ties by objects.
+	class CDistanceLess {
+	public:
+		explicit CDistanceLess( const DistanceType* _distances ) : distances( _distances ) {}
+
+		bool operator()( uint32_t object1, uint32_t object2 ) const
+		{
+			return ( distances[object1] < distances[object2]
+				|| ( distances[object1] == distances[object2] && object1 < object2 ) );
+		}
+
+	private:
+		const DistanceType* distances;
+	};
+
+	const CDistanceCalculator<DistanceType>* calculator;
+	vector<size_t> rowBegins;
+	vector<uint32_t> neighbors;
+	vector<DistanceType> distances;
+	DistanceType cap;
+	bool capped;
+
+	void findNearestNeighbors( size_t objectBegin, size_t objectEnd, size_t count,
+		vector<CEdge>& edges ) const;
+	void allGather( size_t count, size_t numberOfProcesses, vector<CEdge>& edges ) const;
+
+	static size_t& numberOfNeighbors()
+	{
+		static size_t count = 32;
+		return count;
+	}
+	static bool& capNonNeighbors()
+	{
+		static bool cap = false;
+		return cap;
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+template<typename DISTANCE_TYPE>
+void CKnnDissimilarityMatrix<DISTANCE_TYPE>::Swap( CKnnDissimilarityMatrix& matrix )
+{
+	swap( calculator, matrix.calculator );
+	rowBegins.swap( matrix.rowBegins );
+	neighbors.swap( matrix.neighbors );
+	distances.swap( matrix.distances );
+	swap( cap, matrix.cap );
+	swap( capped, matrix.capped );
+}
+
+template<typename DISTANCE_TYPE>
+void CKnnDissimilarityMatrix<DISTANCE_TYPE>::Load( istream& /* input */ )
+{
+	throw domain_error( "CKnnDissimilarityMatrix: loading is not supported" );
+}
+
+template<typename DISTANCE_TYPE>
+void CKnnDissimilarityMatrix<DISTANCE_TYPE>::Save( ostream& output ) const
+{
+	output.precision( numeric_limits<DistanceType>::digits10 + 3 );
+	output << Size() << endl;
+	for( size_t i = 0; i < Size(); i++ ) {
+		for( size_t j = 0; j < Size(); j++ ) {
+			if( i > 0 || j > 0 ) {
+				output << " ";
+			}
+			output << Distance( i, j );
+		}
+	}
+	output << endl;
+}
+
+template<typename DISTANCE_TYPE>
+void CKnnDissimilarityMatrix<DISTANCE_TYPE>::SetCalculator(
+	const CDistanceCalculator<DistanceType>* newCalculator,
+	size_t rank, size_t numberOfProcesses )
+{
+	delete calculator;
+	calculator = newCalculator;
+
+	const size_t size = calculator->Size();
+	if( size > numeric_limits<uint32_t>::max() ) {
+		throw invalid_argument( "CKnnDissimilarityMatrix: too many objects" );
+	}
+	const size_t count = min( numberOfNeighbors(), size > 0 ? size - 1 : 0 );
+
+	// directed edges to the nearest neighbors and back, each process fills
+	// them for its objects
+	vector<CEdge> edges( 2 * size * count );
+	size_t objectBegin = 0;
+	size_t objectEnd = 0;
+	CalcBeginEndObjects( size, numberOfProcesses, rank, objectBegin, objectEnd );
+	findNearestNeighbors( objectBegin, objectEnd, count, edges );
+	if( numberOfProcesses > 1 ) {
+		allGather( count, numberOfProcesses, edges );
+	}
+	sort( edges.begin(), edges.end() );
+	edges.erase( unique( edges.begin(), edges.end() ), edges.end() );
+
+	rowBegins.assign( size + 1, 0 );
+	neighbors.resize( edges.size() );
+	distances.resize( edges.size() );
+	cap = 0;
+	for( size_t i = 0; i < edges.size(); i++ ) {
+		rowBegins[edges[i].From + 1]++;
+		neighbors[i] = edges[i].To;
+		distances[i] = edges[i].Distance;
+		cap = max( cap, edges[i].Distance );
+	}
+	for( size_t object = 0; object < size; object++ ) {
+		rowBegins[object + 1] += rowBegins[object];
+	}
+	// distances of both directions of an edge are the same
+	for( size_t object = 0; object < size; object++ ) {
+		for( size_t i = rowBegins[object]; i < rowBegins[object + 1]; i++ ) {
+			if( neighbors[i] < object ) {
+				const uint32_t* const begin = &neighbors[0] + rowBegins[neighbors[i]];
+				const uint32_t* const end = &neighbors[0] + rowBegins[neighbors[i] + 1];
+				distances[i] = distances[lower_bound( begin, end,
+					static_cast<uint32_t>( object ) ) - &neighbors[0]];
+			}
+		}
+	}
+	capped = capNonNeighbors();
+}
+
+template<typename DISTANCE_TYPE>
+void CKnnDissimilarityMatrix<DISTANCE_TYPE>::findNearestNeighbors(
+	size_t objectBegin, size_t objectEnd, size_t count, vector<CEdge>& edges ) const
+{
+	const size_t size = calculator->Size();
+	vector<DistanceType> row( size );
+	vector<uint32_t> objects( size );
+	for( size_t object = objectBegin; object < objectEnd; object++ ) {
+		calculator->CalculateRow( object, &row[0] );
+		for( size_t i = 0; i < size; i++ ) {
+			objects[i] = static_cast<uint32_t>( i );
+		}
+		// the object itself is moved to the end
+		swap( objects[object], objects[size - 1] );
+		if( count > 0 ) {
+			nth_element( objects.begin(), objects.begin() + ( count - 1 ),
+				objects.end() - 1, CDistanceLess( &row[0] ) );
+		}
+		CEdge* const objectEdges = &edges[2 * count * object];
+		for( size_t i = 0; i < count; i++ ) {
+			CEdge& edge = objectEdges[2 * i];
+			edge.From = static_cast<uint32_t>( object );
+			edge.To = objects[i];
+			edge.Distance = row[objects[i]];
+			CEdge& backEdge = objectEdges[2 * i + 1];
+			backEdge.From = edge.To;
+			backEdge.To = edge.From;
+			backEdge.Distance = edge.Distance;
+		}
+	}
+}
+
+template<typename DISTANCE_TYPE>
+void CKnnDissimilarityMatrix<DISTANCE_TYPE>::allGather( size_t count,
+	size_t numberOfProcesses, vector<CEdge>& edges ) const
+{
+	if( edges.empty() ) {
+		return;
+	}
+	if( edges.size() > static_cast<size_t>( numeric_limits<int>::max() ) ) {
+		throw invalid_argument( "CKnnDissimilarityMatrix: too many edges to gather" );
+	}
+	const size_t size = calculator->Size();
+	vector<int> counts( numberOfProcesses );
+	vector<int> displacements( numberOfProcesses );
+	for( size_t process = 0; process < numberOfProcesses; process++ ) {
+		size_t processBegin = 0;
+		size_t processEnd = 0;
+		CalcBeginEndObjects( size, numberOfProcesses, process, processBegin, processEnd );
+		counts[process] = static_cast<int>( 2 * count * ( processEnd - processBegin ) );
+		displacements[process] = static_cast<int>( 2 * count * processBegin );
+	}
+	MPI_Datatype edgeType;
+	MpiCheck( MPI_Type_contiguous( sizeof( CEdge ), MPI_BYTE, &edgeType ),
+		"MPI_Type_contiguous for knn graph edges" );
+	MpiCheck( MPI_Type_commit( &edgeType ), "MPI_Type_commit for knn graph edges" );
+	const int result = MPI_Allgatherv( MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, &edges[0],
+		&counts[0], &displacements[0], edgeType, MPI_COMM_WORLD );
+	MPI_Type_free( &edgeType );
+	MpiCheck( result, "MPI_Allgatherv for knn graph edges" );
+}
+
+///////////////////////////////////////////////////////////////////////////////
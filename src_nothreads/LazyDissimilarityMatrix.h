@@ -0,0 +1,244 @@
+#pragma once
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Statistics of row cache: rows found in the cache, calculated rows and
+// rows removed from the cache to calculate other rows.
+struct CRowCacheStatistics {
+	size_t Hits;
+	size_t Misses;
+	size_t Evictions;
+
+	CRowCacheStatistics() :
+		Hits( 0 ),
+		Misses( 0 ),
+		Evictions( 0 )
+	{
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Calculates rows of dissimilarity matrix of objects.
+template<typename DISTANCE_TYPE>
+class CRowCalculator {
+public:
+	typedef DISTANCE_TYPE DistanceType;
+
+	virtual ~CRowCalculator() {}
+	virtual size_t Size() const = 0;
+	virtual void Calculate( size_t row, DistanceType* distances ) const = 0;
+};
+
+template<typename OBJECT_TYPE>
+class CObjectsRowCalculator : public CRowCalculator<typename OBJECT_TYPE::DistanceType> {
+public:
+	typedef OBJECT_TYPE ObjectType;
+	typedef typename ObjectType::DistanceType DistanceType;
+
+	explicit CObjectsRowCalculator( const vector<ObjectType>& _objects ) :
+		objects( _objects )
+	{
+	}
+
+	virtual size_t Size() const { return objects.size(); }
+
+	virtual void Calculate( size_t row, DistanceType* distances ) const
+	{
+		ObjectType::Distances( objects[row], &objects[0], objects.size(), distances );
+		distances[row] = 0;
+	}
+
+private:
+	const vector<ObjectType> objects;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Dissimilarity matrix of objects, which calculates rows on the first access
+// and keeps at most cache size bytes of rows, for expensive dissimilarities.
+// Rows are evicted from the cache by the CLOCK algorithm: a row, which was
+// used since the last pass of the clock hand, is kept for one more pass.
+template<typename DISTANCE_TYPE>
+class CLazyDissimilarityMatrix {
+private:
+	CLazyDissimilarityMatrix( const CLazyDissimilarityMatrix& matrix );
+	CLazyDissimilarityMatrix& operator=( const CLazyDissimilarityMatrix& matrix );
+
+public:
+	typedef DISTANCE_TYPE DistanceType;
+	// Distance( i, j ) equals Distance( j, i ).
+	static const bool IsSymmetric = true;
+	// Rows are found in the cache or calculated, so they are read one by one.
+	static const bool IsRandomAccess = false;
+
+	// At least one row is kept regardless of the cache size.
+	static void SetCacheSize( size_t bytes ) { cacheSize() = bytes; }
+	static size_t CacheSize() { return cacheSize(); }
+
+	CLazyDissimilarityMatrix() :
+		calculator( 0 ),
+		maxCachedRows( 0 ),
+		clockHand( 0 ),
+		currentRow( 0 ),
+		currentDistances( 0 )
+	{
+	}
+
+	~CLazyDissimilarityMatrix() { delete calculator; }
+
+	size_t Size() const { return rowSlots.size(); }
+
+	DistanceType Distance( size_t i, size_t j ) const
+	{
+		assert( i < Size() && j < Size() );
+		if( currentDistances == 0 || i != currentRow ) {
+			currentDistances = findRow( i );
+			currentRow = i;
+		}
+		return currentDistances[j];
+	}
+
+	// Maximal error of distances in row, distances are exact.
+	DistanceType MaxError( size_t /* row */ ) const { return 0; }
+
+	// Accesses to the row of the previous access are not counted.
+	const CRowCacheStatistics& CacheStatistics() const { return statistics; }
+
+	// Objects are copied, OBJECT_TYPE must provide static Distances
+	// as CDissimilarityMatrixBuilder requires.
+	template<typename OBJECT_TYPE>
+	void SetObjects( const vector<OBJECT_TYPE>& objects )
+	{
+		SetCalculator( new CObjectsRowCalculator<OBJECT_TYPE>( objects ) );
+	}
+	// Takes ownership of the calculator.
+	void SetCalculator( const CRowCalculator<DistanceType>* newCalculator );
+
+	void Swap( CLazyDissimilarityMatrix& matrix );
+
+	void Load( istream& input );
+	void Save( ostream& output ) const;
+
+private:
+	static const size_t NotCached = static_cast<size_t>( -1 );
+
+	struct CCachedRow {
+		size_t Row;
+		bool Referenced;
+		vector<DistanceType> Distances;
+	};
+
+	const CRowCalculator<DistanceType>* calculator;
+	size_t maxCachedRows;
+	mutable vector<CCachedRow> cachedRows;
+	mutable vector<size_t> rowSlots;
+	mutable size_t clockHand;
+	mutable size_t currentRow;
+	mutable const DistanceType* currentDistances;
+	mutable CRowCacheStatistics statistics;
+
+	static size_t& cacheSize()
+	{
+		static size_t bytes = 256 << 20;
+		return bytes;
+	}
+
+	const DistanceType* findRow( size_t row ) const;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+template<typename DISTANCE_TYPE>
+const size_t CLazyDissimilarityMatrix<DISTANCE_TYPE>::NotCached;
+
+template<typename DISTANCE_TYPE>
+void CLazyDissimilarityMatrix<DISTANCE_TYPE>::Swap( CLazyDissimilarityMatrix& matrix )
+{
+	swap( calculator, matrix.calculator );
+	swap( maxCachedRows, matrix.maxCachedRows );
+	cachedRows.swap( matrix.cachedRows );
+	rowSlots.swap( matrix.rowSlots );
+	swap( clockHand, matrix.clockHand );
+	swap( currentRow, matrix.currentRow );
+	swap( currentDistances, matrix.currentDistances );
+	swap( statistics, matrix.statistics );
+}
+
+template<typename DISTANCE_TYPE>
+void CLazyDissimilarityMatrix<DISTANCE_TYPE>::Load( istream& /* input */ )
+{
+	throw domain_error( "CLazyDissimilarityMatrix: loading is not supported" );
+}
+
+template<typename DISTANCE_TYPE>
+void CLazyDissimilarityMatrix<DISTANCE_TYPE>::Save( ostream& output ) const
+{
+	output.precision( numeric_limits<DistanceType>::digits10 + 3 );
+	output << Size() << endl;
+	for( size_t i = 0; i < Size(); i++ ) {
+		for( size_t j = 0; j < Size(); j++ ) {
+			if( i > 0 || j > 0 ) {
+				output << " ";
+			}
+			output << Distance( i, j );
+		}
+	}
+	output << endl;
+}
+
+template<typename DISTANCE_TYPE>
+void CLazyDissimilarityMatrix<DISTANCE_TYPE>::SetCalculator(
+	const CRowCalculator<DistanceType>* newCalculator )
+{
+	delete calculator;
+	calculator = newCalculator;
+
+	const size_t size = calculator->Size();
+	const size_t rowSize = max<size_t>( 1, size * sizeof( DistanceType ) );
+	maxCachedRows = min( size, max<size_t>( 1, cacheSize() / rowSize ) );
+	cachedRows.clear();
+	// rows are not moved, so currentDistances stays valid
+	cachedRows.reserve( maxCachedRows );
+	rowSlots.assign( size, NotCached );
+	clockHand = 0;
+	currentDistances = 0;
+	statistics = CRowCacheStatistics();
+}
+
+template<typename DISTANCE_TYPE>
+const typename CLazyDissimilarityMatrix<DISTANCE_TYPE>::DistanceType*
+CLazyDissimilarityMatrix<DISTANCE_TYPE>::findRow( size_t row ) const
+{
+	size_t slot = rowSlots[row];
+	if( slot != NotCached ) {
+		statistics.Hits++;
+		cachedRows[slot].Referenced = true;
+		return &cachedRows[slot].Distances[0];
+	}
+
+	statistics.Misses++;
+	if( cachedRows.size() < maxCachedRows ) {
+		slot = cachedRows.size();
+		cachedRows.push_back( CCachedRow() );
+		cachedRows.back().Distances.resize( Size() );
+	} else {
+		while( cachedRows[clockHand].Referenced ) {
+			cachedRows[clockHand].Referenced = false;
+			clockHand = ( clockHand + 1 ) % cachedRows.size();
+		}
+		slot = clockHand;
+		clockHand = ( clockHand + 1 ) % cachedRows.size();
+		rowSlots[cachedRows[slot].Row] = NotCached;
+		statistics.Evictions++;
+	}
+
+	CCachedRow& cachedRow = cachedRows[slot];
+	calculator->Calculate( row, &cachedRow.Distances[0] );
+	cachedRow.Row = row;
+	cachedRow.Referenced = false;
+	rowSlots[row] = slot;
+	return &cachedRow.Distances[0];
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <DistanceKernels.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Metric policies provide Distance between two points and batch Distances
+// from a point to consecutive points. IsMetric is true if the distance
+// satisfies the triangle inequality.
+
+// Sum of squared differences of coordinates.
+struct CSquaredDifferences {
+	template<typename NUMERIC_TYPE>
+	static NUMERIC_TYPE Accumulate( NUMERIC_TYPE sum, NUMERIC_TYPE difference )
+	{
+		return sum + difference * difference;
+	}
+
+	template<typename NUMERIC_TYPE>
+	static NUMERIC_TYPE Combine( NUMERIC_TYPE first, NUMERIC_TYPE second )
+	{
+		return first + second;
+	}
+
+#ifdef PAM_SSE2_KERNELS
+	static __m128 Accumulate( __m128 sum, __m128 difference )
+	{
+		return _mm_add_ps( sum, _mm_mul_ps( difference, difference ) );
+	}
+
+	static __m128 Combine( __m128 first, __m128 second )
+	{
+		return _mm_add_ps( first, second );
+	}
+#endif
+
+#ifdef PAM_AVX_KERNELS
+	static __m256 Accumulate( __m256 sum, __m256 difference )
+	{
+		return _mm256_add_ps( sum, _mm256_mul_ps( difference, difference ) );
+	}
+#endif
+};
+
+struct CSquaredEuclideanMetric :
+	public CSquaredDifferences,
+	public CDifferencesMetric<CSquaredEuclideanMetric>
+{
+	static const bool IsMetric = false;
+	static const char* Name() { return "squared-euclidean"; }
+
+	template<typename NUMERIC_TYPE>
+	static NUMERIC_TYPE Finish( NUMERIC_TYPE sum ) { return sum; }
+};
+
+struct CEuclideanMetric :
+	public CSquaredDifferences,
+	public CDifferencesMetric<CEuclideanMetric>
+{
+	static const bool IsMetric = true;
+	static const char* Name() { return "euclidean"; }
+
+	template<typename NUMERIC_TYPE>
+	static NUMERIC_TYPE Finish( NUMERIC_TYPE sum ) { return sqrt( sum ); }
+
+#ifdef PAM_SSE2_KERNELS
+	static __m128 Finish( __m128 sum ) { return _mm_sqrt_ps( sum ); }
+#endif
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct CManhattanMetric : public CDifferencesMetric<CManhattanMetric> {
+	static const bool IsMetric = true;
+	static const char* Name() { return "manhattan"; }
+
+	template<typename NUMERIC_TYPE>
+	static NUMERIC_TYPE Accumulate( NUMERIC_TYPE sum, NUMERIC_TYPE difference )
+	{
+		return sum + ( difference < 0 ? -difference : difference );
+	}
+
+	template<typename NUMERIC_TYPE>
+	static NUMERIC_TYPE Combine( NUMERIC_TYPE first, NUMERIC_TYPE second )
+	{
+		return first + second;
+	}
+
+	template<typename NUMERIC_TYPE>
+	static NUMERIC_TYPE Finish( NUMERIC_TYPE sum ) { return sum; }
+
+#ifdef PAM_SSE2_KERNELS
+	static __m128 Accumulate( __m128 sum, __m128 difference )
+	{
+		return _mm_add_ps( sum, _mm_andnot_ps( _mm_set1_ps( -0.0f ), difference ) );
+	}
+
+	static __m128 Combine( __m128 first, __m128 second )
+	{
+		return _mm_add_ps( first, second );
+	}
+#endif
+
+#ifdef PAM_AVX_KERNELS
+	static __m256 Accumulate( __m256 sum, __m256 difference )
+	{
+		return _mm256_add_ps( sum, _mm256_andnot_ps( _mm256_set1_ps( -0.0f ), difference ) );
+	}
+#endif
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct CChebyshevMetric : public CDifferencesMetric<CChebyshevMetric> {
+	static const bool IsMetric = true;
+	static const char* Name() { return "chebyshev"; }
+
+	template<typename NUMERIC_TYPE>
+	static NUMERIC_TYPE Accumulate( NUMERIC_TYPE maximum, NUMERIC_TYPE difference )
+	{
+		return max( maximum, difference < 0 ? -difference : difference );
+	}
+
+	template<typename NUMERIC_TYPE>
+	static NUMERIC_TYPE Combine( NUMERIC_TYPE first, NUMERIC_TYPE second )
+	{
+		return max( first, second );
+	}
+
+	template<typename NUMERIC_TYPE>
+	static NUMERIC_TYPE Finish( NUMERIC_TYPE maximum ) { return maximum; }
+
+#ifdef PAM_SSE2_KERNELS
+	static __m128 Accumulate( __m128 maximum, __m128 difference )
+	{
+		return _mm_max_ps( maximum, _mm_andnot_ps( _mm_set1_ps( -0.0f ), difference ) );
+	}
+
+	static __m128 Combine( __m128 first, __m128 second )
+	{
+		return _mm_max_ps( first, second );
+	}
+#endif
+
+#ifdef PAM_AVX_KERNELS
+	static __m256 Accumulate( __m256 maximum, __m256 difference )
+	{
+		return _mm256_max_ps( maximum, _mm256_andnot_ps( _mm256_set1_ps( -0.0f ), difference ) );
+	}
+#endif
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Cosine dissimilarity does not satisfy the triangle inequality.
+struct CCosineMetric {
+	static const bool IsMetric = false;
+	static const char* Name() { return "cosine"; }
+
+	template<typename NUMERIC_TYPE>
+	static NUMERIC_TYPE Distance( const NUMERIC_TYPE* first, const NUMERIC_TYPE* second,
+		const size_t dimension )
+	{
+		return CosineDistance( first, second, dimension );
+	}
+
+	template<typename NUMERIC_TYPE>
+	static void Distances( const NUMERIC_TYPE* point, const NUMERIC_TYPE* points,
+		const size_t count, const size_t dimension, NUMERIC_TYPE* distances )
+	{
+		for( size_t i = 0; i < count; i++ ) {
+			distances[i] = CosineDistance( point, points + i * dimension, dimension );
+		}
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
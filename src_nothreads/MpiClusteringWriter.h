@@ -0,0 +1,65 @@
+#pragma once
+
+#include <mpi.h>
+#include <stdint.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Clustering of vectors, each process has clusters of its slice of vectors.
+struct CClusteringOutput {
+	double Cost;
+	// Vectors of medoids, cluster i has medoid Medoids[i].
+	vector<size_t> Medoids;
+	size_t NumberOfVectors;
+	// Clusters of vectors [FirstVector, FirstVector + Clusters.size()).
+	size_t FirstVector;
+	vector<uint32_t> Clusters;
+
+	CClusteringOutput() :
+		Cost( 0 ),
+		NumberOfVectors( 0 ),
+		FirstVector( 0 )
+	{
+	}
+};
+
+// Header of binary clustering file, it is followed by NumberOfClusters
+// medoids (uint64_t) and NumberOfVectors clusters of vectors (uint32_t).
+// Byte order is the native one.
+struct CClusteringBinaryHeader {
+	char Magic[4];
+	uint32_t Version;
+	uint64_t NumberOfClusters;
+	uint64_t NumberOfVectors;
+	double Cost;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Writes clustering file by all processes, each process writes its slice
+// of vectors clusters by one collective MPI-IO write, so writing does not
+// wait for a single process to format the whole file. Must be called by all
+// processes, slices of vectors must follow in order of ranks.
+class CMpiClusteringWriter {
+private:
+	CMpiClusteringWriter();
+
+public:
+	static const uint32_t BinaryVersion = 1;
+
+	// Text file with lines 'cost COST', 'medoids NUMBER_OF_CLUSTERS',
+	// a line 'MEDOID' for each cluster, 'vectors NUMBER_OF_VECTORS' and
+	// a line 'VECTOR CLUSTER' for each vector, separated by tabs.
+	static void WriteText( const string& filename, const CClusteringOutput& clustering );
+	// Binary file with CClusteringBinaryHeader.
+	static void WriteBinary( const string& filename, const CClusteringOutput& clustering );
+
+private:
+	static const char* binaryMagic() { return "PAMC"; }
+
+	// Writes buffer at offset, file gets fileSize bytes.
+	static void write( const string& filename, MPI_Offset offset, const vector<char>& buffer,
+		MPI_Offset fileSize );
+};
+
+///////////////////////////////////////////////////////////////////////////////
@@ -9,6 +9,22 @@ void MpiCheck( const int mpiResult, const string& mpiFunctionName );
 
 ///////////////////////////////////////////////////////////////////////////////
 
+// MPI datatype of numbers of NUMERIC_TYPE, other types do not compile.
+template<typename NUMERIC_TYPE>
+struct CMpiDatatype;
+
+template<>
+struct CMpiDatatype<float> {
+	static MPI_Datatype Type() { return MPI_FLOAT; }
+};
+
+template<>
+struct CMpiDatatype<double> {
+	static MPI_Datatype Type() { return MPI_DOUBLE; }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
 class CMpiSupport {
 private:
 	CMpiSupport();
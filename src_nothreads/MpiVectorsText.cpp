@@ -0,0 +1,222 @@
+#include <vector>
+#include <string>
+#include <limits>
+#include <climits>
+#include <cstring>
+#include <stdint.h>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+using namespace std;
+
+#include <MpiSupport.h>
+#include <VectorsText.h>
+#include <MpiVectorsText.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Reads buffer.size() bytes at offset by pieces, numberOfPieces must be the same
+// for all processes if reading is collective.
+static void ReadFile( MPI_File file, MPI_Offset offset, vector<char>& buffer,
+	bool collective, size_t numberOfPieces = 1 )
+{
+	const size_t pieceSize = ( buffer.size() + numberOfPieces - 1 ) / numberOfPieces;
+	for( size_t piece = 0; piece < numberOfPieces; piece++ ) {
+		const size_t begin = min( buffer.size(), piece * pieceSize );
+		const size_t size = min( buffer.size() - begin, pieceSize );
+		char* const data = buffer.empty() ? 0 : &buffer[begin];
+		MPI_Status status;
+		if( collective ) {
+			MpiCheck( MPI_File_read_at_all( file, offset + begin, data, static_cast<int>( size ),
+				MPI_CHAR, &status ), "MPI_File_read_at_all for vectors file" );
+		} else {
+			MpiCheck( MPI_File_read_at( file, offset + begin, data, static_cast<int>( size ),
+				MPI_CHAR, &status ), "MPI_File_read_at for vectors file" );
+		}
+		int count = 0;
+		MpiCheck( MPI_Get_count( &status, MPI_CHAR, &count ), "MPI_Get_count" );
+		if( static_cast<size_t>( count ) != size ) {
+			throw runtime_error( "cannot read vectors file!" );
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+CMpiVectorsText::CMpiVectorsText( const string& filename ) :
+	numberOfVectors( 0 ),
+	dimension( 0 )
+{
+	MPI_File file;
+	if( MPI_File_open( MPI_COMM_WORLD, const_cast<char*>( filename.c_str() ),
+		MPI_MODE_RDONLY, MPI_INFO_NULL, &file ) != MPI_SUCCESS )
+	{
+		throw domain_error( "cannot open vectors file '" + filename + "'!" );
+	}
+	try {
+		MPI_Offset fileSize = 0;
+		MpiCheck( MPI_File_get_size( file, &fileSize ), "MPI_File_get_size" );
+		if( fileSize == 0 ) {
+			throw domain_error( "bad vectors file format!" );
+		}
+		MPI_Offset vectorsBegin = 0;
+		readHeader( file, fileSize, vectorsBegin );
+		readVectors( file, fileSize, vectorsBegin );
+	} catch( ... ) {
+		MPI_File_close( &file );
+		throw;
+	}
+	MPI_File_close( &file );
+}
+
+void CMpiVectorsText::Read( float* const* vectorsCoordinates ) const
+{
+	for( size_t i = 0; i < numberOfVectors; i++ ) {
+		copy( coordinates.begin() + i * dimension, coordinates.begin() + ( i + 1 ) * dimension,
+			vectorsCoordinates[i] );
+	}
+}
+
+void CMpiVectorsText::readHeader( MPI_File file, MPI_Offset fileSize, MPI_Offset& vectorsBegin )
+{
+	// number of vectors, dimension, offset of vectors lines,
+	// zero dimension means bad header, so all processes throw
+	uint64_t header[3] = { 0, 0, 0 };
+	string error;
+	if( CMpiSupport::Rank() == 0 ) {
+		try {
+			vector<char> buffer( static_cast<size_t>( min<MPI_Offset>( fileSize, MaxLineLength ) ) );
+			ReadFile( file, 0, buffer, false /* collective */ );
+			const char* const begin = &buffer[0];
+			const char* const end = begin + buffer.size();
+			if( end - begin < fileSize && memchr( begin, '\n', end - begin ) == 0 ) {
+				throw domain_error( "too long line in vectors file!" );
+			}
+			const char* const linesBegin = CVectorsText::ParseHeader( begin, end,
+				numberOfVectors, dimension );
+			header[0] = numberOfVectors;
+			header[1] = dimension;
+			header[2] = linesBegin - begin;
+		} catch( exception& e ) {
+			error = e.what();
+		}
+	}
+	MpiCheck( MPI_Bcast( header, 3, MPI_UINT64_T, 0, MPI_COMM_WORLD ),
+		"MPI_Bcast for vectors file header" );
+	if( header[1] == 0 ) {
+		throw domain_error( error.empty() ? "bad vectors file format!" : error );
+	}
+	numberOfVectors = static_cast<size_t>( header[0] );
+	dimension = static_cast<size_t>( header[1] );
+	vectorsBegin = static_cast<MPI_Offset>( header[2] );
+}
+
+void CMpiVectorsText::readVectors( MPI_File file, MPI_Offset fileSize, MPI_Offset vectorsBegin )
+{
+	const MPI_Offset rank = CMpiSupport::Rank();
+	const MPI_Offset numberOfProcesses = CMpiSupport::NumberOfProccess();
+	const MPI_Offset size = fileSize - vectorsBegin;
+	// the process parses lines starting in [begin, end), it reads the byte
+	// before begin to find the first line start and a long enough tail to
+	// find the end of the last line
+	const MPI_Offset begin = vectorsBegin + size * rank / numberOfProcesses;
+	const MPI_Offset end = vectorsBegin + size * ( rank + 1 ) / numberOfProcesses;
+	const MPI_Offset readBegin = ( begin > vectorsBegin ) ? ( begin - 1 ) : begin;
+	const MPI_Offset readEnd = ( begin < end ) ?
+		min<MPI_Offset>( fileSize, end + MaxLineLength ) : readBegin;
+
+	vector<char> buffer( static_cast<size_t>( readEnd - readBegin ) );
+	const MPI_Offset maxReadSize = size / numberOfProcesses + 2 + MaxLineLength;
+	ReadFile( file, readBegin, buffer, true /* collective */,
+		static_cast<size_t>( maxReadSize / INT_MAX + 1 ) );
+
+	const char* const bufferBegin = buffer.empty() ? 0 : &buffer[0];
+	const char* const bufferEnd = bufferBegin + buffer.size();
+	const char* const rangeEnd = bufferBegin + ( end - readBegin );
+	// errors are passed to gathering, so all processes throw together
+	string error;
+	vector<float> rankCoordinates;
+	try {
+		const char* linesBegin = bufferBegin + ( begin - readBegin );
+		if( begin > vectorsBegin ) {
+			const char* const lineEnd = static_cast<const char*>(
+				memchr( bufferBegin, '\n', buffer.size() ) );
+			linesBegin = min( rangeEnd, ( lineEnd != 0 ) ? ( lineEnd + 1 ) : bufferEnd );
+		}
+		const char* linesEnd = rangeEnd;
+		if( linesBegin < rangeEnd ) {
+			const char* const lineEnd = static_cast<const char*>(
+				memchr( rangeEnd - 1, '\n', bufferEnd - ( rangeEnd - 1 ) ) );
+			if( lineEnd != 0 ) {
+				linesEnd = lineEnd + 1;
+			} else if( readEnd == fileSize ) {
+				linesEnd = bufferEnd;
+			} else {
+				throw domain_error( "too long line in vectors file!" );
+			}
+		}
+
+		vector<CVectorsChunk> chunks;
+		CVectorsText::SplitLines( linesBegin, linesEnd, 1, chunks );
+		const size_t rankNumberOfVectors = chunks.empty() ? 0 : chunks.back().NumberOfVectors;
+		rankCoordinates.resize( rankNumberOfVectors * dimension );
+		const char* position = linesBegin;
+		for( size_t i = 0; i < rankNumberOfVectors; i++ ) {
+			CVectorsText::ParseVector( position, linesEnd, dimension, &rankCoordinates[i * dimension] );
+		}
+	} catch( exception& e ) {
+		error = e.what();
+	}
+	gatherVectors( rankCoordinates, error );
+}
+
+void CMpiVectorsText::gatherVectors( vector<float>& rankCoordinates, const string& error )
+{
+	// the maximal number of vectors means an error of the process
+	const uint64_t Failed = numeric_limits<uint64_t>::max();
+	const size_t numberOfProcesses = CMpiSupport::NumberOfProccess();
+	vector<uint64_t> rankNumbersOfVectors( numberOfProcesses );
+	rankNumbersOfVectors[CMpiSupport::Rank()] =
+		error.empty() ? ( rankCoordinates.size() / dimension ) : Failed;
+	MpiCheck( MPI_Allgather( MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+		&rankNumbersOfVectors[0], 1, MPI_UINT64_T, MPI_COMM_WORLD ),
+		"MPI_Allgather for numbers of vectors" );
+	if( find( rankNumbersOfVectors.begin(), rankNumbersOfVectors.end(), Failed )
+		!= rankNumbersOfVectors.end() )
+	{
+		throw domain_error( error.empty() ? "bad vectors file format!" : error );
+	}
+
+	vector<int> counts( numberOfProcesses );
+	vector<int> displacements( numberOfProcesses );
+	uint64_t gatheredNumberOfVectors = 0;
+	for( size_t rank = 0; rank < numberOfProcesses; rank++ ) {
+		if( rankNumbersOfVectors[rank] > INT_MAX || gatheredNumberOfVectors > INT_MAX ) {
+			throw domain_error( "too many vectors in vectors file!" );
+		}
+		counts[rank] = static_cast<int>( rankNumbersOfVectors[rank] );
+		displacements[rank] = static_cast<int>( gatheredNumberOfVectors );
+		gatheredNumberOfVectors += rankNumbersOfVectors[rank];
+	}
+	if( gatheredNumberOfVectors != numberOfVectors ) {
+		throw domain_error( "number of vectors does not match vectors file header!" );
+	}
+	if( numberOfVectors == 0 ) {
+		return;
+	}
+
+	// vectors are gathered whole, so counts do not overflow for large dimensions
+	MPI_Datatype vectorType;
+	MpiCheck( MPI_Type_contiguous( static_cast<int>( dimension ), MPI_FLOAT, &vectorType ),
+		"MPI_Type_contiguous for vectors" );
+	MpiCheck( MPI_Type_commit( &vectorType ), "MPI_Type_commit for vectors" );
+	coordinates.resize( numberOfVectors * dimension );
+	rankCoordinates.resize( max<size_t>( 1, rankCoordinates.size() ) );
+	const int result = MPI_Allgatherv( &rankCoordinates[0], counts[CMpiSupport::Rank()],
+		vectorType, &coordinates[0], &counts[0], &displacements[0], vectorType, MPI_COMM_WORLD );
+	MPI_Type_free( &vectorType );
+	MpiCheck( result, "MPI_Allgatherv for vectors" );
+}
+
+///////////////////////////////////////////////////////////////////////////////
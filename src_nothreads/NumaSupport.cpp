@@ -0,0 +1,93 @@
+#include <new>
+#include <limits>
+#include <string>
+#include <cstddef>
+#include <iostream>
+
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+using namespace std;
+
+#include <MpiSupport.h>
+#include <NumaSupport.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+CNumaSupport::HugePagesType CNumaSupport::hugePages = CNumaSupport::NoHugePages;
+
+// Rank of the process among processes of its node, 0 without MPI.
+static size_t NodeRank()
+{
+	int initialized = 0;
+	MPI_Initialized( &initialized );
+	if( initialized == 0 ) {
+		return 0;
+	}
+	MPI_Comm node;
+	MpiCheck( MPI_Comm_split_type( MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL,
+		&node ), "MPI_Comm_split_type" );
+	int nodeRank = 0;
+	MpiCheck( MPI_Comm_rank( node, &nodeRank ), "MPI_Comm_rank" );
+	MpiCheck( MPI_Comm_free( &node ), "MPI_Comm_free" );
+	return static_cast<size_t>( nodeRank );
+}
+
+void CNumaSupport::PinProcess()
+{
+	const size_t nodeRank = NodeRank();
+	const long numberOfCores = sysconf( _SC_NPROCESSORS_ONLN );
+	if( numberOfCores <= 0 ) {
+		return;
+	}
+	const size_t core = nodeRank % static_cast<size_t>( numberOfCores );
+	cpu_set_t cores;
+	CPU_ZERO( &cores );
+	CPU_SET( core, &cores );
+	if( sched_setaffinity( 0, sizeof( cores ), &cores ) != 0 ) {
+		cerr << "Warning: cannot pin process to core " << core << "!" << endl;
+	}
+}
+
+void* CNumaSupport::AllocatePages( size_t bytes )
+{
+	if( bytes < HugePageSize ) {
+		return ::operator new( bytes );
+	}
+	const size_t length = ( bytes + HugePageSize - 1 ) / HugePageSize * HugePageSize;
+	void* pages = MAP_FAILED;
+#ifdef MAP_HUGETLB
+	if( hugePages == ExplicitHugePages ) {
+		pages = mmap( 0, length, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+	}
+#endif
+	if( pages == MAP_FAILED ) {
+		pages = mmap( 0, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+		if( pages == MAP_FAILED ) {
+			throw bad_alloc();
+		}
+#ifdef MADV_HUGEPAGE
+		if( hugePages != NoHugePages ) {
+			// ignored if transparent huge pages are disabled
+			madvise( pages, length, MADV_HUGEPAGE );
+		}
+#endif
+	}
+	return pages;
+}
+
+void CNumaSupport::FreePages( void* pages, size_t bytes )
+{
+	if( pages == 0 ) {
+		return;
+	}
+	if( bytes < HugePageSize ) {
+		::operator delete( pages );
+		return;
+	}
+	munmap( pages, ( bytes + HugePageSize - 1 ) / HugePageSize * HugePageSize );
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,101 @@
+#pragma once
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Placement of dissimilarity matrix in memory and of processes on cores, it
+// is set by the command line before the matrix is built. Each process keeps
+// its own matrix and steps its objects by CalcBeginEndObjects alone, so pages
+// it touches are allocated on the NUMA node of its core.
+class CNumaSupport {
+private:
+	CNumaSupport();
+
+public:
+	enum HugePagesType {
+		// pages of the system
+		NoHugePages,
+		// pages are merged to huge pages by the kernel if it can
+		TransparentHugePages,
+		// pages are reserved huge pages, regular pages if there are no free ones
+		ExplicitHugePages
+	};
+
+	// Allocations of at least HugePageSize bytes are pages of the system,
+	// smaller ones are on the heap.
+	static const size_t HugePageSize = 2 << 20;
+
+	static void SetHugePages( HugePagesType _hugePages ) { hugePages = _hugePages; }
+	static HugePagesType HugePages() { return hugePages; }
+
+	// Pins calling process to core of its rank among processes of its node
+	// modulo number of cores, all processes call it.
+	static void PinProcess();
+
+	static void* AllocatePages( size_t bytes );
+	static void FreePages( void* pages, size_t bytes );
+
+private:
+	static HugePagesType hugePages;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Allocator of CNumaSupport pages.
+template<typename TYPE>
+class CPageAllocator {
+public:
+	typedef TYPE value_type;
+	typedef TYPE* pointer;
+	typedef const TYPE* const_pointer;
+	typedef TYPE& reference;
+	typedef const TYPE& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+
+	template<typename OTHER_TYPE>
+	struct rebind {
+		typedef CPageAllocator<OTHER_TYPE> other;
+	};
+
+	CPageAllocator() {}
+	template<typename OTHER_TYPE>
+	CPageAllocator( const CPageAllocator<OTHER_TYPE>& ) {}
+
+	pointer address( reference value ) const { return &value; }
+	const_pointer address( const_reference value ) const { return &value; }
+	size_type max_size() const { return numeric_limits<size_type>::max() / sizeof( TYPE ); }
+
+	pointer allocate( size_type n, const void* /* hint */ = 0 )
+	{
+		return static_cast<pointer>( CNumaSupport::AllocatePages( n * sizeof( TYPE ) ) );
+	}
+
+	void deallocate( pointer p, size_type n )
+	{
+		CNumaSupport::FreePages( p, n * sizeof( TYPE ) );
+	}
+
+	void construct( pointer p, const TYPE& value )
+	{
+		::new( static_cast<void*>( p ) ) TYPE( value );
+	}
+
+	void destroy( pointer p )
+	{
+		p->~TYPE();
+	}
+};
+
+template<typename TYPE, typename OTHER_TYPE>
+bool operator==( const CPageAllocator<TYPE>&, const CPageAllocator<OTHER_TYPE>& )
+{
+	return true;
+}
+
+template<typename TYPE, typename OTHER_TYPE>
+bool operator!=( const CPageAllocator<TYPE>&, const CPageAllocator<OTHER_TYPE>& )
+{
+	return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
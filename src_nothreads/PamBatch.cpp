@@ -0,0 +1,362 @@
+#include <map>
+#include <set>
+#include <limits>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <cassert>
+#include <climits>
+#include <cstdlib>
+#include <stdint.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+#include <MpiSupport.h>
+#include <CommandLine.h>
+#include <VectorsFile.h>
+#include <PamEngine.h>
+#include <PamLibrary.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Independent clustering problem given by a line of manifest.
+struct CBatchTask {
+	string Filename;
+	size_t NumberOfClusters;
+	// Estimated work, tasks are scheduled from the largest one.
+	double Work;
+	// Rank of the process clustering the task.
+	size_t Rank;
+
+	CBatchTask() :
+		NumberOfClusters( 0 ),
+		Work( 0 ),
+		Rank( 0 )
+	{
+	}
+};
+
+// Manifest has lines 'FILENAME NUMBER_OF_CLUSTERS', empty lines and lines
+// starting with '#' are skipped.
+static void ReadManifest( const string& filename, vector<CBatchTask>& tasks )
+{
+	ifstream manifest( filename.c_str() );
+	if( !manifest.good() ) {
+		throw domain_error( "cannot read manifest '" + filename + "'!" );
+	}
+	string line;
+	for( size_t lineNumber = 1; getline( manifest, line ); lineNumber++ ) {
+		const size_t end = line.find_last_not_of( " \t\r" );
+		if( end == string::npos || line[line.find_first_not_of( " \t" )] == '#' ) {
+			continue;
+		}
+		line.erase( end + 1 );
+		// filename may contain spaces, the number of clusters is the last word
+		const size_t separator = line.find_last_of( " \t" );
+		char* numberEnd = 0;
+		const unsigned long numberOfClusters = ( separator == string::npos ) ? 0 :
+			strtoul( line.c_str() + separator + 1, &numberEnd, 10 );
+		if( numberOfClusters == 0 || *numberEnd != '\0' ) {
+			ostringstream message;
+			message << "bad manifest line " << lineNumber << "!";
+			throw domain_error( message.str() );
+		}
+		CBatchTask task;
+		task.Filename = line.substr( 0, line.find_last_not_of( " \t", separator ) + 1 );
+		task.Filename.erase( 0, task.Filename.find_first_not_of( " \t" ) );
+		task.NumberOfClusters = static_cast<size_t>( numberOfClusters );
+		tasks.push_back( task );
+	}
+}
+
+// Orders tasks from the largest work.
+struct CLargerWork {
+	const vector<CBatchTask>& Tasks;
+
+	explicit CLargerWork( const vector<CBatchTask>& tasks ) : Tasks( tasks ) {}
+
+	bool operator()( size_t first, size_t second ) const
+	{
+		return Tasks[first].Work > Tasks[second].Work;
+	}
+};
+
+// Assigns tasks to processes from the largest one, each task goes to the
+// least loaded process. Work of a task is estimated by the size of its
+// file, which is proportional to the number of vectors, as
+// NUMBER_OF_CLUSTERS * SIZE^2. Sizes are read by the process of rank 0, so
+// the file system is not queried by all processes, and all processes get
+// the same schedule. Returns order of tasks of this process.
+static void ScheduleTasks( vector<CBatchTask>& tasks, vector<size_t>& order )
+{
+	if( tasks.empty() ) {
+		order.clear();
+		return;
+	}
+	vector<double> sizes( tasks.size(), 0 );
+	if( CMpiSupport::Rank() == 0 ) {
+		for( size_t i = 0; i < tasks.size(); i++ ) {
+			struct stat fileStatus;
+			if( stat( tasks[i].Filename.c_str(), &fileStatus ) == 0 ) {
+				sizes[i] = static_cast<double>( fileStatus.st_size );
+			}
+		}
+	}
+	if( tasks.size() > static_cast<size_t>( numeric_limits<int>::max() ) ) {
+		throw domain_error( "too many tasks in manifest!" );
+	}
+	MpiCheck( MPI_Bcast( &sizes[0], static_cast<int>( sizes.size() ), MPI_DOUBLE, 0,
+		MPI_COMM_WORLD ), "MPI_Bcast for sizes of batch files" );
+	for( size_t i = 0; i < tasks.size(); i++ ) {
+		tasks[i].Work = tasks[i].NumberOfClusters * sizes[i] * sizes[i];
+	}
+	vector<size_t> allOrder( tasks.size() );
+	for( size_t i = 0; i < allOrder.size(); i++ ) {
+		allOrder[i] = i;
+	}
+	stable_sort( allOrder.begin(), allOrder.end(), CLargerWork( tasks ) );
+
+	vector<double> loads( CMpiSupport::NumberOfProccess(), 0 );
+	order.clear();
+	for( size_t i = 0; i < allOrder.size(); i++ ) {
+		CBatchTask& task = tasks[allOrder[i]];
+		task.Rank = min_element( loads.begin(), loads.end() ) - loads.begin();
+		loads[task.Rank] += task.Work;
+		if( task.Rank == CMpiSupport::Rank() ) {
+			order.push_back( allOrder[i] );
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Clusters tasks of this process one by one, the matrix of the first task
+// is rebuilt for the next ones, so its memory is allocated once.
+class CBatchWorker {
+private:
+	CBatchWorker( const CBatchWorker& );
+	CBatchWorker& operator=( const CBatchWorker& );
+
+public:
+	CBatchWorker( const CClusteringOptions& _options, bool _withClusters ) :
+		options( _options ),
+		withClusters( _withClusters ),
+		dissimilarities( 0 )
+	{
+	}
+	~CBatchWorker() { delete dissimilarities; }
+
+	// Makes line of result, returns false if the task failed.
+	bool Run( const CBatchTask& task, string& resultLine );
+
+private:
+	CClusteringOptions options;
+	const bool withClusters;
+	vector<DistanceType> coordinates;
+	CVectorsDissimilarities* dissimilarities;
+
+	void run( const CBatchTask& task, ostream& result );
+};
+
+bool CBatchWorker::Run( const CBatchTask& task, string& resultLine )
+{
+	bool succeeded = true;
+	ostringstream result;
+	result.precision( numeric_limits<double>::digits10 );
+	result << task.Filename << "\t" << task.NumberOfClusters << "\t";
+	try {
+		ostringstream taskResult;
+		taskResult.precision( numeric_limits<double>::digits10 );
+		run( task, taskResult );
+		result << "ok\t" << taskResult.str();
+	} catch( exception& e ) {
+		// the matrix may be partially built
+		delete dissimilarities;
+		dissimilarities = 0;
+		result << "error\t" << e.what();
+		succeeded = false;
+	}
+	result << "\n";
+	resultLine = result.str();
+	return succeeded;
+}
+
+void CBatchWorker::run( const CBatchTask& task, ostream& result )
+{
+	size_t numberOfVectors = 0;
+	size_t dimension = 0;
+	ReadVectorsFile( task.Filename, coordinates, numberOfVectors, dimension );
+	const DistanceType* const vectorsCoordinates = coordinates.empty() ? 0 : &coordinates[0];
+	if( dissimilarities == 0 ) {
+		dissimilarities = new CVectorsDissimilarities( vectorsCoordinates,
+			numberOfVectors, dimension, options );
+	} else {
+		dissimilarities->Reset( vectorsCoordinates, numberOfVectors, dimension );
+	}
+
+	options.NumberOfClusters = task.NumberOfClusters;
+	const CClusteringResult clustering = dissimilarities->Cluster( options );
+	CPamResult pamResult;
+	pamResult.StopReason = clustering.StopReason;
+	result << clustering.Cost << "\t" << pamResult.StopReasonName()
+		<< "\t" << clustering.Iterations << "\t";
+	for( size_t i = 0; i < clustering.Medoids.size(); i++ ) {
+		result << ( i > 0 ? " " : "" ) << clustering.Medoids[i];
+	}
+	if( withClusters ) {
+		result << "\t";
+		for( size_t i = 0; i < clustering.Clusters.size(); i++ ) {
+			result << ( i > 0 ? " " : "" ) << clustering.Clusters[i];
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Writes results of tasks to one file in order of manifest, each process
+// writes results of its tasks. Must be called by all processes.
+static void WriteResults( const string& filename, const vector<CBatchTask>& tasks,
+	const vector<string>& results )
+{
+	vector<uint64_t> sizes( tasks.size(), 0 );
+	for( size_t i = 0; i < tasks.size(); i++ ) {
+		sizes[i] = results[i].size();
+	}
+	if( !sizes.empty() ) {
+		MpiCheck( MPI_Allreduce( MPI_IN_PLACE, &sizes[0], static_cast<int>( sizes.size() ),
+			MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD ), "MPI_Allreduce for results sizes" );
+	}
+
+	MPI_File file;
+	if( MPI_File_open( MPI_COMM_WORLD, const_cast<char*>( filename.c_str() ),
+		MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file ) != MPI_SUCCESS )
+	{
+		throw domain_error( "cannot write results file '" + filename + "'!" );
+	}
+	uint64_t offset = 0;
+	for( size_t i = 0; i < tasks.size(); i++ ) {
+		offset += sizes[i];
+	}
+	// errors are gathered before closing, so all processes throw together
+	int failed = ( MPI_File_set_size( file, static_cast<MPI_Offset>( offset ) )
+		== MPI_SUCCESS ) ? 0 : 1;
+	offset = 0;
+	for( size_t i = 0; i < tasks.size(); i++ ) {
+		if( tasks[i].Rank == CMpiSupport::Rank() && !results[i].empty() ) {
+			assert( results[i].size() <= INT_MAX );
+			const int count = static_cast<int>( results[i].size() );
+			MPI_Status status;
+			int written = 0;
+			if( MPI_File_write_at( file, static_cast<MPI_Offset>( offset ),
+					const_cast<char*>( results[i].data() ), count, MPI_CHAR, &status )
+					!= MPI_SUCCESS
+				|| MPI_Get_count( &status, MPI_CHAR, &written ) != MPI_SUCCESS
+				|| written != count )
+			{
+				failed = 1;
+			}
+		}
+		offset += sizes[i];
+	}
+	MpiCheck( MPI_Allreduce( MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD ),
+		"MPI_Allreduce for results file" );
+	MPI_File_close( &file );
+	if( failed != 0 ) {
+		throw domain_error( "cannot write results file '" + filename + "'!" );
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+const char* const Usage =
+	"Usage: pam_batch [OPTIONS] MANIFEST_FILENAME RESULTS_FILENAME\n"
+	"Clusters many small vectors files given by lines 'FILENAME K' of manifest,\n"
+	"each file is clustered to K clusters by one process. Files are scheduled\n"
+	"from the largest one. Results file has a line for each manifest line\n"
+	"'FILENAME<TAB>K<TAB>ok<TAB>COST<TAB>STOP_REASON<TAB>ITERATIONS<TAB>MEDOIDS'\n"
+	"or 'FILENAME<TAB>K<TAB>error<TAB>MESSAGE', medoids are separated by spaces.\n"
+	"Options:\n"
+	"  --max-iterations=N      do at most N swap steps (default: 1000)\n"
+	"  --min-improvement=R     stop when a swap improves cost by less than R * cost\n"
+	"  --time-limit=SECONDS    stop swapping a file after SECONDS of clustering\n"
+	"  --metric=NAME           dissimilarity of vectors as of pam (default: euclidean)\n"
+	"  --matrix=dense|quantized|lazy|knn\n"
+	"                          storage of dissimilarity matrix (default: dense)\n"
+	"  --row-cache=MIB         rows of lazy matrix (default: 256)\n"
+	"  --neighbors=M           nearest neighbors of knn matrix (default: 32)\n"
+	"  --cap-non-neighbors     distances to non-neighbors of knn matrix are capped\n"
+	"  --clusters              append clusters of vectors separated by spaces";
+
+void DoMain( const int argc, const char* const argv[] )
+{
+	const CCommandLine commandLine( argc, argv );
+	if( commandLine.NumberOfArguments() != 2 ) {
+		throw invalid_argument( Usage );
+	}
+	CClusteringOptions options;
+	options.StopCriteria.MaxIterations = commandLine.SizeOption( "max-iterations",
+		options.StopCriteria.MaxIterations );
+	options.StopCriteria.MinRelativeImprovement = commandLine.DoubleOption( "min-improvement",
+		options.StopCriteria.MinRelativeImprovement );
+	options.StopCriteria.TimeLimit = commandLine.DoubleOption( "time-limit",
+		options.StopCriteria.TimeLimit );
+	options.Metric = commandLine.Option( "metric", options.Metric );
+	options.Matrix = ParseMatrixType( commandLine.Option( "matrix", "dense" ) );
+	options.RowCacheSize = commandLine.SizeOption( "row-cache", options.RowCacheSize >> 20 ) << 20;
+	options.NumberOfNeighbors = commandLine.SizeOption( "neighbors", options.NumberOfNeighbors );
+	options.CapNonNeighbors = commandLine.HasOption( "cap-non-neighbors" );
+	const bool withClusters = commandLine.HasOption( "clusters" );
+	commandLine.CheckUnknownOptions();
+
+	const double startTime = WallTime();
+	vector<CBatchTask> tasks;
+	ReadManifest( commandLine.Argument( 0 ), tasks );
+	vector<size_t> order;
+	ScheduleTasks( tasks, order );
+
+	CBatchWorker worker( options, withClusters );
+	vector<string> results( tasks.size() );
+	uint64_t failures[2] = { 0, 0 };
+	for( size_t i = 0; i < order.size(); i++ ) {
+		if( !worker.Run( tasks[order[i]], results[order[i]] ) ) {
+			failures[0]++;
+		}
+	}
+	MpiCheck( MPI_Reduce( &failures[0], &failures[1], 1, MPI_UINT64_T, MPI_SUM, 0,
+		MPI_COMM_WORLD ), "MPI_Reduce for failed tasks" );
+	const double clusteringTime = WallTime();
+
+	WriteResults( commandLine.Argument( 1 ), tasks, results );
+
+	if( CMpiSupport::Rank() == 0 ) {
+		cout << "tasks\t" << tasks.size() << endl;
+		cout << "failed tasks\t" << failures[1] << endl;
+		cout << "clustering time\t" << clusteringTime - startTime << endl;
+		cout << "total time\t" << WallTime() - startTime << endl;
+	}
+}
+
+int main( int argc, char** argv )
+{
+	try {
+		CMpiSupport::Initialize( &argc, &argv );
+		DoMain( argc, argv );
+		CMpiSupport::Finalize();
+	} catch( exception& e ) {
+		cerr << "Error: " << e.what() << endl;
+		CMpiSupport::Abort( 1 );
+		return 1;
+	} catch( ... ) {
+		cerr << "Unknown error!" << endl;
+		CMpiSupport::Abort( 2 );
+		return 2;
+	}
+
+	return 0;
+}
@@ -0,0 +1,180 @@
+#include <cassert>
+#include <limits>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <fstream>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <stddef.h>
+#include <sys/time.h>
+
+using namespace std;
+
+#include <MpiSupport.h>
+#include <PamEngine.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+double WallTime()
+{
+	timeval time;
+	gettimeofday( &time, 0 );
+	return time.tv_sec + time.tv_usec * 1e-6;
+}
+
+void CalcBeginEndObjects(
+	const size_t numberOfObjects, const size_t numberOfProcess, const size_t rank,
+	size_t& beginObject, size_t& endObject )
+{
+	const size_t objectsPerProcess = numberOfObjects / numberOfProcess;
+	const size_t additionalObjects = numberOfObjects % numberOfProcess;
+	beginObject = objectsPerProcess * rank + min( rank, additionalObjects );
+	endObject = beginObject + objectsPerProcess;
+	if( rank < additionalObjects ) {
+		endObject++;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void CObjectMedoidDistance::Min( const CObjectMedoidDistance& another )
+{
+	const unsigned long int stop = ( Stop != 0 || another.Stop != 0 ) ? 1 : 0;
+	const unsigned long int visited = Visited + another.Visited;
+	const unsigned long int skipped = Skipped + another.Skipped;
+	if( another.Distance < Distance ) {
+		*this = another;
+	}
+	Stop = stop;
+	Visited = visited;
+	Skipped = skipped;
+}
+
+void CObjectMedoidDistance::AllReduce()
+{
+	MpiCheck( MPI_Allreduce( MPI_IN_PLACE, this, 1 /* count */, datatype(), op(), MPI_COMM_WORLD ),
+		"MPI_Allreduce for CObjectMedoidDistance" );
+}
+
+MPI_Datatype CObjectMedoidDistance::datatype()
+{
+	static MPI_Datatype type = MPI_DATATYPE_NULL;
+	if( type == MPI_DATATYPE_NULL ) {
+		const int count = 6;
+		int blocklengths[count] = { 1, 1, 1, 1, 1, 1 };
+		MPI_Datatype types[count] = { MPI_UNSIGNED_LONG, MPI_UNSIGNED_LONG, MPI_FLOAT,
+			MPI_UNSIGNED_LONG, MPI_UNSIGNED_LONG, MPI_UNSIGNED_LONG };
+		MPI_Aint offsets[count] = {
+			offsetof( CObjectMedoidDistance, Object ),
+			offsetof( CObjectMedoidDistance, Medoid ),
+			offsetof( CObjectMedoidDistance, Distance ),
+			offsetof( CObjectMedoidDistance, Stop ),
+			offsetof( CObjectMedoidDistance, Visited ),
+			offsetof( CObjectMedoidDistance, Skipped ) };
+		MpiCheck( MPI_Type_create_struct( count, blocklengths, offsets, types, &type ),
+			"MPI_Type_create_struct for CObjectMedoidDistance" );
+		MpiCheck( MPI_Type_commit( &type ), "MPI_Type_commit for CObjectMedoidDistance" );
+	}
+	return type;
+}
+
+MPI_Op CObjectMedoidDistance::op()
+{
+	static MPI_Op op = MPI_OP_NULL;
+	if( op == MPI_OP_NULL ) {
+		MpiCheck( MPI_Op_create( objectMedoidDistanceMin,
+			false /* commute */, &op ), "MPI_Op_create for CObjectMedoidDistance" );
+	}
+	return op;
+}
+
+void MPIAPI CObjectMedoidDistance::objectMedoidDistanceMin(
+	void* _in, void* _inout,
+	int* length, MPI_Datatype* /*type*/ )
+{
+	CObjectMedoidDistance* in = reinterpret_cast<CObjectMedoidDistance*>( _in );
+	CObjectMedoidDistance* inout = reinterpret_cast<CObjectMedoidDistance*>( _inout );
+	for( int i = 0; i < *length; i++ ) {
+		inout[i].Min( in[i] );
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+const char* CPamResult::StopReasonName() const
+{
+	switch( StopReason ) {
+		case NotStopped:
+			return "not stopped";
+		case Converged:
+			return "converged";
+		case MaxIterationsReached:
+			return "max iterations reached";
+		case SmallImprovement:
+			return "small improvement";
+		case TimeLimitReached:
+			return "time limit reached";
+	}
+	assert( false );
+	return "";
+}
+
+void CPamCheckpoint::Save( const string& filename ) const
+{
+	// the previous checkpoint is replaced only by a completely written one
+	const string temporaryFilename = filename + ".tmp";
+	{
+		ofstream output( temporaryFilename.c_str() );
+		output << NumberOfObjects << " " << NumberOfClusters << " "
+			<< Iterations << " " << Medoids.size();
+		for( size_t i = 0; i < Medoids.size(); i++ ) {
+			output << " " << Medoids[i];
+		}
+		output << endl;
+		if( output.fail() ) {
+			throw domain_error( "cannot write checkpoint file '" + temporaryFilename + "'!" );
+		}
+	}
+	if( rename( temporaryFilename.c_str(), filename.c_str() ) != 0 ) {
+		throw domain_error( "cannot write checkpoint file '" + filename + "'!" );
+	}
+}
+
+void CPamCheckpoint::Load( const string& filename )
+{
+	vector<unsigned long int> buffer;
+	if( CMpiSupport::Rank() == 0 ) {
+		ifstream input( filename.c_str() );
+		size_t numberOfMedoids = 0;
+		input >> NumberOfObjects >> NumberOfClusters >> Iterations >> numberOfMedoids;
+		Medoids.resize( numberOfMedoids );
+		for( size_t i = 0; i < Medoids.size(); i++ ) {
+			input >> Medoids[i];
+		}
+		if( !input.fail() ) {
+			buffer.push_back( NumberOfObjects );
+			buffer.push_back( NumberOfClusters );
+			buffer.push_back( Iterations );
+			buffer.insert( buffer.end(), Medoids.begin(), Medoids.end() );
+		}
+	}
+
+	unsigned long int size = buffer.size();
+	MpiCheck( MPI_Bcast( &size, 1, MPI_UNSIGNED_LONG, 0, MPI_COMM_WORLD ),
+		"MPI_Bcast for CPamCheckpoint" );
+	if( size == 0 ) {
+		throw domain_error( "bad checkpoint file '" + filename + "'!" );
+	}
+	buffer.resize( size );
+	MpiCheck( MPI_Bcast( &buffer[0], static_cast<int>( size ), MPI_UNSIGNED_LONG,
+		0, MPI_COMM_WORLD ), "MPI_Bcast for CPamCheckpoint" );
+
+	NumberOfObjects = buffer[0];
+	NumberOfClusters = buffer[1];
+	Iterations = buffer[2];
+	Medoids.assign( buffer.begin() + 3, buffer.end() );
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,302 @@
+#pragma once
+
+#include <mpi.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Dissimilarities of objects, they are passed by MPI as MPI_FLOAT.
+typedef float DistanceType;
+
+// Seconds since an arbitrary moment, does not require MPI.
+double WallTime();
+
+void CalcBeginEndObjects(
+	const size_t numberOfObjects, const size_t numberOfProcess, const size_t rank,
+	size_t& beginObject, size_t& endObject );
+
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MPIAPI
+#define MPIAPI
+#endif
+
+struct CObjectMedoidDistance {
+	unsigned long int Object;
+	unsigned long int Medoid;
+	DistanceType Distance;
+	// Nonzero if any worker asks to stop, reduced by logical or.
+	unsigned long int Stop;
+	// Objects visited and skipped by the step, reduced by sum.
+	unsigned long int Visited;
+	unsigned long int Skipped;
+
+	CObjectMedoidDistance() :
+		Object( 0 ),
+		Medoid( 0 ),
+		Distance( 0 ),
+		Stop( 0 ),
+		Visited( 0 ),
+		Skipped( 0 )
+	{
+	}
+
+	void Min( const CObjectMedoidDistance& another );
+	void AllReduce();
+
+private:
+	static MPI_Datatype datatype();
+	static MPI_Op op();
+	static void MPIAPI objectMedoidDistanceMin( void* in, void* inout,
+		int* length, MPI_Datatype* /*type*/ );
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Criteria to stop swapping, besides absence of improving swaps.
+struct CStopCriteria {
+	size_t MaxIterations;
+	// Swapping stops if a swap improves cost by less than this part of it.
+	double MinRelativeImprovement;
+	// Swapping stops after this number of seconds of clustering, 0 - no limit.
+	double TimeLimit;
+
+	CStopCriteria() :
+		MaxIterations( 1000 ),
+		MinRelativeImprovement( 0 ),
+		TimeLimit( 0 )
+	{
+	}
+};
+
+struct CPamResult {
+	enum StopReasonType {
+		NotStopped,
+		Converged,
+		MaxIterationsReached,
+		SmallImprovement,
+		TimeLimitReached
+	};
+
+	StopReasonType StopReason;
+	// Number of swap steps.
+	size_t Iterations;
+	DistanceType Cost;
+	// Objects visited and skipped by building and swapping, objects are
+	// skipped only by scans of sorted neighbors.
+	size_t VisitedObjects;
+	size_t SkippedObjects;
+
+	CPamResult() :
+		StopReason( NotStopped ),
+		Iterations( 0 ),
+		Cost( 0 ),
+		VisitedObjects( 0 ),
+		SkippedObjects( 0 )
+	{
+	}
+
+	const char* StopReasonName() const;
+};
+
+// State of PAM, saved periodically by rank 0 to restart a failed run.
+struct CPamCheckpoint {
+	size_t NumberOfObjects;
+	size_t NumberOfClusters;
+	// Number of swap steps done.
+	size_t Iterations;
+	// All medoids when swapping, medoids found so far when building.
+	vector<size_t> Medoids;
+
+	CPamCheckpoint() :
+		NumberOfObjects( 0 ),
+		NumberOfClusters( 0 ),
+		Iterations( 0 )
+	{
+	}
+
+	void Save( const string& filename ) const;
+	// Loads checkpoint on rank 0 and broadcasts it to all ranks.
+	void Load( const string& filename );
+};
+
+// Saves checkpoints of PAM on rank 0 not more often than once per interval.
+class CPamCheckpointer {
+private:
+	CPamCheckpointer( const CPamCheckpointer& );
+	CPamCheckpointer& operator=( const CPamCheckpointer& );
+
+public:
+	// Does nothing if filename is empty.
+	CPamCheckpointer( const string& _filename, double _interval ) :
+		filename( _filename ),
+		interval( _interval ),
+		lastTime( WallTime() )
+	{
+	}
+
+	// Saves checkpoint if the interval passed since the last one or if forced.
+	template<typename PAM_TYPE>
+	void Checkpoint( const PAM_TYPE& pam, size_t iterations, bool force = false );
+
+private:
+	const string filename;
+	const double interval;
+	double lastTime;
+};
+
+template<typename PAM_TYPE>
+void CPamCheckpointer::Checkpoint( const PAM_TYPE& pam, size_t iterations, bool force )
+{
+	if( filename.empty() || CMpiSupport::Rank() != 0 ) {
+		return;
+	}
+	const double time = WallTime();
+	if( force || time - lastTime >= interval ) {
+		CPamCheckpoint checkpoint;
+		checkpoint.NumberOfObjects = pam.NumberOfObjects();
+		checkpoint.NumberOfClusters = pam.NumberOfClusters();
+		checkpoint.Iterations = iterations;
+		checkpoint.Medoids = pam.Medoids();
+		checkpoint.Save( filename );
+		lastTime = time;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Initializing or Build  step
+template<typename PAM_TYPE>
+void DoBuildStep( PAM_TYPE& pam, CObjectMedoidDistance& best,
+	const size_t objectBegin, const size_t objectEnd )
+{
+	best.Distance = numeric_limits<DistanceType>::max();
+	best.Object = objectBegin;
+	best.Visited = 0;
+	best.Skipped = 0;
+	for( size_t object = objectBegin; object < objectEnd; object++ ) {
+		if( pam.IsMedoid( object ) ) {
+			continue; // if object is medoid
+		}
+
+		size_t visited = pam.NumberOfObjects();
+		const DistanceType distance = ( pam.State() == PAM_TYPE::Initializing ) ?
+			pam.FindObjectDistanceToAll( object, visited ) :
+			-pam.AddMedoidProfit( object, visited );
+		best.Visited += visited;
+		best.Skipped += pam.NumberOfObjects() - visited;
+
+		if( distance < best.Distance ) {
+			best.Distance = distance;
+			best.Object = object;
+		}
+	}
+}
+
+// Swap step
+template<typename PAM_TYPE>
+void DoSwapStep( PAM_TYPE& pam, CObjectMedoidDistance& best,
+	const size_t objectBegin, const size_t objectEnd )
+{
+	best.Distance = 0;
+	best.Medoid = pam.Medoids().front();
+	best.Object = objectBegin;
+	best.Visited = pam.UpdateSwapCache( objectBegin, objectEnd );
+	best.Skipped = 0;
+
+	vector<DistanceType> results( pam.Medoids().size() );
+	for( size_t object = objectBegin; object < objectEnd; object++ ) {
+		if( pam.IsMedoid( object ) ) {
+			continue; // if object is medoid
+		}
+
+		size_t visited = 0;
+		pam.SwapResults( object, &results[0], visited );
+		best.Visited += visited;
+		best.Skipped += results.size() * pam.NumberOfObjects() - visited;
+		for( size_t i = 0; i < results.size(); i++ ) {
+			if( results[i] < best.Distance ) {
+				best.Distance = results[i];
+				best.Medoid = pam.Medoids()[i];
+				best.Object = object;
+			}
+		}
+	}
+	// cached results are sums updated by many swaps, so the best one is
+	// calculated again not to swap by rounding errors
+	if( pam.HasSwapCache() && best.Distance < 0 ) {
+		best.Distance = pam.SwapResult( best.Medoid, best.Object );
+	}
+}
+
+// Swap steps are counted from iterations done before. The process steps
+// objects [objectBegin, objectEnd), the best steps of all processes are
+// reduced if distributed, otherwise objects must be all objects.
+template<typename PAM_TYPE>
+CPamResult RunPam( PAM_TYPE& pam, const CStopCriteria& stopCriteria,
+	CPamCheckpointer& checkpointer, const size_t iterations,
+	const size_t objectBegin, const size_t objectEnd, const bool distributed = true )
+{
+	const double deadline = WallTime() + stopCriteria.TimeLimit;
+	CObjectMedoidDistance best;
+	CPamResult result;
+
+	// Building and Initializing, skipped if medoids were set
+	for( size_t i = pam.Medoids().size(); i < pam.NumberOfClusters(); i++ ) {
+#ifdef _DEBUG
+		cout << CMpiSupport::Rank() << " ["
+			<< objectBegin << ", " << objectEnd << ") "
+			<< "Building..." << i << endl;
+#endif
+		DoBuildStep( pam, best, objectBegin, objectEnd );
+		if( distributed ) {
+			best.AllReduce();
+		}
+		result.VisitedObjects += best.Visited;
+		result.SkippedObjects += best.Skipped;
+
+		pam.AddMedoid( best.Object );
+		checkpointer.Checkpoint( pam, iterations );
+	}
+
+	// Swapping
+	result.Iterations = iterations;
+	result.Cost = pam.Cost();
+	while( result.StopReason == CPamResult::NotStopped ) {
+		if( result.Iterations >= stopCriteria.MaxIterations ) {
+			result.StopReason = CPamResult::MaxIterationsReached;
+			break;
+		}
+#ifdef _DEBUG
+		cout << CMpiSupport::Rank()
+			<< " Swapping..." << result.Iterations << endl;
+#endif
+		DoSwapStep( pam, best, objectBegin, objectEnd );
+		best.Stop = ( stopCriteria.TimeLimit > 0 && WallTime() >= deadline ) ? 1 : 0;
+		if( distributed ) {
+			best.AllReduce();
+		}
+		result.Iterations++;
+		result.VisitedObjects += best.Visited;
+		result.SkippedObjects += best.Skipped;
+
+		if( !( best.Distance < 0 ) ) {
+			result.StopReason = CPamResult::Converged;
+			break;
+		}
+
+		pam.Swap( best.Medoid, best.Object );
+		checkpointer.Checkpoint( pam, result.Iterations );
+		const DistanceType improvement = -best.Distance;
+		if( best.Stop != 0 ) {
+			result.StopReason = CPamResult::TimeLimitReached;
+		} else if( improvement < stopCriteria.MinRelativeImprovement * result.Cost ) {
+			result.StopReason = CPamResult::SmallImprovement;
+		}
+		result.Cost -= improvement;
+	}
+	checkpointer.Checkpoint( pam, result.Iterations, true /* force */ );
+	result.Cost = pam.Cost();
+	return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
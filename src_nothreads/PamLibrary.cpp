@@ -0,0 +1,1056 @@
+#include <cmath>
+#include <cassert>
+#include <climits>
+#include <limits>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <stdint.h>
+
+using namespace std;
+
+#include <MpiSupport.h>
+#include <Metrics.h>
+#include <PamEngine.h>
+#include <NumaSupport.h>
+#include <DissimilarityMatrix.h>
+#include <QuantizedDissimilarityMatrix.h>
+#include <LazyDissimilarityMatrix.h>
+#include <KnnDissimilarityMatrix.h>
+#include <SortedNeighbors.h>
+#include <PartitioningAroundMedoids.h>
+#include <PamLibrary.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Rows of dissimilarity matrix of vectors given by consecutive rows of
+// coordinates of the caller.
+template<typename METRIC>
+class CCoordinatesRowCalculator : public CRowCalculator<DistanceType> {
+public:
+	CCoordinatesRowCalculator( const DistanceType* _coordinates,
+			size_t _numberOfVectors, size_t _dimension ) :
+		coordinates( _coordinates ),
+		numberOfVectors( _numberOfVectors ),
+		dimension( _dimension )
+	{
+	}
+
+	virtual size_t Size() const { return numberOfVectors; }
+
+	virtual void Calculate( size_t row, DistanceType* distances ) const
+	{
+		METRIC::Distances( coordinates + row * dimension, coordinates,
+			numberOfVectors, dimension, distances );
+		distances[row] = 0;
+	}
+
+private:
+	const DistanceType* const coordinates;
+	const size_t numberOfVectors;
+	const size_t dimension;
+};
+
+// Distances of vectors given by consecutive rows of coordinates of the caller
+// for graph of nearest neighbors.
+template<typename METRIC>
+class CCoordinatesDistanceCalculator : public CDistanceCalculator<DistanceType> {
+public:
+	CCoordinatesDistanceCalculator( const DistanceType* _coordinates,
+			size_t _numberOfVectors, size_t _dimension ) :
+		coordinates( _coordinates ),
+		numberOfVectors( _numberOfVectors ),
+		dimension( _dimension )
+	{
+	}
+
+	virtual size_t Size() const { return numberOfVectors; }
+
+	virtual void CalculateRow( size_t object, DistanceType* distances ) const
+	{
+		METRIC::Distances( coordinates + object * dimension, coordinates,
+			numberOfVectors, dimension, distances );
+		distances[object] = 0;
+	}
+
+	virtual DistanceType Calculate( size_t object1, size_t object2 ) const
+	{
+		return METRIC::Distance( coordinates + object1 * dimension,
+			coordinates + object2 * dimension, dimension );
+	}
+
+private:
+	const DistanceType* const coordinates;
+	const size_t numberOfVectors;
+	const size_t dimension;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Sums of distances from each object to all objects are summed while rows
+// are calculated as CDissimilarityMatrixBuilder does, they are empty if the
+// matrix does not keep distances exactly.
+template<typename DISSIMILARITY_MATRIX_TYPE>
+static void BuildMatrix( const CRowCalculator<DistanceType>& calculator,
+	DISSIMILARITY_MATRIX_TYPE& matrix, vector<DistanceType>& distancesToAll )
+{
+	const size_t size = calculator.Size();
+	const size_t blockSize = DISSIMILARITY_MATRIX_TYPE::RowsBlockSize;
+	matrix.Reset( size );
+	distancesToAll.resize( size );
+	bool isExact = true;
+	vector<DistanceType> rows;
+	for( size_t firstRow = 0; firstRow < size; firstRow += blockSize ) {
+		const size_t numberOfRows = min( firstRow + blockSize, size ) - firstRow;
+		rows.resize( numberOfRows * size );
+		for( size_t i = 0; i < numberOfRows; i++ ) {
+			DistanceType* const row = &rows[i * size];
+			calculator.Calculate( firstRow + i, row );
+			DistanceType distance = 0;
+			for( size_t j = 0; j < size; j++ ) {
+				distance += row[j];
+			}
+			distancesToAll[firstRow + i] = distance;
+		}
+		matrix.SetRows( firstRow, numberOfRows, &rows[0] );
+		for( size_t i = 0; i < numberOfRows; i++ ) {
+			isExact = isExact && ( matrix.MaxError( firstRow + i ) == 0 );
+		}
+	}
+	if( !isExact ) {
+		vector<DistanceType>().swap( distancesToAll );
+	}
+}
+
+// Rank of the process and number of processes sharing the work.
+static void GetProcesses( const CClusteringOptions& options,
+	size_t& rank, size_t& numberOfProcesses )
+{
+	rank = 0;
+	numberOfProcesses = 1;
+	if( options.Distributed ) {
+		int initialized = 0;
+		MPI_Initialized( &initialized );
+		if( initialized == 0 ) {
+			throw logic_error( "distributed clustering requires initialized MPI!" );
+		}
+		int mpiRank = 0;
+		int mpiSize = 0;
+		MpiCheck( MPI_Comm_rank( MPI_COMM_WORLD, &mpiRank ), "MPI_Comm_rank" );
+		MpiCheck( MPI_Comm_size( MPI_COMM_WORLD, &mpiSize ), "MPI_Comm_size" );
+		rank = static_cast<size_t>( mpiRank );
+		numberOfProcesses = static_cast<size_t>( mpiSize );
+	}
+}
+
+// Distances to all are sums of distances from each object to all objects
+// calculated with the matrix, they are used if objects are not weighted.
+template<typename DISSIMILARITY_MATRIX_TYPE>
+static CClusteringResult ClusterMatrix( const DISSIMILARITY_MATRIX_TYPE& matrix,
+	const vector<DistanceType>& distancesToAll, const CClusteringOptions& options )
+{
+	size_t rank = 0;
+	size_t numberOfProcesses = 1;
+	GetProcesses( options, rank, numberOfProcesses );
+
+	CPartitioningAroundMedois<DISSIMILARITY_MATRIX_TYPE> pam( matrix, options.NumberOfClusters );
+	if( !options.Weights.empty() ) {
+		pam.SetWeights( options.Weights );
+	} else if( !distancesToAll.empty() ) {
+		pam.SetDistancesToAll( distancesToAll );
+	}
+	if( options.SortedNeighbors > 0 && options.SwapCache ) {
+		throw domain_error( "sorted neighbors and swap cache are incompatible!" );
+	}
+	if( options.SwapCache ) {
+		pam.EnableSwapCache();
+	}
+	CSortedNeighbors<DistanceType> sortedNeighbors;
+	if( options.SortedNeighbors > 0 ) {
+		sortedNeighbors.Build( matrix, options.SortedNeighbors, rank, numberOfProcesses );
+		pam.SetSortedNeighbors( sortedNeighbors );
+	}
+	if( !options.InitialMedoids.empty() ) {
+		pam.SetMedoids( options.InitialMedoids );
+	}
+	size_t objectBegin = 0;
+	size_t objectEnd = 0;
+	CalcBeginEndObjects( pam.NumberOfObjects(), numberOfProcesses, rank,
+		objectBegin, objectEnd );
+
+	CPamCheckpointer checkpointer( "" /* no checkpoints */, 0 );
+	const CPamResult pamResult = RunPam( pam, options.StopCriteria, checkpointer,
+		0 /* iterations */, objectBegin, objectEnd, options.Distributed );
+
+	CClusteringResult result;
+	result.Medoids = pam.Medoids();
+	vector<uint32_t> medoidClusters( pam.NumberOfObjects() );
+	for( size_t i = 0; i < result.Medoids.size(); i++ ) {
+		medoidClusters[result.Medoids[i]] = static_cast<uint32_t>( i );
+	}
+	result.Clusters.resize( pam.NumberOfObjects() );
+	for( size_t object = 0; object < pam.NumberOfObjects(); object++ ) {
+		result.Clusters[object] = medoidClusters[pam.ObjectMedoids()[object]];
+	}
+	result.Cost = pamResult.Cost;
+	result.StopReason = pamResult.StopReason;
+	result.Iterations = pamResult.Iterations;
+	return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Builds matrix of vectors given by consecutive rows of dimension coordinates,
+// memory of the previous matrix is reused. Processes share building of
+// matrices, which support it.
+template<typename METRIC, typename DISSIMILARITY_MATRIX_TYPE>
+static void BuildVectorsMatrix( const DistanceType* coordinates, size_t numberOfVectors,
+	size_t dimension, size_t /* rank */, size_t /* numberOfProcesses */,
+	DISSIMILARITY_MATRIX_TYPE& matrix, vector<DistanceType>& distancesToAll )
+{
+	BuildMatrix( CCoordinatesRowCalculator<METRIC>( coordinates, numberOfVectors, dimension ),
+		matrix, distancesToAll );
+}
+
+template<typename METRIC>
+static void BuildVectorsMatrix( const DistanceType* coordinates, size_t numberOfVectors,
+	size_t dimension, size_t /* rank */, size_t /* numberOfProcesses */,
+	CLazyDissimilarityMatrix<DistanceType>& matrix,
+	vector<DistanceType>& distancesToAll )
+{
+	distancesToAll.clear();
+	matrix.SetCalculator(
+		new CCoordinatesRowCalculator<METRIC>( coordinates, numberOfVectors, dimension ) );
+}
+
+template<typename METRIC>
+static void BuildVectorsMatrix( const DistanceType* coordinates, size_t numberOfVectors,
+	size_t dimension, size_t rank, size_t numberOfProcesses,
+	CKnnDissimilarityMatrix<DistanceType>& matrix, vector<DistanceType>& distancesToAll )
+{
+	distancesToAll.clear();
+	matrix.SetCalculator(
+		new CCoordinatesDistanceCalculator<METRIC>( coordinates, numberOfVectors, dimension ),
+		rank, numberOfProcesses );
+}
+
+// Dissimilarity matrix of CVectorsDissimilarities.
+class CClusteringMatrix {
+public:
+	virtual ~CClusteringMatrix() {}
+	virtual size_t Size() const = 0;
+	// All processes call it if there are more than one.
+	virtual void Build( const DistanceType* coordinates, size_t numberOfVectors,
+		size_t dimension, size_t rank, size_t numberOfProcesses ) = 0;
+	virtual CClusteringResult Cluster( const CClusteringOptions& options ) const = 0;
+};
+
+template<typename DISSIMILARITY_MATRIX_TYPE, typename METRIC>
+class CClusteringMatrixOf : public CClusteringMatrix {
+public:
+	virtual size_t Size() const { return matrix.Size(); }
+
+	virtual void Build( const DistanceType* coordinates, size_t numberOfVectors,
+		size_t dimension, size_t rank, size_t numberOfProcesses )
+	{
+		BuildVectorsMatrix<METRIC>( coordinates, numberOfVectors, dimension,
+			rank, numberOfProcesses, matrix, distancesToAll );
+	}
+
+	virtual CClusteringResult Cluster( const CClusteringOptions& options ) const
+	{
+		return ClusterMatrix( matrix, distancesToAll, options );
+	}
+
+private:
+	DISSIMILARITY_MATRIX_TYPE matrix;
+	vector<DistanceType> distancesToAll;
+};
+
+template<typename METRIC>
+static CClusteringMatrix* CreateMetricMatrix( const CClusteringOptions& options )
+{
+	switch( options.Matrix ) {
+		case CClusteringOptions::DenseMatrix:
+			return new CClusteringMatrixOf<CDissimilarityMatrix<DistanceType>, METRIC>;
+		case CClusteringOptions::QuantizedMatrix:
+			return new CClusteringMatrixOf<CQuantizedDissimilarityMatrix<DistanceType>, METRIC>;
+		case CClusteringOptions::LazyMatrix:
+			CLazyDissimilarityMatrix<DistanceType>::SetCacheSize( options.RowCacheSize );
+			return new CClusteringMatrixOf<CLazyDissimilarityMatrix<DistanceType>, METRIC>;
+		case CClusteringOptions::KnnMatrix:
+			CKnnDissimilarityMatrix<DistanceType>::SetNumberOfNeighbors( options.NumberOfNeighbors );
+			CKnnDissimilarityMatrix<DistanceType>::SetCapNonNeighbors( options.CapNonNeighbors );
+			return new CClusteringMatrixOf<CKnnDissimilarityMatrix<DistanceType>, METRIC>;
+	}
+	throw invalid_argument( "unknown matrix type!" );
+}
+
+static CClusteringMatrix* CreateMatrix( const CClusteringOptions& options )
+{
+	const string& metric = options.Metric;
+	if( metric == CEuclideanMetric::Name() ) {
+		return CreateMetricMatrix<CEuclideanMetric>( options );
+	} else if( metric == CSquaredEuclideanMetric::Name() ) {
+		return CreateMetricMatrix<CSquaredEuclideanMetric>( options );
+	} else if( metric == CManhattanMetric::Name() ) {
+		return CreateMetricMatrix<CManhattanMetric>( options );
+	} else if( metric == CChebyshevMetric::Name() ) {
+		return CreateMetricMatrix<CChebyshevMetric>( options );
+	} else if( metric == CCosineMetric::Name() ) {
+		return CreateMetricMatrix<CCosineMetric>( options );
+	}
+	throw invalid_argument( "unknown metric '" + metric + "'!" );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+CClusteringOptions::MatrixType ParseMatrixType( const string& name )
+{
+	if( name == "dense" ) {
+		return CClusteringOptions::DenseMatrix;
+	} else if( name == "quantized" ) {
+		return CClusteringOptions::QuantizedMatrix;
+	} else if( name == "lazy" ) {
+		return CClusteringOptions::LazyMatrix;
+	} else if( name == "knn" ) {
+		return CClusteringOptions::KnnMatrix;
+	}
+	throw domain_error( "unknown matrix '" + name + "'!" );
+}
+
+CVectorsDissimilarities::CVectorsDissimilarities( const DistanceType* coordinates,
+		size_t numberOfVectors, size_t dimension, const CClusteringOptions& _options ) :
+	matrix( CreateMatrix( _options ) ),
+	options( _options ),
+	memorySize( 0 )
+{
+	try {
+		Reset( coordinates, numberOfVectors, dimension );
+	} catch( ... ) {
+		delete matrix;
+		throw;
+	}
+}
+
+CVectorsDissimilarities::~CVectorsDissimilarities()
+{
+	delete matrix;
+}
+
+void CVectorsDissimilarities::Reset( const DistanceType* coordinates,
+	size_t numberOfVectors, size_t dimension )
+{
+	if( dimension == 0 ) {
+		throw invalid_argument( "bad vectors dimension!" );
+	}
+	size_t rank = 0;
+	size_t numberOfProcesses = 1;
+	GetProcesses( options, rank, numberOfProcesses );
+	matrix->Build( coordinates, numberOfVectors, dimension, rank, numberOfProcesses );
+	memorySize = MemorySize( numberOfVectors, options );
+}
+
+size_t CVectorsDissimilarities::MemorySize( size_t numberOfVectors,
+	const CClusteringOptions& options )
+{
+	const size_t size = numberOfVectors;
+	switch( options.Matrix ) {
+		case CClusteringOptions::DenseMatrix:
+			// and sums of rows
+			return ( size + 1 ) * size * sizeof( DistanceType );
+		case CClusteringOptions::QuantizedMatrix:
+		{
+			typedef CQuantizedDissimilarityMatrix<DistanceType> QuantizedMatrixType;
+			const size_t blocks = ( size + QuantizedMatrixType::RowsBlockSize - 1 )
+				/ QuantizedMatrixType::RowsBlockSize;
+			return size * size * sizeof( QuantizedMatrixType::QuantizedDistanceType )
+				+ blocks * sizeof( DistanceType );
+		}
+		case CClusteringOptions::LazyMatrix:
+		{
+			// as CLazyDissimilarityMatrix::SetCalculator
+			const size_t rowSize = max<size_t>( 1, size * sizeof( DistanceType ) );
+			const size_t cachedRows = min( size, max<size_t>( 1, options.RowCacheSize / rowSize ) );
+			return cachedRows * rowSize + size * sizeof( size_t );
+		}
+		case CClusteringOptions::KnnMatrix:
+		{
+			// at most twice the number of neighbors per vector if they are
+			// not mutual, as CKnnDissimilarityMatrix::SetCalculator
+			const size_t neighbors = min( options.NumberOfNeighbors, size > 0 ? size - 1 : 0 );
+			return 2 * size * neighbors * ( sizeof( uint32_t ) + sizeof( DistanceType ) )
+				+ ( size + 1 ) * sizeof( size_t );
+		}
+	}
+	return 0;
+}
+
+size_t CVectorsDissimilarities::NumberOfVectors() const
+{
+	return matrix->Size();
+}
+
+CClusteringResult CVectorsDissimilarities::Cluster( const CClusteringOptions& options ) const
+{
+	return matrix->Cluster( options );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Generator of shuffling of vectors, which is the same for any number of
+// processes and any standard library.
+class CPartitionsRandom {
+public:
+	explicit CPartitionsRandom( uint64_t seed ) : state( seed ) {}
+
+	// Random number in [0, bound).
+	size_t Next( size_t bound )
+	{
+		// splitmix64
+		state += 0x9E3779B97F4A7C15ULL;
+		uint64_t z = state;
+		z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+		z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBULL;
+		z = z ^ ( z >> 31 );
+		return static_cast<size_t>( z % bound );
+	}
+
+private:
+	uint64_t state;
+};
+
+// Orders vectors by a coordinate.
+class CCoordinateLess {
+public:
+	CCoordinateLess( const DistanceType* _coordinates, size_t _dimension, size_t _axis ) :
+		coordinates( _coordinates ),
+		dimension( _dimension ),
+		axis( _axis )
+	{
+	}
+
+	bool operator()( size_t vector1, size_t vector2 ) const
+	{
+		const DistanceType x1 = coordinates[vector1 * dimension + axis];
+		const DistanceType x2 = coordinates[vector2 * dimension + axis];
+		return ( x1 < x2 || ( x1 == x2 && vector1 < vector2 ) );
+	}
+
+private:
+	const DistanceType* coordinates;
+	size_t dimension;
+	size_t axis;
+};
+
+// Splits vectors order[begin, end) to numberOfPartitions partitions by
+// medians of the coordinate of the largest spread, adds ends of partitions.
+static void SplitSpatially( const DistanceType* coordinates, size_t dimension,
+	vector<size_t>& order, size_t begin, size_t end, size_t numberOfPartitions,
+	vector<size_t>& partitionEnds )
+{
+	if( numberOfPartitions == 1 ) {
+		partitionEnds.push_back( end );
+		return;
+	}
+
+	size_t axis = 0;
+	DistanceType largestSpread = 0;
+	for( size_t d = 0; d < dimension; d++ ) {
+		DistanceType minX = coordinates[order[begin] * dimension + d];
+		DistanceType maxX = minX;
+		for( size_t i = begin + 1; i < end; i++ ) {
+			const DistanceType x = coordinates[order[i] * dimension + d];
+			minX = min( minX, x );
+			maxX = max( maxX, x );
+		}
+		if( maxX - minX > largestSpread ) {
+			largestSpread = maxX - minX;
+			axis = d;
+		}
+	}
+
+	// sizes of parts are proportional to their numbers of partitions, so no
+	// partition gets more vectors than the partition size
+	const size_t leftPartitions = numberOfPartitions / 2;
+	const size_t middle = begin + ( end - begin ) * leftPartitions / numberOfPartitions;
+	nth_element( order.begin() + begin, order.begin() + middle, order.begin() + end,
+		CCoordinateLess( coordinates, dimension, axis ) );
+	SplitSpatially( coordinates, dimension, order, begin, middle,
+		leftPartitions, partitionEnds );
+	SplitSpatially( coordinates, dimension, order, middle, end,
+		numberOfPartitions - leftPartitions, partitionEnds );
+}
+
+// Splits vectors to partitions of at most options.PartitionSize vectors,
+// vectors of partition p are order[partitionEnds[p - 1], partitionEnds[p]).
+static void SplitToPartitions( const DistanceType* coordinates, size_t numberOfVectors,
+	size_t dimension, const CClusteringOptions& options,
+	vector<size_t>& order, vector<size_t>& partitionEnds )
+{
+	const size_t numberOfPartitions =
+		( numberOfVectors + options.PartitionSize - 1 ) / options.PartitionSize;
+	order.resize( numberOfVectors );
+	for( size_t i = 0; i < numberOfVectors; i++ ) {
+		order[i] = i;
+	}
+	partitionEnds.clear();
+	switch( options.Partitioning ) {
+		case CClusteringOptions::RandomPartitioning:
+		{
+			CPartitionsRandom random( numberOfVectors );
+			for( size_t i = numberOfVectors - 1; i > 0; i-- ) {
+				swap( order[i], order[random.Next( i + 1 )] );
+			}
+			for( size_t partition = 0; partition < numberOfPartitions; partition++ ) {
+				size_t begin = 0;
+				size_t end = 0;
+				CalcBeginEndObjects( numberOfVectors, numberOfPartitions, partition, begin, end );
+				partitionEnds.push_back( end );
+			}
+			break;
+		}
+		case CClusteringOptions::SpatialPartitioning:
+			SplitSpatially( coordinates, dimension, order, 0, numberOfVectors,
+				numberOfPartitions, partitionEnds );
+			break;
+		default:
+			throw invalid_argument( "unknown partitioning type!" );
+	}
+}
+
+// Clusters partitions of the process, fills medoids and their weights at
+// offsets of the partitions, medoids of other partitions are left zero.
+static void ClusterPartitions( const DistanceType* coordinates, size_t dimension,
+	const CClusteringOptions& options, const vector<size_t>& order,
+	const vector<size_t>& partitionEnds, const vector<size_t>& medoidsOffsets,
+	vector<uint64_t>& medoids, vector<DistanceType>& weights )
+{
+	size_t rank = 0;
+	size_t numberOfProcesses = 1;
+	GetProcesses( options, rank, numberOfProcesses );
+
+	CClusteringOptions partitionOptions = options;
+	partitionOptions.Distributed = false;
+	partitionOptions.PartitionSize = 0;
+	// unknown metric is reported by all processes
+	CClusteringMatrix* const matrix = CreateMatrix( options );
+	// an error of a process is reported by all processes, so others are not
+	// left waiting for it in MPI_Allreduce
+	int failed = 0;
+	string error;
+	try {
+		vector<DistanceType> partitionCoordinates;
+		for( size_t p = rank; p < partitionEnds.size(); p += numberOfProcesses ) {
+			const size_t begin = p == 0 ? 0 : partitionEnds[p - 1];
+			const size_t size = partitionEnds[p] - begin;
+			const size_t offset = medoidsOffsets[p];
+			if( size <= options.NumberOfClusters ) {
+				// all vectors are medoids
+				for( size_t i = 0; i < size; i++ ) {
+					medoids[offset + i] = order[begin + i];
+					weights[offset + i] = 1;
+				}
+				continue;
+			}
+
+			partitionCoordinates.resize( size * dimension );
+			for( size_t i = 0; i < size; i++ ) {
+				copy( coordinates + order[begin + i] * dimension,
+					coordinates + ( order[begin + i] + 1 ) * dimension,
+					partitionCoordinates.begin() + i * dimension );
+			}
+			matrix->Build( &partitionCoordinates[0], size, dimension,
+				0 /* rank */, 1 /* numberOfProcesses */ );
+			const CClusteringResult result = matrix->Cluster( partitionOptions );
+			for( size_t i = 0; i < result.Medoids.size(); i++ ) {
+				medoids[offset + i] = order[begin + result.Medoids[i]];
+			}
+			for( size_t i = 0; i < size; i++ ) {
+				weights[offset + result.Clusters[i]] += 1;
+			}
+		}
+	} catch( exception& e ) {
+		failed = 1;
+		error = e.what();
+	} catch( ... ) {
+		failed = 1;
+		error = "unknown error in clustering of partitions!";
+	}
+	delete matrix;
+
+	if( options.Distributed ) {
+		int failures = 0;
+		MpiCheck( MPI_Allreduce( &failed, &failures, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD ),
+			"MPI_Allreduce for failures of partitions" );
+		if( failures != 0 && failed == 0 ) {
+			throw runtime_error( "clustering of partitions failed on another process!" );
+		}
+	}
+	if( failed != 0 ) {
+		throw runtime_error( error );
+	}
+	if( options.Distributed ) {
+		MpiCheck( MPI_Allreduce( MPI_IN_PLACE, &medoids[0], static_cast<int>( medoids.size() ),
+			MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD ), "MPI_Allreduce for medoids of partitions" );
+		MpiCheck( MPI_Allreduce( MPI_IN_PLACE, &weights[0], static_cast<int>( weights.size() ),
+			MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD ), "MPI_Allreduce for weights of partitions" );
+	}
+}
+
+// Assigns all vectors to the nearest medoids, processes assign their parts of
+// vectors and gather the clusters.
+static void AssignToMedoids( const DistanceType* coordinates, size_t numberOfVectors,
+	size_t dimension, const CClusteringOptions& options, CClusteringResult& result )
+{
+	vector<DistanceType> medoidsCoordinates( result.Medoids.size() * dimension );
+	for( size_t i = 0; i < result.Medoids.size(); i++ ) {
+		copy( coordinates + result.Medoids[i] * dimension,
+			coordinates + ( result.Medoids[i] + 1 ) * dimension,
+			medoidsCoordinates.begin() + i * dimension );
+	}
+	CClusteringModel model;
+	model.Reset( options.Metric, dimension, result.Medoids, medoidsCoordinates );
+
+	size_t rank = 0;
+	size_t numberOfProcesses = 1;
+	GetProcesses( options, rank, numberOfProcesses );
+	size_t begin = 0;
+	size_t end = 0;
+	CalcBeginEndObjects( numberOfVectors, numberOfProcesses, rank, begin, end );
+
+	const size_t BatchSize = 4096;
+	vector<CMedoidAssignment> assignments( BatchSize );
+	result.Clusters.resize( numberOfVectors );
+	double cost = 0;
+	for( size_t first = begin; first < end; first += BatchSize ) {
+		const size_t size = min( BatchSize, end - first );
+		model.Predict( coordinates + first * dimension, size, &assignments[0] );
+		for( size_t i = 0; i < size; i++ ) {
+			result.Clusters[first + i] = assignments[i].Cluster;
+			cost += assignments[i].Distance;
+		}
+	}
+
+	if( options.Distributed ) {
+		MpiCheck( MPI_Allreduce( MPI_IN_PLACE, &cost, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD ),
+			"MPI_Allreduce for cost" );
+		vector<int> counts( numberOfProcesses );
+		vector<int> displacements( numberOfProcesses );
+		for( size_t process = 0; process < numberOfProcesses; process++ ) {
+			size_t processBegin = 0;
+			size_t processEnd = 0;
+			CalcBeginEndObjects( numberOfVectors, numberOfProcesses, process,
+				processBegin, processEnd );
+			counts[process] = static_cast<int>( processEnd - processBegin );
+			displacements[process] = static_cast<int>( processBegin );
+		}
+		MpiCheck( MPI_Allgatherv( MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, &result.Clusters[0],
+			&counts[0], &displacements[0], MPI_UINT32_T, MPI_COMM_WORLD ),
+			"MPI_Allgatherv for clusters" );
+	}
+	result.Cost = cost;
+}
+
+// Clusters partitions of vectors, then medoids of partitions weighted by
+// sizes of their clusters, and assigns all vectors to the resulting medoids.
+static CClusteringResult ClusterVectorsByPartitions( const DistanceType* coordinates,
+	size_t numberOfVectors, size_t dimension, const CClusteringOptions& options )
+{
+	if( !options.InitialMedoids.empty() || !options.Weights.empty() ) {
+		throw invalid_argument(
+			"two-level clustering does not support initial medoids and weights!" );
+	}
+	if( dimension == 0 ) {
+		throw invalid_argument( "bad vectors dimension!" );
+	}
+	if( numberOfVectors > INT_MAX ) {
+		throw invalid_argument( "too many vectors for two-level clustering!" );
+	}
+
+	vector<size_t> order;
+	vector<size_t> partitionEnds;
+	SplitToPartitions( coordinates, numberOfVectors, dimension, options,
+		order, partitionEnds );
+	vector<size_t> medoidsOffsets( partitionEnds.size() );
+	size_t numberOfMedoids = 0;
+	for( size_t p = 0; p < partitionEnds.size(); p++ ) {
+		const size_t begin = p == 0 ? 0 : partitionEnds[p - 1];
+		medoidsOffsets[p] = numberOfMedoids;
+		numberOfMedoids += min( options.NumberOfClusters, partitionEnds[p] - begin );
+	}
+
+	vector<uint64_t> partitionsMedoids( numberOfMedoids );
+	vector<DistanceType> weights( numberOfMedoids );
+	ClusterPartitions( coordinates, dimension, options, order, partitionEnds,
+		medoidsOffsets, partitionsMedoids, weights );
+
+	vector<DistanceType> medoidsCoordinates( numberOfMedoids * dimension );
+	for( size_t i = 0; i < numberOfMedoids; i++ ) {
+		copy( coordinates + partitionsMedoids[i] * dimension,
+			coordinates + ( partitionsMedoids[i] + 1 ) * dimension,
+			medoidsCoordinates.begin() + i * dimension );
+	}
+	CClusteringOptions medoidsOptions = options;
+	medoidsOptions.PartitionSize = 0;
+	medoidsOptions.Weights = weights;
+	CClusteringResult result = ClusterVectors( &medoidsCoordinates[0], numberOfMedoids,
+		dimension, medoidsOptions );
+	for( size_t i = 0; i < result.Medoids.size(); i++ ) {
+		result.Medoids[i] = static_cast<size_t>( partitionsMedoids[result.Medoids[i]] );
+	}
+
+	AssignToMedoids( coordinates, numberOfVectors, dimension, options, result );
+	return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+CClusteringResult ClusterVectors( const DistanceType* coordinates,
+	size_t numberOfVectors, size_t dimension, const CClusteringOptions& options )
+{
+	if( options.PartitionSize > 0 && numberOfVectors > options.PartitionSize ) {
+		return ClusterVectorsByPartitions( coordinates, numberOfVectors, dimension, options );
+	}
+	const CVectorsDissimilarities dissimilarities( coordinates, numberOfVectors,
+		dimension, options );
+	return dissimilarities.Cluster( options );
+}
+
+CClusteringResult ClusterObjects( const DistanceType* dissimilarities,
+	size_t numberOfObjects, const CClusteringOptions& options )
+{
+	const CDissimilarityMatrixView<DistanceType> matrix( dissimilarities, numberOfObjects );
+	return ClusterMatrix( matrix, vector<DistanceType>(), options );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Updates nearest medoids of a vector by medoid of cluster at distance,
+// ties go to the smaller cluster.
+static void AssignCluster( CMedoidAssignment& assignment, uint32_t cluster,
+	DistanceType distance )
+{
+	if( distance < assignment.Distance
+		|| ( distance == assignment.Distance && cluster < assignment.Cluster ) )
+	{
+		assignment.SecondCluster = assignment.Cluster;
+		assignment.SecondDistance = assignment.Distance;
+		assignment.Cluster = cluster;
+		assignment.Distance = distance;
+	} else if( distance < assignment.SecondDistance
+		|| ( distance == assignment.SecondDistance && cluster < assignment.SecondCluster ) )
+	{
+		assignment.SecondCluster = cluster;
+		assignment.SecondDistance = distance;
+	}
+}
+
+static void ResetAssignment( CMedoidAssignment& assignment )
+{
+	assignment.Cluster = numeric_limits<uint32_t>::max();
+	assignment.Distance = numeric_limits<DistanceType>::max();
+	assignment.SecondCluster = numeric_limits<uint32_t>::max();
+	assignment.SecondDistance = numeric_limits<DistanceType>::max();
+}
+
+// Finds nearest medoids of vectors, medoids are given by consecutive rows of
+// coordinates of CClusteringModel.
+class CMedoidsIndex {
+public:
+	virtual ~CMedoidsIndex() {}
+	virtual void Predict( const DistanceType* coordinates, size_t numberOfVectors,
+		CMedoidAssignment* assignments ) const = 0;
+};
+
+// Calculates distances of a vector to all medoids by one batch call.
+template<typename METRIC>
+class CMedoidsScan : public CMedoidsIndex {
+public:
+	CMedoidsScan( const DistanceType* _medoidsCoordinates, size_t _numberOfClusters,
+			size_t _dimension ) :
+		medoidsCoordinates( _medoidsCoordinates ),
+		numberOfClusters( _numberOfClusters ),
+		dimension( _dimension )
+	{
+	}
+
+	virtual void Predict( const DistanceType* coordinates, size_t numberOfVectors,
+		CMedoidAssignment* assignments ) const
+	{
+		vector<DistanceType> distances( numberOfClusters );
+		for( size_t i = 0; i < numberOfVectors; i++ ) {
+			METRIC::Distances( coordinates + i * dimension, medoidsCoordinates,
+				numberOfClusters, dimension, &distances[0] );
+			ResetAssignment( assignments[i] );
+			for( size_t cluster = 0; cluster < numberOfClusters; cluster++ ) {
+				AssignCluster( assignments[i], static_cast<uint32_t>( cluster ),
+					distances[cluster] );
+			}
+		}
+	}
+
+private:
+	const DistanceType* const medoidsCoordinates;
+	const size_t numberOfClusters;
+	const size_t dimension;
+};
+
+// Medoids are grouped around leader medoids, medoids of a group are stored
+// together and their distances are calculated by one batch call. By the
+// triangle inequality medoids of a group are not nearer to a vector than
+// its distance to the leader minus the radius of the group, so the group of
+// the nearest leader is visited first and other groups only if the bound
+// does not exceed the second distance found.
+template<typename METRIC>
+class CMedoidsGroupsIndex : public CMedoidsIndex {
+public:
+	CMedoidsGroupsIndex( const DistanceType* medoidsCoordinates, size_t numberOfClusters,
+		size_t dimension );
+
+	virtual void Predict( const DistanceType* coordinates, size_t numberOfVectors,
+		CMedoidAssignment* assignments ) const;
+
+private:
+	const size_t dimension;
+	vector<DistanceType> leadersCoordinates;
+	// group g has medoids [groupBegins[g], groupBegins[g + 1]) of clusters
+	vector<size_t> groupBegins;
+	vector<DistanceType> radii;
+	vector<uint32_t> clusters;
+	// coordinates of medoids of clusters
+	vector<DistanceType> groupedCoordinates;
+
+	void visitGroup( const DistanceType* point, size_t group, DistanceType* distances,
+		CMedoidAssignment& assignment ) const;
+};
+
+template<typename METRIC>
+CMedoidsGroupsIndex<METRIC>::CMedoidsGroupsIndex( const DistanceType* medoidsCoordinates,
+		size_t numberOfClusters, size_t _dimension ) :
+	dimension( _dimension )
+{
+	// leaders are chosen one by one as the medoid farthest from chosen ones
+	const size_t numberOfGroups = static_cast<size_t>(
+		ceil( sqrt( static_cast<double>( numberOfClusters ) ) ) );
+	vector<size_t> medoidGroups( numberOfClusters, 0 );
+	vector<DistanceType> leaderDistances( numberOfClusters,
+		numeric_limits<DistanceType>::max() );
+	vector<DistanceType> distances( numberOfClusters );
+	size_t leader = 0;
+	for( size_t group = 0; group < numberOfGroups; group++ ) {
+		const DistanceType* const leaderCoordinates = medoidsCoordinates + leader * dimension;
+		leadersCoordinates.insert( leadersCoordinates.end(),
+			leaderCoordinates, leaderCoordinates + dimension );
+		METRIC::Distances( leaderCoordinates, medoidsCoordinates, numberOfClusters,
+			dimension, &distances[0] );
+		distances[leader] = 0;
+		for( size_t cluster = 0; cluster < numberOfClusters; cluster++ ) {
+			if( distances[cluster] < leaderDistances[cluster] ) {
+				leaderDistances[cluster] = distances[cluster];
+				medoidGroups[cluster] = group;
+			}
+		}
+		leader = max_element( leaderDistances.begin(), leaderDistances.end() )
+			- leaderDistances.begin();
+	}
+
+	groupBegins.assign( numberOfGroups + 1, 0 );
+	radii.assign( numberOfGroups, 0 );
+	for( size_t cluster = 0; cluster < numberOfClusters; cluster++ ) {
+		groupBegins[medoidGroups[cluster] + 1]++;
+		radii[medoidGroups[cluster]] =
+			max( radii[medoidGroups[cluster]], leaderDistances[cluster] );
+	}
+	for( size_t group = 0; group < numberOfGroups; group++ ) {
+		groupBegins[group + 1] += groupBegins[group];
+	}
+	clusters.resize( numberOfClusters );
+	groupedCoordinates.resize( numberOfClusters * dimension );
+	vector<size_t> groupEnds( groupBegins.begin(), groupBegins.end() - 1 );
+	for( size_t cluster = 0; cluster < numberOfClusters; cluster++ ) {
+		const size_t position = groupEnds[medoidGroups[cluster]]++;
+		clusters[position] = static_cast<uint32_t>( cluster );
+		copy( medoidsCoordinates + cluster * dimension,
+			medoidsCoordinates + ( cluster + 1 ) * dimension,
+			groupedCoordinates.begin() + position * dimension );
+	}
+}
+
+template<typename METRIC>
+void CMedoidsGroupsIndex<METRIC>::Predict( const DistanceType* coordinates,
+	size_t numberOfVectors, CMedoidAssignment* assignments ) const
+{
+	const size_t numberOfGroups = radii.size();
+	vector<DistanceType> leaderDistances( numberOfGroups );
+	vector<DistanceType> distances( clusters.size() );
+	for( size_t i = 0; i < numberOfVectors; i++ ) {
+		const DistanceType* const point = coordinates + i * dimension;
+		CMedoidAssignment& assignment = assignments[i];
+		ResetAssignment( assignment );
+		METRIC::Distances( point, &leadersCoordinates[0], numberOfGroups, dimension,
+			&leaderDistances[0] );
+		const size_t nearestGroup = min_element( leaderDistances.begin(),
+			leaderDistances.end() ) - leaderDistances.begin();
+		visitGroup( point, nearestGroup, &distances[0], assignment );
+		for( size_t group = 0; group < numberOfGroups; group++ ) {
+			// distances are rounded, so bounds are lowered a little
+			const DistanceType bound = ( leaderDistances[group] - radii[group] ) * ( 1 - 1e-5f );
+			if( group != nearestGroup && bound <= assignment.SecondDistance ) {
+				visitGroup( point, group, &distances[0], assignment );
+			}
+		}
+	}
+}
+
+template<typename METRIC>
+void CMedoidsGroupsIndex<METRIC>::visitGroup( const DistanceType* point, size_t group,
+	DistanceType* distances, CMedoidAssignment& assignment ) const
+{
+	const size_t begin = groupBegins[group];
+	const size_t end = groupBegins[group + 1];
+	if( begin == end ) {
+		return;
+	}
+	METRIC::Distances( point, &groupedCoordinates[begin * dimension], end - begin, dimension,
+		distances );
+	for( size_t i = begin; i < end; i++ ) {
+		AssignCluster( assignment, clusters[i], distances[i - begin] );
+	}
+}
+
+// Index pays off only for many clusters.
+static const size_t MinIndexedClusters = 64;
+
+template<typename METRIC>
+static CMedoidsIndex* CreateMetricIndex( const DistanceType* medoidsCoordinates,
+	size_t numberOfClusters, size_t dimension )
+{
+	if( METRIC::IsMetric && numberOfClusters >= MinIndexedClusters ) {
+		return new CMedoidsGroupsIndex<METRIC>( medoidsCoordinates, numberOfClusters,
+			dimension );
+	}
+	return new CMedoidsScan<METRIC>( medoidsCoordinates, numberOfClusters, dimension );
+}
+
+static CMedoidsIndex* CreateIndex( const string& metric,
+	const DistanceType* medoidsCoordinates, size_t numberOfClusters, size_t dimension )
+{
+	if( metric == CEuclideanMetric::Name() ) {
+		return CreateMetricIndex<CEuclideanMetric>(
+			medoidsCoordinates, numberOfClusters, dimension );
+	} else if( metric == CSquaredEuclideanMetric::Name() ) {
+		return CreateMetricIndex<CSquaredEuclideanMetric>(
+			medoidsCoordinates, numberOfClusters, dimension );
+	} else if( metric == CManhattanMetric::Name() ) {
+		return CreateMetricIndex<CManhattanMetric>(
+			medoidsCoordinates, numberOfClusters, dimension );
+	} else if( metric == CChebyshevMetric::Name() ) {
+		return CreateMetricIndex<CChebyshevMetric>(
+			medoidsCoordinates, numberOfClusters, dimension );
+	} else if( metric == CCosineMetric::Name() ) {
+		return CreateMetricIndex<CCosineMetric>(
+			medoidsCoordinates, numberOfClusters, dimension );
+	}
+	throw invalid_argument( "unknown metric '" + metric + "'!" );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+CClusteringModel::CClusteringModel() :
+	dimension( 0 ),
+	index( 0 )
+{
+}
+
+CClusteringModel::~CClusteringModel()
+{
+	delete index;
+}
+
+void CClusteringModel::Reset( const string& _metric, size_t _dimension,
+	const vector<size_t>& _medoidVectors, const vector<DistanceType>& _medoidsCoordinates )
+{
+	if( _dimension == 0 || _medoidVectors.empty()
+		|| _medoidVectors.size() > numeric_limits<uint32_t>::max()
+		|| _medoidsCoordinates.size() != _medoidVectors.size() * _dimension )
+	{
+		throw invalid_argument( "bad medoids of clustering model!" );
+	}
+	delete index;
+	index = 0;
+	metric = _metric;
+	dimension = _dimension;
+	medoidVectors = _medoidVectors;
+	medoidsCoordinates = _medoidsCoordinates;
+	index = CreateIndex( metric, &medoidsCoordinates[0], medoidVectors.size(), dimension );
+}
+
+void CClusteringModel::Save( const string& filename ) const
+{
+	ofstream output( filename.c_str() );
+	// enough digits to read the same coordinates
+	output.precision( numeric_limits<DistanceType>::digits10 + 3 );
+	output << "metric\t" << metric << "\n";
+	output << "dimension\t" << dimension << "\n";
+	output << "medoids\t" << medoidVectors.size() << "\n";
+	for( size_t cluster = 0; cluster < medoidVectors.size(); cluster++ ) {
+		output << medoidVectors[cluster];
+		for( size_t i = 0; i < dimension; i++ ) {
+			output << "\t" << medoidsCoordinates[cluster * dimension + i];
+		}
+		output << "\n";
+	}
+	if( output.fail() ) {
+		throw domain_error( "cannot write clustering model '" + filename + "'!" );
+	}
+}
+
+void CClusteringModel::Load( const string& filename )
+{
+	ifstream input( filename.c_str() );
+	string metricName;
+	string dimensionName;
+	string medoidsName;
+	string newMetric;
+	size_t newDimension = 0;
+	size_t numberOfClusters = 0;
+	input >> metricName >> newMetric >> dimensionName >> newDimension
+		>> medoidsName >> numberOfClusters;
+	if( !input.good() || metricName != "metric" || dimensionName != "dimension"
+		|| medoidsName != "medoids" )
+	{
+		throw domain_error( "bad clustering model '" + filename + "'!" );
+	}
+	vector<size_t> newMedoidVectors;
+	vector<DistanceType> newMedoidsCoordinates;
+	for( size_t cluster = 0; cluster < numberOfClusters && input.good(); cluster++ ) {
+		size_t medoidVector = 0;
+		input >> medoidVector;
+		newMedoidVectors.push_back( medoidVector );
+		for( size_t i = 0; i < newDimension && input.good(); i++ ) {
+			DistanceType coordinate = 0;
+			input >> coordinate;
+			newMedoidsCoordinates.push_back( coordinate );
+		}
+	}
+	if( input.fail() ) {
+		throw domain_error( "bad clustering model '" + filename + "'!" );
+	}
+	Reset( newMetric, newDimension, newMedoidVectors, newMedoidsCoordinates );
+}
+
+void CClusteringModel::Predict( const DistanceType* coordinates, size_t numberOfVectors,
+	CMedoidAssignment* assignments ) const
+{
+	if( index == 0 ) {
+		throw logic_error( "clustering model is empty!" );
+	}
+	index->Predict( coordinates, numberOfVectors, assignments );
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,93 @@
+#include <map>
+#include <set>
+#include <limits>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <stdint.h>
+
+using namespace std;
+
+#include <MpiSupport.h>
+#include <CommandLine.h>
+#include <VectorsFile.h>
+#include <PamEngine.h>
+#include <PamLibrary.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+const char* const Usage =
+	"Usage: pam_predict [OPTIONS] MODEL_FILENAME VECTORS_FILENAME [ASSIGNMENTS_FILENAME]\n"
+	"Assigns vectors to the nearest medoids of model saved by 'pam --save-model'\n"
+	"and reports the number of vectors assigned per second. Assignments file has\n"
+	"lines 'VECTOR CLUSTER DISTANCE SECOND_CLUSTER SECOND_DISTANCE' separated\n"
+	"by tabs, second cluster is omitted for models of one cluster.\n"
+	"Options:\n"
+	"  --batch=N               assign N vectors by a call (default: 4096)";
+
+void DoMain( const int argc, const char* const argv[] )
+{
+	const CCommandLine commandLine( argc, argv );
+	if( commandLine.NumberOfArguments() != 2 && commandLine.NumberOfArguments() != 3 ) {
+		throw invalid_argument( Usage );
+	}
+	const size_t batchSize = max<size_t>( 1, commandLine.SizeOption( "batch", 4096 ) );
+	commandLine.CheckUnknownOptions();
+
+	CClusteringModel model;
+	model.Load( commandLine.Argument( 0 ) );
+	vector<DistanceType> coordinates;
+	size_t numberOfVectors = 0;
+	size_t dimension = 0;
+	ReadVectorsFile( commandLine.Argument( 1 ), coordinates, numberOfVectors, dimension );
+	if( dimension != model.Dimension() ) {
+		throw domain_error( "dimension of vectors differs from dimension of model!" );
+	}
+
+	vector<CMedoidAssignment> assignments( numberOfVectors );
+	const double startTime = WallTime();
+	for( size_t first = 0; first < numberOfVectors; first += batchSize ) {
+		model.Predict( &coordinates[first * dimension],
+			min( batchSize, numberOfVectors - first ), &assignments[first] );
+	}
+	const double predictTime = WallTime() - startTime;
+
+	cout << "vectors\t" << numberOfVectors << endl;
+	cout << "clusters\t" << model.NumberOfClusters() << endl;
+	cout << "predict time\t" << predictTime << endl;
+	if( predictTime > 0 ) {
+		cout << "vectors per second\t" << numberOfVectors / predictTime << endl;
+	}
+
+	if( commandLine.NumberOfArguments() == 3 ) {
+		const string& filename = commandLine.Argument( 2 );
+		ofstream output( filename.c_str() );
+		for( size_t i = 0; i < numberOfVectors; i++ ) {
+			output << i << "\t" << assignments[i].Cluster << "\t" << assignments[i].Distance;
+			if( model.NumberOfClusters() > 1 ) {
+				output << "\t" << assignments[i].SecondCluster
+					<< "\t" << assignments[i].SecondDistance;
+			}
+			output << "\n";
+		}
+		if( output.fail() ) {
+			throw runtime_error( "cannot write file '" + filename + "'!" );
+		}
+	}
+}
+
+int main( int argc, char** argv )
+{
+	try {
+		DoMain( argc, argv );
+	} catch( exception& e ) {
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	}
+
+	return 0;
+}
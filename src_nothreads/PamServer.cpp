@@ -0,0 +1,638 @@
+#include <map>
+#include <set>
+#include <deque>
+#include <limits>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/socket.h>
+
+using namespace std;
+
+#include <MpiSupport.h>
+#include <CommandLine.h>
+#include <MpiVectorsText.h>
+#include <VectorsBinary.h>
+#include <PamEngine.h>
+#include <PamLibrary.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Vectors of a dataset and their dissimilarity matrix, kept between requests.
+struct CDataset {
+	size_t Dimension;
+	vector<DistanceType> Coordinates;
+	CVectorsDissimilarities* Dissimilarities;
+	// Number of the request, which used the dataset last.
+	size_t LastUse;
+
+	CDataset() :
+		Dimension( 0 ),
+		Dissimilarities( 0 ),
+		LastUse( 0 )
+	{
+	}
+
+	~CDataset() { delete Dissimilarities; }
+
+	size_t MemorySize() const
+	{
+		return Coordinates.size() * sizeof( DistanceType ) + Dissimilarities->MemorySize();
+	}
+
+private:
+	CDataset( const CDataset& );
+	CDataset& operator=( const CDataset& );
+};
+
+// Handles requests given by lines 'REQUEST [--NAME[=VALUE]]... [ARGUMENT]...'.
+// All processes handle each request and cluster together, the response of
+// the process with rank 0 is sent to the client.
+class CClusteringServer {
+private:
+	CClusteringServer( const CClusteringServer& );
+	CClusteringServer& operator=( const CClusteringServer& );
+
+public:
+	// Least recently used datasets are unloaded to keep memory of datasets
+	// below maxMemorySize bytes.
+	explicit CClusteringServer( size_t _maxMemorySize ) :
+		maxMemorySize( _maxMemorySize ),
+		requests( 0 ),
+		stopped( false )
+	{
+	}
+	~CClusteringServer();
+
+	bool Stopped() const { return stopped; }
+	// Returns lines 'NAME<TAB>VALUE' of the response, throws on errors.
+	string Handle( const string& request );
+
+private:
+	typedef map<string, CDataset*> CDatasets;
+
+	const size_t maxMemorySize;
+	CDatasets datasets;
+	size_t requests;
+	bool stopped;
+
+	void load( const CCommandLine& request, ostream& response );
+	void cluster( const CCommandLine& request, ostream& response );
+	void unload( const CCommandLine& request, ostream& response );
+	void status( const CCommandLine& request, ostream& response ) const;
+
+	// Memory of datasets except replacedId.
+	size_t memorySize( const string& replacedId = "" ) const;
+	// Memory of dataset replacedId is counted as freed, it is not unloaded.
+	void admit( size_t datasetMemorySize, const string& replacedId );
+	CDataset& find( const string& id );
+	template<typename VECTORS_FILE>
+	void loadDataset( const VECTORS_FILE& vectorsFile, const CClusteringOptions& options,
+		const string& id, CDataset& dataset );
+};
+
+static size_t ParseSize( const string& text, const string& name )
+{
+	char* end = 0;
+	const unsigned long value = strtoul( text.c_str(), &end, 10 );
+	if( text.empty() || *end != '\0' ) {
+		throw domain_error( name + " must be a number!" );
+	}
+	return static_cast<size_t>( value );
+}
+
+CClusteringServer::~CClusteringServer()
+{
+	for( CDatasets::iterator i = datasets.begin(); i != datasets.end(); ++i ) {
+		delete i->second;
+	}
+}
+
+string CClusteringServer::Handle( const string& request )
+{
+	requests++;
+	vector<string> words;
+	istringstream input( request );
+	string word;
+	while( input >> word ) {
+		words.push_back( word );
+	}
+	vector<const char*> argv( 1, "pam_server" );
+	for( size_t i = 0; i < words.size(); i++ ) {
+		argv.push_back( words[i].c_str() );
+	}
+	const CCommandLine commandLine( static_cast<int>( argv.size() ), &argv[0] );
+
+	ostringstream response;
+	const string& name = commandLine.Argument( 0 );
+	if( name == "load" ) {
+		load( commandLine, response );
+	} else if( name == "cluster" ) {
+		cluster( commandLine, response );
+	} else if( name == "unload" ) {
+		unload( commandLine, response );
+	} else if( name == "status" ) {
+		status( commandLine, response );
+	} else if( name == "shutdown" ) {
+		commandLine.CheckUnknownOptions();
+		stopped = true;
+	} else {
+		throw domain_error( "unknown request '" + name + "'!" );
+	}
+	return response.str();
+}
+
+void CClusteringServer::load( const CCommandLine& request, ostream& response )
+{
+	if( request.NumberOfArguments() != 3 ) {
+		throw domain_error( "load request is 'load ID FILENAME [OPTIONS]'!" );
+	}
+	const string& id = request.Argument( 1 );
+	const string& filename = request.Argument( 2 );
+	CClusteringOptions options;
+	options.Metric = request.Option( "metric", options.Metric );
+	options.Matrix = ParseMatrixType( request.Option( "matrix", "dense" ) );
+	options.RowCacheSize = request.SizeOption( "row-cache", options.RowCacheSize >> 20 ) << 20;
+	options.NumberOfNeighbors = request.SizeOption( "neighbors", options.NumberOfNeighbors );
+	options.CapNonNeighbors = request.HasOption( "cap-non-neighbors" );
+	request.CheckUnknownOptions();
+
+	// the replaced dataset is kept until the new one is loaded, so it is not
+	// lost if loading fails
+	const double startTime = WallTime();
+	CDataset* dataset = new CDataset;
+	try {
+		if( CVectorsBinary::IsBinary( filename ) ) {
+			const CVectorsBinary vectorsFile( filename );
+			loadDataset( vectorsFile, options, id, *dataset );
+		} else {
+			const CMpiVectorsText vectorsFile( filename );
+			loadDataset( vectorsFile, options, id, *dataset );
+		}
+	} catch( ... ) {
+		delete dataset;
+		throw;
+	}
+	dataset->LastUse = requests;
+	CDatasets::iterator replaced = datasets.find( id );
+	if( replaced != datasets.end() ) {
+		delete replaced->second;
+		replaced->second = dataset;
+	} else {
+		datasets[id] = dataset;
+	}
+
+	response << "vectors\t" << dataset->Dissimilarities->NumberOfVectors() << endl;
+	response << "dimension\t" << dataset->Dimension << endl;
+	response << "memory\t" << dataset->MemorySize() << endl;
+	response << "load time\t" << WallTime() - startTime << endl;
+}
+
+template<typename VECTORS_FILE>
+void CClusteringServer::loadDataset( const VECTORS_FILE& vectorsFile,
+	const CClusteringOptions& options, const string& id, CDataset& dataset )
+{
+	const size_t numberOfVectors = vectorsFile.NumberOfVectors();
+	dataset.Dimension = vectorsFile.Dimension();
+	admit( numberOfVectors * dataset.Dimension * sizeof( DistanceType )
+		+ CVectorsDissimilarities::MemorySize( numberOfVectors, options ), id );
+
+	dataset.Coordinates.resize( numberOfVectors * dataset.Dimension );
+	vector<DistanceType*> vectorsCoordinates( numberOfVectors );
+	for( size_t i = 0; i < numberOfVectors; i++ ) {
+		vectorsCoordinates[i] = &dataset.Coordinates[i * dataset.Dimension];
+	}
+	if( numberOfVectors > 0 ) {
+		vectorsFile.Read( &vectorsCoordinates[0] );
+	}
+	dataset.Dissimilarities = new CVectorsDissimilarities(
+		dataset.Coordinates.empty() ? 0 : &dataset.Coordinates[0],
+		numberOfVectors, dataset.Dimension, options );
+}
+
+void CClusteringServer::cluster( const CCommandLine& request, ostream& response )
+{
+	if( request.NumberOfArguments() != 3 ) {
+		throw domain_error( "cluster request is 'cluster ID NUMBER_OF_CLUSTERS [OPTIONS]'!" );
+	}
+	CDataset& dataset = find( request.Argument( 1 ) );
+	CClusteringOptions options;
+	options.NumberOfClusters = ParseSize( request.Argument( 2 ), "number of clusters" );
+	options.StopCriteria.MaxIterations = request.SizeOption( "max-iterations",
+		options.StopCriteria.MaxIterations );
+	options.StopCriteria.MinRelativeImprovement = request.DoubleOption( "min-improvement",
+		options.StopCriteria.MinRelativeImprovement );
+	options.StopCriteria.TimeLimit = request.DoubleOption( "time-limit",
+		options.StopCriteria.TimeLimit );
+	if( request.HasOption( "medoids" ) ) {
+		istringstream medoids( request.Option( "medoids" ) );
+		string medoid;
+		while( getline( medoids, medoid, ',' ) ) {
+			options.InitialMedoids.push_back( ParseSize( medoid, "medoid" ) );
+		}
+	}
+	options.SortedNeighbors = request.SizeOption( "sorted-neighbors", options.SortedNeighbors );
+	options.SwapCache = request.HasOption( "swap-cache" );
+	const bool withClusters = request.HasOption( "clusters" );
+	request.CheckUnknownOptions();
+	options.Distributed = true;
+
+	const double startTime = WallTime();
+	const CClusteringResult result = dataset.Dissimilarities->Cluster( options );
+	CPamResult pamResult;
+	pamResult.StopReason = result.StopReason;
+	response << "stop reason\t" << pamResult.StopReasonName() << endl;
+	response << "iterations\t" << result.Iterations << endl;
+	response << "pam time\t" << WallTime() - startTime << endl;
+	response << "cost\t" << result.Cost << endl;
+	response << "medoids\t" << result.Medoids.size() << endl;
+	for( size_t i = 0; i < result.Medoids.size(); i++ ) {
+		response << result.Medoids[i] << endl;
+	}
+	if( withClusters ) {
+		response << "vectors\t" << result.Clusters.size() << endl;
+		for( size_t i = 0; i < result.Clusters.size(); i++ ) {
+			response << i << "\t" << result.Clusters[i] << "\n";
+		}
+	}
+}
+
+void CClusteringServer::unload( const CCommandLine& request, ostream& /* response */ )
+{
+	if( request.NumberOfArguments() != 2 ) {
+		throw domain_error( "unload request is 'unload ID'!" );
+	}
+	request.CheckUnknownOptions();
+	CDataset& dataset = find( request.Argument( 1 ) );
+	delete &dataset;
+	datasets.erase( request.Argument( 1 ) );
+}
+
+void CClusteringServer::status( const CCommandLine& request, ostream& response ) const
+{
+	request.CheckUnknownOptions();
+	response << "memory\t" << memorySize() << endl;
+	response << "memory limit\t" << maxMemorySize << endl;
+	response << "datasets\t" << datasets.size() << endl;
+	for( CDatasets::const_iterator i = datasets.begin(); i != datasets.end(); ++i ) {
+		response << i->first << "\t" << i->second->Dissimilarities->NumberOfVectors()
+			<< "\t" << i->second->Dimension << "\t" << i->second->MemorySize() << endl;
+	}
+}
+
+size_t CClusteringServer::memorySize( const string& replacedId ) const
+{
+	size_t size = 0;
+	for( CDatasets::const_iterator i = datasets.begin(); i != datasets.end(); ++i ) {
+		if( i->first != replacedId ) {
+			size += i->second->MemorySize();
+		}
+	}
+	return size;
+}
+
+void CClusteringServer::admit( size_t datasetMemorySize, const string& replacedId )
+{
+	if( datasetMemorySize > maxMemorySize ) {
+		throw domain_error( "dataset does not fit into the memory limit!" );
+	}
+	while( memorySize( replacedId ) + datasetMemorySize > maxMemorySize ) {
+		CDatasets::iterator leastRecentlyUsed = datasets.end();
+		for( CDatasets::iterator i = datasets.begin(); i != datasets.end(); ++i ) {
+			if( i->first != replacedId && ( leastRecentlyUsed == datasets.end()
+				|| i->second->LastUse < leastRecentlyUsed->second->LastUse ) )
+			{
+				leastRecentlyUsed = i;
+			}
+		}
+		delete leastRecentlyUsed->second;
+		datasets.erase( leastRecentlyUsed );
+	}
+}
+
+CDataset& CClusteringServer::find( const string& id )
+{
+	CDatasets::iterator dataset = datasets.find( id );
+	if( dataset == datasets.end() ) {
+		throw domain_error( "unknown dataset '" + id + "'!" );
+	}
+	dataset->second->LastUse = requests;
+	return *dataset->second;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Unix socket, clients of which send one request line each and receive
+// the response, after which the connection is closed. Requests are queued
+// while a request is handled, connections over the queue size are refused
+// by an error response.
+class CRequestListener {
+private:
+	CRequestListener( const CRequestListener& );
+	CRequestListener& operator=( const CRequestListener& );
+
+public:
+	static const size_t MaxRequestLength = 1 << 16;
+
+	// Replaces an existing socket file at path.
+	CRequestListener( const string& _path, size_t _maxQueueSize );
+	~CRequestListener();
+
+	// Waits for the next request.
+	void Next( int& client, string& request );
+	// Sends response to client and closes the connection.
+	static void Respond( int client, const string& response );
+
+private:
+	// Connection of a client, which request is being received.
+	struct CConnection {
+		int Client;
+		string Request;
+	};
+
+	const string path;
+	const size_t maxQueueSize;
+	int listener;
+	vector<CConnection> connections;
+	deque<CConnection> requests;
+
+	void poll( int timeout );
+	void accept();
+	// Returns false if the connection is closed.
+	bool receive( CConnection& connection );
+};
+
+CRequestListener::CRequestListener( const string& _path, size_t _maxQueueSize ) :
+	path( _path ),
+	maxQueueSize( _maxQueueSize ),
+	listener( -1 )
+{
+	sockaddr_un address;
+	memset( &address, 0, sizeof( address ) );
+	address.sun_family = AF_UNIX;
+	if( path.empty() || path.length() >= sizeof( address.sun_path ) ) {
+		throw invalid_argument( "bad socket path '" + path + "'!" );
+	}
+	strcpy( address.sun_path, path.c_str() );
+
+	listener = socket( AF_UNIX, SOCK_STREAM, 0 );
+	if( listener == -1 ) {
+		throw runtime_error( "cannot create socket!" );
+	}
+	unlink( path.c_str() );
+	if( bind( listener, reinterpret_cast<sockaddr*>( &address ), sizeof( address ) ) != 0
+		|| listen( listener, SOMAXCONN ) != 0
+		|| fcntl( listener, F_SETFL, O_NONBLOCK ) != 0 )
+	{
+		close( listener );
+		throw runtime_error( "cannot listen on socket '" + path + "'!" );
+	}
+}
+
+CRequestListener::~CRequestListener()
+{
+	for( size_t i = 0; i < connections.size(); i++ ) {
+		close( connections[i].Client );
+	}
+	for( size_t i = 0; i < requests.size(); i++ ) {
+		close( requests[i].Client );
+	}
+	close( listener );
+	unlink( path.c_str() );
+}
+
+void CRequestListener::Next( int& client, string& request )
+{
+	// requests, which came while the previous one was handled, are queued
+	// before waiting
+	poll( 0 /* timeout */ );
+	while( requests.empty() ) {
+		poll( -1 /* no timeout */ );
+	}
+	client = requests.front().Client;
+	request = requests.front().Request;
+	requests.pop_front();
+}
+
+void CRequestListener::Respond( int client, const string& response )
+{
+	size_t sent = 0;
+	while( sent < response.size() ) {
+		const ssize_t size = send( client, response.data() + sent, response.size() - sent, 0 );
+		if( size < 0 && errno == EINTR ) {
+			continue;
+		}
+		if( size <= 0 ) {
+			break; // the client has gone
+		}
+		sent += size;
+	}
+	// unread input makes close reset the connection and drop the response
+	shutdown( client, SHUT_WR );
+	char buffer[4096];
+	while( recv( client, buffer, sizeof( buffer ), MSG_DONTWAIT ) > 0 ) {
+	}
+	close( client );
+}
+
+void CRequestListener::poll( int timeout )
+{
+	vector<pollfd> descriptors( connections.size() + 1 );
+	descriptors[0].fd = listener;
+	descriptors[0].events = POLLIN;
+	for( size_t i = 0; i < connections.size(); i++ ) {
+		descriptors[i + 1].fd = connections[i].Client;
+		descriptors[i + 1].events = POLLIN;
+	}
+	if( ::poll( &descriptors[0], descriptors.size(), timeout ) < 0 ) {
+		if( errno == EINTR ) {
+			return;
+		}
+		throw runtime_error( "cannot poll socket '" + path + "'!" );
+	}
+
+	vector<CConnection> receiving;
+	for( size_t i = 0; i < connections.size(); i++ ) {
+		if( descriptors[i + 1].revents == 0 || receive( connections[i] ) ) {
+			receiving.push_back( connections[i] );
+		}
+	}
+	connections.swap( receiving );
+	if( descriptors[0].revents != 0 ) {
+		accept();
+	}
+}
+
+void CRequestListener::accept()
+{
+	while( true ) {
+		const int client = ::accept( listener, 0, 0 );
+		if( client == -1 ) {
+			if( errno == EINTR ) {
+				continue;
+			}
+			return; // no more connections
+		}
+		if( connections.size() + requests.size() >= maxQueueSize ) {
+			Respond( client, "error\tserver is busy!\n" );
+		} else {
+			CConnection connection;
+			connection.Client = client;
+			connections.push_back( connection );
+		}
+	}
+}
+
+bool CRequestListener::receive( CConnection& connection )
+{
+	char buffer[4096];
+	const ssize_t size = recv( connection.Client, buffer, sizeof( buffer ), 0 );
+	if( size < 0 && errno == EINTR ) {
+		return true;
+	}
+	if( size > 0 ) {
+		connection.Request.append( buffer, size );
+	}
+	const size_t lineEnd = connection.Request.find( '\n' );
+	if( lineEnd != string::npos || ( size == 0 && !connection.Request.empty() ) ) {
+		connection.Request.resize( min( lineEnd, connection.Request.size() ) );
+		requests.push_back( connection );
+		return false;
+	}
+	if( size <= 0 ) {
+		close( connection.Client );
+		return false;
+	}
+	if( connection.Request.size() > MaxRequestLength ) {
+		Respond( connection.Client, "error\trequest is too long!\n" );
+		return false;
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static void BroadcastRequest( string& request )
+{
+	uint64_t length = request.size();
+	MpiCheck( MPI_Bcast( &length, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD ),
+		"MPI_Bcast for request" );
+	request.resize( static_cast<size_t>( length ) );
+	if( length > 0 ) {
+		MpiCheck( MPI_Bcast( &request[0], static_cast<int>( length ), MPI_CHAR,
+			0, MPI_COMM_WORLD ), "MPI_Bcast for request" );
+	}
+}
+
+const char* const Usage =
+	"Usage: pam_server [OPTIONS] SOCKET_PATH\n"
+	"Serves clustering requests on Unix socket SOCKET_PATH, datasets are loaded\n"
+	"once and kept in memory. A client sends one request line and receives\n"
+	"'ok' or 'error<TAB>MESSAGE' followed by lines 'NAME<TAB>VALUE'.\n"
+	"Options:\n"
+	"  --max-queue=N           refuse connections when N requests wait (default: 16)\n"
+	"  --max-memory=MIB        memory for datasets (default: 4096), least recently\n"
+	"                          used datasets are unloaded to load new ones\n"
+	"Requests:\n"
+	"  load ID FILENAME        load vectors file as dataset ID, options:\n"
+	"                          --metric=NAME as of pam (default: euclidean),\n"
+	"                          --matrix=dense|quantized|lazy|knn (default: dense),\n"
+	"                          --row-cache=MIB rows of lazy matrix (default: 256),\n"
+	"                          --neighbors=M nearest neighbors of knn matrix\n"
+	"                          (default: 32), --cap-non-neighbors\n"
+	"  cluster ID K            cluster dataset ID to K clusters, options:\n"
+	"                          --max-iterations=N, --min-improvement=R,\n"
+	"                          --time-limit=SECONDS, --sorted-neighbors=L,\n"
+	"                          --swap-cache as of pam, --medoids=I,J,... to start\n"
+	"                          swapping from, --clusters to list clusters of\n"
+	"                          vectors\n"
+	"  unload ID               unload dataset ID\n"
+	"  status                  list loaded datasets\n"
+	"  shutdown                stop the server";
+
+void DoMain( const int argc, const char* const argv[] )
+{
+	const CCommandLine commandLine( argc, argv );
+	if( commandLine.NumberOfArguments() != 1 ) {
+		throw invalid_argument( Usage );
+	}
+	const size_t maxQueueSize = commandLine.SizeOption( "max-queue", 16 );
+	const size_t maxMemorySize = commandLine.SizeOption( "max-memory", 4096 ) << 20;
+	commandLine.CheckUnknownOptions();
+
+	CClusteringServer server( maxMemorySize );
+	CRequestListener* listener = 0;
+	if( CMpiSupport::Rank() == 0 ) {
+		signal( SIGPIPE, SIG_IGN );
+		listener = new CRequestListener( commandLine.Argument( 0 ), maxQueueSize );
+	}
+	try {
+		while( !server.Stopped() ) {
+			int client = -1;
+			string request;
+			if( listener != 0 ) {
+				listener->Next( client, request );
+			}
+			BroadcastRequest( request );
+
+			string response;
+			int failed = 0;
+			try {
+				response = "ok\n" + server.Handle( request );
+			} catch( exception& e ) {
+				response = string( "error\t" ) + e.what() + "\n";
+				failed = 1;
+			}
+			// datasets of processes differ if only some of them failed
+			int failures = 0;
+			MpiCheck( MPI_Allreduce( &failed, &failures, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD ),
+				"MPI_Allreduce for request failures" );
+			const bool diverged = ( failures > 0
+				&& static_cast<size_t>( failures ) < CMpiSupport::NumberOfProccess() );
+			if( listener != 0 ) {
+				CRequestListener::Respond( client,
+					diverged ? "error\trequest failed on some processes!\n" : response );
+			}
+			if( diverged ) {
+				throw runtime_error( "request '" + request + "' failed on some processes!" );
+			}
+		}
+	} catch( ... ) {
+		delete listener;
+		throw;
+	}
+	delete listener;
+}
+
+int main( int argc, char** argv )
+{
+	try {
+		CMpiSupport::Initialize( &argc, &argv );
+		DoMain( argc, argv );
+		CMpiSupport::Finalize();
+	} catch( exception& e ) {
+		cerr << "Error: " << e.what() << endl;
+		CMpiSupport::Abort( 1 );
+		return 1;
+	} catch( ... ) {
+		cerr << "Unknown error!" << endl;
+		CMpiSupport::Abort( 2 );
+		return 2;
+	}
+
+	return 0;
+}
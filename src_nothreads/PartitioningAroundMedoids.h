@@ -18,7 +18,12 @@ public:
 			size_t _numberOfClusters ) :
 		matrix( dissimilarityMatrix ),
 		numberOfClusters( _numberOfClusters ),
-		state( Initializing )
+		state( Initializing ),
+		sortedNeighbors( 0 ),
+		maxMedoidDistance( 0 ),
+		hasSwapCache( false ),
+		swaps( 0 ),
+		swappedMedoidIndex( 0 )
 	{
 		if( numberOfClusters < 2 || numberOfClusters > matrix.Size() ) {
 			throw invalid_argument( "CPartitioningAroundMedois initializing failed" );
@@ -27,6 +32,9 @@ public:
 		medoids.reserve( numberOfClusters );
 		objectMedoids.resize( matrix.Size() );
 		objectSecondMedoids.resize( matrix.Size() );
+		objectMedoidDistances.resize( matrix.Size() );
+		objectSecondMedoidDistances.resize( matrix.Size() );
+		weights.resize( matrix.Size(), 1 );
 	}
 
 	const DissimilarityMatrixType& DissimilarityMatrix() const { return matrix; }
@@ -35,17 +43,51 @@ public:
 	StateType State() const { return state; }
 	const vector<size_t>& Medoids() const { return medoids; }
 	const vector<size_t>& ObjectMedoids() const { return objectMedoids; }
+	const vector<DistanceType>& Weights() const { return weights; }
 	bool IsMedoid( size_t object ) const
 	{
 		return ( objectMedoids[object] == object );
 	}
+	// Sets weights of objects, all weights are 1 by default.
+	void SetWeights( const vector<DistanceType>& objectWeights );
+	// Swap results of objects are cached and updated by objects, which
+	// medoids are changed by swaps, instead of calculated by all objects.
+	// Cache takes ( NumberOfClusters + 1 ) doubles per object.
+	void EnableSwapCache();
+	bool HasSwapCache() const { return hasSwapCache; }
+	// Sets lists of neighbors, which are scanned instead of all objects by
+	// building, swapping and finding medoids of objects. The matrix must be
+	// symmetric, the lists are used in place and must outlive PAM.
+	void SetSortedNeighbors( const CSortedNeighbors<DistanceType>& neighbors );
+	// Sets sums of weighted distances from each object to all objects,
+	// which are calculated with the matrix, the first building step takes
+	// them instead of sweeping the matrix.
+	void SetDistancesToAll( const vector<DistanceType>& distances );
+	// Sum of weighted distances from objects to their medoids.
+	DistanceType Cost() const;
+	// Sets medoids found before: starts swapping if all medoids are given,
+	// otherwise continues building.
+	void SetMedoids( const vector<size_t>& initialMedoids );
 	// build operations
 	DistanceType FindObjectDistanceToAll( size_t object ) const;
+	// Visited is 0 if sums of distances to all objects are set.
+	DistanceType FindObjectDistanceToAll( size_t object, size_t& visited ) const;
 	void AddMedoid( size_t object );
 	DistanceType AddMedoidProfit( size_t object ) const;
+	// Visited is the number of objects visited, less than all objects if
+	// sorted neighbors are scanned.
+	DistanceType AddMedoidProfit( size_t object, size_t& visited ) const;
 	// swap operatations
 	void Swap( size_t medoid, size_t object );
 	DistanceType SwapResult( size_t medoid, size_t object ) const;
+	DistanceType SwapResult( size_t medoid, size_t object, size_t& visited ) const;
+	// Swap results of object and each of medoids in order of Medoids(),
+	// visited is the number of objects visited for all of them.
+	void SwapResults( size_t object, DistanceType* results, size_t& visited ) const;
+	// Updates cached swap results of objects [objectBegin, objectEnd) before
+	// SwapResult, different ranges may be updated concurrently. Returns the
+	// number of objects visited.
+	size_t UpdateSwapCache( size_t objectBegin, size_t objectEnd );
 
 private:
 	const DissimilarityMatrixType& matrix;
@@ -54,35 +96,237 @@ private:
 	vector<size_t> medoids;
 	vector<size_t> objectMedoids;
 	vector<size_t> objectSecondMedoids;
+	// distances to objectMedoids and objectSecondMedoids
+	vector<DistanceType> objectMedoidDistances;
+	vector<DistanceType> objectSecondMedoidDistances;
+	vector<DistanceType> weights;
+	vector<DistanceType> distancesToAll;
+	const CSortedNeighbors<DistanceType>* sortedNeighbors;
+	// objects of the cluster of a medoid are clusterObjects from
+	// clusterBegins[medoid] to clusterBegins[medoid + 1], they and the largest
+	// distance to medoids are kept only for sorted neighbors
+	vector<size_t> clusterBegins;
+	vector<size_t> clusterObjects;
+	DistanceType maxMedoidDistance;
+	// Previous medoids of an object changed by the last swap.
+	struct CObjectChange {
+		size_t Object;
+		// index of the previous medoid in medoids
+		size_t MedoidIndex;
+		DistanceType MedoidDistance;
+		DistanceType SecondMedoidDistance;
+	};
+	// swap result of medoid and object is swapShared[object] +
+	// swapByMedoids[object * NumberOfClusters() + medoidIndices[medoid]],
+	// which are updated to the swapVersions[object] swap
+	bool hasSwapCache;
+	size_t swaps;
+	vector<size_t> medoidIndices;
+	vector<double> swapShared;
+	vector<double> swapByMedoids;
+	vector<size_t> swapVersions;
+	size_t swappedMedoidIndex;
+	vector<CObjectChange> changedObjects;
+	vector<size_t> previousObjectMedoids;
+	vector<size_t> previousObjectSecondMedoids;
+	vector<DistanceType> previousObjectMedoidDistances;
+	vector<DistanceType> previousObjectSecondMedoidDistances;
 
 	DistanceType distanceToMedoid( size_t object ) const
 	{
-		return matrix.Distance( object, objectMedoids[object] );
+		return objectMedoidDistances[object];
 	}
 	DistanceType distanceToSecondMedoid( size_t object ) const
 	{
-		return matrix.Distance( object, objectSecondMedoids[object] );
+		return objectSecondMedoidDistances[object];
+	}
+	// Distance between object and j for sweeps over j, it is taken from
+	// the row of object if the matrix is symmetric to read it sequentially.
+	DistanceType sweepDistance( size_t object, size_t j ) const
+	{
+		return DissimilarityMatrixType::IsSymmetric ?
+			matrix.Distance( object, j ) : matrix.Distance( j, object );
+	}
+	// Sorted neighbors of object contain all objects, which are closer to it
+	// than to their medoids.
+	bool hasCloseNeighbors( size_t object ) const
+	{
+		return ( !sortedNeighbors->IsTruncated() || ( sortedNeighbors->Length() > 0
+			&& sortedNeighbors->Distances( object )[sortedNeighbors->Length() - 1]
+				>= maxMedoidDistance ) );
+	}
+	// Increase of swap result of a medoid and an object at distance from j
+	// beyond min( 0, distance - distanceToMedoid( j ) ) if medoid is medoid of j.
+	static DistanceType medoidLoss( DistanceType distance,
+		DistanceType medoidDistance, DistanceType secondMedoidDistance )
+	{
+		return ( min( max( distance, medoidDistance ), secondMedoidDistance ) - medoidDistance );
 	}
+	// Kernels of fixed numbers of medoids up to MaxKernelMedoids keep
+	// medoids and their results in registers, sweeps of larger numbers of
+	// medoids loop over medoids.
+	static const size_t MaxKernelMedoids = 16;
+	template<size_t NUMBER_OF_MEDOIDS>
+	void findObjectMedoidsOf();
+	template<size_t NUMBER_OF_MEDOIDS>
+	void swapResultsOf( size_t object, DistanceType* results ) const;
 	void findObjectMedoids();
+	void findObjectMedoidsByKernel();
+	void findObjectMedoidsByNeighbors();
+	void groupClusters();
+	void updateMaxMedoidDistance();
 	DistanceType swapResult( size_t medoid, size_t j, size_t object ) const;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 
+template<typename DMT>
+void CPartitioningAroundMedois<DMT>::SetWeights( const vector<DistanceType>& objectWeights )
+{
+	assert( State() == Initializing );
+
+	if( objectWeights.size() != NumberOfObjects() ) {
+		throw invalid_argument( "CPartitioningAroundMedois: wrong number of weights" );
+	}
+	for( size_t object = 0; object < NumberOfObjects(); object++ ) {
+		if( !( objectWeights[object] > 0 ) ) {
+			throw invalid_argument( "CPartitioningAroundMedois: weights must be positive" );
+		}
+	}
+
+	weights = objectWeights;
+}
+
+template<typename DMT>
+void CPartitioningAroundMedois<DMT>::EnableSwapCache()
+{
+	assert( State() == Initializing );
+
+	hasSwapCache = true;
+	medoidIndices.resize( NumberOfObjects() );
+	swapShared.resize( NumberOfObjects() );
+	swapByMedoids.resize( NumberOfObjects() * NumberOfClusters() );
+	swapVersions.assign( NumberOfObjects(), numeric_limits<size_t>::max() );
+	previousObjectMedoids.resize( NumberOfObjects() );
+	previousObjectSecondMedoids.resize( NumberOfObjects() );
+	previousObjectMedoidDistances.resize( NumberOfObjects() );
+	previousObjectSecondMedoidDistances.resize( NumberOfObjects() );
+}
+
+template<typename DMT>
+void CPartitioningAroundMedois<DMT>::SetSortedNeighbors(
+	const CSortedNeighbors<DistanceType>& neighbors )
+{
+	assert( State() == Initializing );
+
+	if( !DissimilarityMatrixType::IsSymmetric ) {
+		throw invalid_argument( "CPartitioningAroundMedois: sorted neighbors"
+			" require symmetric matrix" );
+	}
+	if( neighbors.Size() != NumberOfObjects() ) {
+		throw invalid_argument( "CPartitioningAroundMedois: wrong number of sorted neighbors" );
+	}
+
+	sortedNeighbors = &neighbors;
+}
+
+template<typename DMT>
+void CPartitioningAroundMedois<DMT>::SetDistancesToAll( const vector<DistanceType>& distances )
+{
+	assert( State() == Initializing );
+
+	if( distances.size() != NumberOfObjects() ) {
+		throw invalid_argument( "CPartitioningAroundMedois: wrong number of distances to all" );
+	}
+
+	distancesToAll = distances;
+}
+
+template<typename DMT>
+typename CPartitioningAroundMedois<DMT>::DistanceType
+CPartitioningAroundMedois<DMT>::Cost() const
+{
+	assert( State() == Swapping );
+
+	DistanceType cost = 0;
+	for( size_t object = 0; object < NumberOfObjects(); object++ ) {
+		cost += weights[object] * distanceToMedoid( object );
+	}
+	return cost;
+}
+
+template<typename DMT>
+void CPartitioningAroundMedois<DMT>::SetMedoids( const vector<size_t>& initialMedoids )
+{
+	assert( State() == Initializing );
+
+	if( initialMedoids.empty() || initialMedoids.size() > NumberOfClusters() ) {
+		throw invalid_argument( "CPartitioningAroundMedois: wrong number of initial medoids" );
+	}
+	vector<bool> isMedoid( NumberOfObjects(), false );
+	for( size_t i = 0; i < initialMedoids.size(); i++ ) {
+		const size_t medoid = initialMedoids[i];
+		if( medoid >= NumberOfObjects() || isMedoid[medoid] ) {
+			throw invalid_argument( "CPartitioningAroundMedois: bad initial medoids" );
+		}
+		isMedoid[medoid] = true;
+	}
+
+	medoids = initialMedoids;
+
+	if( medoids.size() == NumberOfClusters() ) {
+		state = Swapping;
+
+		findObjectMedoids();
+	} else {
+		state = Building;
+
+		// the same objectMedoids as adding medoids one by one gives
+		for( size_t object = 0; object < NumberOfObjects(); object++ ) {
+			objectMedoids[object] = medoids.front();
+			objectMedoidDistances[object] = sweepDistance( medoids.front(), object );
+		}
+		for( size_t i = 1; i < medoids.size(); i++ ) {
+			for( size_t object = 0; object < NumberOfObjects(); object++ ) {
+				const DistanceType distance = sweepDistance( medoids[i], object );
+				if( distance < distanceToMedoid( object ) ) {
+					objectMedoids[object] = medoids[i];
+					objectMedoidDistances[object] = distance;
+				}
+			}
+		}
+		if( sortedNeighbors != 0 ) {
+			updateMaxMedoidDistance();
+		}
+	}
+}
+
 template<typename DMT>
 typename CPartitioningAroundMedois<DMT>::DistanceType
 CPartitioningAroundMedois<DMT>::FindObjectDistanceToAll( size_t object ) const
 {
 	assert( object < NumberOfObjects() );
 
+	if( !distancesToAll.empty() ) {
+		return distancesToAll[object];
+	}
+
 	DistanceType distance = 0;
 	for( size_t anotherObject = 0; anotherObject < NumberOfObjects(); anotherObject++ ) {
-		distance += matrix.Distance( object, anotherObject );
+		distance += weights[anotherObject] * matrix.Distance( object, anotherObject );
 	}
 
 	return distance;
 }
 
+template<typename DMT>
+typename CPartitioningAroundMedois<DMT>::DistanceType
+CPartitioningAroundMedois<DMT>::FindObjectDistanceToAll( size_t object, size_t& visited ) const
+{
+	visited = distancesToAll.empty() ? NumberOfObjects() : 0;
+	return FindObjectDistanceToAll( object );
+}
+
 template<typename DMT>
 void CPartitioningAroundMedois<DMT>::AddMedoid( size_t medoid )
 {
@@ -94,7 +338,10 @@ void CPartitioningAroundMedois<DMT>::AddMedoid( size_t medoid )
 	medoids.push_back( medoid );
 
 	if( State() == Initializing ) {
-		fill( objectMedoids.begin(), objectMedoids.end(), 0 );
+		fill( objectMedoids.begin(), objectMedoids.end(), medoid );
+		for( size_t object = 0; object < NumberOfObjects(); object++ ) {
+			objectMedoidDistances[object] = sweepDistance( medoid, object );
+		}
 		state = Building;
 	} else {
 		// calculate new objectMedoids
@@ -103,8 +350,10 @@ void CPartitioningAroundMedois<DMT>::AddMedoid( size_t medoid )
 				continue; // if object is medoid
 			}
 
-			if( matrix.Distance( object, medoid ) < distanceToMedoid( object ) ) {
+			const DistanceType distance = sweepDistance( medoid, object );
+			if( distance < distanceToMedoid( object ) ) {
 				objectMedoids[object] = medoid;
+				objectMedoidDistances[object] = distance;
 			}
 		}
 
@@ -114,6 +363,9 @@ void CPartitioningAroundMedois<DMT>::AddMedoid( size_t medoid )
 			findObjectMedoids();
 		}
 	}
+	if( sortedNeighbors != 0 && State() == Building ) {
+		updateMaxMedoidDistance();
+	}
 }
 
 template<typename DMT>
@@ -131,13 +383,40 @@ CPartitioningAroundMedois<DMT>::AddMedoidProfit( size_t object ) const
 		}
 
 		if( matrix.Distance( object, anotherObject ) < distanceToMedoid( anotherObject ) ) {
-			profit += distanceToMedoid( anotherObject ) - matrix.Distance( object, anotherObject );
+			profit += weights[anotherObject] *
+				( distanceToMedoid( anotherObject ) - matrix.Distance( object, anotherObject ) );
 		}
 	}
 
 	return profit;
 }
 
+template<typename DMT>
+typename CPartitioningAroundMedois<DMT>::DistanceType
+CPartitioningAroundMedois<DMT>::AddMedoidProfit( size_t object, size_t& visited ) const
+{
+	if( sortedNeighbors == 0 || !hasCloseNeighbors( object ) ) {
+		visited = NumberOfObjects();
+		return AddMedoidProfit( object );
+	}
+
+	const uint32_t* const neighbors = sortedNeighbors->Neighbors( object );
+	const DistanceType* const distances = sortedNeighbors->Distances( object );
+	DistanceType profit = 0;
+	// objects not closer to object than the largest distance to medoids
+	// are closer to their medoids
+	size_t i = 0;
+	for( ; i < sortedNeighbors->Length() && distances[i] < maxMedoidDistance; i++ ) {
+		const size_t anotherObject = neighbors[i];
+		if( !IsMedoid( anotherObject ) && distances[i] < distanceToMedoid( anotherObject ) ) {
+			profit += weights[anotherObject] * ( distanceToMedoid( anotherObject ) - distances[i] );
+		}
+	}
+	visited = i;
+
+	return profit;
+}
+
 template<typename DMT>
 void CPartitioningAroundMedois<DMT>::Swap( size_t medoid, size_t object )
 {
@@ -148,7 +427,34 @@ void CPartitioningAroundMedois<DMT>::Swap( size_t medoid, size_t object )
 	assert( mi != medoids.end() );
 	*mi = object;
 
+	if( !hasSwapCache ) {
+		findObjectMedoids();
+		return;
+	}
+
+	// findObjectMedoids fills all medoids of objects anew
+	objectMedoids.swap( previousObjectMedoids );
+	objectSecondMedoids.swap( previousObjectSecondMedoids );
+	objectMedoidDistances.swap( previousObjectMedoidDistances );
+	objectSecondMedoidDistances.swap( previousObjectSecondMedoidDistances );
 	findObjectMedoids();
+
+	swappedMedoidIndex = mi - medoids.begin();
+	changedObjects.clear();
+	for( size_t j = 0; j < NumberOfObjects(); j++ ) {
+		if( objectMedoids[j] != previousObjectMedoids[j]
+			|| objectSecondMedoids[j] != previousObjectSecondMedoids[j] )
+		{
+			CObjectChange change;
+			change.Object = j;
+			// index of removed medoid is still kept
+			change.MedoidIndex = medoidIndices[previousObjectMedoids[j]];
+			change.MedoidDistance = previousObjectMedoidDistances[j];
+			change.SecondMedoidDistance = previousObjectSecondMedoidDistances[j];
+			changedObjects.push_back( change );
+		}
+	}
+	swaps++;
 }
 
 template<typename DMT>
@@ -166,39 +472,391 @@ CPartitioningAroundMedois<DMT>::SwapResult( size_t medoid, size_t object ) const
 		if( j != medoid && IsMedoid( j ) ) {
 			continue; // if j is object or medoid
 		}
-		result += swapResult( medoid, j, object );
+		result += weights[j] * swapResult( medoid, j, object );
 	}
 	return result;
 }
 
+template<typename DMT>
+typename CPartitioningAroundMedois<DMT>::DistanceType
+CPartitioningAroundMedois<DMT>::SwapResult( size_t medoid, size_t object, size_t& visited ) const
+{
+	if( hasSwapCache ) {
+		assert( swapVersions[object] == swaps );
+		visited = 0;
+		return static_cast<DistanceType>( swapShared[object]
+			+ swapByMedoids[object * NumberOfClusters() + medoidIndices[medoid]] );
+	}
+	if( sortedNeighbors == 0 || !hasCloseNeighbors( object ) ) {
+		visited = NumberOfObjects();
+		return SwapResult( medoid, object );
+	}
+
+	DistanceType result = 0;
+	// objects of the cluster of medoid lose it
+	for( size_t i = clusterBegins[medoid]; i < clusterBegins[medoid + 1]; i++ ) {
+		const size_t j = clusterObjects[i];
+		result += weights[j] * swapResult( medoid, j, object );
+	}
+	visited = clusterBegins[medoid + 1] - clusterBegins[medoid];
+	if( objectMedoids[object] != medoid ) {
+		result += weights[object] * swapResult( medoid, object, object );
+		visited++;
+	}
+	// other objects move to object only if it is closer than their medoids
+	const uint32_t* const neighbors = sortedNeighbors->Neighbors( object );
+	const DistanceType* const distances = sortedNeighbors->Distances( object );
+	size_t i = 0;
+	for( ; i < sortedNeighbors->Length() && distances[i] < maxMedoidDistance; i++ ) {
+		const size_t j = neighbors[i];
+		if( objectMedoids[j] != medoid && distances[i] < distanceToMedoid( j ) ) {
+			result += weights[j] * ( distances[i] - distanceToMedoid( j ) );
+		}
+	}
+	visited += i;
+	return result;
+}
+
+template<typename DMT>
+void CPartitioningAroundMedois<DMT>::SwapResults( size_t object,
+	DistanceType* results, size_t& visited ) const
+{
+	assert( object < NumberOfObjects() );
+	assert( !IsMedoid( object ) );
+	assert( State() == Swapping );
+
+	if( hasSwapCache || sortedNeighbors != 0 ) {
+		visited = 0;
+		for( size_t i = 0; i < medoids.size(); i++ ) {
+			size_t medoidVisited = 0;
+			results[i] = SwapResult( medoids[i], object, medoidVisited );
+			visited += medoidVisited;
+		}
+		return;
+	}
+
+	visited = medoids.size() * NumberOfObjects();
+	if( medoids.size() > MaxKernelMedoids ) {
+		for( size_t i = 0; i < medoids.size(); i++ ) {
+			results[i] = SwapResult( medoids[i], object );
+		}
+		return;
+	}
+	switch( medoids.size() ) {
+		case 2: swapResultsOf<2>( object, results ); break;
+		case 3: swapResultsOf<3>( object, results ); break;
+		case 4: swapResultsOf<4>( object, results ); break;
+		case 5: swapResultsOf<5>( object, results ); break;
+		case 6: swapResultsOf<6>( object, results ); break;
+		case 7: swapResultsOf<7>( object, results ); break;
+		case 8: swapResultsOf<8>( object, results ); break;
+		case 9: swapResultsOf<9>( object, results ); break;
+		case 10: swapResultsOf<10>( object, results ); break;
+		case 11: swapResultsOf<11>( object, results ); break;
+		case 12: swapResultsOf<12>( object, results ); break;
+		case 13: swapResultsOf<13>( object, results ); break;
+		case 14: swapResultsOf<14>( object, results ); break;
+		case 15: swapResultsOf<15>( object, results ); break;
+		case 16: swapResultsOf<16>( object, results ); break;
+		default: assert( false );
+	}
+}
+
+template<typename DMT>
+size_t CPartitioningAroundMedois<DMT>::UpdateSwapCache( size_t objectBegin, size_t objectEnd )
+{
+	assert( State() == Swapping );
+
+	if( !hasSwapCache ) {
+		return 0;
+	}
+
+	size_t visited = 0;
+	for( size_t object = objectBegin; object < objectEnd; object++ ) {
+		// medoids are cached anew when they are swapped
+		if( IsMedoid( object ) || swapVersions[object] == swaps ) {
+			continue;
+		}
+		double* const byMedoids = &swapByMedoids[object * NumberOfClusters()];
+		if( swapVersions[object] != numeric_limits<size_t>::max()
+			&& swapVersions[object] + 1 == swaps )
+		{
+			// all objects of the swapped medoid are changed
+			byMedoids[swappedMedoidIndex] = 0;
+			for( size_t i = 0; i < changedObjects.size(); i++ ) {
+				const CObjectChange& change = changedObjects[i];
+				const size_t j = change.Object;
+				const DistanceType distance = sweepDistance( object, j );
+				swapShared[object] += weights[j] *
+					( min<DistanceType>( 0, distance - distanceToMedoid( j ) )
+						- min<DistanceType>( 0, distance - change.MedoidDistance ) );
+				if( change.MedoidIndex != swappedMedoidIndex ) {
+					byMedoids[change.MedoidIndex] -= weights[j] * medoidLoss( distance,
+						change.MedoidDistance, change.SecondMedoidDistance );
+				}
+				byMedoids[medoidIndices[objectMedoids[j]]] += weights[j] * medoidLoss( distance,
+					distanceToMedoid( j ), distanceToSecondMedoid( j ) );
+			}
+			visited += changedObjects.size();
+		} else {
+			swapShared[object] = 0;
+			fill( byMedoids, byMedoids + NumberOfClusters(), 0 );
+			for( size_t j = 0; j < NumberOfObjects(); j++ ) {
+				const DistanceType distance = sweepDistance( object, j );
+				swapShared[object] += weights[j] *
+					min<DistanceType>( 0, distance - distanceToMedoid( j ) );
+				byMedoids[medoidIndices[objectMedoids[j]]] += weights[j] * medoidLoss( distance,
+					distanceToMedoid( j ), distanceToSecondMedoid( j ) );
+			}
+			visited += NumberOfObjects();
+		}
+		swapVersions[object] = swaps;
+	}
+	return visited;
+}
+
 template<typename DMT>
 void CPartitioningAroundMedois<DMT>::findObjectMedoids()
 {
 	assert( State() != Initializing );
 
+	if( hasSwapCache ) {
+		for( size_t medoidIndex = 0; medoidIndex < medoids.size(); medoidIndex++ ) {
+			medoidIndices[medoids[medoidIndex]] = medoidIndex;
+		}
+	}
+
+	// kernels set medoids of all objects
+	if( DissimilarityMatrixType::IsRandomAccess && medoids.size() <= MaxKernelMedoids ) {
+		findObjectMedoidsByKernel();
+		if( sortedNeighbors != 0 ) {
+			groupClusters();
+			updateMaxMedoidDistance();
+		}
+		return;
+	}
+
+	fill( objectMedoids.begin(), objectMedoids.end(), NumberOfObjects() );
+	fill( objectMedoidDistances.begin(), objectMedoidDistances.end(),
+		numeric_limits<DistanceType>::max() );
+	fill( objectSecondMedoids.begin(), objectSecondMedoids.end(), NumberOfObjects() );
+	fill( objectSecondMedoidDistances.begin(), objectSecondMedoidDistances.end(),
+		numeric_limits<DistanceType>::max() );
+
+	// medoids are expected among the first 2 * objects / medoids neighbors
+	if( sortedNeighbors != 0 && medoids.size() * medoids.size() > 2 * NumberOfObjects() ) {
+		findObjectMedoidsByNeighbors();
+		groupClusters();
+		updateMaxMedoidDistance();
+		return;
+	}
+
+	// sweeps go over rows of medoids, distances are taken as in swapResult
+	// for not symmetric (e.g. quantized) matrices, so swapping is consistent
+	for( size_t medoidIndex = 0; medoidIndex < medoids.size(); medoidIndex++ ) {
+		const size_t medoid = medoids[medoidIndex];
+		for( size_t i = 0; i < NumberOfObjects(); i++ ) {
+			const DistanceType distance = sweepDistance( medoid, i );
+			if( distance < objectMedoidDistances[i] ) {
+				objectSecondMedoids[i] = objectMedoids[i];
+				objectSecondMedoidDistances[i] = objectMedoidDistances[i];
+				objectMedoids[i] = medoid;
+				objectMedoidDistances[i] = distance;
+			} else if( distance < objectSecondMedoidDistances[i] ) {
+				objectSecondMedoids[i] = medoid;
+				objectSecondMedoidDistances[i] = distance;
+			}
+		}
+	}
+	if( sortedNeighbors != 0 ) {
+		groupClusters();
+		updateMaxMedoidDistance();
+	}
+}
+
+template<typename DMT>
+void CPartitioningAroundMedois<DMT>::findObjectMedoidsByKernel()
+{
+	switch( medoids.size() ) {
+		case 2: findObjectMedoidsOf<2>(); break;
+		case 3: findObjectMedoidsOf<3>(); break;
+		case 4: findObjectMedoidsOf<4>(); break;
+		case 5: findObjectMedoidsOf<5>(); break;
+		case 6: findObjectMedoidsOf<6>(); break;
+		case 7: findObjectMedoidsOf<7>(); break;
+		case 8: findObjectMedoidsOf<8>(); break;
+		case 9: findObjectMedoidsOf<9>(); break;
+		case 10: findObjectMedoidsOf<10>(); break;
+		case 11: findObjectMedoidsOf<11>(); break;
+		case 12: findObjectMedoidsOf<12>(); break;
+		case 13: findObjectMedoidsOf<13>(); break;
+		case 14: findObjectMedoidsOf<14>(); break;
+		case 15: findObjectMedoidsOf<15>(); break;
+		case 16: findObjectMedoidsOf<16>(); break;
+		default: assert( false );
+	}
+}
+
+// Rows of all medoids are read by turns for each object instead of by
+// sweeps of medoids, which read and write medoids of all objects for each
+// medoid. Medoids are compared in the same order as by sweeps.
+template<typename DMT>
+template<size_t NUMBER_OF_MEDOIDS>
+void CPartitioningAroundMedois<DMT>::findObjectMedoidsOf()
+{
+	assert( medoids.size() == NUMBER_OF_MEDOIDS );
+
+	size_t kernelMedoids[NUMBER_OF_MEDOIDS];
+	copy( medoids.begin(), medoids.end(), kernelMedoids );
 	for( size_t i = 0; i < NumberOfObjects(); i++ ) {
-		size_t objectMedoid = NumberOfObjects();
-		DistanceType objectMedoidDistance = numeric_limits<DistanceType>::max();
-		size_t objectSecondMedoid = NumberOfObjects();
-		DistanceType objectSecondMedoidDistance = numeric_limits<DistanceType>::max();
+		DistanceType distances[NUMBER_OF_MEDOIDS];
+		for( size_t m = 0; m < NUMBER_OF_MEDOIDS; m++ ) {
+			distances[m] = sweepDistance( kernelMedoids[m], i );
+		}
+		size_t medoid = NumberOfObjects();
+		size_t secondMedoid = NumberOfObjects();
+		DistanceType medoidDistance = numeric_limits<DistanceType>::max();
+		DistanceType secondMedoidDistance = numeric_limits<DistanceType>::max();
+		for( size_t m = 0; m < NUMBER_OF_MEDOIDS; m++ ) {
+			if( distances[m] < medoidDistance ) {
+				secondMedoid = medoid;
+				secondMedoidDistance = medoidDistance;
+				medoid = kernelMedoids[m];
+				medoidDistance = distances[m];
+			} else if( distances[m] < secondMedoidDistance ) {
+				secondMedoid = kernelMedoids[m];
+				secondMedoidDistance = distances[m];
+			}
+		}
+		objectMedoids[i] = medoid;
+		objectMedoidDistances[i] = medoidDistance;
+		objectSecondMedoids[i] = secondMedoid;
+		objectSecondMedoidDistances[i] = secondMedoidDistance;
+	}
+}
+
+// One sweep of the row of object sums results of all medoids, each of them
+// by the same operations as SwapResult does.
+template<typename DMT>
+template<size_t NUMBER_OF_MEDOIDS>
+void CPartitioningAroundMedois<DMT>::swapResultsOf( size_t object, DistanceType* results ) const
+{
+	assert( medoids.size() == NUMBER_OF_MEDOIDS );
+
+	size_t kernelMedoids[NUMBER_OF_MEDOIDS];
+	DistanceType sums[NUMBER_OF_MEDOIDS];
+	for( size_t m = 0; m < NUMBER_OF_MEDOIDS; m++ ) {
+		kernelMedoids[m] = medoids[m];
+		sums[m] = 0;
+	}
+	for( size_t j = 0; j < NumberOfObjects(); j++ ) {
+		const DistanceType distance = sweepDistance( object, j );
+		const DistanceType medoidDistance = distanceToMedoid( j );
+		const DistanceType secondMedoidDistance = distanceToSecondMedoid( j );
+		const DistanceType weight = weights[j];
+		// results of swap of the medoid of j and of other medoids
+		const DistanceType medoidResult =
+			( secondMedoidDistance > distance ? distance : secondMedoidDistance ) - medoidDistance;
+		const DistanceType otherResult =
+			( medoidDistance > distance ) ? ( distance - medoidDistance ) : 0;
+		const size_t medoid = objectMedoids[j];
+		if( medoid == j ) {
+			// j is medoid, it counts only for its own swap
+			for( size_t m = 0; m < NUMBER_OF_MEDOIDS; m++ ) {
+				if( kernelMedoids[m] == j ) {
+					sums[m] += weight * medoidResult;
+				}
+			}
+			continue;
+		}
+		for( size_t m = 0; m < NUMBER_OF_MEDOIDS; m++ ) {
+			sums[m] += weight * ( kernelMedoids[m] == medoid ? medoidResult : otherResult );
+		}
+	}
+	copy( sums, sums + NUMBER_OF_MEDOIDS, results );
+}
 
+template<typename DMT>
+void CPartitioningAroundMedois<DMT>::findObjectMedoidsByNeighbors()
+{
+	vector<bool> isMedoid( NumberOfObjects(), false );
+	for( size_t medoidIndex = 0; medoidIndex < medoids.size(); medoidIndex++ ) {
+		isMedoid[medoids[medoidIndex]] = true;
+	}
+	// scanning more neighbors is slower than sweeping medoids
+	const size_t maxScan = min( sortedNeighbors->Length(), medoids.size() );
+	for( size_t object = 0; object < NumberOfObjects(); object++ ) {
+		size_t found = 0;
+		if( isMedoid[object] ) {
+			objectMedoids[object] = object;
+			objectMedoidDistances[object] = 0;
+			found++;
+		}
+		const uint32_t* const neighbors = sortedNeighbors->Neighbors( object );
+		const DistanceType* const distances = sortedNeighbors->Distances( object );
+		for( size_t i = 0; i < maxScan && found < 2; i++ ) {
+			if( !isMedoid[neighbors[i]] ) {
+				continue;
+			}
+			if( found == 0 ) {
+				objectMedoids[object] = neighbors[i];
+				objectMedoidDistances[object] = distances[i];
+			} else {
+				objectSecondMedoids[object] = neighbors[i];
+				objectSecondMedoidDistances[object] = distances[i];
+			}
+			found++;
+		}
+		if( found == 2 ) {
+			continue;
+		}
+		// medoids are not among scanned neighbors
+		objectMedoids[object] = NumberOfObjects();
+		objectMedoidDistances[object] = numeric_limits<DistanceType>::max();
 		for( size_t medoidIndex = 0; medoidIndex < medoids.size(); medoidIndex++ ) {
 			const size_t medoid = medoids[medoidIndex];
-			const DistanceType distance = matrix.Distance( medoid, i );
-			if( distance < objectMedoidDistance ) {
-				objectSecondMedoid = objectMedoid;
-				objectSecondMedoidDistance = objectMedoidDistance;
-				objectMedoid = medoid;
-				objectMedoidDistance = distance;
-			} else if( distance < objectSecondMedoidDistance ) {
-				objectSecondMedoid = medoid;
-				objectSecondMedoidDistance = distance;
+			const DistanceType distance = ( medoid == object ) ? 0 : sweepDistance( medoid, object );
+			if( distance < objectMedoidDistances[object] || medoid == object ) {
+				objectSecondMedoids[object] = objectMedoids[object];
+				objectSecondMedoidDistances[object] = objectMedoidDistances[object];
+				objectMedoids[object] = medoid;
+				objectMedoidDistances[object] = distance;
+			} else if( distance < objectSecondMedoidDistances[object] ) {
+				objectSecondMedoids[object] = medoid;
+				objectSecondMedoidDistances[object] = distance;
 			}
 		}
+	}
+}
+
+template<typename DMT>
+void CPartitioningAroundMedois<DMT>::groupClusters()
+{
+	// counting sort of objects by medoids
+	clusterBegins.assign( NumberOfObjects() + 1, 0 );
+	for( size_t object = 0; object < NumberOfObjects(); object++ ) {
+		clusterBegins[objectMedoids[object] + 1]++;
+	}
+	for( size_t object = 0; object < NumberOfObjects(); object++ ) {
+		clusterBegins[object + 1] += clusterBegins[object];
+	}
+	clusterObjects.resize( NumberOfObjects() );
+	for( size_t object = 0; object < NumberOfObjects(); object++ ) {
+		clusterObjects[clusterBegins[objectMedoids[object]]++] = object;
+	}
+	// beginnings were moved to ends
+	for( size_t object = NumberOfObjects(); object > 0; object-- ) {
+		clusterBegins[object] = clusterBegins[object - 1];
+	}
+	clusterBegins[0] = 0;
+}
 
-		assert( objectMedoid < NumberOfObjects() && objectSecondMedoid < NumberOfObjects() );
-		objectMedoids[i] = objectMedoid;
-		objectSecondMedoids[i] = objectSecondMedoid;
+template<typename DMT>
+void CPartitioningAroundMedois<DMT>::updateMaxMedoidDistance()
+{
+	maxMedoidDistance = 0;
+	for( size_t object = 0; object < NumberOfObjects(); object++ ) {
+		maxMedoidDistance = max( maxMedoidDistance, distanceToMedoid( object ) );
 	}
 }
 
@@ -206,20 +864,21 @@ template<typename DMT>
 typename CPartitioningAroundMedois<DMT>::DistanceType
 CPartitioningAroundMedois<DMT>::swapResult( size_t medoid, size_t j, size_t object ) const
 {
+	const DistanceType distance = sweepDistance( object, j );
 	if( objectMedoids[j] == medoid ) {
 		// medoid is medoid of j-object
-		if( distanceToSecondMedoid( j ) > matrix.Distance( j, object ) ) {
+		if( distanceToSecondMedoid( j ) > distance ) {
 			// object is new medoid of j-object
-			return ( matrix.Distance( j, object ) - distanceToMedoid( j ) );
+			return ( distance - distanceToMedoid( j ) );
 		} else {
 			// second j-object medoid is new medoid of j-object
 			return ( distanceToSecondMedoid( j ) - distanceToMedoid( j ) );
 		}
 	} else {
 		// medoid is NOT medoid of j-object
-		if( distanceToMedoid( j ) > matrix.Distance( j, object ) ) {
+		if( distanceToMedoid( j ) > distance ) {
 			// object is new medoid of j-object
-			return ( matrix.Distance( j, object ) - distanceToMedoid( j ) );
+			return ( distance - distanceToMedoid( j ) );
 		} else {
 			return 0;
 		}
@@ -0,0 +1,228 @@
+#pragma once
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Dissimilarity matrix of distances quantized to 16 bits with a scale for
+// each block of RowsBlockSize rows, it takes half of the memory of a float
+// matrix. Decoded distance differs from the original one by at most
+// MaxError of its row, so the matrix is only approximately symmetric.
+template<typename DISTANCE_TYPE>
+class CQuantizedDissimilarityMatrix {
+private:
+	CQuantizedDissimilarityMatrix( const CQuantizedDissimilarityMatrix& matrix );
+	CQuantizedDissimilarityMatrix& operator=( const CQuantizedDissimilarityMatrix& matrix );
+
+public:
+	typedef DISTANCE_TYPE DistanceType;
+	typedef unsigned short QuantizedDistanceType;
+	static const bool IsSymmetric = false;
+	// Distances of any rows are read by turns as fast as of one row.
+	static const bool IsRandomAccess = true;
+	// Rows are set by blocks of RowsBlockSize rows.
+	static const size_t RowsBlockSize = 64;
+
+	CQuantizedDissimilarityMatrix() :
+		size( 0 )
+	{
+	}
+
+	size_t Size() const { return size; }
+
+	DistanceType Distance( size_t i, size_t j ) const
+	{
+		assert( i < size && j < size );
+		return quantizedDistances[i * size + j] * scales[i / RowsBlockSize];
+	}
+
+	// Maximal difference of decoded and original distances in row.
+	DistanceType MaxError( size_t row ) const
+	{
+		assert( row < size );
+		return maxErrors[row / RowsBlockSize];
+	}
+
+	void Reset( size_t newSize )
+	{
+		size = newSize;
+		quantizedDistances.assign( size * size, 0 );
+		scales.assign( ( size + RowsBlockSize - 1 ) / RowsBlockSize, 0 );
+		maxErrors.assign( scales.size(), 0 );
+	}
+
+	// Distances must be nonnegative, firstRow must start a block of rows.
+	void SetRows( size_t firstRow, size_t numberOfRows, const DistanceType* rowsDistances );
+	// Sets rows of matrix extended from the first matrix.Size() objects,
+	// rows of old objects are given only with distances to new objects. Codes
+	// of distances to old objects are kept if distances to new objects fit
+	// the scale of their block, otherwise they are rescaled and MaxError of
+	// the block grows by the error of the new scale.
+	void SetExtendedRows( const CQuantizedDissimilarityMatrix& matrix, size_t firstRow,
+		size_t numberOfRows, const DistanceType* rowsDistances );
+
+	void Swap( CQuantizedDissimilarityMatrix& matrix )
+	{
+		swap( size, matrix.size );
+		quantizedDistances.swap( matrix.quantizedDistances );
+		scales.swap( matrix.scales );
+		maxErrors.swap( matrix.maxErrors );
+	}
+
+	void Load( istream& input );
+	void Save( ostream& output ) const;
+
+private:
+	size_t size;
+	vector<QuantizedDistanceType> quantizedDistances;
+	vector<DistanceType> scales;
+	vector<DistanceType> maxErrors;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+template<typename DISTANCE_TYPE>
+void CQuantizedDissimilarityMatrix<DISTANCE_TYPE>::SetRows( size_t firstRow,
+	size_t numberOfRows, const DistanceType* rowsDistances )
+{
+	assert( firstRow % RowsBlockSize == 0 && numberOfRows <= RowsBlockSize );
+	assert( firstRow + numberOfRows <= size );
+
+	const size_t count = numberOfRows * size;
+	DistanceType maxDistance = 0;
+	for( size_t i = 0; i < count; i++ ) {
+		assert( rowsDistances[i] >= 0 );
+		maxDistance = max( maxDistance, rowsDistances[i] );
+	}
+
+	const DistanceType maxQuantizedDistance = numeric_limits<QuantizedDistanceType>::max();
+	const DistanceType scale = maxDistance / maxQuantizedDistance;
+	scales[firstRow / RowsBlockSize] = scale;
+	maxErrors[firstRow / RowsBlockSize] = scale / 2;
+	if( scale > 0 ) {
+		QuantizedDistanceType* quantized = &quantizedDistances[firstRow * size];
+		for( size_t i = 0; i < count; i++ ) {
+			quantized[i] = static_cast<QuantizedDistanceType>(
+				min( maxQuantizedDistance, rowsDistances[i] / scale + DistanceType( 0.5 ) ) );
+		}
+	}
+}
+
+template<typename DISTANCE_TYPE>
+void CQuantizedDissimilarityMatrix<DISTANCE_TYPE>::SetExtendedRows(
+	const CQuantizedDissimilarityMatrix& matrix, size_t firstRow, size_t numberOfRows,
+	const DistanceType* rowsDistances )
+{
+	assert( firstRow % RowsBlockSize == 0 && numberOfRows <= RowsBlockSize );
+	assert( firstRow + numberOfRows <= size && matrix.size <= size );
+	const size_t oldSize = matrix.size;
+	if( firstRow >= oldSize ) {
+		SetRows( firstRow, numberOfRows, rowsDistances );
+		return;
+	}
+
+	const size_t numberOfOldRows = min( numberOfRows, oldSize - firstRow );
+	DistanceType maxDistance = 0;
+	for( size_t i = 0; i < numberOfRows; i++ ) {
+		const DistanceType* const row = rowsDistances + i * size;
+		for( size_t j = ( i < numberOfOldRows ) ? oldSize : 0; j < size; j++ ) {
+			assert( row[j] >= 0 );
+			maxDistance = max( maxDistance, row[j] );
+		}
+	}
+
+	const DistanceType maxQuantizedDistance = numeric_limits<QuantizedDistanceType>::max();
+	const size_t block = firstRow / RowsBlockSize;
+	const DistanceType oldScale = matrix.scales[block];
+	DistanceType scale = oldScale;
+	DistanceType maxError = matrix.maxErrors[block];
+	// distances up to half of the scale over the range are within the error
+	if( maxDistance >= oldScale * ( maxQuantizedDistance + DistanceType( 0.5 ) ) ) {
+		QuantizedDistanceType maxCode = 0;
+		for( size_t i = 0; i < numberOfOldRows; i++ ) {
+			const QuantizedDistanceType* const codes =
+				&matrix.quantizedDistances[( firstRow + i ) * oldSize];
+			maxCode = max( maxCode, *max_element( codes, codes + oldSize ) );
+		}
+		scale = max( maxDistance, maxCode * oldScale ) / maxQuantizedDistance;
+		maxError += scale / 2;
+	}
+	scales[block] = scale;
+	maxErrors[block] = maxError;
+
+	for( size_t i = 0; i < numberOfRows; i++ ) {
+		const DistanceType* const row = rowsDistances + i * size;
+		QuantizedDistanceType* quantized = &quantizedDistances[0] + ( firstRow + i ) * size;
+		size_t j = 0;
+		if( i < numberOfOldRows ) {
+			const QuantizedDistanceType* const codes =
+				&matrix.quantizedDistances[( firstRow + i ) * oldSize];
+			if( scale == oldScale ) {
+				copy( codes, codes + oldSize, quantized );
+			} else {
+				for( ; j < oldSize; j++ ) {
+					quantized[j] = static_cast<QuantizedDistanceType>(
+						min( maxQuantizedDistance, codes[j] * oldScale / scale + DistanceType( 0.5 ) ) );
+				}
+			}
+			j = oldSize;
+		}
+		for( ; j < size; j++ ) {
+			quantized[j] = ( scale > 0 ) ? static_cast<QuantizedDistanceType>(
+				min( maxQuantizedDistance, row[j] / scale + DistanceType( 0.5 ) ) ) : 0;
+		}
+	}
+}
+
+template<typename DISTANCE_TYPE>
+void CQuantizedDissimilarityMatrix<DISTANCE_TYPE>::Load( istream& input )
+{
+	bool good = false;
+	size_t newSize = 0;
+	if( input.good() && input >> newSize ) {
+		Reset( newSize );
+		good = true;
+		vector<DistanceType> rows;
+		for( size_t firstRow = 0; good && firstRow < size; firstRow += RowsBlockSize ) {
+			const size_t numberOfRows = min( firstRow + RowsBlockSize, size ) - firstRow;
+			rows.resize( numberOfRows * size );
+			for( size_t i = 0; good && i < rows.size(); i++ ) {
+				good = ( input.good() && input >> rows[i] && rows[i] >= 0 );
+			}
+			if( good ) {
+				SetRows( firstRow, numberOfRows, &rows[0] );
+			}
+		}
+	}
+	if( !good ) {
+		Reset( 0 );
+	}
+}
+
+template<typename DISTANCE_TYPE>
+void CQuantizedDissimilarityMatrix<DISTANCE_TYPE>::Save( ostream& output ) const
+{
+	output.precision( numeric_limits<DistanceType>::digits10 + 3 );
+	output << size << endl;
+	for( size_t i = 0; i < size; i++ ) {
+		for( size_t j = 0; j < size; j++ ) {
+			if( i > 0 || j > 0 ) {
+				output << " ";
+			}
+			output << Distance( i, j );
+		}
+	}
+	output << endl;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Overload of SetExtendedRows of DissimilarityMatrix.h, distances to old
+// objects are not quantized again.
+template<typename DISTANCE_TYPE>
+void SetExtendedRows( CQuantizedDissimilarityMatrix<DISTANCE_TYPE>& newMatrix,
+	const CQuantizedDissimilarityMatrix<DISTANCE_TYPE>& matrix,
+	size_t firstRow, size_t numberOfRows, DISTANCE_TYPE* rowsDistances )
+{
+	newMatrix.SetExtendedRows( matrix, firstRow, numberOfRows, rowsDistances );
+}
+
+///////////////////////////////////////////////////////////////////////////////
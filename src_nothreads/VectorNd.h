@@ -0,0 +1,96 @@
+#pragma once
+
+#include <Metrics.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Vector of compile-time dimension.
+template<size_t DIMENSION, typename NUMERIC_TYPE, typename METRIC = CEuclideanMetric>
+struct CVectorNd {
+	typedef NUMERIC_TYPE NumericType;
+	typedef NumericType DistanceType;
+	typedef METRIC MetricType;
+	static const size_t Dimension = DIMENSION;
+
+	NumericType Coordinates[DIMENSION];
+
+	CVectorNd()
+	{
+		fill( Coordinates, Coordinates + Dimension, NumericType( 0 ) );
+	}
+
+	size_t Size() const { return Dimension; }
+	NumericType& operator[]( size_t i ) { return Coordinates[i]; }
+	NumericType operator[]( size_t i ) const { return Coordinates[i]; }
+
+	DistanceType Distance( const CVectorNd& point ) const
+	{
+		return MetricType::Distance( Coordinates, point.Coordinates, Dimension );
+	}
+
+	// Distances from point to points[0, count), coordinates of consecutive
+	// vectors are consecutive since vector has no padding.
+	static void Distances( const CVectorNd& point, const CVectorNd* points,
+		size_t count, DistanceType* distances )
+	{
+		MetricType::Distances( point.Coordinates, points->Coordinates, count, Dimension, distances );
+	}
+
+	bool operator==( const CVectorNd& point ) const
+	{
+		return equal( Coordinates, Coordinates + Dimension, point.Coordinates );
+	}
+
+	bool operator<( const CVectorNd& point ) const
+	{
+		return lexicographical_compare( Coordinates, Coordinates + Dimension,
+			point.Coordinates, point.Coordinates + Dimension );
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Vector of dimension known only at runtime, slower than CVectorNd.
+template<typename NUMERIC_TYPE, typename METRIC = CEuclideanMetric>
+struct CDynamicVector {
+	typedef NUMERIC_TYPE NumericType;
+	typedef NumericType DistanceType;
+	typedef METRIC MetricType;
+
+	vector<NumericType> Coordinates;
+
+	explicit CDynamicVector( size_t dimension = 0 ) :
+		Coordinates( dimension, 0 )
+	{
+	}
+
+	size_t Size() const { return Coordinates.size(); }
+	NumericType& operator[]( size_t i ) { return Coordinates[i]; }
+	NumericType operator[]( size_t i ) const { return Coordinates[i]; }
+
+	DistanceType Distance( const CDynamicVector& point ) const
+	{
+		assert( Size() == point.Size() );
+		return MetricType::Distance( &Coordinates[0], &point.Coordinates[0], Size() );
+	}
+
+	static void Distances( const CDynamicVector& point, const CDynamicVector* points,
+		size_t count, DistanceType* distances )
+	{
+		for( size_t i = 0; i < count; i++ ) {
+			distances[i] = point.Distance( points[i] );
+		}
+	}
+
+	bool operator==( const CDynamicVector& point ) const
+	{
+		return ( Coordinates == point.Coordinates );
+	}
+
+	bool operator<( const CDynamicVector& point ) const
+	{
+		return ( Coordinates < point.Coordinates );
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
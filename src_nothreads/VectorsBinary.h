@@ -0,0 +1,160 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstring>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Header of binary vectors file, it is followed by Dimension columns of
+// NumberOfVectors coordinates of ElementSize bytes (4 - float, 8 - double).
+// Byte order is the native one.
+struct CVectorsBinaryHeader {
+	char Magic[4];
+	uint32_t Version;
+	uint32_t ElementSize;
+	uint32_t Reserved;
+	uint64_t NumberOfVectors;
+	uint64_t Dimension;
+};
+
+// Binary vectors file, it is mapped to memory.
+class CVectorsBinary {
+private:
+	CVectorsBinary( const CVectorsBinary& );
+	CVectorsBinary& operator=( const CVectorsBinary& );
+
+public:
+	static const uint32_t Version = 1;
+
+	// File starts with the magic of binary vectors files.
+	static bool IsBinary( const string& filename );
+	// Writes numberOfVectors vectors given by rows of coordinates.
+	static void Write( ostream& output, size_t numberOfVectors, size_t dimension,
+		const float* coordinates );
+
+	explicit CVectorsBinary( const string& filename );
+	~CVectorsBinary();
+
+	size_t NumberOfVectors() const { return static_cast<size_t>( header.NumberOfVectors ); }
+	size_t Dimension() const { return static_cast<size_t>( header.Dimension ); }
+
+	// Copies coordinates of vector i to vectorsCoordinates[i][0, Dimension()).
+	template<typename NUMERIC_TYPE>
+	void Read( NUMERIC_TYPE* const* vectorsCoordinates ) const;
+
+private:
+	int file;
+	const char* data;
+	size_t dataSize;
+	CVectorsBinaryHeader header;
+
+	static const char* magic() { return "PAMV"; }
+
+	template<typename NUMERIC_TYPE, typename ELEMENT_TYPE>
+	void read( NUMERIC_TYPE* const* vectorsCoordinates ) const;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+inline bool CVectorsBinary::IsBinary( const string& filename )
+{
+	ifstream input( filename.c_str(), ios::binary );
+	char fileMagic[sizeof( header.Magic )];
+	return ( input.read( fileMagic, sizeof( fileMagic ) )
+		&& equal( fileMagic, fileMagic + sizeof( fileMagic ), magic() ) );
+}
+
+inline void CVectorsBinary::Write( ostream& output, size_t numberOfVectors,
+	size_t dimension, const float* coordinates )
+{
+	CVectorsBinaryHeader fileHeader;
+	memcpy( fileHeader.Magic, magic(), sizeof( fileHeader.Magic ) );
+	fileHeader.Version = Version;
+	fileHeader.ElementSize = sizeof( float );
+	fileHeader.Reserved = 0;
+	fileHeader.NumberOfVectors = numberOfVectors;
+	fileHeader.Dimension = dimension;
+	output.write( reinterpret_cast<const char*>( &fileHeader ), sizeof( fileHeader ) );
+
+	vector<float> column( numberOfVectors );
+	for( size_t j = 0; j < dimension; j++ ) {
+		for( size_t i = 0; i < numberOfVectors; i++ ) {
+			column[i] = coordinates[i * dimension + j];
+		}
+		output.write( reinterpret_cast<const char*>( &column[0] ),
+			numberOfVectors * sizeof( float ) );
+	}
+}
+
+inline CVectorsBinary::CVectorsBinary( const string& filename ) :
+	file( -1 ),
+	data( 0 ),
+	dataSize( 0 )
+{
+	file = open( filename.c_str(), O_RDONLY );
+	struct stat fileStatus;
+	if( file == -1 || fstat( file, &fileStatus ) != 0
+		|| static_cast<size_t>( fileStatus.st_size ) < sizeof( header ) )
+	{
+		if( file != -1 ) {
+			close( file );
+		}
+		throw domain_error( "bad binary vectors file '" + filename + "'!" );
+	}
+	dataSize = fileStatus.st_size;
+	void* const mapping = mmap( 0, dataSize, PROT_READ, MAP_PRIVATE, file, 0 );
+	if( mapping == MAP_FAILED ) {
+		close( file );
+		throw runtime_error( "cannot map vectors file '" + filename + "'!" );
+	}
+	data = static_cast<const char*>( mapping );
+
+	memcpy( &header, data, sizeof( header ) );
+	const bool good = ( equal( header.Magic, header.Magic + sizeof( header.Magic ), magic() )
+		&& header.Version == Version
+		&& ( header.ElementSize == sizeof( float ) || header.ElementSize == sizeof( double ) )
+		&& header.Dimension > 0
+		&& ( dataSize - sizeof( header ) ) / header.ElementSize / header.Dimension
+			== header.NumberOfVectors
+		&& ( dataSize - sizeof( header ) ) % ( header.ElementSize * header.Dimension ) == 0 );
+	if( !good ) {
+		munmap( mapping, dataSize );
+		close( file );
+		throw domain_error( "bad binary vectors file '" + filename + "'!" );
+	}
+}
+
+inline CVectorsBinary::~CVectorsBinary()
+{
+	munmap( const_cast<char*>( data ), dataSize );
+	close( file );
+}
+
+template<typename NUMERIC_TYPE>
+void CVectorsBinary::Read( NUMERIC_TYPE* const* vectorsCoordinates ) const
+{
+	if( header.ElementSize == sizeof( float ) ) {
+		read<NUMERIC_TYPE, float>( vectorsCoordinates );
+	} else {
+		read<NUMERIC_TYPE, double>( vectorsCoordinates );
+	}
+}
+
+template<typename NUMERIC_TYPE, typename ELEMENT_TYPE>
+void CVectorsBinary::read( NUMERIC_TYPE* const* vectorsCoordinates ) const
+{
+	// header size is a multiple of element size, so columns are aligned
+	const ELEMENT_TYPE* column = reinterpret_cast<const ELEMENT_TYPE*>( data + sizeof( header ) );
+	for( size_t j = 0; j < Dimension(); j++ ) {
+		for( size_t i = 0; i < NumberOfVectors(); i++ ) {
+			vectorsCoordinates[i][j] = static_cast<NUMERIC_TYPE>( column[i] );
+		}
+		column += NumberOfVectors();
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
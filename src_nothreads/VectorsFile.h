@@ -0,0 +1,43 @@
+#pragma once
+
+#include <VectorsText.h>
+#include <VectorsBinary.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Reads vectors text or binary file by one process to consecutive rows of
+// coordinates, memory of coordinates is reused.
+template<typename NUMERIC_TYPE>
+void ReadVectorsFile( const string& filename, vector<NUMERIC_TYPE>& coordinates,
+	size_t& numberOfVectors, size_t& dimension )
+{
+	if( CVectorsBinary::IsBinary( filename ) ) {
+		const CVectorsBinary binary( filename );
+		numberOfVectors = binary.NumberOfVectors();
+		dimension = binary.Dimension();
+		coordinates.resize( numberOfVectors * dimension );
+		vector<NUMERIC_TYPE*> vectorsCoordinates( numberOfVectors );
+		for( size_t i = 0; i < numberOfVectors; i++ ) {
+			vectorsCoordinates[i] = &coordinates[i * dimension];
+		}
+		if( numberOfVectors > 0 ) {
+			binary.Read( &vectorsCoordinates[0] );
+		}
+	} else {
+		const CVectorsText text( filename );
+		numberOfVectors = text.NumberOfVectors();
+		dimension = text.Dimension();
+		coordinates.resize( numberOfVectors * dimension );
+		vector<CVectorsChunk> chunks;
+		text.Split( 1, chunks );
+		for( size_t chunk = 0; chunk < chunks.size(); chunk++ ) {
+			const char* position = chunks[chunk].Begin;
+			const size_t end = chunks[chunk].FirstVector + chunks[chunk].NumberOfVectors;
+			for( size_t i = chunks[chunk].FirstVector; i < end; i++ ) {
+				text.ParseVector( position, chunks[chunk].End, &coordinates[i * dimension] );
+			}
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
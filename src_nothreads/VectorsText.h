@@ -0,0 +1,359 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstdlib>
+#include <cstring>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Decimal numbers of up to MaxDigits significant digits are integers exact in
+// REAL_TYPE, and so are powers of ten up to 10^MaxExponent.
+template<typename REAL_TYPE>
+struct CExactDecimals;
+
+template<>
+struct CExactDecimals<double> {
+	static const int MaxDigits = 15;
+	static const int MaxExponent = 22;
+	static double Convert( const char* text, char** end ) { return strtod( text, end ); }
+};
+
+template<>
+struct CExactDecimals<float> {
+	static const int MaxDigits = 7;
+	static const int MaxExponent = 10;
+	static float Convert( const char* text, char** end ) { return strtof( text, end ); }
+};
+
+// Parses number from [position, end) after spaces and tabs, the number must
+// end with a space, a tab, a line end or the end. Decimal numbers of at most
+// MaxDigits significant digits and small exponents are converted exactly in
+// REAL_TYPE and rounded once, others are converted by strtod or strtof, so
+// values are those of strtod or strtof.
+template<typename REAL_TYPE>
+inline bool ParseNumber( const char*& position, const char* end, REAL_TYPE& value )
+{
+	static const double PowersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6,
+		1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18,
+		1e19, 1e20, 1e21, 1e22 };
+	const int MaxDigits = CExactDecimals<REAL_TYPE>::MaxDigits;
+	const int MaxExponent = CExactDecimals<REAL_TYPE>::MaxExponent;
+
+	while( position < end && ( *position == ' ' || *position == '\t' ) ) {
+		++position;
+	}
+	const char* const begin = position;
+	const char* tokenEnd = begin;
+	while( tokenEnd < end && *tokenEnd != ' ' && *tokenEnd != '\t'
+		&& *tokenEnd != '\r' && *tokenEnd != '\n' )
+	{
+		++tokenEnd;
+	}
+	if( begin == tokenEnd ) {
+		return false;
+	}
+
+	const char* p = begin;
+	const bool negative = ( *p == '-' );
+	if( *p == '-' || *p == '+' ) {
+		++p;
+	}
+	unsigned long long mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool hasDigits = false;
+	bool exact = true;
+	bool fraction = false;
+	for( ; p < tokenEnd; ++p ) {
+		if( *p == '.' && !fraction ) {
+			fraction = true;
+			continue;
+		}
+		if( *p < '0' || *p > '9' ) {
+			break;
+		}
+		hasDigits = true;
+		const int digit = *p - '0';
+		if( mantissa > 0 || digit > 0 ) {
+			if( digits < MaxDigits ) {
+				mantissa = mantissa * 10 + digit;
+				digits++;
+				exponent -= fraction ? 1 : 0;
+			} else {
+				exact = false;
+			}
+		} else {
+			exponent -= fraction ? 1 : 0;
+		}
+	}
+	if( hasDigits && p < tokenEnd && ( *p == 'e' || *p == 'E' ) ) {
+		++p;
+		const bool negativeExponent = ( p < tokenEnd && *p == '-' );
+		if( p < tokenEnd && ( *p == '-' || *p == '+' ) ) {
+			++p;
+		}
+		int exponentValue = 0;
+		const char* const exponentBegin = p;
+		for( ; p < tokenEnd && *p >= '0' && *p <= '9'; ++p ) {
+			exponentValue = min( exponentValue * 10 + ( *p - '0' ), 10000 );
+		}
+		hasDigits = ( p > exponentBegin );
+		exponent += negativeExponent ? -exponentValue : exponentValue;
+	}
+
+	if( hasDigits && p == tokenEnd && exact
+		&& exponent >= -MaxExponent && exponent <= MaxExponent )
+	{
+		const REAL_TYPE exactMantissa = static_cast<REAL_TYPE>( mantissa );
+		const REAL_TYPE power = static_cast<REAL_TYPE>(
+			PowersOfTen[exponent < 0 ? -exponent : exponent] );
+		value = ( exponent < 0 ) ? ( exactMantissa / power ) : ( exactMantissa * power );
+		value = negative ? -value : value;
+	} else {
+		// long, inf or nan numbers
+		char buffer[64];
+		const size_t length = tokenEnd - begin;
+		if( length >= sizeof( buffer ) ) {
+			return false;
+		}
+		copy( begin, tokenEnd, buffer );
+		buffer[length] = '\0';
+		char* bufferEnd = 0;
+		value = CExactDecimals<REAL_TYPE>::Convert( buffer, &bufferEnd );
+		if( bufferEnd != buffer + length ) {
+			return false;
+		}
+	}
+	position = tokenEnd;
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Lines of vectors file between Begin and End.
+struct CVectorsChunk {
+	const char* Begin;
+	const char* End;
+	// Index of the first vector of the chunk.
+	size_t FirstVector;
+	size_t NumberOfVectors;
+};
+
+// Vectors file with header 'UNUSED NUMBER_OF_VECTORS [DIMENSION]', dimension
+// is 2 by default, and lines 'UNUSED X1 ... XDIMENSION', empty lines are
+// skipped. The file is mapped to memory and parsed in place by chunks of
+// lines, so chunks may be parsed independently.
+class CVectorsText {
+private:
+	CVectorsText( const CVectorsText& );
+	CVectorsText& operator=( const CVectorsText& );
+
+public:
+	explicit CVectorsText( const string& filename );
+	~CVectorsText();
+
+	size_t NumberOfVectors() const { return numberOfVectors; }
+	size_t Dimension() const { return dimension; }
+
+	// Splits lines of vectors to at most numberOfChunks chunks of about equal
+	// size and numbers them, checks the number of vectors given by the header.
+	void Split( size_t numberOfChunks, vector<CVectorsChunk>& chunks ) const;
+
+	// Parses vector line at position, which is moved to the next line.
+	template<typename NUMERIC_TYPE>
+	void ParseVector( const char*& position, const char* end, NUMERIC_TYPE* coordinates ) const
+	{
+		ParseVector( position, end, dimension, coordinates );
+	}
+
+	// Parses header in [begin, end), returns the beginning of vectors lines.
+	static const char* ParseHeader( const char* begin, const char* end,
+		size_t& numberOfVectors, size_t& dimension );
+	// Splits lines in [begin, end) to at most numberOfChunks chunks as Split.
+	static void SplitLines( const char* begin, const char* end, size_t numberOfChunks,
+		vector<CVectorsChunk>& chunks );
+	template<typename NUMERIC_TYPE>
+	static void ParseVector( const char*& position, const char* end, size_t dimension,
+		NUMERIC_TYPE* coordinates );
+
+private:
+	int file;
+	const char* text;
+	size_t textSize;
+	const char* vectorsBegin;
+	size_t numberOfVectors;
+	size_t dimension;
+
+	static bool isBlank( const char* position, const char* end );
+	static size_t countVectors( const char* begin, const char* end );
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+inline CVectorsText::CVectorsText( const string& filename ) :
+	file( -1 ),
+	text( 0 ),
+	textSize( 0 ),
+	vectorsBegin( 0 ),
+	numberOfVectors( 0 ),
+	dimension( 0 )
+{
+	file = open( filename.c_str(), O_RDONLY );
+	if( file == -1 ) {
+		throw domain_error( "cannot open vectors file '" + filename + "'!" );
+	}
+	struct stat fileStatus;
+	if( fstat( file, &fileStatus ) != 0 || fileStatus.st_size == 0 ) {
+		close( file );
+		throw domain_error( "bad vectors file format!" );
+	}
+	textSize = fileStatus.st_size;
+	void* const mapping = mmap( 0, textSize, PROT_READ, MAP_PRIVATE, file, 0 );
+	if( mapping == MAP_FAILED ) {
+		close( file );
+		throw runtime_error( "cannot map vectors file '" + filename + "'!" );
+	}
+	text = static_cast<const char*>( mapping );
+	madvise( mapping, textSize, MADV_SEQUENTIAL );
+
+	try {
+		vectorsBegin = ParseHeader( text, text + textSize, numberOfVectors, dimension );
+	} catch( ... ) {
+		munmap( const_cast<char*>( text ), textSize );
+		close( file );
+		throw;
+	}
+}
+
+inline CVectorsText::~CVectorsText()
+{
+	munmap( const_cast<char*>( text ), textSize );
+	close( file );
+}
+
+inline void CVectorsText::Split( size_t numberOfChunks, vector<CVectorsChunk>& chunks ) const
+{
+	SplitLines( vectorsBegin, text + textSize, numberOfChunks, chunks );
+	const size_t numberOfSplitVectors = chunks.empty() ?
+		0 : ( chunks.back().FirstVector + chunks.back().NumberOfVectors );
+	if( numberOfSplitVectors != numberOfVectors ) {
+		throw domain_error( "number of vectors does not match vectors file header!" );
+	}
+}
+
+inline void CVectorsText::SplitLines( const char* const vectorsBegin, const char* const end,
+	size_t numberOfChunks, vector<CVectorsChunk>& chunks )
+{
+	const size_t size = end - vectorsBegin;
+	numberOfChunks = max<size_t>( 1, min( numberOfChunks, size ) );
+
+	chunks.clear();
+	const char* begin = vectorsBegin;
+	for( size_t i = 1; i <= numberOfChunks && begin < end; i++ ) {
+		const char* chunkEnd = vectorsBegin + size / numberOfChunks * i;
+		if( i == numberOfChunks ) {
+			chunkEnd = end;
+		}
+		chunkEnd = max( chunkEnd, begin );
+		const char* const lineEnd = static_cast<const char*>(
+			memchr( chunkEnd, '\n', end - chunkEnd ) );
+		chunkEnd = ( lineEnd != 0 ) ? ( lineEnd + 1 ) : end;
+
+		CVectorsChunk chunk;
+		chunk.Begin = begin;
+		chunk.End = chunkEnd;
+		chunks.push_back( chunk );
+		begin = chunkEnd;
+	}
+
+	size_t firstVector = 0;
+	for( size_t i = 0; i < chunks.size(); i++ ) {
+		chunks[i].FirstVector = firstVector;
+		chunks[i].NumberOfVectors = countVectors( chunks[i].Begin, chunks[i].End );
+		firstVector += chunks[i].NumberOfVectors;
+	}
+}
+
+template<typename NUMERIC_TYPE>
+void CVectorsText::ParseVector( const char*& position, const char* end, size_t dimension,
+	NUMERIC_TYPE* coordinates )
+{
+	while( isBlank( position, end ) ) {
+		position = static_cast<const char*>( memchr( position, '\n', end - position ) ) + 1;
+	}
+
+	NUMERIC_TYPE value = 0;
+	bool good = ParseNumber( position, end, value ); // unused
+	for( size_t i = 0; good && i < dimension; i++ ) {
+		good = ParseNumber( position, end, coordinates[i] );
+	}
+	while( position < end && ( *position == ' ' || *position == '\t' || *position == '\r' ) ) {
+		++position;
+	}
+	if( !good || ( position < end && *position != '\n' ) ) {
+		throw domain_error( "bad vectors file format!" );
+	}
+	if( position < end ) {
+		++position;
+	}
+}
+
+// Line at position is blank and ends with a line end.
+inline bool CVectorsText::isBlank( const char* position, const char* end )
+{
+	while( position < end && ( *position == ' ' || *position == '\t' || *position == '\r' ) ) {
+		++position;
+	}
+	return ( position < end && *position == '\n' );
+}
+
+inline size_t CVectorsText::countVectors( const char* begin, const char* end )
+{
+	size_t count = 0;
+	while( begin < end ) {
+		const char* lineEnd = static_cast<const char*>( memchr( begin, '\n', end - begin ) );
+		lineEnd = ( lineEnd != 0 ) ? lineEnd : end;
+		for( const char* position = begin; position < lineEnd; ++position ) {
+			if( *position != ' ' && *position != '\t' && *position != '\r' ) {
+				count++;
+				break;
+			}
+		}
+		begin = lineEnd + 1;
+	}
+	return count;
+}
+
+inline const char* CVectorsText::ParseHeader( const char* const begin, const char* const end,
+	size_t& numberOfVectors, size_t& dimension )
+{
+	const char* position = begin;
+	double unused = 0;
+	double vectors = 0;
+	if( !ParseNumber( position, end, unused ) || !ParseNumber( position, end, vectors )
+		|| !( vectors >= 0 ) || vectors != static_cast<size_t>( vectors ) )
+	{
+		throw domain_error( "bad vectors file format!" );
+	}
+	numberOfVectors = static_cast<size_t>( vectors );
+
+	dimension = 2;
+	double headerDimension = 0;
+	if( ParseNumber( position, end, headerDimension ) ) {
+		if( !( headerDimension >= 0 ) || headerDimension != static_cast<size_t>( headerDimension ) ) {
+			throw domain_error( "bad vectors file format!" );
+		}
+		dimension = static_cast<size_t>( headerDimension );
+	}
+	if( dimension == 0 ) {
+		throw domain_error( "bad vectors dimension!" );
+	}
+
+	const char* const lineEnd = static_cast<const char*>( memchr( position, '\n', end - position ) );
+	return ( lineEnd != 0 ) ? ( lineEnd + 1 ) : end;
+}
+
+///////////////////////////////////////////////////////////////////////////////
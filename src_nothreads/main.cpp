@@ -1,9 +1,12 @@
 #include <cmath>
 #include <cassert>
 #include <map>
+#include <set>
 #include <limits>
 #include <vector>
 #include <string>
+#include <sstream>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
 #include <algorithm>
@@ -13,257 +16,891 @@
 using namespace std;
 
 #include <MpiSupport.h>
-#include <Vector2d.h>
+#include <CommandLine.h>
+#include <VectorNd.h>
+#include <VectorsText.h>
+#include <MpiVectorsText.h>
+#include <MpiClusteringWriter.h>
+#include <VectorsBinary.h>
+#include <PamEngine.h>
+#include <NumaSupport.h>
 #include <DissimilarityMatrix.h>
+#include <QuantizedDissimilarityMatrix.h>
+#ifdef PAM_FILE_MATRIX
+#include <FileDissimilarityMatrix.h>
+#endif
+#ifdef PAM_LAZY_MATRIX
+#include <LazyDissimilarityMatrix.h>
+#endif
+#ifdef PAM_KNN_MATRIX
+#include <KnnDissimilarityMatrix.h>
+#endif
+#include <SortedNeighbors.h>
 #include <PartitioningAroundMedoids.h>
-
-typedef float DistanceType;
-typedef CVector2d<DistanceType> CVector;
+#include <ClusteringQuality.h>
+#include <PamLibrary.h>
+
+#if defined( PAM_QUANTIZED_MATRIX )
+typedef CQuantizedDissimilarityMatrix<DistanceType> DissimilarityMatrixType;
+#elif defined( PAM_FILE_MATRIX )
+typedef CFileDissimilarityMatrix<DistanceType> DissimilarityMatrixType;
+#elif defined( PAM_LAZY_MATRIX )
+typedef CLazyDissimilarityMatrix<DistanceType> DissimilarityMatrixType;
+#elif defined( PAM_KNN_MATRIX )
+typedef CKnnDissimilarityMatrix<DistanceType> DissimilarityMatrixType;
+#else
 typedef CDissimilarityMatrix<DistanceType> DissimilarityMatrixType;
+#endif
 typedef CPartitioningAroundMedois<DissimilarityMatrixType> PamType;
+typedef CClusteringQuality<DissimilarityMatrixType> ClusteringQualityType;
 
 ///////////////////////////////////////////////////////////////////////////////
 
-#ifndef MPIAPI
-#define MPIAPI
-#endif
+// Input vectors collapsed into objects: identical vectors are one object,
+// weight of which is the number of the vectors.
+struct CInputObjects {
+	vector<DistanceType> Weights;
+	// object of each input vector
+	vector<size_t> VectorObjects;
+	// first input vector of each object
+	vector<size_t> ObjectVectors;
+	// Coordinates of objects by consecutive rows, only if KeepCoordinates.
+	bool KeepCoordinates;
+	size_t Dimension;
+	vector<DistanceType> Coordinates;
+	// Sums of weighted distances from each object to all objects, only if
+	// the matrix is built exactly and not extended.
+	vector<DistanceType> DistancesToAll;
+
+	CInputObjects() :
+		KeepCoordinates( false ),
+		Dimension( 0 )
+	{
+	}
+};
 
-struct CObjectMedoidDistance {
-	unsigned long int Object;
-	unsigned long int Medoid;
-	DistanceType Distance;
+void AllReduce( CClusteringQualitySums& sums )
+{
+	const size_t numberOfClusters = sums.NumberOfClusters();
+	vector<double> buffer;
+	buffer.reserve( 4 * numberOfClusters );
+	buffer.insert( buffer.end(), sums.Sizes.begin(), sums.Sizes.end() );
+	buffer.insert( buffer.end(), sums.Deviations.begin(), sums.Deviations.end() );
+	buffer.insert( buffer.end(), sums.Silhouettes.begin(), sums.Silhouettes.end() );
+	buffer.insert( buffer.end(), sums.SimplifiedSilhouettes.begin(),
+		sums.SimplifiedSilhouettes.end() );
+
+	MpiCheck( MPI_Allreduce( MPI_IN_PLACE, &buffer[0], static_cast<int>( buffer.size() ),
+		MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD ), "MPI_Allreduce for CClusteringQualitySums" );
+
+	vector<double>::const_iterator begin = buffer.begin();
+	copy( begin, begin + numberOfClusters, sums.Sizes.begin() );
+	begin += numberOfClusters;
+	copy( begin, begin + numberOfClusters, sums.Deviations.begin() );
+	begin += numberOfClusters;
+	copy( begin, begin + numberOfClusters, sums.Silhouettes.begin() );
+	begin += numberOfClusters;
+	copy( begin, begin + numberOfClusters, sums.SimplifiedSilhouettes.begin() );
+}
 
-	CObjectMedoidDistance() :
-		Object( 0 ),
-		Medoid( 0 ),
-		Distance( 0 )
+// Gathers values of all objects, each process has values of its objects.
+void AllGatherObjects( vector<DistanceType>& values )
+{
+	vector<int> counts( CMpiSupport::NumberOfProccess() );
+	vector<int> displacements( CMpiSupport::NumberOfProccess() );
+	for( size_t rank = 0; rank < CMpiSupport::NumberOfProccess(); rank++ ) {
+		size_t objectBegin = 0;
+		size_t objectEnd = 0;
+		CalcBeginEndObjects( values.size(), CMpiSupport::NumberOfProccess(), rank,
+			objectBegin, objectEnd );
+		counts[rank] = static_cast<int>( objectEnd - objectBegin );
+		displacements[rank] = static_cast<int>( objectBegin );
+	}
+
+	MpiCheck( MPI_Allgatherv( MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+		&values[0], &counts[0], &displacements[0], MPI_FLOAT, MPI_COMM_WORLD ),
+		"MPI_Allgatherv for objects" );
+}
+
+void PrintQuality( const PamType& pam, const CInputObjects& objects,
+	const CClusteringQualitySums& sums )
+{
+	cout << "cost\t" << sums.Deviation() << endl;
+	cout << "silhouette\t" << sums.Silhouette() << endl;
+	cout << "simplified silhouette\t" << sums.SimplifiedSilhouette() << endl;
+	for( size_t cluster = 0; cluster < sums.NumberOfClusters(); cluster++ ) {
+		const double size = sums.Sizes[cluster];
+		cout << "cluster\t" << objects.ObjectVectors[pam.Medoids()[cluster]] << "\t" << size
+			<< "\t" << sums.Silhouettes[cluster] / size
+			<< "\t" << sums.SimplifiedSilhouettes[cluster] / size << endl;
+	}
+}
+
+void EvaluateQuality( const PamType& pam, const CInputObjects& objects,
+	const size_t objectBegin, const size_t objectEnd )
+{
+	double qualityTime = 0.0;
+	CClusteringQualitySums sums( pam.NumberOfClusters() );
+	ClusteringQualityType quality( pam.DissimilarityMatrix(),
+		pam.Medoids(), pam.ObjectMedoids(), pam.Weights() );
 	{
+		CMpiTimer timer( qualityTime );
+		quality.Evaluate( objectBegin, objectEnd, sums );
+		AllReduce( sums );
+		AllGatherObjects( quality.Silhouettes() );
 	}
 
-	void Min( const CObjectMedoidDistance& another );
-	void AllReduce();
+	if( CMpiSupport::Rank() == 0 ) {
+		PrintQuality( pam, objects, sums );
+		cout << "quality time\t" << qualityTime << endl;
+#ifdef _DEBUG
+		cout << endl;
+		for( size_t i = 0; i < objects.VectorObjects.size(); i++ ) {
+			const size_t object = objects.VectorObjects[i];
+			cout << i << "\t" << quality.ObjectCluster( object )
+				<< "\t" << quality.Silhouettes()[object] << endl;
+		}
+		cout << endl;
+#endif
+	}
+}
 
-private:
-	static MPI_Datatype datatype();
-	static MPI_Op op();
-	static void MPIAPI objectMedoidDistanceMin( void* in, void* inout,
-		int* length, MPI_Datatype* /*type*/ );
+// Options of pam given by command line.
+struct CPamOptions {
+	size_t NumberOfClusters;
+	CStopCriteria StopCriteria;
+	// Medoids to start swapping from, building is skipped if they are given.
+	vector<size_t> InitialMedoids;
+	string SaveMedoidsFilename;
+	// Clusters of all vectors are saved if filename is given.
+	string SaveClusteringFilename;
+	bool BinaryClustering;
+	string MatrixFilename;
+	string SaveMatrixFilename;
+	string CheckpointFilename;
+	// Minimal number of seconds between checkpoints.
+	double CheckpointInterval;
+	string ResumeFilename;
+	bool EvaluateQuality;
+	string Metric;
+	string SaveModelFilename;
+	// Vectors are clustered by two levels if PartitionSize is not 0,
+	// see CClusteringOptions::PartitionSize.
+	size_t PartitionSize;
+	CClusteringOptions::PartitioningType Partitioning;
+	// Length of lists of sorted neighbors, 0 - no lists.
+	size_t SortedNeighbors;
+	bool SwapCache;
+
+	CPamOptions() :
+		NumberOfClusters( 0 ),
+		BinaryClustering( false ),
+		CheckpointInterval( 60 ),
+		EvaluateQuality( false ),
+		PartitionSize( 0 ),
+		Partitioning( CClusteringOptions::RandomPartitioning ),
+		SortedNeighbors( 0 ),
+		SwapCache( false )
+	{
+	}
 };
 
-void CObjectMedoidDistance::Min( const CObjectMedoidDistance& another )
+vector<size_t> ReadMedoids( const string& filename )
 {
-	if( another.Distance < Distance ) {
-		*this = another;
+	ifstream input( filename.c_str() );
+	vector<size_t> medoids;
+	size_t medoid = 0;
+	while( input >> medoid ) {
+		medoids.push_back( medoid );
 	}
+	if( !input.eof() ) {
+		throw domain_error( "bad medoids file '" + filename + "'!" );
+	}
+	return medoids;
 }
 
-void CObjectMedoidDistance::AllReduce()
+void SaveMedoids( const string& filename, const vector<size_t>& medoids )
 {
-	MpiCheck( MPI_Allreduce( MPI_IN_PLACE, this, 1 /* count */, datatype(), op(), MPI_COMM_WORLD ),
-		"MPI_Allreduce for CObjectMedoidDistance" );
+	ofstream output( filename.c_str() );
+	for( size_t i = 0; i < medoids.size(); i++ ) {
+		output << medoids[i] << endl;
+	}
+	if( output.fail() ) {
+		throw domain_error( "cannot write medoids file '" + filename + "'!" );
+	}
 }
 
-MPI_Datatype CObjectMedoidDistance::datatype()
+// Saves clusters of vectors, each process gives clusters of its slice of vectors.
+void SaveClustering( const CPamOptions& options, const PamType& pam,
+	const CInputObjects& objects, DistanceType cost )
 {
-	static MPI_Datatype type = MPI_DATATYPE_NULL;
-	if( type == MPI_DATATYPE_NULL ) {
-		const int count = 3;
-		int blocklengths[count] = { 1, 1, 1 };
-		MPI_Datatype types[count] = { MPI_UNSIGNED_LONG, MPI_UNSIGNED_LONG, MPI_FLOAT };
-		MPI_Aint offsets[count] = {
-			offsetof( CObjectMedoidDistance, Object ),
-			offsetof( CObjectMedoidDistance, Medoid ),
-			offsetof( CObjectMedoidDistance, Distance ) };
-		MpiCheck( MPI_Type_create_struct( count, blocklengths, offsets, types, &type ),
-			"MPI_Type_create_struct for CObjectMedoidDistance" );
-		MpiCheck( MPI_Type_commit( &type ), "MPI_Type_commit for CObjectMedoidDistance" );
-	}
-	return type;
+	CClusteringOutput clustering;
+	clustering.Cost = cost;
+	vector<uint32_t> medoidClusters( pam.NumberOfObjects() );
+	for( size_t i = 0; i < pam.Medoids().size(); i++ ) {
+		clustering.Medoids.push_back( objects.ObjectVectors[pam.Medoids()[i]] );
+		medoidClusters[pam.Medoids()[i]] = static_cast<uint32_t>( i );
+	}
+	clustering.NumberOfVectors = objects.VectorObjects.size();
+	size_t vectorEnd = 0;
+	CalcBeginEndObjects( clustering.NumberOfVectors,
+		CMpiSupport::NumberOfProccess(), CMpiSupport::Rank(),
+		clustering.FirstVector, vectorEnd );
+	clustering.Clusters.resize( vectorEnd - clustering.FirstVector );
+	for( size_t i = clustering.FirstVector; i < vectorEnd; i++ ) {
+		const size_t medoid = pam.ObjectMedoids()[objects.VectorObjects[i]];
+		clustering.Clusters[i - clustering.FirstVector] = medoidClusters[medoid];
+	}
+
+	if( options.BinaryClustering ) {
+		CMpiClusteringWriter::WriteBinary( options.SaveClusteringFilename, clustering );
+	} else {
+		CMpiClusteringWriter::WriteText( options.SaveClusteringFilename, clustering );
+	}
 }
 
-MPI_Op CObjectMedoidDistance::op()
+// Saves medoids with their coordinates to assign other vectors by pam_predict.
+void SaveModel( const CPamOptions& options, const PamType& pam, const CInputObjects& objects )
 {
-	static MPI_Op op = MPI_OP_NULL;
-	if( op == MPI_OP_NULL ) {
-		MpiCheck( MPI_Op_create( objectMedoidDistanceMin,
-			false /* commute */, &op ), "MPI_Op_create for CObjectMedoidDistance" );
+	vector<size_t> medoidVectors;
+	vector<DistanceType> medoidsCoordinates;
+	for( size_t i = 0; i < pam.Medoids().size(); i++ ) {
+		const size_t medoid = pam.Medoids()[i];
+		medoidVectors.push_back( objects.ObjectVectors[medoid] );
+		medoidsCoordinates.insert( medoidsCoordinates.end(),
+			objects.Coordinates.begin() + medoid * objects.Dimension,
+			objects.Coordinates.begin() + ( medoid + 1 ) * objects.Dimension );
 	}
-	return op;
+	CClusteringModel model;
+	model.Reset( options.Metric, objects.Dimension, medoidVectors, medoidsCoordinates );
+	model.Save( options.SaveModelFilename );
 }
 
-void MPIAPI CObjectMedoidDistance::objectMedoidDistanceMin(
-	void* _in, void* _inout,
-	int* length, MPI_Datatype* /*type*/ )
+// Bound of difference between the cost and the cost of exact distances.
+DistanceType CostErrorBound( const PamType& pam )
 {
-	CObjectMedoidDistance* in = reinterpret_cast<CObjectMedoidDistance*>( _in );
-	CObjectMedoidDistance* inout = reinterpret_cast<CObjectMedoidDistance*>( _inout );
-	for( int i = 0; i < *length; i++ ) {
-		inout[i].Min( in[i] );
+	DistanceType bound = 0;
+	for( size_t object = 0; object < pam.NumberOfObjects(); object++ ) {
+		bound += pam.Weights()[object] * pam.DissimilarityMatrix().MaxError( object );
 	}
+	return bound;
 }
 
-///////////////////////////////////////////////////////////////////////////////
-
-// Initializing or Build  step
-void DoBuildStep( PamType& pam, CObjectMedoidDistance& best,
-	const size_t objectBegin, const size_t objectEnd )
+void DoPam( const CPamOptions& options, const DissimilarityMatrixType& matrix,
+	const CInputObjects& objects, double& pamTime )
 {
-	best.Distance = numeric_limits<DistanceType>::max();
-	best.Object = objectBegin;
-	for( size_t object = objectBegin; object < objectEnd; object++ ) {
-		if( pam.IsMedoid( object ) ) {
-			continue; // if object is medoid
+	typedef CPartitioningAroundMedois<DissimilarityMatrixType> PamType;
+	PamType pam( matrix, options.NumberOfClusters );
+	pam.SetWeights( objects.Weights );
+	if( !objects.DistancesToAll.empty() ) {
+		pam.SetDistancesToAll( objects.DistancesToAll );
+	}
+	if( options.SwapCache ) {
+		pam.EnableSwapCache();
+	}
+	CSortedNeighbors<DistanceType> sortedNeighbors;
+	if( options.SortedNeighbors > 0 ) {
+		double sortTime = 0.0;
+		{
+			CMpiTimer timer( sortTime );
+			sortedNeighbors.Build( matrix, options.SortedNeighbors,
+				CMpiSupport::Rank(), CMpiSupport::NumberOfProccess() );
 		}
+		if( CMpiSupport::Rank() == 0 ) {
+			cout << "sorted neighbors time\t" << sortTime << endl;
+		}
+		pam.SetSortedNeighbors( sortedNeighbors );
+	}
+	if( !options.InitialMedoids.empty() ) {
+		vector<size_t> initialMedoids;
+		for( size_t i = 0; i < options.InitialMedoids.size(); i++ ) {
+			if( options.InitialMedoids[i] >= objects.VectorObjects.size() ) {
+				throw domain_error( "bad initial medoids!" );
+			}
+			initialMedoids.push_back( objects.VectorObjects[options.InitialMedoids[i]] );
+		}
+		pam.SetMedoids( initialMedoids );
+	}
+	size_t iterations = 0;
+	if( !options.ResumeFilename.empty() ) {
+		CPamCheckpoint checkpoint;
+		checkpoint.Load( options.ResumeFilename );
+		if( checkpoint.NumberOfObjects != pam.NumberOfObjects()
+			|| checkpoint.NumberOfClusters != pam.NumberOfClusters() )
+		{
+			throw domain_error( "checkpoint '" + options.ResumeFilename
+				+ "' is for another problem!" );
+		}
+		pam.SetMedoids( checkpoint.Medoids );
+		iterations = checkpoint.Iterations;
+	}
 
-		const DistanceType distance = ( pam.State() == PamType::Initializing ) ?
-			pam.FindObjectDistanceToAll( object ) : -pam.AddMedoidProfit( object );
+	size_t objectBegin = 0;
+	size_t objectEnd = 0;
+	CalcBeginEndObjects( pam.NumberOfObjects(),
+		CMpiSupport::NumberOfProccess(), CMpiSupport::Rank(),
+		objectBegin, objectEnd );
+	CPamResult result;
+	{
+		CMpiTimer timer( pamTime );
+		CPamCheckpointer checkpointer( options.CheckpointFilename, options.CheckpointInterval );
+		result = RunPam( pam, options.StopCriteria, checkpointer, iterations,
+			objectBegin, objectEnd );
+	}
+
+	if( CMpiSupport::Rank() == 0 ) {
+		cout << "stop reason\t" << result.StopReasonName() << endl;
+		cout << "iterations\t" << result.Iterations << endl;
+		cout << "final cost\t" << result.Cost << endl;
+		const DistanceType costErrorBound = CostErrorBound( pam );
+		if( costErrorBound > 0 ) {
+			cout << "cost error bound\t" << costErrorBound << endl;
+		}
+		if( options.SortedNeighbors > 0 || options.SwapCache ) {
+			cout << "visited objects\t" << result.VisitedObjects << endl;
+			cout << "skipped objects\t" << result.SkippedObjects << endl;
+		}
+	}
+
+#ifdef _DEBUG
+	if( CMpiSupport::Rank() == 0 ) {
+		cout << endl;
+		map<size_t, size_t> medoidToClusterId;
+		for( size_t i = 0; i < objects.VectorObjects.size(); i++ ) {
+			const size_t object = objects.VectorObjects[i];
+			pair<map<size_t, size_t>::iterator, bool> pair = medoidToClusterId.insert(
+				make_pair( pam.ObjectMedoids()[object], medoidToClusterId.size() ) );
+			cout << i << "\t" << pair.first->second << endl;
+		}
+		cout << endl;
+	}
+#endif
 
-		if( distance < best.Distance ) {
-			best.Distance = distance;
-			best.Object = object;
+	if( CMpiSupport::Rank() == 0 && !options.SaveMedoidsFilename.empty() ) {
+		vector<size_t> medoids;
+		for( size_t i = 0; i < pam.Medoids().size(); i++ ) {
+			medoids.push_back( objects.ObjectVectors[pam.Medoids()[i]] );
 		}
+		SaveMedoids( options.SaveMedoidsFilename, medoids );
+	}
+
+	if( !options.SaveClusteringFilename.empty() ) {
+		SaveClustering( options, pam, objects, result.Cost );
+	}
+
+	if( CMpiSupport::Rank() == 0 && !options.SaveModelFilename.empty() ) {
+		SaveModel( options, pam, objects );
+	}
+
+	if( options.EvaluateQuality ) {
+		EvaluateQuality( pam, objects, objectBegin, objectEnd );
 	}
 }
 
-// Swap step
-void DoSwapStep( PamType& pam, CObjectMedoidDistance& best,
-	const size_t objectBegin, const size_t objectEnd )
+// Clusters vectors given by consecutive rows of dimension coordinates by
+// partitions and then their medoids, all processes share partitions.
+void DoPartitionedPam( const CPamOptions& options, const vector<DistanceType>& coordinates,
+	size_t dimension, double& pamTime )
 {
-	best.Distance = 0;
-	best.Medoid = pam.Medoids().front();
-	best.Object = objectBegin;
+	CClusteringOptions clusteringOptions;
+	clusteringOptions.NumberOfClusters = options.NumberOfClusters;
+	clusteringOptions.StopCriteria = options.StopCriteria;
+	clusteringOptions.Metric = options.Metric;
+#if defined( PAM_QUANTIZED_MATRIX )
+	clusteringOptions.Matrix = CClusteringOptions::QuantizedMatrix;
+#elif defined( PAM_LAZY_MATRIX )
+	clusteringOptions.Matrix = CClusteringOptions::LazyMatrix;
+	clusteringOptions.RowCacheSize = DissimilarityMatrixType::CacheSize();
+#elif defined( PAM_KNN_MATRIX )
+	clusteringOptions.Matrix = CClusteringOptions::KnnMatrix;
+	clusteringOptions.NumberOfNeighbors = DissimilarityMatrixType::NumberOfNeighbors();
+	clusteringOptions.CapNonNeighbors = DissimilarityMatrixType::CapNonNeighbors();
+#endif
+	clusteringOptions.Distributed = true;
+	clusteringOptions.PartitionSize = options.PartitionSize;
+	clusteringOptions.SortedNeighbors = options.SortedNeighbors;
+	clusteringOptions.SwapCache = options.SwapCache;
+	clusteringOptions.Partitioning = options.Partitioning;
+
+	const size_t numberOfVectors = coordinates.size() / dimension;
+	CClusteringResult result;
+	{
+		CMpiTimer timer( pamTime );
+		result = ClusterVectors( &coordinates[0], numberOfVectors, dimension,
+			clusteringOptions );
+	}
+
+	if( CMpiSupport::Rank() == 0 ) {
+		CPamResult pamResult;
+		pamResult.StopReason = result.StopReason;
+		cout << "partitions\t"
+			<< ( numberOfVectors + options.PartitionSize - 1 ) / options.PartitionSize << endl;
+		cout << "stop reason\t" << pamResult.StopReasonName() << endl;
+		cout << "iterations\t" << result.Iterations << endl;
+		cout << "final cost\t" << result.Cost << endl;
+	}
 
-	for( size_t object = objectBegin; object < objectEnd; object++ ) {
-		if( pam.IsMedoid( object ) ) {
-			continue; // if object is medoid
+	if( CMpiSupport::Rank() == 0 && !options.SaveMedoidsFilename.empty() ) {
+		SaveMedoids( options.SaveMedoidsFilename, result.Medoids );
+	}
+
+	if( !options.SaveClusteringFilename.empty() ) {
+		CClusteringOutput clustering;
+		clustering.Cost = result.Cost;
+		clustering.Medoids = result.Medoids;
+		clustering.NumberOfVectors = numberOfVectors;
+		size_t vectorEnd = 0;
+		CalcBeginEndObjects( numberOfVectors, CMpiSupport::NumberOfProccess(),
+			CMpiSupport::Rank(), clustering.FirstVector, vectorEnd );
+		clustering.Clusters.assign( result.Clusters.begin() + clustering.FirstVector,
+			result.Clusters.begin() + vectorEnd );
+		if( options.BinaryClustering ) {
+			CMpiClusteringWriter::WriteBinary( options.SaveClusteringFilename, clustering );
+		} else {
+			CMpiClusteringWriter::WriteText( options.SaveClusteringFilename, clustering );
 		}
+	}
 
-		for( size_t i = 0; i < pam.Medoids().size(); i++ ) {
-			const size_t medoid = pam.Medoids()[i];
-			DistanceType distance = pam.SwapResult( medoid, object );
-			if( distance < best.Distance ) {
-				best.Distance = distance;
-				best.Medoid = medoid;
-				best.Object = object;
-			}
+	if( CMpiSupport::Rank() == 0 && !options.SaveModelFilename.empty() ) {
+		vector<DistanceType> medoidsCoordinates;
+		for( size_t i = 0; i < result.Medoids.size(); i++ ) {
+			medoidsCoordinates.insert( medoidsCoordinates.end(),
+				coordinates.begin() + result.Medoids[i] * dimension,
+				coordinates.begin() + ( result.Medoids[i] + 1 ) * dimension );
 		}
+		CClusteringModel model;
+		model.Reset( options.Metric, dimension, result.Medoids, medoidsCoordinates );
+		model.Save( options.SaveModelFilename );
 	}
 }
 
-void CalcBeginEndObjects(
-	const size_t numberOfObjects, const size_t numberOfProcess, const size_t rank,
-	size_t& beginObject, size_t& endObject )
+// Collapses identical vectors into weighted objects, keeping order of
+// the first occurrences.
+template<typename VECTOR_TYPE>
+void CollapseDuplicates( vector<VECTOR_TYPE>& vectors, CInputObjects& objects )
 {
-	const size_t objectsPerProcess = numberOfObjects / numberOfProcess;
-	const size_t additionalObjects = numberOfObjects % numberOfProcess;
-	beginObject = objectsPerProcess * rank + min( rank, additionalObjects );
-	endObject = beginObject + objectsPerProcess;
-	if( rank < additionalObjects ) {
-		endObject++;
+	objects.Weights.clear();
+	objects.VectorObjects.resize( vectors.size() );
+	objects.ObjectVectors.clear();
+
+	typedef map<VECTOR_TYPE, size_t> CVectorToObjectMap;
+	CVectorToObjectMap vectorToObject;
+	for( size_t i = 0; i < vectors.size(); i++ ) {
+		pair<typename CVectorToObjectMap::iterator, bool> pair = vectorToObject.insert(
+			make_pair( vectors[i], objects.ObjectVectors.size() ) );
+		if( pair.second ) {
+			vectors[objects.ObjectVectors.size()] = vectors[i];
+			objects.ObjectVectors.push_back( i );
+			objects.Weights.push_back( 0 );
+		}
+		objects.Weights[pair.first->second] += 1;
+		objects.VectorObjects[i] = pair.first->second;
 	}
+	vectors.resize( objects.ObjectVectors.size() );
 }
 
-void RunPam( PamType& pam, const size_t objectBegin, const size_t objectEnd )
+template<size_t DIMENSION, typename METRIC>
+DistanceType* VectorCoordinates( size_t /* dimension */,
+	CVectorNd<DIMENSION, DistanceType, METRIC>& point )
 {
-	CObjectMedoidDistance best;
+	return point.Coordinates;
+}
 
-	// Building and Initializing
-	for( size_t i = 0; i < pam.NumberOfClusters(); i++ ) {
-#ifdef _DEBUG
-		cout << CMpiSupport::Rank() << " ["
-			<< objectBegin << ", " << objectEnd << ") "
-			<< "Building..." << i << endl;
-#endif
-		DoBuildStep( pam, best, objectBegin, objectEnd );
-		best.AllReduce();
+template<typename METRIC>
+DistanceType* VectorCoordinates( size_t dimension,
+	CDynamicVector<DistanceType, METRIC>& point )
+{
+	point.Coordinates.resize( dimension );
+	return &point.Coordinates[0];
+}
 
-		pam.AddMedoid( best.Object );
+template<typename VECTOR_TYPE>
+void ReadVectors( const CVectorsText& text, vector<VECTOR_TYPE>& vectors )
+{
+	vector<CVectorsChunk> chunks;
+	text.Split( 1, chunks );
+	vectors.resize( text.NumberOfVectors() );
+	for( size_t chunk = 0; chunk < chunks.size(); chunk++ ) {
+		const char* position = chunks[chunk].Begin;
+		const size_t end = chunks[chunk].FirstVector + chunks[chunk].NumberOfVectors;
+		for( size_t i = chunks[chunk].FirstVector; i < end; i++ ) {
+			text.ParseVector( position, chunks[chunk].End,
+				VectorCoordinates( text.Dimension(), vectors[i] ) );
+		}
 	}
+}
 
-	// Swapping
-	for( size_t iteration = 0; iteration < 1000; iteration++ ) {
-#ifdef _DEBUG
-		cout << CMpiSupport::Rank()
-			<< " Swapping..." << iteration << endl;
-#endif
-		DoSwapStep( pam, best, objectBegin, objectEnd );
-		best.AllReduce();
-
-		if( best.Distance < 0 ) {
-			pam.Swap( best.Medoid, best.Object );
-		} else {
-			break;
-		}
+template<typename VECTOR_TYPE>
+void ReadVectors( const CVectorsBinary& binary, vector<VECTOR_TYPE>& vectors )
+{
+	vectors.resize( binary.NumberOfVectors() );
+	vector<DistanceType*> coordinates( vectors.size() );
+	for( size_t i = 0; i < vectors.size(); i++ ) {
+		coordinates[i] = VectorCoordinates( binary.Dimension(), vectors[i] );
+	}
+	if( !coordinates.empty() ) {
+		binary.Read( &coordinates[0] );
 	}
 }
 
-void DoPam( const size_t numberOfClusters, const DissimilarityMatrixType& matrix )
+template<typename VECTOR_TYPE>
+void ReadVectors( const CMpiVectorsText& text, vector<VECTOR_TYPE>& vectors )
 {
-	typedef CPartitioningAroundMedois<DissimilarityMatrixType> PamType;
-	PamType pam( matrix, numberOfClusters );
+	vectors.resize( text.NumberOfVectors() );
+	vector<DistanceType*> coordinates( vectors.size() );
+	for( size_t i = 0; i < vectors.size(); i++ ) {
+		coordinates[i] = VectorCoordinates( text.Dimension(), vectors[i] );
+	}
+	if( !coordinates.empty() ) {
+		text.Read( &coordinates[0] );
+	}
+}
 
-	size_t objectBegin = 0;
-	size_t objectEnd = 0;
-	CalcBeginEndObjects( pam.NumberOfObjects(),
-		CMpiSupport::NumberOfProccess(), CMpiSupport::Rank(),
-		objectBegin, objectEnd );
-	RunPam( pam, objectBegin, objectEnd );
+// Reads vectors of CMpiVectorsText or CVectorsBinary by consecutive rows.
+template<typename VECTORS_FILE>
+void ReadCoordinates( const VECTORS_FILE& vectorsFile, vector<DistanceType>& coordinates )
+{
+	const size_t dimension = vectorsFile.Dimension();
+	coordinates.resize( vectorsFile.NumberOfVectors() * dimension );
+	vector<DistanceType*> vectors( vectorsFile.NumberOfVectors() );
+	for( size_t i = 0; i < vectors.size(); i++ ) {
+		vectors[i] = &coordinates[i * dimension];
+	}
+	if( !vectors.empty() ) {
+		vectorsFile.Read( &vectors[0] );
+	}
+}
 
-#ifdef _DEBUG
-	if( CMpiSupport::Rank() == 0 ) {
-		cout << endl;
-		map<size_t, size_t> medoidToClusterId;
-		for( size_t object = 0; object < pam.NumberOfObjects(); object++ ) {
-			pair<map<size_t, size_t>::iterator, bool> pair = medoidToClusterId.insert(
-				make_pair( pam.ObjectMedoids()[object], medoidToClusterId.size() ) );
-			cout << object << "\t" << pair.first->second << endl;
+template<typename VECTOR_TYPE, typename VECTORS_FILE>
+void BuildDissimilarityMatrix( const VECTORS_FILE& vectorsFile,
+	DissimilarityMatrixType& matrix, CInputObjects& objects )
+{
+	vector<VECTOR_TYPE> vectors;
+	ReadVectors( vectorsFile, vectors );
+	CollapseDuplicates( vectors, objects );
+	if( objects.KeepCoordinates ) {
+		objects.Dimension = vectorsFile.Dimension();
+		objects.Coordinates.resize( vectors.size() * objects.Dimension );
+		for( size_t i = 0; i < vectors.size(); i++ ) {
+			const DistanceType* const coordinates =
+				VectorCoordinates( objects.Dimension, vectors[i] );
+			copy( coordinates, coordinates + objects.Dimension,
+				objects.Coordinates.begin() + i * objects.Dimension );
 		}
-		cout << endl;
+	}
+#if defined( PAM_LAZY_MATRIX )
+	matrix.SetObjects( vectors );
+#elif defined( PAM_KNN_MATRIX )
+	matrix.SetObjects( vectors, CMpiSupport::Rank(), CMpiSupport::NumberOfProccess() );
+#else
+	if( matrix.Size() == 0 ) {
+		CDissimilarityMatrixBuilder<VECTOR_TYPE, DissimilarityMatrixType> builder( vectors.size() );
+		builder.assign( vectors.begin(), vectors.end() );
+		builder.Build( matrix, objects.Weights, objects.DistancesToAll );
+	} else {
+		CDissimilarityMatrixBuilder<VECTOR_TYPE, DissimilarityMatrixType>::Extend(
+			matrix, vectors.begin(), vectors.end() );
 	}
 #endif
 }
 
-void BuildDissimilarityMatrix( istream& input, DissimilarityMatrixType& matrix )
+template<typename METRIC, typename VECTORS_FILE>
+void BuildMetricDissimilarityMatrix( const VECTORS_FILE& vectorsFile,
+	DissimilarityMatrixType& matrix, CInputObjects& objects )
 {
-	size_t unused = 0;
-	size_t numberOfVectors = 0;
-	input >> unused >> numberOfVectors;
-	vector<CVector> vectors;
-	vectors.resize( numberOfVectors );
-	for( size_t i = 0; input.good() && i < numberOfVectors; i++ ) {
-		input >> unused >> vectors[i].X >> vectors[i].Y;
-	}
-	if( input.fail() ) {
-		throw domain_error( "bad vectors file format!" );
-	}
-	CDissimilarityMatrixBuilder<CVector>::Build( matrix, vectors.begin(), vectors.end() );
+	switch( vectorsFile.Dimension() ) {
+		case 2:
+			BuildDissimilarityMatrix<CVectorNd<2, DistanceType, METRIC> >(
+				vectorsFile, matrix, objects );
+			break;
+		case 3:
+			BuildDissimilarityMatrix<CVectorNd<3, DistanceType, METRIC> >(
+				vectorsFile, matrix, objects );
+			break;
+		case 4:
+			BuildDissimilarityMatrix<CVectorNd<4, DistanceType, METRIC> >(
+				vectorsFile, matrix, objects );
+			break;
+		case 8:
+			BuildDissimilarityMatrix<CVectorNd<8, DistanceType, METRIC> >(
+				vectorsFile, matrix, objects );
+			break;
+		case 16:
+			BuildDissimilarityMatrix<CVectorNd<16, DistanceType, METRIC> >(
+				vectorsFile, matrix, objects );
+			break;
+		case 32:
+			BuildDissimilarityMatrix<CVectorNd<32, DistanceType, METRIC> >(
+				vectorsFile, matrix, objects );
+			break;
+		case 64:
+			BuildDissimilarityMatrix<CVectorNd<64, DistanceType, METRIC> >(
+				vectorsFile, matrix, objects );
+			break;
+		case 128:
+			BuildDissimilarityMatrix<CVectorNd<128, DistanceType, METRIC> >(
+				vectorsFile, matrix, objects );
+			break;
+		default:
+			BuildDissimilarityMatrix<CDynamicVector<DistanceType, METRIC> >(
+				vectorsFile, matrix, objects );
+			break;
+	}
 }
 
+// Vectors file is CVectorsText, CMpiVectorsText or CVectorsBinary.
+// Common dimensions have fixed size vectors.
+// Identical vectors are collapsed into weighted objects.
+// If matrix is not empty it must contain distances of the first
+// matrix.Size() objects, only distances to the rest objects are calculated.
+template<typename VECTORS_FILE>
+void BuildDissimilarityMatrix( const VECTORS_FILE& vectorsFile, const string& metric,
+	DissimilarityMatrixType& matrix, CInputObjects& objects )
+{
+	if( metric == CEuclideanMetric::Name() ) {
+		BuildMetricDissimilarityMatrix<CEuclideanMetric>(
+			vectorsFile, matrix, objects );
+	} else if( metric == CSquaredEuclideanMetric::Name() ) {
+		BuildMetricDissimilarityMatrix<CSquaredEuclideanMetric>(
+			vectorsFile, matrix, objects );
+	} else if( metric == CManhattanMetric::Name() ) {
+		BuildMetricDissimilarityMatrix<CManhattanMetric>(
+			vectorsFile, matrix, objects );
+	} else if( metric == CChebyshevMetric::Name() ) {
+		BuildMetricDissimilarityMatrix<CChebyshevMetric>(
+			vectorsFile, matrix, objects );
+	} else if( metric == CCosineMetric::Name() ) {
+		BuildMetricDissimilarityMatrix<CCosineMetric>(
+			vectorsFile, matrix, objects );
+	} else {
+		throw domain_error( "unknown metric '" + metric + "'!" );
+	}
+}
+
+const char* const Usage =
+	"Usage: pam [OPTIONS] NUMBER_OF_CLUSTERS VECTORS_FILENAME\n"
+	"Options:\n"
+	"  --max-iterations=N      do at most N swap steps (default: 1000)\n"
+	"  --min-improvement=R     stop when a swap improves cost by less than R * cost\n"
+	"  --time-limit=SECONDS    stop swapping after SECONDS of clustering\n"
+	"  --checkpoint=FILE       periodically save state of clustering to FILE\n"
+	"  --checkpoint-interval=SECONDS\n"
+	"                          minimal time between checkpoints (default: 60)\n"
+	"  --resume=FILE           continue clustering from checkpoint FILE\n"
+	"  --quality               evaluate cost and silhouettes of the result\n"
+	"  --medoids=FILE          start swapping from medoids in FILE\n"
+	"  --save-medoids=FILE     save result medoids to FILE\n"
+	"  --save-clustering=FILE  save cost, medoids and clusters of vectors to FILE\n"
+	"  --save-model=FILE       save medoids and their coordinates to FILE to assign\n"
+	"                          other vectors to clusters by pam_predict\n"
+	"  --binary-clustering     save clustering in binary format\n"
+	"  --matrix=FILE           reuse dissimilarity matrix saved to FILE\n"
+	"                          for the first vectors of VECTORS_FILENAME\n"
+	"  --save-matrix=FILE      save dissimilarity matrix to FILE\n"
+	"  --metric=NAME           dissimilarity of vectors: euclidean (default),\n"
+	"                          squared-euclidean, manhattan, chebyshev or cosine\n"
+	"  --partition-size=N      cluster partitions of at most N vectors, then their\n"
+	"                          medoids, and assign vectors to the nearest medoids\n"
+	"  --partitioning=NAME     partitions of vectors: random (default) or spatial\n"
+	"  --sorted-neighbors=L    scan lists of L nearest objects sorted by distances\n"
+	"                          instead of all objects when building and swapping,\n"
+	"                          the lists take L * 8 bytes per object\n"
+	"  --swap-cache            keep results of swaps and update them by objects\n"
+	"                          changed by swaps, takes ( NUMBER_OF_CLUSTERS + 1 ) * 8\n"
+	"                          bytes per object, not with --sorted-neighbors\n"
+	"  --huge-pages=MODE       back dissimilarity matrix by huge pages: none (default),\n"
+	"                          transparent or explicit (reserved by the system)\n"
+	"  --pin-processes         pin each process to a core by its rank on its node, so\n"
+	"                          its matrix is allocated on the memory node of the core\n"
+#ifdef PAM_FILE_MATRIX
+	"  --matrix-files=PREFIX   keep dissimilarity matrix in files PREFIX.RANK.N\n"
+	"                          (default: pam_matrix)\n"
+#endif
+#ifdef PAM_LAZY_MATRIX
+	"  --row-cache=MIB         keep at most MIB MiB of dissimilarity matrix rows\n"
+	"                          (default: 256), rows are calculated on demand\n"
+#endif
+#ifdef PAM_KNN_MATRIX
+	"  --neighbors=M           keep distances to M nearest neighbors (default: 32),\n"
+	"                          distances to others are calculated on demand\n"
+	"  --cap-non-neighbors     distances to non-neighbors are the largest distance\n"
+	"                          to neighbors, cost is approximate\n"
+#endif
+	"Header of VECTORS_FILENAME is 'UNUSED NUMBER_OF_VECTORS [DIMENSION]',\n"
+	"each vector is given by a line 'UNUSED X1 ... XDIMENSION'.\n"
+	"VECTORS_FILENAME may also be a binary vectors file made by pam_convert.";
+
 void DoMain( const int argc, const char* const argv[] )
 {
-	if( argc != 3 ) {
-		throw domain_error( "too few arguments!\n"
-			"Usage: pam NUMBER_OF_CLUSTERS VECTORS_FILENAME" );
+	const CCommandLine commandLine( argc, argv );
+	if( commandLine.NumberOfArguments() != 2 ) {
+		throw domain_error( string( "too few arguments!\n" ) + Usage );
 	}
 
 	double readDataTime = 0.0;
 	double pamTime = 0.0;
 
-	const size_t numberOfClusters = static_cast<size_t>( atoi( argv[1] ) );
+	CPamOptions options;
+	options.NumberOfClusters =
+		static_cast<size_t>( atoi( commandLine.Argument( 0 ).c_str() ) );
+	options.StopCriteria.MaxIterations = commandLine.SizeOption( "max-iterations",
+		options.StopCriteria.MaxIterations );
+	options.StopCriteria.MinRelativeImprovement = commandLine.DoubleOption( "min-improvement",
+		options.StopCriteria.MinRelativeImprovement );
+	options.StopCriteria.TimeLimit = commandLine.DoubleOption( "time-limit",
+		options.StopCriteria.TimeLimit );
+	options.CheckpointFilename = commandLine.Option( "checkpoint" );
+	options.CheckpointInterval = commandLine.DoubleOption( "checkpoint-interval",
+		options.CheckpointInterval );
+	options.ResumeFilename = commandLine.Option( "resume" );
+	if( !options.ResumeFilename.empty() && commandLine.HasOption( "medoids" ) ) {
+		throw domain_error( "options '--resume' and '--medoids' are incompatible!" );
+	}
+	options.EvaluateQuality = commandLine.HasOption( "quality" );
+	if( commandLine.HasOption( "medoids" ) ) {
+		options.InitialMedoids = ReadMedoids( commandLine.Option( "medoids" ) );
+	}
+	options.SaveMedoidsFilename = commandLine.Option( "save-medoids" );
+	options.SaveClusteringFilename = commandLine.Option( "save-clustering" );
+	options.BinaryClustering = commandLine.HasOption( "binary-clustering" );
+	options.MatrixFilename = commandLine.Option( "matrix" );
+	options.SaveMatrixFilename = commandLine.Option( "save-matrix" );
+	options.Metric = commandLine.Option( "metric", CEuclideanMetric::Name() );
+	options.SaveModelFilename = commandLine.Option( "save-model" );
+	options.PartitionSize = commandLine.SizeOption( "partition-size", 0 );
+	const string partitioning = commandLine.Option( "partitioning", "random" );
+	if( partitioning == "spatial" ) {
+		options.Partitioning = CClusteringOptions::SpatialPartitioning;
+	} else if( partitioning != "random" ) {
+		throw domain_error( "unknown partitioning '" + partitioning + "'!" );
+	}
+	options.SortedNeighbors = commandLine.SizeOption( "sorted-neighbors", 0 );
+	options.SwapCache = commandLine.HasOption( "swap-cache" );
+	// swaps of the swap cache do not scan the lists
+	if( options.SortedNeighbors > 0 && options.SwapCache ) {
+		throw domain_error( "options '--sorted-neighbors' and '--swap-cache' are incompatible!" );
+	}
+	const string hugePages = commandLine.Option( "huge-pages", "none" );
+	if( hugePages == "transparent" ) {
+		CNumaSupport::SetHugePages( CNumaSupport::TransparentHugePages );
+	} else if( hugePages == "explicit" ) {
+		CNumaSupport::SetHugePages( CNumaSupport::ExplicitHugePages );
+	} else if( hugePages != "none" ) {
+		throw domain_error( "unknown huge pages '" + hugePages + "'!" );
+	}
+	if( commandLine.HasOption( "pin-processes" ) ) {
+		CNumaSupport::PinProcess();
+	}
+	if( options.PartitionSize > 0 ) {
+		const char* const incompatibleOptions[] =
+			{ "matrix", "save-matrix", "checkpoint", "resume", "medoids", "quality" };
+		const size_t numberOfIncompatibleOptions =
+			sizeof( incompatibleOptions ) / sizeof( incompatibleOptions[0] );
+		for( size_t i = 0; i < numberOfIncompatibleOptions; i++ ) {
+			if( commandLine.HasOption( incompatibleOptions[i] ) ) {
+				throw domain_error( string( "options '--partition-size' and '--" )
+					+ incompatibleOptions[i] + "' are incompatible!" );
+			}
+		}
+	}
+#ifdef PAM_FILE_MATRIX
+	ostringstream matrixFilenamePrefix;
+	matrixFilenamePrefix << commandLine.Option( "matrix-files", "pam_matrix" )
+		<< "." << CMpiSupport::Rank();
+	DissimilarityMatrixType::SetFilenamePrefix( matrixFilenamePrefix.str() );
+#endif
+#ifdef PAM_LAZY_MATRIX
+	DissimilarityMatrixType::SetCacheSize( commandLine.SizeOption( "row-cache", 256 ) << 20 );
+#endif
+#ifdef PAM_KNN_MATRIX
+	DissimilarityMatrixType::SetNumberOfNeighbors( commandLine.SizeOption( "neighbors", 32 ) );
+	DissimilarityMatrixType::SetCapNonNeighbors( commandLine.HasOption( "cap-non-neighbors" ) );
+#endif
+	commandLine.CheckUnknownOptions();
+
+	if( options.PartitionSize > 0 ) {
+		vector<DistanceType> coordinates;
+		size_t dimension = 0;
+		{
+			CMpiTimer timer( readDataTime );
+			const string vectorsFilename = commandLine.Argument( 1 );
+			if( CVectorsBinary::IsBinary( vectorsFilename ) ) {
+				const CVectorsBinary vectorsFile( vectorsFilename );
+				ReadCoordinates( vectorsFile, coordinates );
+				dimension = vectorsFile.Dimension();
+			} else {
+				const CMpiVectorsText vectorsFile( vectorsFilename );
+				ReadCoordinates( vectorsFile, coordinates );
+				dimension = vectorsFile.Dimension();
+			}
+		}
+		if( coordinates.empty() ) {
+			throw domain_error( "no vectors to cluster!" );
+		}
+		DoPartitionedPam( options, coordinates, dimension, pamTime );
+		cout << CMpiSupport::Rank() << "\t" << readDataTime << "\t" << pamTime << endl;
+		return;
+	}
 
 	DissimilarityMatrixType matrix;
+	CInputObjects objects;
+	objects.KeepCoordinates = !options.SaveModelFilename.empty();
 	{
 		CMpiTimer timer( readDataTime );
-		ifstream input( argv[2] );
-		BuildDissimilarityMatrix( input, matrix );
+		if( !options.MatrixFilename.empty() ) {
+			ifstream matrixInput( options.MatrixFilename.c_str() );
+			matrix.Load( matrixInput );
+			if( matrix.Size() == 0 ) {
+				throw domain_error( "bad matrix file '" + options.MatrixFilename + "'!" );
+			}
+		}
+		const string vectorsFilename = commandLine.Argument( 1 );
+		if( CVectorsBinary::IsBinary( vectorsFilename ) ) {
+			const CVectorsBinary vectorsFile( vectorsFilename );
+			BuildDissimilarityMatrix( vectorsFile, options.Metric, matrix, objects );
+		} else {
+			const CMpiVectorsText vectorsFile( vectorsFilename );
+			BuildDissimilarityMatrix( vectorsFile, options.Metric, matrix, objects );
+		}
 	}
 
+#ifdef PAM_FILE_MATRIX
 	{
-		CMpiTimer timer( pamTime );
-		DoPam( numberOfClusters, matrix );
+		// rows of objects which this process steps in DoPam
+		size_t beginRow = 0;
+		size_t endRow = 0;
+		CalcBeginEndObjects( matrix.Size(), CMpiSupport::NumberOfProccess(), CMpiSupport::Rank(),
+			beginRow, endRow );
+		matrix.SetSweptRows( beginRow, endRow );
 	}
+#endif
+
+	if( CMpiSupport::Rank() == 0 && !options.SaveMatrixFilename.empty() ) {
+		ofstream matrixOutput( options.SaveMatrixFilename.c_str() );
+		matrix.Save( matrixOutput );
+	}
+
+	DoPam( options, matrix, objects, pamTime );
 
 	cout << CMpiSupport::Rank() << "\t" << readDataTime << "\t" << pamTime << endl;
+#ifdef PAM_FILE_MATRIX
+	// rank, MiB read, achieved MiB/s, number of stalls and their total time
+	const CMatrixReadStatistics& statistics = matrix.ReadStatistics();
+	const double mebibyte = 1 << 20;
+	cout << CMpiSupport::Rank() << "\tmatrix read\t" << statistics.BytesRead / mebibyte
+		<< "\t" << statistics.Bandwidth() / mebibyte << "\t" << statistics.Stalls
+		<< "\t" << statistics.StallTime << endl;
+#endif
+#ifdef PAM_LAZY_MATRIX
+	// rank, row cache hits, misses and evictions
+	const CRowCacheStatistics statistics = matrix.CacheStatistics();
+	cout << CMpiSupport::Rank() << "\trow cache\t" << statistics.Hits << "\t"
+		<< statistics.Misses << "\t" << statistics.Evictions << endl;
+#endif
+#ifdef PAM_KNN_MATRIX
+	// rank and kept distances
+	cout << CMpiSupport::Rank() << "\tknn graph\t" << matrix.NumberOfEdges() << endl;
+#endif
 }
 
 int main( int argc, char** argv )